@@ -0,0 +1,86 @@
+// Boot stage. Linked at the start of flash in the first FLASH_BOOT_SIZE bytes, the bootrom
+// starts it through its boot2 and it is never written by an update. It installs a verified
+// image staged by the OTA module (include/pico_ota.h) into the application region and then
+// starts the firmware linked at FLASH_APP_OFFSET.
+//
+// The copy only reads the staged image and the state sector is cleared once the copy matches
+// the digest, so a reset or a power cut at any point copies the image again at the next boot.
+// A flash error reboots and tries again, BOOT_MAX_ATTEMPTS times in a row before the image is
+// abandoned and the firmware started, so a worn out sector cannot keep the board rebooting.
+// The application region may then hold a partial copy, flash that wore out needs a reflash.
+// host/ota_install_test.c cuts the power at every flash operation of an install.
+
+#include "pico_flash.h"
+#include "pico_ota.h"
+
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "hardware/structs/nvic.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/watchdog.h"
+
+#define BOOT_RETRY_MS           1000
+#define BOOT2_SIZE              0x100   // the firmware image starts with its own boot2
+#define BOOT_MAX_ATTEMPTS       5
+#define BOOT_ATTEMPTS_SCRATCH   0       // kept over watchdog reboots, cleared at power on
+#define BOOT_ATTEMPTS_TAG       0xB0070000u     // upper half, the attempts are in the lower
+
+static flash_dev_t ota_flash;
+static flash_dev_t app_flash;
+
+// Install attempts in a row, counted in a watchdog scratch register. Scratch registers 4 to 7
+// belong to watchdog_reboot.
+static uint32_t install_attempts(void) {
+    uint32_t value = watchdog_hw->scratch[BOOT_ATTEMPTS_SCRATCH];
+    return (value & 0xFFFF0000u) == BOOT_ATTEMPTS_TAG ? value & 0xFFFFu : 0;
+}
+
+static void set_install_attempts(uint32_t attempts) {
+    watchdog_hw->scratch[BOOT_ATTEMPTS_SCRATCH] = attempts ? BOOT_ATTEMPTS_TAG | attempts : 0;
+}
+
+// Hands the core over to the firmware as the bootrom hands it to boot2: nothing of this stage
+// may interrupt it, the vector table moves to the firmware's, then its stack and reset handler
+static void __attribute__((noreturn)) start_firmware(void) {
+    const uint32_t *vectors = (const uint32_t *)(XIP_BASE + FLASH_APP_OFFSET + BOOT2_SIZE);
+
+    systick_hw->csr = 0;
+    nvic_hw->icer = 0xFFFFFFFFu;
+    nvic_hw->icpr = 0xFFFFFFFFu;
+    scb_hw->vtor = (uint32_t)(uintptr_t)vectors;
+
+    __asm volatile (
+        "msr msp, %0\n"
+        "bx %1\n"
+        :
+        : "r" (vectors[0]), "r" (vectors[1])
+    );
+    __builtin_unreachable();
+}
+
+int main(void) {
+    if (flash_dev_init_onboard(&ota_flash, FLASH_OTA_OFFSET, FLASH_OTA_SIZE) == 0 &&
+        ota_init(&ota_flash) == 0 && ota_state() == OTA_VERIFIED) {
+        uint32_t attempts = install_attempts();
+
+        if (attempts >= BOOT_MAX_ATTEMPTS) {
+            // The firmware abandons it as well if the mark cannot be programmed
+            ota_abandon();
+        } else {
+            set_install_attempts(attempts + 1);
+
+            // The firmware may be half copied, it only starts once the copy is whole
+            if (flash_dev_init_onboard(&app_flash, FLASH_APP_OFFSET, FLASH_APP_MAX_SIZE) != 0 ||
+                (ota_install(&app_flash) != 0 && ota_state() == OTA_VERIFIED)) {
+                watchdog_reboot(0, 0, BOOT_RETRY_MS);
+                while (1) {
+                    tight_loop_contents();
+                }
+            }
+        }
+        set_install_attempts(0);
+    }
+
+    start_firmware();
+}
@@ -0,0 +1,145 @@
+// Replays the allocation pattern of TLS reconnects against pico_arena for a long time and
+// checks that the arena does not fragment. The certificates stay allocated for the whole
+// run, and the cached session of one connection outlives it into the next. Every connection
+// allocates the record buffers and a burst of short lived handshake temporaries. After each
+// connection the arena must be back to the same used bytes and the same largest free block.
+//
+//     ./arena_soak -c 100000 -s 49152
+
+#include "pico_arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SOAK_DEFAULT_CYCLES     100000
+#define SOAK_DEFAULT_SIZE       (48 * 1024)
+#define SOAK_MAX_LIVE           48
+#define SOAK_CERT_ALLOCS        40
+#define SOAK_HANDSHAKE_ALLOCS   400
+#define SOAK_IN_BUF_LEN         (16384 + 29 + 13)   // content, record overhead and header
+#define SOAK_OUT_BUF_LEN        (2048 + 29 + 13)
+#define SOAK_SSL_CONTEXT_LEN    600
+#define SOAK_SESSION_LEN        200
+
+static uint64_t arena_buf[SOAK_DEFAULT_SIZE * 4 / sizeof(uint64_t)];
+
+static arena_t arena;
+static void *live[SOAK_MAX_LIVE];
+static size_t live_count;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void *alloc_or_fail(size_t len) {
+    void *ptr = arena_calloc(&arena, 1, len);
+
+    if (!ptr) {
+        arena_stats_t stats;
+        arena_get_stats(&arena, &stats);
+        fprintf(stderr, "allocation of %zu bytes failed, %lu used, largest free %lu in %lu blocks\n", len,
+            (unsigned long)stats.used, (unsigned long)stats.largest_free, (unsigned long)stats.free_blocks);
+        exit(1);
+    }
+    return ptr;
+}
+
+// Bignum temporaries, mostly small with the odd large one, freed in random order
+static void handshake(void) {
+    for (size_t i = 0; i < SOAK_HANDSHAKE_ALLOCS; i++) {
+        if (live_count == SOAK_MAX_LIVE || (live_count > 0 && rng() % 3 == 0)) {
+            size_t victim = rng() % live_count;
+            arena_free(&arena, live[victim]);
+            live[victim] = live[--live_count];
+        }
+
+        size_t len = rng() % 16 == 0 ? 256 + rng() % 512 : 8 + rng() % 120;
+        live[live_count++] = alloc_or_fail(len);
+    }
+
+    while (live_count > 0) {
+        arena_free(&arena, live[--live_count]);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t cycles = SOAK_DEFAULT_CYCLES;
+    size_t size = SOAK_DEFAULT_SIZE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:s:")) != -1) {
+        switch (opt) {
+        case 'c':
+            cycles = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c cycles] [-s arena bytes]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (cycles == 0) return 1;
+
+    if (size == 0 || size > sizeof(arena_buf)) {
+        fprintf(stderr, "arena size must be between 1 and %zu\n", sizeof(arena_buf));
+        return 1;
+    }
+
+    arena_init(&arena, arena_buf, size);
+
+    // Parsed certificates and keys, kept for the lifetime of the device
+    for (size_t i = 0; i < SOAK_CERT_ALLOCS; i++) {
+        alloc_or_fail(16 + rng() % 400);
+    }
+
+    void *session = NULL;
+    arena_stats_t stats, first;
+    uint32_t max_free_blocks = 0;
+
+    for (size_t cycle = 0; cycle < cycles; cycle++) {
+        void *ssl = alloc_or_fail(SOAK_SSL_CONTEXT_LEN);
+        void *in_buf = alloc_or_fail(SOAK_IN_BUF_LEN);
+        void *out_buf = alloc_or_fail(SOAK_OUT_BUF_LEN);
+
+        handshake();
+
+        // The new session replaces the cached one while the connection is still up
+        void *next_session = alloc_or_fail(SOAK_SESSION_LEN);
+        arena_free(&arena, session);
+        session = next_session;
+
+        arena_free(&arena, out_buf);
+        arena_free(&arena, in_buf);
+        arena_free(&arena, ssl);
+
+        arena_get_stats(&arena, &stats);
+        if (cycle == 0) first = stats;
+        if (stats.free_blocks > max_free_blocks) max_free_blocks = stats.free_blocks;
+
+        if (stats.used != first.used || stats.largest_free < first.largest_free) {
+            fprintf(stderr, "cycle %zu: %lu used, largest free %lu, after the first cycle %lu used, largest free %lu\n",
+                cycle, (unsigned long)stats.used, (unsigned long)stats.largest_free,
+                (unsigned long)first.used, (unsigned long)first.largest_free);
+            return 1;
+        }
+    }
+
+    printf("arena:       %zu bytes, %zu connections\n", size, cycles);
+    printf("peak:        %lu bytes (%lu%%)\n", (unsigned long)stats.peak, (unsigned long)(stats.peak * 100 / size));
+    printf("allocations: %lu, %lu frees, %lu failed\n", (unsigned long)stats.allocs,
+        (unsigned long)stats.frees, (unsigned long)stats.failed);
+    printf("idle:        %lu bytes used, largest free %lu in %lu blocks, at most %lu blocks\n",
+        (unsigned long)stats.used, (unsigned long)stats.largest_free, (unsigned long)stats.free_blocks,
+        (unsigned long)max_free_blocks);
+
+    return stats.failed != 0;
+}
@@ -0,0 +1,267 @@
+// Drains the sample store through pico_backlog.c and the MQTT client of pico_mqtt.c against
+// the simulated broker of sim_lwip.c, on simulated flash and a simulated clock, and checks
+// that records leave the store only once the broker acknowledged them: not while the
+// PUBACK is on its way, not when the publish queue gives up, not when the connection drops,
+// not when the device reboots and not when the store overwrote records meanwhile.
+//
+//     ./backlog_test
+//
+// Every record must reach the broker at least once. Prints every failed check, exits non-zero if any.
+
+#include "pico_backlog.h"
+#include "pico_mqtt.h"
+#include "pico_pubq.h"
+#include "sim_flash.h"
+#include "sim_lwip.h"
+#include "pico.h"
+#include "pico/time.h"
+#include "lwip/apps/mqtt.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_STEP_US        1000
+#define TEST_DRAIN_MS       10
+#define TEST_CONNECT_MS     50
+#define TEST_RTT_MS         20
+#define TEST_SECTORS        16
+#define TEST_MAX_SEQ        2048
+#define TEST_RUN            5       // records of one sensor in a row
+#define TEST_BACKLOG_TOPIC  "/room_meas/%u/backlog"
+
+static uint64_t sim_clock_us;
+static uint32_t failures;
+static MQTT_client_handle_t handle;
+static backlog_t backlog;
+static flash_dev_t flash;
+static uint8_t payload[MQTT_PAYLOAD_MAX_LEN + 1];
+static char topics[2][MQTT_TOPIC_LEN];
+
+static uint32_t next_seq;
+static uint32_t received[TEST_MAX_SEQ];     // times the broker saw each record
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+static const char *backlog_topic(__unused void *arg, uint16_t sensor) {
+    return topics[sensor & 1];
+}
+
+static void publish_done(__unused void *arg, const char *topic, int err, __unused uint32_t latency_us) {
+    backlog_publish_done(&backlog, topic, err);
+}
+
+// The client also publishes its online message on every connect
+static void broker_observer(__unused void *arg, const char *topic, const uint8_t *data, size_t len) {
+    sample_t samples[STORE_DRAIN_BATCH];
+
+    if (strcmp(topic, topics[0]) != 0 && strcmp(topic, topics[1]) != 0) return;
+    int count = codec_decode_binary(data, len, samples, STORE_DRAIN_BATCH, NULL);
+
+    CHECK(count > 0);
+    for (int i = 0; i < count; i++) {
+        if (samples[i].pressure < TEST_MAX_SEQ) received[samples[i].pressure]++;
+    }
+}
+
+// Records carry their sequence number in the pressure, the sensor changes every TEST_RUN
+static void append(uint32_t count) {
+    sample_t sample;
+
+    for (uint32_t i = 0; i < count; i++, next_seq++) {
+        memset(&sample, 0, sizeof(sample));
+        sample.temperature = 2150;
+        sample.humidity = 4500;
+        sample.pressure = next_seq;
+        sample.sensor = (uint16_t)(next_seq / TEST_RUN % 2);
+        sample_set_time(&sample, 1700000000000000ull + (uint64_t)next_seq * 1000000ull);
+        CHECK(store_append(&sample) == 0);
+    }
+}
+
+// Polls the network and the client every millisecond and drains every TEST_DRAIN_MS, as
+// the main loop and the publish task do
+static void run(uint32_t ms) {
+    uint64_t end_us = sim_clock_us + (uint64_t)ms * 1000;
+
+    while (sim_clock_us < end_us) {
+        sim_lwip_poll();
+        if (MQTT_process(handle) == MQTT_STATE_CONNECTED && sim_clock_us / 1000 % TEST_DRAIN_MS == 0) {
+            backlog_drain(&backlog, payload, sizeof(payload));
+        }
+        sim_clock_us += TEST_STEP_US;
+    }
+}
+
+// Runs until the store is empty. Returns 0 if it emptied within limit_ms.
+static uint8_t run_until_drained(uint32_t limit_ms) {
+    for (uint32_t ms = 0; ms < limit_ms; ms += TEST_DRAIN_MS) {
+        if (store_pending() == 0 && backlog.in_flight == 0) return 0;
+        run(TEST_DRAIN_MS);
+    }
+    return 1;
+}
+
+static void open_client(void) {
+    CHECK(MQTT_open(&handle) == 0);
+    MQTT_set_publish_cb(handle, publish_done, NULL);
+    backlog_init(&backlog, handle, CODEC_FORMAT_BINARY, backlog_topic, NULL);
+
+    for (uint32_t ms = 0; ms < 1000 && MQTT_process(handle) != MQTT_STATE_CONNECTED; ms++) {
+        sim_lwip_poll();
+        sim_clock_us += TEST_STEP_US;
+    }
+    CHECK(MQTT_process(handle) == MQTT_STATE_CONNECTED);
+}
+
+// Every record from first on reached the broker at least once
+static void check_received(uint32_t first, uint8_t exactly_once) {
+    uint32_t missing = 0, duplicated = 0;
+
+    for (uint32_t seq = first; seq < next_seq; seq++) {
+        if (received[seq] == 0) missing++;
+        if (received[seq] > 1) duplicated++;
+    }
+    CHECK(missing == 0);
+    if (exactly_once) CHECK(duplicated == 0);
+}
+
+static void test_acked(void) {
+    uint32_t first = next_seq;
+
+    append(4 * TEST_RUN);
+    CHECK(store_pending() == 4 * TEST_RUN);
+
+    // The run is in flight, the records stay in the store until the PUBACK
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    CHECK(backlog.in_flight == TEST_RUN);
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) == 0);
+    sim_clock_us += (TEST_RTT_MS - 1) * 1000;
+    sim_lwip_poll();
+    CHECK(store_pending() == 4 * TEST_RUN);
+    sim_clock_us += 1000;
+    sim_lwip_poll();
+    CHECK(backlog.completed);
+    CHECK(store_pending() == 4 * TEST_RUN);
+
+    // The next drain consumes it and sends the next run
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    CHECK(store_pending() == 3 * TEST_RUN);
+
+    CHECK(run_until_drained(10000) == 0);
+    check_received(first, 1);
+    CHECK(backlog.stats.acked == 4 && backlog.stats.publishes == 4);
+}
+
+static void test_failed(void) {
+    uint32_t first = next_seq;
+    backlog_stats_t before = backlog.stats;
+
+    // The broker takes the publish but never acknowledges it, the queue gives up
+    sim_broker_set_acks(false);
+    append(2 * TEST_RUN);
+    run(PUBQ_MAX_ATTEMPTS * MQTT_REQ_TIMEOUT * 1000 + 1000);
+    CHECK(backlog.stats.failed == before.failed + 1);
+    CHECK(backlog.stats.acked == before.acked);
+    CHECK(store_pending() == 2 * TEST_RUN);
+
+    sim_broker_set_acks(true);
+    CHECK(run_until_drained(PUBQ_MAX_ATTEMPTS * MQTT_REQ_TIMEOUT * 1000) == 0);
+    check_received(first, 0);
+}
+
+static void test_lost(void) {
+    uint32_t first = next_seq;
+
+    // The connection drops before the PUBACK, the queue sends the run again after the reconnect
+    append(2 * TEST_RUN);
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    sim_broker_drop();
+    run(TEST_RTT_MS);
+    CHECK(MQTT_process(handle) != MQTT_STATE_CONNECTED);
+    CHECK(store_pending() == 2 * TEST_RUN);
+
+    CHECK(run_until_drained(MQTT_BACKOFF_BASE_MS + 10000) == 0);
+    check_received(first, 0);
+}
+
+static void test_reboot(void) {
+    uint32_t first = next_seq;
+
+    // The device restarts before the PUBACK: the client, the backlog and the store start over
+    append(2 * TEST_RUN);
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    MQTT_close(handle);
+    CHECK(store_init(&flash) == 0);
+    CHECK(store_pending() == 2 * TEST_RUN);
+    open_client();
+
+    CHECK(run_until_drained(10000) == 0);
+    check_received(first, 0);
+}
+
+static void test_overwritten(void) {
+    static flash_dev_t small;
+    store_stats_t stats;
+    sample_t oldest;
+
+    // A store of two sectors drops its oldest one while a run is in flight
+    CHECK(sim_flash_init(&small, 2 * FLASH_DEV_SECTOR_SIZE, NULL) == 0);
+    CHECK(store_init(&small) == 0);
+    backlog_init(&backlog, handle, CODEC_FORMAT_BINARY, backlog_topic, NULL);
+
+    append(TEST_RUN);
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    append(2 * FLASH_DEV_SECTOR_SIZE / STORE_RECORD_SIZE);
+    store_get_stats(&stats);
+    CHECK(stats.dropped > 0);
+    CHECK(store_peek(&oldest, 1) == 1);
+    uint32_t pending = store_pending();
+
+    // Consuming the run now would consume records that were never sent
+    sim_clock_us += TEST_RTT_MS * 1000;
+    sim_lwip_poll();
+    CHECK(backlog_drain(&backlog, payload, sizeof(payload)) > 0);
+    CHECK(backlog.stats.kept == 1 && backlog.stats.acked == 0);
+    CHECK(store_pending() == pending);
+
+    CHECK(run_until_drained(60000) == 0);
+    check_received(oldest.pressure, 0);
+    sim_flash_deinit(&small);
+}
+
+int main(void) {
+    sim_clock_us = 1000000;
+    host_set_clock(sim_now_us);
+    sim_lwip_reset();
+    sim_broker_set_timing(TEST_CONNECT_MS, TEST_RTT_MS);
+    sim_broker_set_observer(broker_observer, NULL);
+    snprintf(topics[0], sizeof(topics[0]), TEST_BACKLOG_TOPIC, 0);
+    snprintf(topics[1], sizeof(topics[1]), TEST_BACKLOG_TOPIC, 1);
+
+    if (sim_flash_init(&flash, TEST_SECTORS * FLASH_DEV_SECTOR_SIZE, NULL) != 0 || store_init(&flash) != 0) {
+        fprintf(stderr, "unable to mount the store\n");
+        return 1;
+    }
+    open_client();
+
+    test_acked();
+    test_failed();
+    test_lost();
+    test_reboot();
+    test_overwritten();
+
+    MQTT_close(handle);
+    sim_flash_deinit(&flash);
+
+    printf("backlog_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
@@ -0,0 +1,233 @@
+// Disciplines the wall clock of a simulated fleet with NTP exchanges over a simulated network
+// and measures how close the clocks get to true time. Every device has a crystal off by up to
+// -d ppm, drifting a further -w ppm over a day as the temperature changes, and boots at a
+// random time. Each exchange sees a fixed delay plus up to -j ms of jitter in either direction,
+// and with -k percent probability one direction is queued for up to 400 ms more. A device has
+// settled once its error stays within -e us.
+//
+// The fleet spread is the largest difference between the clocks of two devices at the same
+// instant, the error of sampling instants aligned to the wall clock across the fleet.
+//
+//     ./clock_bench -n 8 -d 30 -p 64 -t 86400
+//     ./clock_bench -n 8 -d 30 -j 40 -k 5     # congested uplink
+
+#include "pico_wallclock.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_DEVICES   8
+#define BENCH_DEFAULT_DRIFT_PPM 30
+#define BENCH_DEFAULT_WANDER_PPM 2
+#define BENCH_DEFAULT_POLL_S    64
+#define BENCH_DEFAULT_JITTER_MS 5
+#define BENCH_DEFAULT_SECONDS   86400
+#define BENCH_DEFAULT_SETTLED_US 2000
+#define BENCH_MAX_DEVICES       64
+#define BENCH_BASE_DELAY_US     15000   // one way, on top of the jitter
+#define BENCH_SERVER_US         50      // the server holds a request this long
+#define BENCH_SPIKE_US          400000
+#define BENCH_MAX_BOOT_S        10
+#define BENCH_UNIX_START_US     1700000000000000ull
+#define BENCH_DAY_S             86400.0
+
+typedef struct {
+    wallclock_t clock;
+    double drift_ppm;       // of the crystal, positive runs fast
+    double phase;           // of the daily wander
+    double mono_us;         // at the start of the current second
+    uint64_t next_sync_s;
+    uint64_t settled_s;     // after the latest error above the -e threshold
+} device_t;
+
+static device_t devices[BENCH_MAX_DEVICES];
+static device_t *current;
+static double wander_ppm;
+static double now_s;        // true time, whole seconds
+static double now_frac_us;  // within the second, for exchanges
+
+static double ppm_at(const device_t *device) {
+    return device->drift_ppm + wander_ppm * sin(2 * M_PI * now_s / BENCH_DAY_S + device->phase);
+}
+
+// Monotonic clock of the current device, the crystal rate is constant within one second
+static uint64_t sim_mono_us(void) {
+    return (uint64_t)(current->mono_us + now_frac_us * (1 + ppm_at(current) * 1e-6));
+}
+
+static uint32_t jitter_us(uint32_t max_us) {
+    return max_us ? (uint32_t)(random() % max_us) : 0;
+}
+
+// One request and reply, the delays are in true time
+static void exchange(device_t *device, uint32_t max_jitter_us, uint32_t spike_pct) {
+    uint32_t out_us = BENCH_BASE_DELAY_US + jitter_us(max_jitter_us);
+    uint32_t back_us = BENCH_BASE_DELAY_US + jitter_us(max_jitter_us);
+
+    if ((uint32_t)(random() % 100) < spike_pct) {
+        if (random() & 1) out_us += jitter_us(BENCH_SPIKE_US);
+        else back_us += jitter_us(BENCH_SPIKE_US);
+    }
+
+    uint64_t true_us = (uint64_t)now_s * 1000000;
+
+    now_frac_us = 0;
+    uint64_t sent_us = sim_mono_us();
+    uint64_t server_rx_us = BENCH_UNIX_START_US + true_us + out_us;
+    uint64_t server_tx_us = server_rx_us + BENCH_SERVER_US;
+    now_frac_us = out_us + BENCH_SERVER_US + back_us;
+    uint64_t received_us = sim_mono_us();
+    now_frac_us = 0;
+
+    wallclock_sync(&device->clock, sent_us, server_rx_us, server_tx_us, received_us);
+}
+
+int main(int argc, char **argv) {
+    size_t count = BENCH_DEFAULT_DEVICES;
+    double drift_ppm = BENCH_DEFAULT_DRIFT_PPM;
+    uint32_t poll_s = BENCH_DEFAULT_POLL_S;
+    uint32_t jitter_ms = BENCH_DEFAULT_JITTER_MS;
+    uint32_t spike_pct = 0;
+    uint32_t seconds = BENCH_DEFAULT_SECONDS;
+    uint32_t settled_us = BENCH_DEFAULT_SETTLED_US;
+    int opt;
+
+    wander_ppm = BENCH_DEFAULT_WANDER_PPM;
+
+    while ((opt = getopt(argc, argv, "n:d:w:p:j:k:t:e:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            drift_ppm = strtod(optarg, NULL);
+            break;
+        case 'w':
+            wander_ppm = strtod(optarg, NULL);
+            break;
+        case 'p':
+            poll_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'j':
+            jitter_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'k':
+            spike_pct = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'e':
+            settled_us = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n devices] [-d drift ppm] [-w wander ppm] [-p poll s] [-j jitter ms] [-k spike %%] [-t seconds] [-e settled us]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (count == 0 || count > BENCH_MAX_DEVICES || poll_s == 0 || seconds < 2 || spike_pct > 100) {
+        fprintf(stderr, "1 to %d devices, poll > 0, at least 2 seconds and spikes up to 100 %%\n", BENCH_MAX_DEVICES);
+        return 1;
+    }
+
+    srandom(1);
+
+    for (size_t i = 0; i < count; i++) {
+        device_t *device = &devices[i];
+
+        device->drift_ppm = count > 1 ? -drift_ppm + 2 * drift_ppm * i / (count - 1) : drift_ppm;
+        device->phase = 2 * M_PI * (random() % 1000) / 1000.0;
+        device->mono_us = (double)(random() % (BENCH_MAX_BOOT_S * 1000000));
+        device->next_sync_s = 0;
+
+        current = device;
+        wallclock_init(&device->clock, sim_mono_us);
+    }
+
+    double sum_sq = 0;
+    uint64_t samples = 0;
+    uint64_t max_error_us = 0;
+    uint64_t max_spread_us = 0;
+
+    for (uint64_t s = 0; s < seconds; s++) {
+        int64_t min_error = INT64_MAX;
+        int64_t max_error = INT64_MIN;
+
+        now_s = (double)s;
+
+        for (size_t i = 0; i < count; i++) {
+            device_t *device = &devices[i];
+            current = device;
+
+            if (s >= device->next_sync_s) {
+                exchange(device, jitter_ms * 1000, spike_pct);
+                device->next_sync_s = s + poll_s;
+            }
+
+            uint64_t unix_us;
+            if (wallclock_unix_us(&device->clock, wallclock_steady_us(&device->clock), &unix_us) != 0) continue;
+
+            int64_t error = (int64_t)(unix_us - BENCH_UNIX_START_US - s * 1000000);
+            uint64_t abs_error = (uint64_t)(error < 0 ? -error : error);
+
+            if (abs_error > settled_us) device->settled_s = s + 1;
+            if (error < min_error) min_error = error;
+            if (error > max_error) max_error = error;
+
+            // The second half shows the clocks once they have settled
+            if (s >= seconds / 2) {
+                sum_sq += (double)error * error;
+                samples++;
+                if (abs_error > max_error_us) max_error_us = abs_error;
+            }
+        }
+
+        if (s >= seconds / 2 && max_error >= min_error && (uint64_t)(max_error - min_error) > max_spread_us) {
+            max_spread_us = (uint64_t)(max_error - min_error);
+        }
+
+        // Advance every crystal by one true second at its current rate
+        for (size_t i = 0; i < count; i++) {
+            devices[i].mono_us += 1e6 * (1 + ppm_at(&devices[i]) * 1e-6);
+        }
+    }
+
+    uint32_t syncs = 0;
+    uint32_t rejected = 0;
+    uint32_t steps = 0;
+    uint64_t settled_s = 0;
+    double max_freq_error_ppm = 0;
+
+    now_s = (double)seconds;
+    for (size_t i = 0; i < count; i++) {
+        const wallclock_stats_t *stats = wallclock_get_stats(&devices[i].clock);
+        // A crystal running fast by p ppm needs a correction of about -p ppm
+        double freq_error_ppm = fabs(stats->freq_ppb / 1000.0 + ppm_at(&devices[i]));
+
+        syncs += stats->syncs;
+        rejected += stats->rejected;
+        steps += stats->steps;
+        if (devices[i].settled_s > settled_s) settled_s = devices[i].settled_s;
+        if (freq_error_ppm > max_freq_error_ppm) max_freq_error_ppm = freq_error_ppm;
+    }
+
+    printf("devices:     %zu, crystals within %.0f ppm, %.1f ppm daily wander, poll %lu s, %lu s simulated\n",
+        count, drift_ppm, wander_ppm, (unsigned long)poll_s, (unsigned long)seconds);
+    printf("network:     %lu ms each way plus up to %lu ms jitter, %lu %% spikes up to %lu ms\n",
+        (unsigned long)(BENCH_BASE_DELAY_US / 1000), (unsigned long)jitter_ms, (unsigned long)spike_pct,
+        (unsigned long)(BENCH_SPIKE_US / 1000));
+    printf("syncs:       %lu accepted, %lu rejected, %lu steps\n", (unsigned long)syncs, (unsigned long)rejected,
+        (unsigned long)steps);
+    printf("settled:     within %lu us of true time after %llu s, worst device\n", (unsigned long)settled_us,
+        (unsigned long long)settled_s);
+    printf("error:       rms %.0f us, max %llu us over the second half\n", samples ? sqrt(sum_sq / samples) : 0.0,
+        (unsigned long long)max_error_us);
+    printf("fleet:       sampling instants at most %llu us apart\n", (unsigned long long)max_spread_us);
+    printf("drift:       estimates within %.2f ppm of the crystals at the end\n", max_freq_error_ppm);
+
+    return 0;
+}
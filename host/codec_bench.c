@@ -0,0 +1,127 @@
+// Encodes batches of samples in both payload formats and compares the encode time and the
+// payload size. Batches grow in powers of two up to -n samples, with -w every payload also
+// carries the aggregates of its window. Every binary payload is decoded again and checked
+// against the samples it was built from.
+//
+//     ./codec_bench                       # batches of 1 to BATCH_MAX_SAMPLES
+//     ./codec_bench -n 255 -w             # up to a full binary payload, with the window
+//
+// Times are for this host, the ratio between the formats is what carries over to the board.
+
+#include "pico_codec.h"
+#include "pico_batch.h"
+#include "pico_window.h"
+#include "pico/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_SAMPLES   BATCH_MAX_SAMPLES
+#define BENCH_DEFAULT_ITERS     20000
+#define BENCH_JSON_MAX_LEN      (CODEC_BINARY_MAX_SAMPLES * (SAMPLE_JSON_MAX_LEN + 1) + CODEC_JSON_WINDOW_MAX_LEN + 32)
+
+static sample_t samples[CODEC_BINARY_MAX_SAMPLES];
+static sample_t decoded[CODEC_BINARY_MAX_SAMPLES];
+static uint8_t buf[BENCH_JSON_MAX_LEN];
+static volatile uint32_t sink;
+
+// Encodes the batch iters times, returns the payload length and the mean time in ns
+static int bench_encode(codec_format_t format, size_t count, const window_summary_t *window, uint32_t iters, double *ns) {
+    int len = -1;
+    uint64_t start_us = time_us_64();
+
+    for (uint32_t i = 0; i < iters; i++) {
+        len = codec_encode(format, samples, count, window, buf, sizeof(buf));
+        sink += buf[len > 0 ? len - 1 : 0];
+    }
+
+    *ns = (time_us_64() - start_us) * 1000.0 / iters;
+    return len;
+}
+
+int main(int argc, char **argv) {
+    size_t max_samples = BENCH_DEFAULT_SAMPLES;
+    uint32_t iters = BENCH_DEFAULT_ITERS;
+    uint8_t with_window = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:i:w")) != -1) {
+        switch (opt) {
+        case 'n':
+            max_samples = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            iters = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            with_window = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n max samples] [-i iterations] [-w]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (max_samples == 0 || max_samples > CODEC_BINARY_MAX_SAMPLES || iters == 0) {
+        fprintf(stderr, "1 to %d samples, iterations > 0\n", CODEC_BINARY_MAX_SAMPLES);
+        return 1;
+    }
+
+    // Indoor readings every 5 s, the way the store and the batcher see them
+    window_t window;
+    window_summary_t summary;
+    window_init(&window, BATCH_EWMA_SHIFT);
+    for (size_t i = 0; i < max_samples; i++) {
+        samples[i].temperature = 2150 + (int32_t)(i % 40) - 20;
+        samples[i].humidity = 4520 + i % 30;
+        samples[i].pressure = 101325 - i % 60;
+        sample_set_time(&samples[i], 1700000000000000ull + (uint64_t)i * 5000000ull);
+        window_add(&window, &samples[i]);
+    }
+
+    uint32_t mismatched = 0;
+
+    printf("samples  json bytes  per sample  ns      binary bytes  per sample  ns      size   time\n");
+    for (size_t count = 1; ; count *= 2) {
+        if (count > max_samples) count = max_samples;
+
+        window_summary(&window, &summary);
+        const window_summary_t *payload_window = with_window ? &summary : NULL;
+        double json_ns;
+        double binary_ns;
+        int json_len = bench_encode(CODEC_FORMAT_JSON, count, payload_window, iters, &json_ns);
+        int binary_len = bench_encode(CODEC_FORMAT_BINARY, count, payload_window, iters, &binary_ns);
+
+        if (json_len < 0 || binary_len < 0) {
+            fprintf(stderr, "%zu samples do not fit the buffer\n", count);
+            return 1;
+        }
+
+        // The buffer still holds the binary payload of the last iteration
+        window_summary_t decoded_window;
+        if (codec_decode_binary(buf, binary_len, decoded, CODEC_BINARY_MAX_SAMPLES, &decoded_window) != (int)count) {
+            mismatched++;
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                if (decoded[i].temperature != samples[i].temperature || decoded[i].humidity != samples[i].humidity ||
+                    decoded[i].pressure != samples[i].pressure || decoded[i].time != samples[i].time ||
+                    decoded[i].time_ms != samples[i].time_ms) {
+                    mismatched++;
+                }
+            }
+            if (with_window && decoded_window.count != summary.count) mismatched++;
+        }
+
+        printf("%7zu  %10d  %10.1f  %6.0f  %12d  %10.1f  %6.0f  %4.1fx  %4.1fx\n", count, json_len,
+            (double)json_len / count, json_ns, binary_len, (double)binary_len / count, binary_ns,
+            (double)json_len / binary_len, binary_ns > 0 ? json_ns / binary_ns : 0.0);
+
+        if (count == max_samples) break;
+    }
+
+    printf("round trip:  %lu binary samples mismatched\n", (unsigned long)mismatched);
+
+    return mismatched != 0;
+}
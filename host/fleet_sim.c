@@ -0,0 +1,538 @@
+// Simulates a fleet of devices against one broker from a single process. Every device is a
+// client of the firmware's pico_mqtt module with its own board id, so it connects with its own
+// client id and the will on MQTT_LWT_TOPIC, and publishes a batch of MQTT_BATCH_SAMPLES
+// readings every -i seconds as main.c does. An event loop drives the devices on the cadence of
+// the link and publish tasks of the firmware. Runs on lwIP's Unix port like mqtt_bench.
+//
+//     PRECONFIGURED_TAPIF=tap0 ./fleet_sim -n 1000 -t 300 -r 120
+//
+// The devices boot together, Wi-Fi joins spread over -s ms. With -r the access point reboots
+// after that many seconds: every device loses its link for -o ms, rejoins within -s ms and
+// reconnects without the backoff, closing the connection the broker still holds. An observer
+// client subscribed to MQTT_LWT_TOPIC counts the wills and online messages of the flood.
+//
+// Reports the duration of both connect storms, the PUBACK latency of every publish and the
+// memory each device adds. FLEET_MAX_DEVICES in host/CMakeLists.txt sizes the lwIP pools.
+//
+// fleet_sim_local is the same program on the broker of sim_lwip.c and the access point of
+// sim_cyw43.c, without lwIP, TLS or a TAP interface. Its clock jumps from one event to the
+// next, so -t 300 with 1000 devices takes seconds; latencies are the simulated round trip plus the
+// queueing in pico_mqtt, memory is that of the client state alone.
+//
+//     ./fleet_sim_local -n 1000 -t 300 -r 120
+
+#include "pico_mqtt.h"
+#include "pico_wifi.h"
+#include "pico_codec.h"
+#include "pico_metrics.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "pico/rand.h"
+
+#ifdef FLEET_SIM_NETWORK
+#include "sim_cyw43.h"
+#include "sim_lwip.h"
+#else
+#include "lwip/stats.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FLEET_DEFAULT_DEVICES   100
+#define FLEET_DEFAULT_SECONDS   300
+#define FLEET_DEFAULT_PUBLISH_S 60          // MQTT_PUBLISH_MS of main.c
+#define FLEET_DEFAULT_SPREAD_MS 3000        // Wi-Fi joins finish within this window
+#define FLEET_DEFAULT_OUTAGE_MS 5000
+#define FLEET_LINK_MS           1000        // LINK_SUPERVISION_MS of main.c, runs MQTT_process
+#define FLEET_BATCH_SAMPLES     12          // MQTT_BATCH_SAMPLES of main.c
+#define FLEET_TOPIC             "/room_meas/i2c0-76"
+#define FLEET_BASE_ID           0xF1EE700000000000ull
+#define FLEET_OBSERVER_ID       0xF1EE6FFFFFFFFFFFull
+#define FLEET_OBSERVER_WAIT_MS  30000
+#define FLEET_OBSERVER_SETTLE_MS 1000
+#define FLEET_MAX_DEVICES       (MQTT_MAX_CLIENTS - 1)  // one handle is the observer's
+
+typedef enum {
+    EVENT_START,        // boot or rejoin after the outage
+    EVENT_LINK,
+    EVENT_PUBLISH
+} event_kind_t;
+
+typedef struct {
+    uint64_t due_us;
+    uint32_t device;
+    event_kind_t kind;
+} event_t;
+
+typedef struct {
+    MQTT_client_handle_t mqtt;
+    uint64_t started_us;        // of the current connection attempt, by boot or rejoin
+    uint8_t online;             // the link is up, as app.online of main.c
+    uint8_t waiting;            // not connected yet in the current storm
+} device_t;
+
+// Connecting every device from boot or from the rejoin after the access point came back
+typedef struct {
+    const char *name;
+    uint64_t start_us;
+    uint64_t end_us;            // the last device connected
+    uint32_t *connect_ms;       // from the start of each device
+    size_t connected;
+    uint32_t failed_before;
+    uint32_t failed_end;        // failed attempts counter once the last device connected
+} storm_t;
+
+static device_t devices[FLEET_MAX_DEVICES];
+static event_t events[3 * FLEET_MAX_DEVICES];
+static size_t event_count;
+static size_t device_count;
+
+static uint8_t payload[MQTT_PAYLOAD_MAX_LEN + 1];
+static int payload_len;
+
+static uint32_t *latency_us;
+static size_t latency_count;
+static size_t latency_cap;
+static uint32_t acked;
+static uint32_t failed;
+static uint32_t deferred;       // publishes while offline or with a full queue, kept in the store by the firmware
+
+static uint32_t wills;
+static uint32_t onlines;
+static uint64_t first_will_us;
+static uint64_t last_will_us;
+
+#ifdef FLEET_SIM_NETWORK
+static uint64_t sim_clock_us;
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+static void sim_wait(uint64_t until_us) {
+    if (until_us > sim_clock_us) sim_clock_us = until_us;
+}
+#endif
+
+static void event_push(uint64_t due_us, uint32_t device, event_kind_t kind) {
+    size_t i = event_count++;
+
+    while (i > 0 && events[(i - 1) / 2].due_us > due_us) {
+        events[i] = events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    events[i] = (event_t){ .due_us = due_us, .device = device, .kind = kind };
+}
+
+static event_t event_pop(void) {
+    event_t top = events[0];
+    event_t last = events[--event_count];
+    size_t i = 0;
+
+    while (2 * i + 1 < event_count) {
+        size_t child = 2 * i + 1;
+
+        if (child + 1 < event_count && events[child + 1].due_us < events[child].due_us) child++;
+        if (last.due_us <= events[child].due_us) break;
+        events[i] = events[child];
+        i = child;
+    }
+    if (event_count > 0) events[i] = last;
+
+    return top;
+}
+
+static uint64_t jitter_us(uint32_t max_ms) {
+    return max_ms ? (uint64_t)(get_rand_32() % max_ms) * 1000 : 0;
+}
+
+static void publish_done(__unused void *arg, __unused const char *topic, int err, uint32_t publish_us) {
+    if (err) {
+        failed++;
+        return;
+    }
+
+    acked++;
+    if (latency_count == latency_cap) {
+        size_t cap = latency_cap ? 2 * latency_cap : 4096;
+        uint32_t *grown = realloc(latency_us, cap * sizeof(*latency_us));
+        if (!grown) return;
+        latency_us = grown;
+        latency_cap = cap;
+    }
+    latency_us[latency_count++] = publish_us;
+}
+
+// Every device publishes its will and its online message to the same topic
+static void observe_online(__unused void *arg, __unused const char *topic, const uint8_t *data, size_t len) {
+    if (len == 0) return;
+
+    if (data[0] == MQTT_LWT_MSG[0]) {
+        uint64_t now_us = time_us_64();
+
+        if (wills++ == 0) first_will_us = now_us;
+        last_will_us = now_us;
+    } else {
+        onlines++;
+    }
+}
+
+#ifdef FLEET_SIM_NETWORK
+// The simulated broker does not route publishes to subscribers, it shows them all here
+static void observe_broker(void *arg, const char *topic, const uint8_t *data, size_t len) {
+    if (strcmp(topic, MQTT_LWT_TOPIC) == 0) observe_online(arg, topic, data, len);
+}
+#endif
+
+static uint8_t open_client(MQTT_client_handle_t *handle, uint64_t board_id) {
+    host_set_board_id(board_id);
+    return MQTT_open(handle);
+}
+
+static void storm_begin(storm_t *storm, const char *name, uint64_t start_us) {
+    storm->name = name;
+    storm->start_us = start_us;
+    storm->end_us = 0;
+    storm->connected = 0;
+    storm->failed_before = metrics_get()->counters[METRIC_MQTT_FAILED];
+
+    for (size_t i = 0; i < device_count; i++) {
+        devices[i].waiting = 1;
+    }
+}
+
+// Counts the devices that connected since the last pass
+static void storm_check(storm_t *storm) {
+    if (storm->name == NULL || storm->connected == device_count) return;
+
+    uint64_t now_us = time_us_64();
+
+    for (size_t i = 0; i < device_count; i++) {
+        device_t *device = &devices[i];
+
+        if (!device->waiting || !device->online || MQTT_poll(device->mqtt) != 0) continue;
+
+        device->waiting = 0;
+        storm->connect_ms[storm->connected++] = (uint32_t)((now_us - device->started_us) / 1000);
+        storm->end_us = now_us;
+    }
+
+    if (storm->connected == device_count) {
+        storm->failed_end = metrics_get()->counters[METRIC_MQTT_FAILED];
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned int per_mille) {
+    if (n == 0) return 0;
+    return sorted[(n - 1) * per_mille / 1000];
+}
+
+static void storm_report(storm_t *storm) {
+    if (storm->name == NULL) return;
+
+    qsort(storm->connect_ms, storm->connected, sizeof(*storm->connect_ms), cmp_u32);
+
+    printf("%-12s %zu of %zu connected", storm->name, storm->connected, device_count);
+    if (storm->connected > 0) {
+        printf(" in %lu ms", (unsigned long)((storm->end_us - storm->start_us) / 1000));
+    }
+    uint32_t failed_end = storm->connected == device_count ? storm->failed_end : metrics_get()->counters[METRIC_MQTT_FAILED];
+    printf(", %lu failed attempts\n", (unsigned long)(failed_end - storm->failed_before));
+    printf("             per device ms: p50 %lu  p90 %lu  p99 %lu  max %lu\n",
+        (unsigned long)percentile(storm->connect_ms, storm->connected, 500),
+        (unsigned long)percentile(storm->connect_ms, storm->connected, 900),
+        (unsigned long)percentile(storm->connect_ms, storm->connected, 990),
+        (unsigned long)(storm->connected ? storm->connect_ms[storm->connected - 1] : 0));
+}
+
+// Resident memory of the process, in bytes
+static size_t resident_bytes(void) {
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+#ifdef FLEET_SIM_NETWORK
+// Moves the clock to next_us or to the next answer of the network, whichever comes first
+static void idle_until(uint64_t next_us) {
+    uint64_t network_us = sim_lwip_next_event_us();
+
+    if (network_us < next_us) next_us = network_us;
+    sim_clock_us = next_us > sim_clock_us ? next_us : sim_clock_us + 1;
+}
+#else
+// lwIP's Unix port runs on the real clock, the loop spins
+static void idle_until(__unused uint64_t next_us) {
+}
+#endif
+
+static void handle_event(const event_t *event, uint32_t publish_ms, uint8_t aligned) {
+    device_t *device = &devices[event->device];
+
+    switch (event->kind) {
+    case EVENT_START:
+        device->online = 1;
+        device->started_us = time_us_64();
+
+        // Both storms start the attempt right away, as MQTT_open and the link task after a rejoin
+        if (device->mqtt == NULL) {
+            if (open_client(&device->mqtt, FLEET_BASE_ID + event->device) != 0) {
+                fprintf(stderr, "unable to create the client of device %lu\n", (unsigned long)event->device);
+                return;
+            }
+            MQTT_set_publish_cb(device->mqtt, publish_done, device);
+
+            event_push(event->due_us + (uint64_t)FLEET_LINK_MS * 1000, event->device, EVENT_LINK);
+
+            // Aligned devices sample on the same wall clock grid and publish together
+            uint64_t first_us = aligned ? (uint64_t)publish_ms * 1000 : jitter_us(publish_ms);
+            event_push(event->due_us + first_us, event->device, EVENT_PUBLISH);
+        } else {
+            MQTT_reconnect(device->mqtt);
+        }
+        break;
+
+    case EVENT_LINK:
+        if (device->online) {
+            MQTT_process(device->mqtt);
+        }
+        event_push(event->due_us + (uint64_t)FLEET_LINK_MS * 1000, event->device, EVENT_LINK);
+        break;
+
+    case EVENT_PUBLISH:
+        if (!device->online || MQTT_publish_bytes(device->mqtt, FLEET_TOPIC, payload, (size_t)payload_len) != 0) {
+            deferred++;
+        }
+        event_push(event->due_us + (uint64_t)publish_ms * 1000, event->device, EVENT_PUBLISH);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = FLEET_DEFAULT_SECONDS;
+    uint32_t publish_s = FLEET_DEFAULT_PUBLISH_S;
+    uint32_t spread_ms = FLEET_DEFAULT_SPREAD_MS;
+    uint32_t outage_ms = FLEET_DEFAULT_OUTAGE_MS;
+    uint32_t reboot_s = 0;
+    uint8_t aligned = 0;
+    int opt;
+
+    device_count = FLEET_DEFAULT_DEVICES;
+
+    while ((opt = getopt(argc, argv, "n:t:i:s:r:o:a")) != -1) {
+        switch (opt) {
+        case 'n':
+            device_count = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            publish_s = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            spread_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            reboot_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            outage_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'a':
+            aligned = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n devices] [-t seconds] [-i publish s] [-s join spread ms] [-r reboot at s] [-o outage ms] [-a]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (device_count == 0 || device_count > FLEET_MAX_DEVICES || seconds == 0 || publish_s == 0 ||
+        (reboot_s != 0 && (reboot_s >= seconds || (uint64_t)reboot_s * 1000 <= spread_ms))) {
+        fprintf(stderr, "1 to %d devices, time and publish interval > 0 and the reboot after the boot and within the time\n",
+            FLEET_MAX_DEVICES);
+        return 1;
+    }
+
+    // The batch of readings main.c publishes, with times as after the first NTP reply
+    sample_t samples[FLEET_BATCH_SAMPLES];
+    for (size_t i = 0; i < FLEET_BATCH_SAMPLES; i++) {
+        samples[i] = (sample_t){ .temperature = 2150 + (int32_t)i, .humidity = 4520, .pressure = 101325 };
+        sample_set_time(&samples[i], 1700000000000000ull + i * 5000000ull);
+    }
+    payload_len = codec_encode(CODEC_FORMAT_JSON, samples, FLEET_BATCH_SAMPLES, NULL, payload, sizeof(payload));
+    if (payload_len < 0 || (size_t)payload_len > MQTT_PAYLOAD_MAX_LEN) {
+        fprintf(stderr, "the batch does not fit a publish\n");
+        return 1;
+    }
+
+    storm_t boot = { 0 };
+    storm_t reboot = { 0 };
+    boot.connect_ms = calloc(device_count, sizeof(*boot.connect_ms));
+    reboot.connect_ms = calloc(device_count, sizeof(*reboot.connect_ms));
+    if (!boot.connect_ms || !reboot.connect_ms) return 1;
+
+#ifdef FLEET_SIM_NETWORK
+    sim_clock_us = 1000000;
+    host_set_clock(sim_now_us);
+    sim_lwip_reset();
+    sim_broker_set_observer(observe_broker, NULL);
+    sim_cyw43_reset();
+    sim_cyw43_set_wait(sim_wait);
+#endif
+
+    if (wifi_init() != WIFI_STATUS_CONNECTED) {
+        fprintf(stderr, "unable to bring up the TAP interface\n");
+        return 1;
+    }
+
+    // The observer connects first, so it sees the online message of every device
+    MQTT_client_handle_t observer = NULL;
+    if (open_client(&observer, FLEET_OBSERVER_ID) != 0 ||
+        MQTT_subscribe_handler(observer, MQTT_LWT_TOPIC, observe_online, NULL) != 0) {
+        fprintf(stderr, "unable to create the observer\n");
+        return 1;
+    }
+
+    uint64_t wait_end_us = time_us_64() + (uint64_t)FLEET_OBSERVER_WAIT_MS * 1000;
+    while (MQTT_process(observer) != MQTT_STATE_CONNECTED) {
+        if (time_us_64() >= wait_end_us) {
+            fprintf(stderr, "the observer could not connect to %s\n", MQTT_SERVER);
+            return 1;
+        }
+        cyw43_arch_poll();
+        idle_until(wait_end_us);
+    }
+
+    // The subscription is made by MQTT_process, the retained message it brings is not counted
+    uint64_t settle_us = time_us_64() + (uint64_t)FLEET_OBSERVER_SETTLE_MS * 1000;
+    while (time_us_64() < settle_us) {
+        MQTT_process(observer);
+        cyw43_arch_poll();
+        idle_until(settle_us);
+    }
+    wills = 0;
+    onlines = 0;
+
+    size_t rss_before = resident_bytes();
+#ifndef FLEET_SIM_NETWORK
+    mem_size_t lwip_before = lwip_stats.mem.used;
+    mem_size_t lwip_peak = 0;
+#endif
+    MQTT_tls_stats_t tls_before;
+    MQTT_tls_stats(&tls_before);
+
+    uint64_t start_us = time_us_64();
+    uint64_t end_us = start_us + (uint64_t)seconds * 1000000;
+    uint64_t reboot_us = reboot_s ? start_us + (uint64_t)reboot_s * 1000000 : 0;
+    size_t rss_connected = 0;
+    uint32_t wills_before_reboot = 0;
+
+    for (uint32_t i = 0; i < device_count; i++) {
+        event_push(start_us + jitter_us(spread_ms), i, EVENT_START);
+    }
+    storm_begin(&boot, "boot:", start_us);
+
+    while (time_us_64() < end_us) {
+        uint64_t now_us = time_us_64();
+
+        if (reboot_us != 0 && now_us >= reboot_us) {
+            // The links drop at once, the devices come back as their joins complete
+            for (uint32_t i = 0; i < device_count; i++) {
+                devices[i].online = 0;
+                event_push(reboot_us + (uint64_t)outage_ms * 1000 + jitter_us(spread_ms), i, EVENT_START);
+            }
+            wills_before_reboot = wills;
+            wills = 0;
+            storm_begin(&reboot, "reboot:", reboot_us + (uint64_t)outage_ms * 1000);
+            reboot_us = 0;
+        }
+
+        while (event_count > 0 && events[0].due_us <= now_us) {
+            event_t event = event_pop();
+            handle_event(&event, publish_s * 1000, aligned);
+        }
+
+        MQTT_process(observer);
+        cyw43_arch_poll();
+
+        storm_check(reboot.name ? &reboot : &boot);
+        if (rss_connected == 0 && boot.connected == device_count) {
+            rss_connected = resident_bytes();
+        }
+#ifndef FLEET_SIM_NETWORK
+        if (lwip_stats.mem.used > lwip_peak) lwip_peak = lwip_stats.mem.used;
+#endif
+
+        uint64_t next_us = end_us;
+        if (event_count > 0 && events[0].due_us < next_us) next_us = events[0].due_us;
+        if (reboot_us != 0 && reboot_us < next_us) next_us = reboot_us;
+        idle_until(next_us);
+    }
+
+    MQTT_tls_stats_t tls;
+    MQTT_tls_stats(&tls);
+    if (rss_connected == 0) rss_connected = resident_bytes();
+
+    qsort(latency_us, latency_count, sizeof(*latency_us), cmp_u32);
+
+    printf("devices:     %zu, a batch of %d bytes every %lu s%s, %lu s simulated\n", device_count, payload_len,
+        (unsigned long)publish_s, aligned ? " on the same instant" : "", (unsigned long)seconds);
+    storm_report(&boot);
+    storm_report(&reboot);
+#ifndef FLEET_SIM_NETWORK
+    printf("handshakes:  %lu full, %lu resumed, %lu TLS allocations failed\n",
+        (unsigned long)(tls.full_handshakes - tls_before.full_handshakes),
+        (unsigned long)(tls.resumed_handshakes - tls_before.resumed_handshakes), (unsigned long)tls.arena_failed);
+#endif
+    printf("online:      %lu online messages and %lu wills before the reboot, %lu wills after it",
+        (unsigned long)onlines, (unsigned long)wills_before_reboot, (unsigned long)wills);
+    if (wills > 0) {
+        printf(" over %lu ms", (unsigned long)((last_will_us - first_will_us) / 1000));
+    }
+    printf("\n");
+    printf("publishes:   %lu acked, %lu failed, %lu deferred while offline or queued full, %lu lost connections\n",
+        (unsigned long)acked, (unsigned long)failed, (unsigned long)deferred,
+        (unsigned long)metrics_get()->counters[METRIC_MQTT_LOST]);
+    printf("latency us:  p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu, queueing and retries included\n",
+        (unsigned long)percentile(latency_us, latency_count, 500),
+        (unsigned long)percentile(latency_us, latency_count, 900),
+        (unsigned long)percentile(latency_us, latency_count, 990),
+        (unsigned long)percentile(latency_us, latency_count, 999),
+        (unsigned long)(latency_count ? latency_us[latency_count - 1] : 0));
+#ifdef FLEET_SIM_NETWORK
+    printf("memory:      per device %zu bytes resident, client state only\n",
+        rss_connected > rss_before ? (rss_connected - rss_before) / device_count : 0);
+#else
+    printf("memory:      per device %zu bytes resident, %lu of TLS arena and %lu of lwIP heap at peak\n",
+        rss_connected > rss_before ? (rss_connected - rss_before) / device_count : 0,
+        (unsigned long)((tls.arena_peak - tls_before.arena_used) / device_count),
+        (unsigned long)((lwip_peak > lwip_before ? lwip_peak - lwip_before : 0) / device_count));
+#endif
+
+    for (size_t i = 0; i < device_count; i++) {
+        MQTT_close(devices[i].mqtt);
+    }
+    MQTT_close(observer);
+    free(boot.connect_ms);
+    free(reboot.connect_ms);
+    free(latency_us);
+
+    return boot.connected < device_count || (reboot.name != NULL && reboot.connected < device_count);
+}
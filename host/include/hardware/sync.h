@@ -0,0 +1,17 @@
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+
+// Host replacement for the interrupt masking of the Pico SDK. The host build polls lwIP
+// from one thread and has no interrupts to mask.
+
+#include <stdint.h>
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_PICO_H
+#define HOST_PICO_H
+
+// Host replacement for the base definitions of the Pico SDK
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define PICO_OK 0
+
+typedef unsigned int uint;
+
+// The host runs everything as core 0
+static inline uint get_core_num(void) {
+    return 0;
+}
+
+/**
+ * @brief Prints the message and aborts the process.
+ */
+void panic(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+// Host replacement for pico_cyw43_arch. The "Wi-Fi" interface is a TAP device driven
+// by lwIP's Unix port, so the firmware modules talk to a broker on the host network.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico.h"
+#include "pico/time.h"
+#include "lwip/netif.h"
+
+#define CYW43_ITF_STA           0
+#define CYW43_ITF_AP            1
+
+#define CYW43_LINK_DOWN         0
+#define CYW43_LINK_JOIN         1
+#define CYW43_LINK_NOIP         2
+#define CYW43_LINK_UP           3
+#define CYW43_LINK_FAIL         (-1)
+#define CYW43_LINK_NONET        (-2)
+#define CYW43_LINK_BADAUTH      (-3)
+
+#define CYW43_AUTH_OPEN         0
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+
+#define CYW43_WL_GPIO_LED_PIN   0
+
+#define CYW43_CHANNEL_NONE      (0xffffffff)
+#define CYW43_IOCTL_GET_CHANNEL (0x3a)
+
+typedef struct {
+    struct netif netif[2];
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+int cyw43_arch_init(void);
+void cyw43_arch_deinit(void);
+void cyw43_arch_enable_sta_mode(void);
+int cyw43_wifi_join(cyw43_t *self, size_t ssid_len, const uint8_t *ssid, size_t key_len, const uint8_t *key,
+    uint32_t auth_type, const uint8_t *bssid, uint32_t channel);
+int cyw43_wifi_leave(cyw43_t *self, int itf);
+int cyw43_wifi_link_status(cyw43_t *self, int itf);
+int cyw43_tcpip_link_status(cyw43_t *self, int itf);
+int cyw43_wifi_get_bssid(cyw43_t *self, uint8_t bssid[6]);
+int cyw43_ioctl(cyw43_t *self, uint32_t cmd, size_t len, uint8_t *buf, uint32_t iface);
+void cyw43_arch_poll(void);
+void cyw43_arch_wait_for_work_until(absolute_time_t until);
+void cyw43_arch_gpio_put(uint wl_gpio, bool value);
+
+static inline void cyw43_arch_lwip_begin(void) {}
+static inline void cyw43_arch_lwip_end(void) {}
+
+/**
+ * @brief Host only. Simulates the access point going away or coming back. While it is away
+ * the association is lost and joins fail with CYW43_LINK_NONET.
+ */
+void cyw43_host_set_link(bool up);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef HOST_PICO_RAND_H
+#define HOST_PICO_RAND_H
+
+// Host replacement for pico_rand
+
+#include <stdint.h>
+
+uint32_t get_rand_32(void);
+
+#endif
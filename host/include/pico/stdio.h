@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_STDIO_H
+#define HOST_PICO_STDIO_H
+
+#include <stdio.h>
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+// Host replacement for the parts of pico_stdlib used by the firmware modules
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pico.h"
+#include "pico/time.h"
+
+static inline bool stdio_init_all(void) {
+    return true;
+}
+
+#endif
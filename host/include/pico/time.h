@@ -0,0 +1,69 @@
+#ifndef HOST_PICO_TIME_H
+#define HOST_PICO_TIME_H
+
+// Host replacement for the time API of the Pico SDK. Time counts from process start.
+
+#include <stdint.h>
+
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+void sleep_us(uint64_t us);
+
+/**
+ * @brief Host only. Replaces the clock behind time_us_64 and sleep_us, so modules that read
+ * the time themselves run on the simulated clock of a test. sleep_us then returns at once.
+ * NULL goes back to the process clock.
+ */
+void host_set_clock(uint64_t (*now_us)(void));
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+    return us;
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+    return t + us;
+}
+
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return t + (uint64_t)ms * 1000;
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return time_us_64() + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + (uint64_t)ms * 1000;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+static inline void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t)ms * 1000);
+}
+
+static inline void sleep_until(absolute_time_t t) {
+    uint64_t now = time_us_64();
+    if (t > now) sleep_us(t - now);
+}
+
+#endif
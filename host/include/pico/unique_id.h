@@ -0,0 +1,19 @@
+#ifndef HOST_PICO_UNIQUE_ID_H
+#define HOST_PICO_UNIQUE_ID_H
+
+#include <stdint.h>
+
+#define PICO_UNIQUE_BOARD_ID_SIZE_BYTES 8
+
+/**
+ * @brief Writes the board id as upper case hex, like the Pico SDK. On the host the id
+ * comes from host_set_board_id, the PICO_HOST_BOARD_ID environment variable or the process id.
+ */
+void pico_get_unique_board_id_string(char *id_out, unsigned int len);
+
+/**
+ * @brief Host only. Sets the board id returned from now on, used to simulate several devices.
+ */
+void host_set_board_id(uint64_t id);
+
+#endif
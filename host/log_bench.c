@@ -0,0 +1,82 @@
+// Measures the cost of one log call on the caller, once through the deferred logger
+// and once through printf, and the cost of draining a deferred record afterwards.
+// stdout is sent to /dev/null, so printf pays for formatting and the stdio copy only.
+// On the device a printf over USB CDC also blocks while the host is not reading.
+//
+//     ./log_bench -n 1000000
+
+#include "pico_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_CALLS     1000000
+#define BENCH_BURST             32      // calls between drains, fits the ring
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    size_t calls = BENCH_DEFAULT_CALLS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            calls = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "unable to open /dev/null\n");
+        return 1;
+    }
+
+    const char *task = "publish";
+    uint64_t log_ns = 0;
+    uint64_t drain_ns = 0;
+    size_t done = 0;
+
+    // A typical line of the firmware, a string and five numbers
+    while (done < calls) {
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < BENCH_BURST; i++) {
+            PICO_LOGI("  %-8s runs %lu, late %lu, skipped %lu, jitter avg %lu us max %lu us\n",
+                task, (unsigned long)done, (unsigned long)i, 0ul, 120ul, 950ul);
+        }
+        log_ns += now_ns() - start;
+
+        start = now_ns();
+        log_flush();
+        drain_ns += now_ns() - start;
+
+        done += BENCH_BURST;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < done; i++) {
+        printf("  %-8s runs %lu, late %lu, skipped %lu, jitter avg %lu us max %lu us\n",
+            task, (unsigned long)i, (unsigned long)i, 0ul, 120ul, 950ul);
+    }
+    uint64_t printf_ns = now_ns() - start;
+
+    const log_stats_t *stats = log_get_stats(0);
+
+    fprintf(stderr, "calls:    %zu, %lu records, %lu dropped, ring high water %lu of %d bytes\n",
+        done, (unsigned long)stats->records, (unsigned long)stats->dropped,
+        (unsigned long)stats->max_used, LOG_RING_SIZE);
+    fprintf(stderr, "deferred: %.1f ns per call\n", (double)log_ns / done);
+    fprintf(stderr, "printf:   %.1f ns per call\n", (double)printf_ns / done);
+    fprintf(stderr, "drain:    %.1f ns per record, paid when idle\n", (double)drain_ns / done);
+
+    return stats->dropped != 0;
+}
@@ -0,0 +1,238 @@
+// Turns the deferred log records printed by the firmware back into text. The format
+// strings are not sent over the wire, they are read from the firmware ELF by address.
+// Lines that are not records are passed through unchanged.
+//
+//     cat /dev/ttyACM0 | ./log_decode build/raspberry_pico_w_bme280_i2c.elf
+
+#include "pico_log.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DECODE_LINE_MAX_LEN     1024
+#define DECODE_SPEC_MAX_LEN     24
+
+static uint8_t *elf;
+static size_t elf_len;
+
+static const char *level_names[] = {"", "ERROR: ", "Warning: ", ""};
+
+static uint8_t load_elf(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 1;
+
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    elf = len > 0 ? malloc((size_t)len) : NULL;
+    if (!elf || fread(elf, 1, (size_t)len, f) != (size_t)len) {
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+    elf_len = (size_t)len;
+
+    const Elf32_Ehdr *header = (const Elf32_Ehdr *)elf;
+    if (elf_len < sizeof(*header) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB ||
+        header->e_phoff + (size_t)header->e_phnum * sizeof(Elf32_Phdr) > elf_len) {
+        return 1;
+    }
+    return 0;
+}
+
+// Finds the format string at a firmware address in the loadable segments
+static const char *elf_string(uint32_t addr) {
+    if (!elf) return NULL;
+
+    const Elf32_Ehdr *header = (const Elf32_Ehdr *)elf;
+    const Elf32_Phdr *segments = (const Elf32_Phdr *)(elf + header->e_phoff);
+
+    for (unsigned int i = 0; i < header->e_phnum; i++) {
+        const Elf32_Phdr *segment = &segments[i];
+
+        if (segment->p_type != PT_LOAD || addr < segment->p_vaddr || addr >= segment->p_vaddr + segment->p_filesz) {
+            continue;
+        }
+
+        size_t offset = segment->p_offset + (addr - segment->p_vaddr);
+        size_t end = segment->p_offset + segment->p_filesz;
+        if (end > elf_len || !memchr(&elf[offset], '\0', end - offset)) return NULL;
+
+        return (const char *)&elf[offset];
+    }
+    return NULL;
+}
+
+static uint64_t get_le(const uint8_t *p, size_t len) {
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+// Formats one argument with the flags, width and precision of the conversion. The length
+// modifier of the format string is replaced by the one that matches the recorded type.
+static size_t format_arg(const char *spec, char conv, const uint8_t *args, size_t len, char *out, size_t out_len) {
+    char format[DECODE_SPEC_MAX_LEN + 4];
+    uint8_t tag = args[0];
+
+    switch (tag) {
+    case LOG_ARG_U32: {
+        if (len < 5) return 0;
+        uint32_t value = (uint32_t)get_le(&args[1], 4);
+
+        if (conv == 'd' || conv == 'i') {
+            snprintf(format, sizeof(format), "%sd", spec);
+            snprintf(out, out_len, format, (int32_t)value);
+        } else if (conv == 'c') {
+            snprintf(format, sizeof(format), "%sc", spec);
+            snprintf(out, out_len, format, (int)value);
+        } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+            snprintf(format, sizeof(format), "%s%c", spec, conv);
+            snprintf(out, out_len, format, (unsigned int)value);
+        } else {
+            snprintf(out, out_len, "0x%08lx", (unsigned long)value);
+        }
+        return 5;
+    }
+    case LOG_ARG_U64: {
+        if (len < 9) return 0;
+        uint64_t value = get_le(&args[1], 8);
+
+        if (conv == 'd' || conv == 'i') {
+            snprintf(format, sizeof(format), "%slld", spec);
+            snprintf(out, out_len, format, (long long)value);
+        } else if (conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o') {
+            snprintf(format, sizeof(format), "%sll%c", spec, conv);
+            snprintf(out, out_len, format, (unsigned long long)value);
+        } else {
+            snprintf(out, out_len, "0x%016llx", (unsigned long long)value);
+        }
+        return 9;
+    }
+    case LOG_ARG_DOUBLE: {
+        if (len < 9) return 0;
+        uint64_t bits = get_le(&args[1], 8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+
+        snprintf(format, sizeof(format), "%s%c", spec, strchr("fFeEgGaA", conv) ? conv : 'g');
+        snprintf(out, out_len, format, value);
+        return 9;
+    }
+    case LOG_ARG_STRING: {
+        if (len < 2 || len < 2u + args[1]) return 0;
+        char value[256];
+        memcpy(value, &args[2], args[1]);
+        value[args[1]] = '\0';
+
+        snprintf(format, sizeof(format), "%ss", spec);
+        snprintf(out, out_len, format, value);
+        return 2u + args[1];
+    }
+    default:
+        return 0;
+    }
+}
+
+static void print_message(const char *fmt, const uint8_t *args, size_t len) {
+    size_t pos = 0;
+    char last = '\n';
+
+    while (*fmt) {
+        if (*fmt != '%' || fmt[1] == '%') {
+            last = *fmt;
+            putchar(*fmt);
+            fmt += *fmt == '%' ? 2 : 1;
+            continue;
+        }
+
+        char spec[DECODE_SPEC_MAX_LEN];
+        size_t n = 0;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && n < sizeof(spec) - 1) spec[n++] = *fmt++;
+        spec[n] = '\0';
+        while (*fmt && strchr("hlLqjzt", *fmt)) fmt++;
+
+        char conv = *fmt;
+        if (!conv) break;
+        fmt++;
+
+        char out[DECODE_LINE_MAX_LEN] = "";
+        size_t used = pos < len ? format_arg(spec, conv, &args[pos], len - pos, out, sizeof(out)) : 0;
+        if (used == 0) {
+            strcpy(out, "<?>");
+            pos = len;
+        }
+        pos += used;
+
+        fputs(out, stdout);
+        if (out[0]) last = out[strlen(out) - 1];
+    }
+
+    if (last != '\n') putchar('\n');
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int decode_line(const char *line) {
+    uint8_t record[LOG_RECORD_MAX_LEN];
+    size_t len = 0;
+
+    for (const char *p = line + 1; hex_value(p[0]) >= 0 && hex_value(p[1]) >= 0; p += 2) {
+        if (len == sizeof(record)) return 1;
+        record[len++] = (uint8_t)(hex_value(p[0]) << 4 | hex_value(p[1]));
+    }
+
+    if (len < LOG_HEADER_LEN || record[0] != len) return 1;
+
+    uint8_t level = record[1] & 0x0F;
+    unsigned int core = record[1] >> 4;
+    uint32_t fmt_addr = (uint32_t)get_le(&record[2], 4);
+    uint32_t time_us = (uint32_t)get_le(&record[6], 4);
+
+    printf("[%5lu.%06lu] core %u %s", (unsigned long)(time_us / 1000000), (unsigned long)(time_us % 1000000),
+        core, level_names[level < 4 ? level : 0]);
+
+    const char *fmt = elf_string(fmt_addr);
+    if (!fmt) {
+        printf("<format 0x%08lx, %zu argument bytes>\n", (unsigned long)fmt_addr, len - LOG_HEADER_LEN);
+        return 0;
+    }
+
+    print_message(fmt, &record[LOG_HEADER_LEN], len - LOG_HEADER_LEN);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char line[DECODE_LINE_MAX_LEN];
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s firmware.elf < log\n", argv[0]);
+        return 1;
+    }
+
+    if (load_elf(argv[1]) != 0) {
+        fprintf(stderr, "unable to read %s as a 32 bit little endian ELF\n", argv[1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), stdin)) {
+        if (line[0] != LOG_LINE_PREFIX || decode_line(line) != 0) {
+            fputs(line, stdout);
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
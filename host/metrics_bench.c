@@ -0,0 +1,76 @@
+// Measures the cost of recording one event in pico_metrics, for every kind of metric,
+// and the cost of encoding a snapshot.
+//
+//     ./metrics_bench -n 10000000
+
+#include "pico_metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_EVENTS    10000000
+#define BENCH_SNAPSHOTS         10000
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    size_t events = BENCH_DEFAULT_EVENTS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            events = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n events]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (events == 0) return 1;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < events; i++) {
+        metrics_count((metric_counter_t)(i % METRIC_COUNTER_COUNT));
+    }
+    uint64_t count_ns = now_ns() - start;
+
+    start = now_ns();
+    for (size_t i = 0; i < events; i++) {
+        metrics_gauge((metric_gauge_t)(i % METRIC_GAUGE_COUNT), (uint32_t)i);
+    }
+    uint64_t gauge_ns = now_ns() - start;
+
+    // Spread the values over every bucket, the worst case scans all bounds
+    start = now_ns();
+    for (size_t i = 0; i < events; i++) {
+        metrics_observe(METRIC_LOOP_US, (uint32_t)(i * 7919 % 30000));
+    }
+    uint64_t observe_ns = now_ns() - start;
+
+    char json[1024];
+    int len = 0;
+    start = now_ns();
+    for (size_t i = 0; i < BENCH_SNAPSHOTS; i++) {
+        len = metrics_to_json((uint32_t)i, json, sizeof(json));
+    }
+    uint64_t json_ns = now_ns() - start;
+
+    const metrics_histogram_t *h = &metrics_get()->histograms[METRIC_LOOP_US];
+
+    printf("counter:   %.1f ns per event\n", (double)count_ns / events);
+    printf("gauge:     %.1f ns per event\n", (double)gauge_ns / events);
+    printf("histogram: %.1f ns per event, %lu recorded, max %lu\n", (double)observe_ns / events,
+        (unsigned long)h->count, (unsigned long)h->max);
+    printf("snapshot:  %.1f us per encode, %d bytes\n", (double)json_ns / BENCH_SNAPSHOTS / 1000, len);
+    printf("%s\n", len > 0 ? json : "snapshot does not fit");
+
+    return len < 0;
+}
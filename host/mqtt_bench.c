@@ -0,0 +1,202 @@
+// Measures MQTT_open connect time, MQTT_publish throughput and PUBACK latency
+// through the firmware's pico_mqtt module, against a broker on the host network.
+// With -r the client also subscribes to its own topic and measures the inbound
+// message rate and the bytes copied while reassembling the echoed publishes.
+//
+// The device side runs on lwIP's Unix port on a TAP interface, for example:
+//
+//     sudo ip tuntap add dev tap0 mode tap user $USER
+//     sudo ip addr add 192.168.1.1/24 dev tap0 && sudo ip link set tap0 up
+//     PRECONFIGURED_TAPIF=tap0 ./mqtt_bench -n 1000 -s 100
+//
+// MQTT_SERVER in pico_mqtt.h must point at the broker, e.g. 192.168.1.1.
+
+#include "pico_mqtt.h"
+#include "pico_wifi.h"
+#include "pico_inbound.h"
+#include "pico_trace.h"
+#include "pico/stdlib.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define BENCH_DEFAULT_COUNT     1000
+#define BENCH_DEFAULT_SIZE      100
+#define BENCH_TIMEOUT_MS        120000
+#define BENCH_TOPIC             "/bench"
+
+static uint32_t *latency_us;
+static size_t completions;
+static size_t acked;
+static size_t failed;
+
+static uint8_t inbound_buf[MQTT_PAYLOAD_MAX_LEN + 1];
+static inbound_msg_t inbound;
+static size_t fragments;
+static uint64_t first_inbound_us;
+static uint64_t last_inbound_us;
+
+static void publish_done(__unused void *arg, __unused const char *topic, int err, uint32_t publish_us) {
+    if (err) {
+        failed++;
+    } else {
+        latency_us[acked++] = publish_us;
+    }
+    completions++;
+}
+
+static uint8_t inbound_begin_cb(__unused void *arg, __unused const char *topic, size_t total_len) {
+    if (inbound.stats.messages == 0) {
+        first_inbound_us = time_us_64();
+    }
+    return inbound_begin(&inbound, total_len);
+}
+
+static void inbound_data_cb(__unused void *arg, const uint8_t *data, size_t len, uint8_t last) {
+    fragments++;
+    if (inbound_append(&inbound, data, len, last) == 0) {
+        last_inbound_us = time_us_64();
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned int pct) {
+    if (n == 0) return 0;
+    return sorted[(n - 1) * pct / 100];
+}
+
+static size_t heap_in_use(void) {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks;
+}
+
+int main(int argc, char **argv) {
+    size_t count = BENCH_DEFAULT_COUNT;
+    size_t size = BENCH_DEFAULT_SIZE;
+    bool echo = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:r")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            echo = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n publishes] [-s payload bytes] [-r]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (count == 0 || size > MQTT_PAYLOAD_MAX_LEN) {
+        fprintf(stderr, "publishes must be > 0 and payload <= %d bytes\n", MQTT_PAYLOAD_MAX_LEN);
+        return 1;
+    }
+
+    latency_us = calloc(count, sizeof(*latency_us));
+    uint8_t *payload = malloc(size);
+    if (!latency_us || !payload) return 1;
+    memset(payload, 'x', size);
+
+    if (wifi_init() != WIFI_STATUS_CONNECTED) {
+        fprintf(stderr, "unable to bring up the TAP interface\n");
+        return 1;
+    }
+
+    MQTT_client_handle_t handle = NULL;
+    size_t heap_before = heap_in_use();
+    uint64_t start = time_us_64();
+
+    if (MQTT_open(&handle) != 0) {
+        fprintf(stderr, "unable to create the MQTT client\n");
+        return 1;
+    }
+
+    // A failed attempt is not retried, the backoff would only distort the connect time
+    MQTT_state_t state;
+    while ((state = MQTT_process(handle)) != MQTT_STATE_CONNECTED) {
+        if (state == MQTT_STATE_BACKOFF) {
+            fprintf(stderr, "unable to connect to %s\n", MQTT_SERVER);
+            return 1;
+        }
+        cyw43_arch_poll();
+    }
+
+    uint64_t connect_us = time_us_64() - start;
+    size_t heap_connected = heap_in_use();
+
+    MQTT_set_publish_cb(handle, publish_done, NULL);
+
+    if (echo) {
+        const MQTT_consumer_t consumer = {
+            .begin = inbound_begin_cb,
+            .data = inbound_data_cb
+        };
+
+        inbound_init(&inbound, inbound_buf, sizeof(inbound_buf));
+        MQTT_set_consumer(handle, &consumer);
+        if (MQTT_subscribe(handle, BENCH_TOPIC) != 0) {
+            fprintf(stderr, "unable to subscribe to %s\n", BENCH_TOPIC);
+            return 1;
+        }
+    }
+
+    // Keep the publish queue full, a rejected publish is retried after polling
+    size_t sent = 0;
+    start = time_us_64();
+    absolute_time_t timeout = make_timeout_time_ms(BENCH_TIMEOUT_MS);
+
+    while ((completions < count || (echo && inbound.stats.messages < count)) &&
+        absolute_time_diff_us(get_absolute_time(), timeout) > 0) {
+        while (sent < count && MQTT_publish_bytes(handle, BENCH_TOPIC, payload, size) == 0) {
+            sent++;
+        }
+        cyw43_arch_poll();
+    }
+
+    uint64_t elapsed_us = time_us_64() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    qsort(latency_us, acked, sizeof(*latency_us), cmp_u32);
+
+    printf("connect:     %.1f ms\n", connect_us / 1000.0);
+    printf("publishes:   %zu sent, %zu acked, %zu failed, %zu bytes each\n", sent, acked, failed, size);
+    printf("throughput:  %.1f msg/s, %.1f kB/s payload\n",
+        acked * 1e6 / elapsed_us, acked * size * 1e3 / elapsed_us);
+    printf("latency us:  p50 %u  p90 %u  p99 %u  max %u, queueing included\n",
+        percentile(latency_us, acked, 50), percentile(latency_us, acked, 90),
+        percentile(latency_us, acked, 99), acked ? latency_us[acked - 1] : 0);
+    if (echo) {
+        uint64_t inbound_us = last_inbound_us - first_inbound_us;
+
+        printf("inbound:     %lu received, %lu dropped, %zu fragments, %.1f msg/s\n",
+            (unsigned long)inbound.stats.messages, (unsigned long)inbound.stats.dropped, fragments,
+            inbound_us ? inbound.stats.messages * 1e6 / inbound_us : 0.0);
+        printf("copied:      %lu bytes, %.1f per message\n", (unsigned long)inbound.stats.bytes_copied,
+            inbound.stats.messages ? (double)inbound.stats.bytes_copied / inbound.stats.messages : 0.0);
+    }
+    printf("memory:      %zu bytes heap for the connection, %ld kB max RSS\n",
+        heap_connected - heap_before, usage.ru_maxrss);
+
+    MQTT_close(handle);
+
+    // Built with PICO_TRACE, the latest spans follow for trace_json
+    trace_dump();
+
+    return completions < count;
+}
@@ -0,0 +1,239 @@
+// Drives the connection state machine of pico_mqtt.c through every phase and every way an
+// attempt can end, against the simulated broker and resolver of sim_lwip.c on a simulated
+// clock. The client is built with MQTT_DNS_NAME, so every attempt starts with a lookup.
+//
+//     ./mqtt_connect_test
+//
+// Checks the time each phase takes to fail, the backoff after every failure, that a refused
+// CONNACK fails the attempt at once, that late DNS answers are ignored and that a lost
+// connection and MQTT_reconnect start over. Prints every failed check, exits non-zero if any.
+
+#include "pico_mqtt.h"
+#include "pico_metrics.h"
+#include "sim_lwip.h"
+#include "pico/time.h"
+
+#include <stdio.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_STEP_US        1000
+#define TEST_DNS_DELAY_MS   30
+#define TEST_CONNECT_MS     50      // TCP connect and TLS handshake
+#define TEST_RTT_MS         20
+
+static uint64_t sim_clock_us;
+static uint32_t failures;
+static MQTT_client_handle_t handle;
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+// Polls the network and the client every millisecond, as the main loop does, until the
+// client is in the state. Returns the milliseconds it took, -1 if limit_ms passed first.
+static int64_t run_until(MQTT_state_t state, uint32_t limit_ms) {
+    uint64_t start_us = sim_clock_us;
+
+    while (1) {
+        sim_lwip_poll();
+        if (MQTT_process(handle) == state) return (int64_t)((sim_clock_us - start_us) / 1000);
+        if (sim_clock_us - start_us >= (uint64_t)limit_ms * 1000) return -1;
+        sim_clock_us += TEST_STEP_US;
+    }
+}
+
+// Returns how long the client stays in the state it is in now
+static int64_t run_while(MQTT_state_t state, uint32_t limit_ms) {
+    uint64_t start_us = sim_clock_us;
+
+    while (1) {
+        sim_lwip_poll();
+        if (MQTT_process(handle) != state) return (int64_t)((sim_clock_us - start_us) / 1000);
+        if (sim_clock_us - start_us >= (uint64_t)limit_ms * 1000) return -1;
+        sim_clock_us += TEST_STEP_US;
+    }
+}
+
+// Checks the wait before the next attempt, half fixed and half random. The wait ends when
+// the client starts a lookup, which every attempt begins with.
+static void check_backoff(uint32_t failed_attempts) {
+    uint32_t delay_ms = MQTT_BACKOFF_MAX_MS;
+    if (failed_attempts < 16 && (MQTT_BACKOFF_BASE_MS << failed_attempts) < MQTT_BACKOFF_MAX_MS) {
+        delay_ms = MQTT_BACKOFF_BASE_MS << failed_attempts;
+    }
+
+    sim_lwip_stats_t stats;
+    sim_lwip_get_stats(&stats);
+    uint32_t lookups = stats.lookups;
+    uint64_t start_us = sim_clock_us;
+    int64_t waited = -1;
+
+    while (sim_clock_us - start_us <= (uint64_t)delay_ms * 1000) {
+        sim_lwip_poll();
+        MQTT_process(handle);
+        sim_lwip_get_stats(&stats);
+        if (stats.lookups != lookups) {
+            waited = (int64_t)((sim_clock_us - start_us) / 1000);
+            break;
+        }
+        sim_clock_us += TEST_STEP_US;
+    }
+
+    if (waited < delay_ms / 2) {
+        fprintf(stderr, "backoff after %lu failures took %lld ms, expected %lu to %lu\n", (unsigned long)failed_attempts,
+            (long long)waited, (unsigned long)delay_ms / 2, (unsigned long)delay_ms);
+        failures++;
+    }
+}
+
+static uint32_t failed_count(void) {
+    return metrics_get()->counters[METRIC_MQTT_FAILED];
+}
+
+static void test_connect(void) {
+    sim_dns_set_mode(SIM_DNS_ANSWER, TEST_DNS_DELAY_MS);
+
+    CHECK(MQTT_open(&handle) == 0);
+    CHECK(MQTT_process(handle) == MQTT_STATE_RESOLVING);
+    CHECK(run_until(MQTT_STATE_CONNECTING, 1000) == TEST_DNS_DELAY_MS);
+    CHECK(run_until(MQTT_STATE_CONNECTED, 1000) == TEST_CONNECT_MS + TEST_RTT_MS);
+    CHECK(MQTT_poll(handle) == 0);
+    CHECK(metrics_get()->counters[METRIC_MQTT_CONNECTS] == 1);
+}
+
+static void test_lost(void) {
+    sim_lwip_stats_t before, after;
+    sim_lwip_get_stats(&before);
+
+    // A dropped connection is not a failed attempt, the backoff starts from the base
+    sim_broker_drop();
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(MQTT_poll(handle) == 1);
+    CHECK(metrics_get()->counters[METRIC_MQTT_LOST] == 1);
+    check_backoff(0);
+
+    CHECK(run_until(MQTT_STATE_CONNECTED, 1000) == TEST_DNS_DELAY_MS + TEST_CONNECT_MS + TEST_RTT_MS);
+    sim_lwip_get_stats(&after);
+    CHECK(after.connects == before.connects + 1);
+}
+
+static void test_failures(void) {
+    sim_lwip_stats_t before, after;
+    uint32_t failed = failed_count();
+    uint32_t attempts = 0;
+
+    sim_broker_drop();
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+
+    // The resolver never answers: RESOLVING times out
+    sim_dns_set_mode(SIM_DNS_NO_ANSWER, 0);
+    check_backoff(attempts);
+    CHECK(MQTT_process(handle) == MQTT_STATE_RESOLVING);
+    CHECK(run_while(MQTT_STATE_RESOLVING, MQTT_DNS_TIMEOUT_MS + 1000) == MQTT_DNS_TIMEOUT_MS);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+
+    // The name does not resolve: the attempt fails with the answer
+    sim_dns_set_mode(SIM_DNS_NOT_FOUND, TEST_DNS_DELAY_MS);
+    check_backoff(attempts);
+    CHECK(run_while(MQTT_STATE_RESOLVING, 1000) == TEST_DNS_DELAY_MS);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+
+    // SYNs are dropped: the TCP connect and TLS handshake never complete
+    sim_dns_set_mode(SIM_DNS_CACHED, 0);
+    sim_broker_set_mode(SIM_BROKER_NO_ANSWER);
+    sim_lwip_get_stats(&before);
+    check_backoff(attempts);
+    CHECK(run_while(MQTT_STATE_CONNECTING, MQTT_CONNECT_TIMEOUT_MS + 1000) == MQTT_CONNECT_TIMEOUT_MS);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+    sim_lwip_get_stats(&after);
+    CHECK(after.connects == before.connects + 1);
+    CHECK(after.disconnects == before.disconnects + 1);
+
+    // TCP and TLS come up, the broker never sends the CONNACK
+    sim_broker_set_mode(SIM_BROKER_NO_CONNACK);
+    sim_lwip_get_stats(&before);
+    check_backoff(attempts);
+    CHECK(run_while(MQTT_STATE_CONNECTING, MQTT_CONNECT_TIMEOUT_MS + 1000) == MQTT_CONNECT_TIMEOUT_MS);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+    sim_lwip_get_stats(&after);
+    CHECK(after.connacks == before.connacks);
+    CHECK(after.disconnects == before.disconnects + 1);
+
+    // The broker refuses the client: the attempt fails with the CONNACK, the client closes
+    // the connection before the broker does
+    sim_broker_set_mode(SIM_BROKER_REFUSE);
+    sim_lwip_get_stats(&before);
+    check_backoff(attempts);
+    CHECK(run_while(MQTT_STATE_CONNECTING, 1000) == TEST_CONNECT_MS + TEST_RTT_MS);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+    sim_lwip_get_stats(&after);
+    CHECK(after.connacks == before.connacks + 1);
+    CHECK(after.drops == before.drops);
+
+    // No route to the broker: mqtt_client_connect fails and the backoff starts at once
+    sim_broker_set_mode(SIM_BROKER_UNREACHABLE);
+    check_backoff(attempts);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    CHECK(failed_count() == failed + ++attempts);
+
+    // The backoff doubles up to MQTT_BACKOFF_MAX_MS
+    sim_broker_set_mode(SIM_BROKER_REFUSE);
+    while (attempts < 12) {
+        check_backoff(attempts);
+        CHECK(run_while(MQTT_STATE_CONNECTING, 1000) == TEST_CONNECT_MS + TEST_RTT_MS);
+        attempts++;
+    }
+    CHECK(failed_count() == failed + attempts);
+
+    // The link is back: skip the backoff, and a success starts the backoff over
+    sim_broker_set_mode(SIM_BROKER_ACCEPT);
+    CHECK(MQTT_process(handle) == MQTT_STATE_BACKOFF);
+    MQTT_reconnect(handle);
+    CHECK(MQTT_process(handle) == MQTT_STATE_CONNECTING);
+    CHECK(run_until(MQTT_STATE_CONNECTED, 1000) == TEST_CONNECT_MS + TEST_RTT_MS);
+    sim_broker_drop();
+    check_backoff(0);
+}
+
+static void test_late_dns(void) {
+    sim_lwip_stats_t before, after;
+
+    // The answer arrives after the lookup timed out and must not start a connect
+    sim_dns_set_mode(SIM_DNS_ANSWER, MQTT_DNS_TIMEOUT_MS + 500);
+    MQTT_reconnect(handle);
+    sim_lwip_get_stats(&before);
+    CHECK(MQTT_process(handle) == MQTT_STATE_RESOLVING);
+    CHECK(run_while(MQTT_STATE_RESOLVING, MQTT_DNS_TIMEOUT_MS + 1000) == MQTT_DNS_TIMEOUT_MS);
+    CHECK(run_while(MQTT_STATE_BACKOFF, MQTT_BACKOFF_BASE_MS - 1) == -1);
+    sim_lwip_get_stats(&after);
+    CHECK(after.connects == before.connects);
+    CHECK(sim_lwip_next_event_us() == UINT64_MAX);
+}
+
+int main(void) {
+    sim_clock_us = 1000000;
+    host_set_clock(sim_now_us);
+    sim_lwip_reset();
+    sim_broker_set_timing(TEST_CONNECT_MS, TEST_RTT_MS);
+
+    test_connect();
+    test_lost();
+    test_failures();
+    test_late_dns();
+
+    MQTT_close(handle);
+
+    printf("mqtt_connect_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
@@ -0,0 +1,118 @@
+// Publishes at QoS 1 through the firmware's pico_mqtt module for a fixed time, keeping its
+// publish queue full, and reports the sustained message rate of every second together with
+// the retries, deferrals and requeues of the queue. Runs on lwIP's Unix port like mqtt_bench.
+//
+//     PRECONFIGURED_TAPIF=tap0 ./mqtt_load -t 60 -s 100
+//
+// Stopping the broker for a few seconds during the run shows the requeue after the reconnect.
+
+#include "pico_mqtt.h"
+#include "pico_wifi.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LOAD_DEFAULT_SECONDS    30
+#define LOAD_DEFAULT_SIZE       100
+#define LOAD_TOPIC              "/load"
+
+static uint32_t acked;
+static uint32_t failed;
+
+static void publish_done(__unused void *arg, __unused const char *topic, int err, __unused uint32_t latency_us) {
+    if (err) {
+        failed++;
+    } else {
+        acked++;
+    }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = LOAD_DEFAULT_SECONDS;
+    size_t size = LOAD_DEFAULT_SIZE;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t seconds] [-s payload bytes]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (seconds == 0 || size > MQTT_PAYLOAD_MAX_LEN) {
+        fprintf(stderr, "time must be > 0 and payload <= %d bytes\n", MQTT_PAYLOAD_MAX_LEN);
+        return 1;
+    }
+
+    uint32_t *rates = calloc(seconds, sizeof(*rates));
+    uint8_t *payload = malloc(size);
+    if (!rates || !payload) return 1;
+    memset(payload, 'x', size);
+
+    if (wifi_init() != WIFI_STATUS_CONNECTED) {
+        fprintf(stderr, "unable to bring up the TAP interface\n");
+        return 1;
+    }
+
+    MQTT_client_handle_t handle = NULL;
+    if (MQTT_open(&handle) != 0) {
+        fprintf(stderr, "unable to create the MQTT client\n");
+        return 1;
+    }
+    MQTT_set_publish_cb(handle, publish_done, NULL);
+
+    // Connection losses during the run are reconnected by MQTT_process as on the device
+    uint64_t start_us = time_us_64();
+    uint64_t second_end_us = start_us + 1000000;
+    uint32_t second = 0;
+    uint32_t acked_before = 0;
+
+    while (second < seconds) {
+        if (MQTT_process(handle) == MQTT_STATE_CONNECTED) {
+            while (MQTT_publish_bytes(handle, LOAD_TOPIC, payload, size) == 0) {
+            }
+        }
+        cyw43_arch_poll();
+
+        if (time_us_64() >= second_end_us) {
+            rates[second++] = acked - acked_before;
+            acked_before = acked;
+            second_end_us += 1000000;
+        }
+    }
+
+    pubq_stats_t stats;
+    MQTT_publish_stats(handle, &stats);
+
+    qsort(rates, seconds, sizeof(*rates), cmp_u32);
+
+    printf("publishes:   %lu acked, %lu failed in %lu s, %zu bytes each, window %d\n", (unsigned long)acked,
+        (unsigned long)failed, (unsigned long)seconds, size, MQTT_PUB_WINDOW);
+    printf("msg/s:       mean %.1f, per second min %lu  p50 %lu  max %lu\n", (double)acked / seconds,
+        (unsigned long)rates[0], (unsigned long)rates[(seconds - 1) / 2], (unsigned long)rates[seconds - 1]);
+    printf("queue:       %lu submitted, %lu retried, %lu requeued, %lu deferred by lwIP, max depth %lu, max in flight %lu\n",
+        (unsigned long)stats.submitted, (unsigned long)stats.retried, (unsigned long)stats.requeued,
+        (unsigned long)stats.deferred, (unsigned long)stats.max_depth, (unsigned long)stats.max_in_flight);
+
+    MQTT_close(handle);
+    free(payload);
+    free(rates);
+
+    return acked == 0;
+}
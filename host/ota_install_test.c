@@ -0,0 +1,315 @@
+// Stages an image through the OTA module (pico_ota.c) on simulated flash and installs it into
+// an application region with ota_install, as the boot stage of boot/pico_boot.c does at every
+// boot. Then cuts the power during every program and erase of an install, and during a second
+// one in the boot after it, and checks that the next boots always end with the whole image
+// installed, and that no boot ever starts a firmware that is not whole. An image that no longer
+// matches its digest or does not fit must leave the old firmware alone and not loop, and a
+// worn out sector in the application region must end the retries after BOOT_MAX_ATTEMPTS.
+//
+//     ./ota_install_test
+//
+// Prints every failed check, exits non-zero if any.
+
+#include "pico_ota.h"
+#include "sim_flash.h"
+#include "mbedtls/sha256.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_STAGED_SECTORS     16
+#define TEST_APP_SECTORS        16
+#define TEST_IMAGE_SIZE         (10 * FLASH_DEV_SECTOR_SIZE + 1000)     // ends inside a page
+#define TEST_CHUNK_SIZE         1024
+#define TEST_OLD_FIRMWARE       0xA5
+#define TEST_MAX_BOOTS          4
+#define BOOT_MAX_ATTEMPTS       5       // as in boot/pico_boot.c
+
+static uint32_t failures;
+static flash_dev_t staged;
+static flash_dev_t app;
+static uint8_t image[TEST_IMAGE_SIZE];
+static uint8_t digest[OTA_DIGEST_LEN];
+static uint32_t attempts;               // the watchdog scratch register, cleared at power on
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void make_image(void) {
+    uint32_t rng = 1;
+    mbedtls_sha256_context sha;
+
+    for (uint32_t i = 0; i < TEST_IMAGE_SIZE; i++) {
+        rng = rng * 1664525u + 1013904223u;
+        image[i] = (uint8_t)(rng >> 24);
+    }
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, image, sizeof(image));
+    mbedtls_sha256_finish(&sha, digest);
+}
+
+// The digest of the image is only as good as the SHA-256 stand-in of host/sim_mbedtls.c
+static void test_sha256(void) {
+    static const uint8_t abc[OTA_DIGEST_LEN] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+    };
+    static const uint8_t two_blocks[OTA_DIGEST_LEN] = {
+        0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+        0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1
+    };
+    const char *long_msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    mbedtls_sha256_context sha;
+    uint8_t out[OTA_DIGEST_LEN];
+
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, (const uint8_t *)"abc", 3);
+    mbedtls_sha256_finish(&sha, out);
+    CHECK(memcmp(out, abc, sizeof(out)) == 0);
+
+    // Fed in two pieces across the block boundary
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, (const uint8_t *)long_msg, 40);
+    mbedtls_sha256_update(&sha, (const uint8_t *)long_msg + 40, strlen(long_msg) - 40);
+    mbedtls_sha256_finish(&sha, out);
+    CHECK(memcmp(out, two_blocks, sizeof(out)) == 0);
+}
+
+// The firmware running before the update
+static void write_old_firmware(const flash_dev_t *dev) {
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+
+    memset(page, TEST_OLD_FIRMWARE, sizeof(page));
+    for (uint32_t offset = 0; offset < dev->size; offset += FLASH_DEV_PAGE_SIZE) {
+        if (offset % FLASH_DEV_SECTOR_SIZE == 0) CHECK(dev->erase_sector(dev, offset) == 0);
+        CHECK(dev->program_page(dev, offset, page) == 0);
+    }
+}
+
+static uint8_t holds_old_firmware(const flash_dev_t *dev) {
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+
+    for (uint32_t offset = 0; offset < dev->size; offset += FLASH_DEV_PAGE_SIZE) {
+        if (dev->read(dev, offset, page, sizeof(page)) != 0) return 0;
+        for (uint32_t i = 0; i < sizeof(page); i++) {
+            if (page[i] != TEST_OLD_FIRMWARE) return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t holds_image(const flash_dev_t *dev) {
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+
+    for (uint32_t offset = 0; offset < TEST_IMAGE_SIZE; offset += FLASH_DEV_PAGE_SIZE) {
+        uint32_t len = TEST_IMAGE_SIZE - offset < FLASH_DEV_PAGE_SIZE ? TEST_IMAGE_SIZE - offset : FLASH_DEV_PAGE_SIZE;
+        if (dev->read(dev, offset, page, len) != 0 || memcmp(page, &image[offset], len) != 0) return 0;
+    }
+    return 1;
+}
+
+// Receives the image as the firmware does, then the firmware reboots into the boot stage
+static void stage(void) {
+    uint8_t manifest[OTA_MANIFEST_LEN];
+    uint8_t chunk[OTA_CHUNK_HEADER_LEN + TEST_CHUNK_SIZE];
+
+    CHECK(ota_init(&staged) == 0);
+    put_u32(&manifest[0], TEST_IMAGE_SIZE);
+    put_u32(&manifest[4], 2);
+    memcpy(&manifest[8], digest, OTA_DIGEST_LEN);
+    ota_begin_handler(NULL, "begin", manifest, sizeof(manifest));
+
+    for (uint32_t offset = 0; offset < TEST_IMAGE_SIZE; offset += TEST_CHUNK_SIZE) {
+        size_t len = TEST_IMAGE_SIZE - offset < TEST_CHUNK_SIZE ? TEST_IMAGE_SIZE - offset : TEST_CHUNK_SIZE;
+
+        put_u32(chunk, offset);
+        memcpy(&chunk[OTA_CHUNK_HEADER_LEN], &image[offset], len);
+        CHECK(ota_chunk_begin(NULL, "chunk", OTA_CHUNK_HEADER_LEN + len) == 0);
+        ota_chunk_data(NULL, chunk, OTA_CHUNK_HEADER_LEN + len, 1);
+    }
+    CHECK(ota_state() == OTA_VERIFIED);
+}
+
+// What boot/pico_boot.c does. Returns 1 when it starts the firmware, 0 when it reboots to try again.
+static uint8_t boot(const flash_dev_t *dev) {
+    if (ota_init(&staged) != 0 || ota_state() != OTA_VERIFIED) return 1;
+
+    if (attempts >= BOOT_MAX_ATTEMPTS) {
+        ota_abandon();
+    } else {
+        attempts++;
+        if (ota_install(dev) != 0 && ota_state() == OTA_VERIFIED) return 0;
+    }
+    attempts = 0;
+    return 1;
+}
+
+static uint64_t flash_ops(void) {
+    sim_flash_stats_t a, s;
+
+    sim_flash_get_stats(&app, &a);
+    sim_flash_get_stats(&staged, &s);
+    return a.pages_programmed + a.sectors_erased + s.pages_programmed + s.sectors_erased;
+}
+
+// Returns the programs and erases of an install
+static uint32_t test_install(void) {
+    write_old_firmware(&app);
+    stage();
+
+    uint64_t before = flash_ops();
+    CHECK(boot(&app) == 1);
+    uint32_t ops = (uint32_t)(flash_ops() - before);
+
+    CHECK(holds_image(&app));
+    CHECK(ota_state() == OTA_IDLE);
+
+    // The next boot starts the firmware right away
+    before = flash_ops();
+    CHECK(boot(&app) == 1);
+    CHECK(flash_ops() == before);
+
+    printf("install:     %u bytes, %lu programs and erases\n", TEST_IMAGE_SIZE, (unsigned long)ops);
+    return ops;
+}
+
+// Boots until the firmware starts, the first boot with the power cut during its cut-th
+// operation and the second during its second_cut-th, 0 for none. Returns the boots it took.
+static uint32_t boot_with_cuts(uint32_t cut, uint32_t second_cut) {
+    for (uint32_t boots = 1; boots <= TEST_MAX_BOOTS; boots++) {
+        sim_flash_cut_power(boots == 1 ? cut : boots == 2 ? second_cut : 0);
+        uint8_t started = boot(&app);
+        sim_flash_cut_power(0);
+        attempts = 0;
+
+        if (started) {
+            // Never a firmware that is not whole
+            CHECK(holds_image(&app));
+            return boots;
+        }
+    }
+    return TEST_MAX_BOOTS + 1;
+}
+
+static void test_power_cuts(uint32_t ops) {
+    uint32_t max_boots = 0;
+
+    for (uint32_t cut = 1; cut <= ops; cut++) {
+        for (uint32_t second = 0; second <= 1; second++) {
+            write_old_firmware(&app);
+            stage();
+
+            // The second cut lands early, halfway or late in the copy after the first
+            uint32_t second_cut = second ? 1 + (cut * 7) % ops : 0;
+            uint32_t boots = boot_with_cuts(cut, second_cut);
+
+            CHECK(boots <= TEST_MAX_BOOTS);
+            CHECK(holds_image(&app));
+            CHECK(ota_init(&staged) == 0 && ota_state() == OTA_IDLE);
+            if (boots > max_boots) max_boots = boots;
+        }
+    }
+
+    printf("power cuts:  at each of %lu operations, alone and with a second cut, installed within %lu boots\n",
+        (unsigned long)ops, (unsigned long)max_boots);
+}
+
+// A staged image that rotted after it was verified is not installed
+static void test_corrupt(void) {
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+
+    write_old_firmware(&app);
+    stage();
+
+    // Clears the lowest set bit of a byte in the middle of the image
+    uint32_t offset = TEST_IMAGE_SIZE / 2;
+    uint32_t bit = 0;
+    while (!(image[offset] & (1u << bit))) bit++;
+    memset(page, 0xFF, sizeof(page));
+    page[offset % FLASH_DEV_PAGE_SIZE] = (uint8_t)~(1u << bit);
+    CHECK(staged.program_page(&staged, offset - offset % FLASH_DEV_PAGE_SIZE, page) == 0);
+
+    CHECK(boot(&app) == 1);
+    CHECK(holds_old_firmware(&app));
+    CHECK(ota_state() == OTA_FAILED);
+    CHECK(boot(&app) == 1);
+}
+
+// An image larger than the application region is given up, not tried at every boot
+static void test_too_large(void) {
+    flash_dev_t small;
+
+    CHECK(sim_flash_init(&small, TEST_IMAGE_SIZE / FLASH_DEV_SECTOR_SIZE * FLASH_DEV_SECTOR_SIZE, NULL) == 0);
+    write_old_firmware(&small);
+    stage();
+
+    CHECK(boot(&small) == 1);
+    CHECK(holds_old_firmware(&small));
+    CHECK(ota_state() == OTA_FAILED);
+    sim_flash_deinit(&small);
+}
+
+// A sector of the application region that no longer erases fails every install
+static void test_worn_out(void) {
+    uint32_t boots = 0;
+    uint8_t started = 0;
+
+    write_old_firmware(&app);
+    stage();
+    sim_flash_wear_out(&app, 3);
+
+    while (!started && boots <= BOOT_MAX_ATTEMPTS + 1) {
+        started = boot(&app);
+        boots++;
+    }
+
+    CHECK(started);
+    CHECK(boots == BOOT_MAX_ATTEMPTS + 1);
+    CHECK(ota_state() == OTA_FAILED);
+
+    // Given up for good, the next boots start the firmware right away
+    uint64_t before = flash_ops();
+    CHECK(boot(&app) == 1);
+    CHECK(flash_ops() == before);
+    CHECK(ota_state() == OTA_FAILED);
+
+    sim_flash_wear_out(&app, UINT32_MAX);
+    printf("worn out:    given up after %lu installs\n", (unsigned long)(boots - 1));
+}
+
+int main(void) {
+    if (sim_flash_init(&staged, TEST_STAGED_SECTORS * FLASH_DEV_SECTOR_SIZE, NULL) != 0 ||
+        sim_flash_init(&app, TEST_APP_SECTORS * FLASH_DEV_SECTOR_SIZE, NULL) != 0) {
+        fprintf(stderr, "unable to create the flash regions\n");
+        return 1;
+    }
+
+    test_sha256();
+    make_image();
+
+    uint32_t ops = test_install();
+    test_power_cuts(ops);
+    test_corrupt();
+    test_too_large();
+    test_worn_out();
+
+    sim_flash_deinit(&staged);
+    sim_flash_deinit(&app);
+
+    printf("ota_install_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
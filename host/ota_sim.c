@@ -0,0 +1,478 @@
+// Streams a firmware image through the broker to a simulated device and installs it, as the
+// firmware does. The device is a client of the pico_mqtt module with the begin handler and the
+// chunk stream of main.c, writing into an emulated OTA region of FLASH_OTA_SIZE. The sender is
+// a second client: it publishes the manifest, then chunks of -c bytes through its publish
+// queue, at most -w KB ahead of the offset of the latest device status. A status with resume
+// set, or no progress for OTA_SIM_STALL_MS, rewinds it to the offset of the status.
+//
+//     PRECONFIGURED_TAPIF=tap0 ./ota_sim -i build/raspberry_pico_w_bme280_i2c.bin
+//     PRECONFIGURED_TAPIF=tap0 ./ota_sim -s 600000 -c 1024 -r 40
+//
+// Without -i the image is -s pseudo random bytes, the same for the same size. With -r the
+// device reboots once that many percent of the image is written: its connection drops, the
+// partial page is lost and the region is mounted again. With -f the region is kept in a file
+// and -x ends the run at that many percent, the next run with the same file and image
+// continues the transfer. Once verified, the image is copied into an emulated application
+// region with ota_install, as the boot stage does, and compared with the source.
+//
+// Reports the transfer rate, the bytes sent again, the flash traffic and the RAM of the
+// device: the module's own, the heap and lwIP's memory over the transfer.
+
+#include "pico_mqtt.h"
+#include "pico_wifi.h"
+#include "pico_ota.h"
+#include "sim_flash.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "lwip/stats.h"
+#include "mbedtls/sha256.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define OTA_SIM_DEFAULT_SIZE        (256 * 1024)
+#define OTA_SIM_DEFAULT_CHUNK       1024
+#define OTA_SIM_DEFAULT_WINDOW_KB   64      // 4 progress statuses
+#define OTA_SIM_DEFAULT_SECONDS     600
+#define OTA_SIM_VERSION             2
+#define OTA_SIM_CHECK_MS            250     // OTA_CHECK_MS of main.c, statuses are published on it
+#define OTA_SIM_BEGIN_RETRY_MS      5000    // the begin is sent again until a status answers it
+#define OTA_SIM_STALL_MS            10000
+#define OTA_SIM_CONNECT_MS          30000
+#define OTA_SIM_SETTLE_MS           1000    // subscriptions are made by MQTT_process
+#define OTA_SIM_DEVICE_ID           0x07A5000000000001ull
+#define OTA_SIM_SENDER_ID           0x07A5000000000002ull
+
+typedef struct {
+    MQTT_client_handle_t mqtt;
+    char status_topic[MQTT_TOPIC_LEN];
+    uint64_t next_check_us;
+    uint32_t fragments;
+    size_t max_fragment;
+    ota_stats_t stats;          // of the runs before the latest ota_init
+} device_t;
+
+typedef struct {
+    MQTT_client_handle_t mqtt;
+    char begin_topic[MQTT_TOPIC_LEN];
+    char chunk_topic[MQTT_TOPIC_LEN];
+    const uint8_t *image;
+    uint32_t size;
+    uint32_t chunk;
+    uint32_t window;
+    uint32_t next;              // offset of the next chunk to publish
+    uint32_t acked;             // offset of the latest status
+    uint64_t progress_us;       // of the latest status that moved the offset
+    uint64_t begin_us;          // of the latest begin sent
+    uint8_t answered;           // a status answered the begin
+    uint8_t done;               // verified or failed
+    char state[16];
+    uint32_t statuses;
+    uint32_t rewinds;
+    uint32_t stalls;
+    uint64_t resent_bytes;      // published again after a rewind
+    uint64_t sent_bytes;
+} sender_t;
+
+static device_t device;
+static sender_t sender;
+static flash_dev_t ota_flash;
+
+static uint8_t payload[MQTT_PAYLOAD_MAX_LEN];
+
+// Counts what lwIP hands over before ota_chunk_data writes it
+static void count_chunk_data(void *arg, const uint8_t *data, size_t len, uint8_t last) {
+    device.fragments++;
+    if (len > device.max_fragment) device.max_fragment = len;
+    ota_chunk_data(arg, data, len, last);
+}
+
+static const MQTT_consumer_t chunk_consumer = {
+    .begin = ota_chunk_begin,
+    .data = count_chunk_data,
+    .arg = NULL
+};
+
+static void on_status(__unused void *arg, __unused const char *topic, const uint8_t *data, size_t len) {
+    char json[OTA_STATUS_MAX_LEN + 1];
+    char state[16];
+    char resume[8];
+    unsigned long version;
+    unsigned long offset;
+    unsigned long size;
+
+    if (len > OTA_STATUS_MAX_LEN) return;
+    memcpy(json, data, len);
+    json[len] = '\0';
+
+    if (sscanf(json, "{\"state\":\"%15[a-z]\",\"version\":%lu,\"offset\":%lu,\"size\":%lu,\"resume\":%7[a-z]}",
+            state, &version, &offset, &size, resume) != 5) {
+        return;
+    }
+    // The retained status of an older transfer
+    if (version != OTA_SIM_VERSION || size != sender.size || offset > sender.size) return;
+
+    sender.statuses++;
+    sender.answered = 1;
+    strcpy(sender.state, state);
+    if (strcmp(state, "verified") == 0 || strcmp(state, "failed") == 0) {
+        sender.done = 1;
+        return;
+    }
+
+    if (offset != sender.acked) sender.progress_us = time_us_64();
+    sender.acked = offset;
+
+    if (strcmp(resume, "true") == 0 || offset > sender.next) {
+        if (offset < sender.next) {
+            sender.rewinds++;
+            sender.resent_bytes += sender.next - offset;
+        }
+        sender.next = offset;
+    }
+}
+
+static uint8_t open_client(MQTT_client_handle_t *handle, uint64_t board_id) {
+    host_set_board_id(board_id);
+    return MQTT_open(handle);
+}
+
+static void send_begin(void) {
+    uint8_t manifest[OTA_MANIFEST_LEN];
+    uint32_t size = sender.size;
+    uint32_t version = OTA_SIM_VERSION;
+
+    memcpy(&manifest[0], &size, 4);
+    memcpy(&manifest[4], &version, 4);
+    mbedtls_sha256(sender.image, sender.size, &manifest[8], 0);
+
+    if (MQTT_publish_bytes(sender.mqtt, sender.begin_topic, manifest, sizeof(manifest)) == 0) {
+        sender.begin_us = time_us_64();
+    }
+}
+
+// Fills the publish queue, within the window ahead of the device
+static void send_chunks(void) {
+    uint64_t now_us = time_us_64();
+
+    if (!sender.answered) {
+        if (now_us - sender.begin_us >= (uint64_t)OTA_SIM_BEGIN_RETRY_MS * 1000) send_begin();
+        return;
+    }
+
+    // A lost chunk at the end of the window is only noticed by the silence
+    if (now_us - sender.progress_us >= (uint64_t)OTA_SIM_STALL_MS * 1000) {
+        sender.stalls++;
+        sender.resent_bytes += sender.next - sender.acked;
+        sender.next = sender.acked;
+        sender.progress_us = now_us;
+    }
+
+    while (sender.next < sender.size && sender.next < sender.acked + sender.window) {
+        uint32_t offset = sender.next;
+        uint32_t len = sender.size - offset < sender.chunk ? sender.size - offset : sender.chunk;
+
+        memcpy(payload, &offset, OTA_CHUNK_HEADER_LEN);
+        memcpy(&payload[OTA_CHUNK_HEADER_LEN], &sender.image[offset], len);
+        if (MQTT_publish_bytes(sender.mqtt, sender.chunk_topic, payload, OTA_CHUNK_HEADER_LEN + len) != 0) break;
+
+        sender.next += len;
+        sender.sent_bytes += len;
+    }
+}
+
+// The OTA task of main.c, without the reboot
+static void device_task(void) {
+    uint64_t now_us = time_us_64();
+    char status[OTA_STATUS_MAX_LEN];
+
+    if (now_us < device.next_check_us) return;
+    device.next_check_us = now_us + (uint64_t)OTA_SIM_CHECK_MS * 1000;
+
+    cyw43_arch_lwip_begin();
+    int len = ota_status(status, sizeof(status));
+    cyw43_arch_lwip_end();
+
+    if (len > 0) MQTT_publish_bytes(device.mqtt, device.status_topic, (const uint8_t *)status, (size_t)len);
+}
+
+static uint64_t written_bytes(void) {
+    return (uint64_t)device.stats.bytes + ota_get_stats()->bytes;
+}
+
+static void add_stats(ota_stats_t *sum, const ota_stats_t *run) {
+    sum->begins += run->begins;
+    sum->resumes += run->resumes;
+    sum->chunks += run->chunks;
+    sum->bytes += run->bytes;
+    sum->duplicate_bytes += run->duplicate_bytes;
+    sum->dropped += run->dropped;
+    sum->rehashed_bytes += run->rehashed_bytes;
+    sum->erases += run->erases;
+    sum->flash_errors += run->flash_errors;
+}
+
+// Power cycle: the connection drops with whatever was in flight and the module starts from flash
+static void device_reboot(void) {
+    add_stats(&device.stats, ota_get_stats());
+
+    cyw43_arch_lwip_begin();
+    ota_init(&ota_flash);
+    cyw43_arch_lwip_end();
+
+    MQTT_reconnect(device.mqtt);
+}
+
+// What the boot stage does with the staged image, then compared with the source
+static uint8_t install(const uint8_t *image, uint32_t size) {
+    flash_dev_t app;
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+    uint8_t ok = 0;
+
+    if (sim_flash_init(&app, FLASH_APP_MAX_SIZE, NULL) != 0) return 1;
+    if (ota_install(&app) != 0) goto out;
+
+    for (uint32_t offset = 0; offset < size; offset += FLASH_DEV_PAGE_SIZE) {
+        uint32_t len = size - offset < FLASH_DEV_PAGE_SIZE ? size - offset : FLASH_DEV_PAGE_SIZE;
+        if (app.read(&app, offset, page, len) != 0 || memcmp(page, &image[offset], len) != 0) goto out;
+    }
+    ok = 1;
+
+out:
+    sim_flash_deinit(&app);
+    return ok ? 0 : 1;
+}
+
+static uint8_t *load_image(const char *path, uint32_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    uint8_t *image = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long len = ftell(f);
+        if (len > 0 && (uint64_t)len <= FLASH_OTA_SIZE && fseek(f, 0, SEEK_SET) == 0) {
+            image = malloc((size_t)len);
+            if (image && fread(image, 1, (size_t)len, f) != (size_t)len) {
+                free(image);
+                image = NULL;
+            }
+            *size = (uint32_t)len;
+        }
+    }
+    fclose(f);
+    return image;
+}
+
+// The same bytes for the same size, so a run with -f can be continued
+static uint8_t *make_image(uint32_t size) {
+    uint8_t *image = malloc(size);
+    uint32_t x = size | 1;
+
+    if (!image) return NULL;
+    for (uint32_t i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        image[i] = (uint8_t)x;
+    }
+    return image;
+}
+
+// Resident memory of the process, in bytes
+static size_t resident_bytes(void) {
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f) {
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t heap_bytes(void) {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks;
+}
+
+int main(int argc, char **argv) {
+    const char *image_path = NULL;
+    const char *flash_path = NULL;
+    uint32_t size = OTA_SIM_DEFAULT_SIZE;
+    uint32_t chunk = OTA_SIM_DEFAULT_CHUNK;
+    uint32_t window_kb = OTA_SIM_DEFAULT_WINDOW_KB;
+    uint32_t seconds = OTA_SIM_DEFAULT_SECONDS;
+    uint32_t reboot_pct = 0;
+    uint32_t exit_pct = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:s:c:w:t:r:f:x:")) != -1) {
+        switch (opt) {
+        case 'i':
+            image_path = optarg;
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            chunk = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            window_kb = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            reboot_pct = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            flash_path = optarg;
+            break;
+        case 'x':
+            exit_pct = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i image | -s size] [-c chunk bytes] [-w window KB] [-t seconds] [-r reboot at %%] [-f flash file [-x exit at %%]]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    uint8_t *image = image_path ? load_image(image_path, &size) : make_image(size);
+    if (!image || size == 0 || size > FLASH_OTA_SIZE - FLASH_DEV_SECTOR_SIZE) {
+        fprintf(stderr, "the image must be 1 to %d bytes\n", FLASH_OTA_SIZE - FLASH_DEV_SECTOR_SIZE);
+        return 1;
+    }
+    if (chunk == 0 || chunk > MQTT_PAYLOAD_MAX_LEN - OTA_CHUNK_HEADER_LEN || window_kb == 0 || seconds == 0 ||
+        reboot_pct >= 100 || exit_pct >= 100 || (exit_pct != 0 && flash_path == NULL)) {
+        fprintf(stderr, "chunks of 1 to %d bytes, window and time > 0, percentages below 100 and -x only with -f\n",
+            MQTT_PAYLOAD_MAX_LEN - OTA_CHUNK_HEADER_LEN);
+        return 1;
+    }
+
+    if (sim_flash_init(&ota_flash, FLASH_OTA_SIZE, flash_path) != 0 || ota_init(&ota_flash) != 0) {
+        fprintf(stderr, "unable to mount the OTA region\n");
+        return 1;
+    }
+
+    if (wifi_init() != WIFI_STATUS_CONNECTED) {
+        fprintf(stderr, "unable to bring up the TAP interface\n");
+        return 1;
+    }
+
+    size_t heap_before = heap_bytes();
+    mem_size_t lwip_before = lwip_stats.mem.used;
+
+    if (open_client(&device.mqtt, OTA_SIM_DEVICE_ID) != 0 || open_client(&sender.mqtt, OTA_SIM_SENDER_ID) != 0) {
+        fprintf(stderr, "unable to create the clients\n");
+        return 1;
+    }
+
+    const char *id = MQTT_device_id(device.mqtt);
+    snprintf(sender.begin_topic, sizeof(sender.begin_topic), OTA_TOPIC "%s" OTA_BEGIN_SUBTOPIC, id);
+    snprintf(sender.chunk_topic, sizeof(sender.chunk_topic), OTA_TOPIC "%s" OTA_CHUNK_SUBTOPIC, id);
+    snprintf(device.status_topic, sizeof(device.status_topic), OTA_TOPIC "%s" OTA_STATUS_SUBTOPIC, id);
+
+    if (MQTT_subscribe_handler(device.mqtt, sender.begin_topic, ota_begin_handler, NULL) != 0 ||
+        MQTT_subscribe_stream(device.mqtt, sender.chunk_topic, &chunk_consumer) != 0 ||
+        MQTT_subscribe_handler(sender.mqtt, device.status_topic, on_status, NULL) != 0) {
+        fprintf(stderr, "unable to subscribe\n");
+        return 1;
+    }
+
+    uint64_t wait_end_us = time_us_64() + (uint64_t)OTA_SIM_CONNECT_MS * 1000;
+    while (MQTT_process(device.mqtt) != MQTT_STATE_CONNECTED || MQTT_process(sender.mqtt) != MQTT_STATE_CONNECTED) {
+        if (time_us_64() >= wait_end_us) {
+            fprintf(stderr, "the clients could not connect to %s\n", MQTT_SERVER);
+            return 1;
+        }
+        cyw43_arch_poll();
+    }
+
+    uint64_t settle_us = time_us_64() + (uint64_t)OTA_SIM_SETTLE_MS * 1000;
+    while (time_us_64() < settle_us) {
+        MQTT_process(device.mqtt);
+        MQTT_process(sender.mqtt);
+        cyw43_arch_poll();
+    }
+
+    sender.image = image;
+    sender.size = size;
+    sender.chunk = chunk;
+    sender.window = window_kb * 1024;
+
+    uint64_t start_us = time_us_64();
+    uint64_t end_us = start_us + (uint64_t)seconds * 1000000;
+    uint64_t reboot_bytes = reboot_pct ? (uint64_t)size * reboot_pct / 100 : 0;
+    uint64_t exit_bytes = exit_pct ? (uint64_t)size * exit_pct / 100 : 0;
+    size_t heap_peak = heap_before;
+    mem_size_t lwip_peak = lwip_before;
+    uint8_t exited = 0;
+
+    sender.progress_us = start_us;
+    send_begin();
+
+    while (!sender.done && time_us_64() < end_us) {
+        MQTT_process(device.mqtt);
+        MQTT_process(sender.mqtt);
+        cyw43_arch_poll();
+
+        device_task();
+        send_chunks();
+
+        if (reboot_bytes != 0 && written_bytes() >= reboot_bytes) {
+            reboot_bytes = 0;
+            device_reboot();
+        }
+        if (exit_bytes != 0 && written_bytes() >= exit_bytes) {
+            exited = 1;
+            break;
+        }
+
+        if (heap_bytes() > heap_peak) heap_peak = heap_bytes();
+        if (lwip_stats.mem.used > lwip_peak) lwip_peak = lwip_stats.mem.used;
+    }
+    uint64_t elapsed_us = time_us_64() - start_us;
+
+    ota_stats_t stats = device.stats;
+    add_stats(&stats, ota_get_stats());
+    sim_flash_stats_t flash;
+    sim_flash_get_stats(&ota_flash, &flash);
+
+    printf("image        %lu bytes, chunks of %lu, window %lu KB\n",
+        (unsigned long)size, (unsigned long)chunk, (unsigned long)window_kb);
+    printf("result       %s after %.1f s", exited ? "stopped" : sender.state[0] ? sender.state : "no answer",
+        elapsed_us / 1e6);
+    if (sender.done && elapsed_us > 0) printf(", %.1f KB/s", (double)size / 1024.0 / (elapsed_us / 1e6));
+    printf("\n");
+    printf("sender       %llu bytes sent, %llu again, %lu rewinds, %lu stalls, %lu statuses\n",
+        (unsigned long long)sender.sent_bytes, (unsigned long long)sender.resent_bytes,
+        (unsigned long)sender.rewinds, (unsigned long)sender.stalls, (unsigned long)sender.statuses);
+    printf("device       %lu chunks in %lu fragments, largest %zu, %lu duplicate bytes, %lu dropped\n",
+        (unsigned long)stats.chunks, (unsigned long)device.fragments, device.max_fragment,
+        (unsigned long)stats.duplicate_bytes, (unsigned long)stats.dropped);
+    printf("             %lu begins, %lu resumes, %lu bytes rehashed\n",
+        (unsigned long)stats.begins, (unsigned long)stats.resumes, (unsigned long)stats.rehashed_bytes);
+    printf("flash        %lu erases, %llu pages programmed, %llu bytes read, %lu errors\n",
+        (unsigned long)stats.erases, (unsigned long long)flash.pages_programmed,
+        (unsigned long long)flash.bytes_read, (unsigned long)stats.flash_errors);
+    printf("ram          module %zu, heap +%zu peak, lwIP +%lu peak, rss %zu KB\n",
+        ota_ram_bytes(), heap_peak - heap_before, (unsigned long)(lwip_peak - lwip_before),
+        resident_bytes() / 1024);
+
+    uint8_t failed = 1;
+    if (exited) {
+        failed = 0;
+    } else if (sender.done && ota_state() == OTA_VERIFIED) {
+        failed = install(image, size);
+        printf("install      %s\n", failed ? "the copy does not match the image" : "the copy matches the image");
+    }
+
+    sim_flash_deinit(&ota_flash);
+    free(image);
+    return failed;
+}
@@ -0,0 +1,184 @@
+// Runs the publish queue of pico_mqtt against a simulated broker link on a simulated clock and
+// measures the sustained QoS 1 message rate. Like lwIP, the link takes at most
+// MQTT_REQ_MAX_IN_FLIGHT requests and refuses more with ERR_MEM. A submission is acknowledged
+// one round trip later, or with -l percent probability times out after -o ms. -d drops the
+// connection every -d ms, losing what is in flight, and reconnects 1 s later.
+//
+//     ./pubq_bench -w 1 -r 50           # stop and wait, one publish per round trip
+//     ./pubq_bench -w 4 -r 50           # the firmware window
+//     ./pubq_bench -w 4 -r 50 -l 2 -d 10000
+
+#include "pico_pubq.h"
+#include "lwipopts.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_COUNT     10000
+#define BENCH_DEFAULT_SIZE      100
+#define BENCH_DEFAULT_RTT_MS    50
+#define BENCH_DEFAULT_TIMEOUT_MS 30000  // MQTT_REQ_TIMEOUT of lwIP
+#define BENCH_QUEUE_SIZE        4096    // MQTT_PUB_QUEUE_SIZE
+#define BENCH_RECONNECT_MS      1000
+#define BENCH_TOPIC             "/bench"
+
+typedef struct {
+    pubq_entry_t *entry;
+    uint64_t done_us;
+    uint8_t ok;
+} request_t;
+
+static request_t requests[MQTT_REQ_MAX_IN_FLIGHT];
+static size_t request_count;
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    size_t count = BENCH_DEFAULT_COUNT;
+    size_t size = BENCH_DEFAULT_SIZE;
+    uint32_t window = MQTT_REQ_MAX_IN_FLIGHT - 1;
+    uint32_t rtt_ms = BENCH_DEFAULT_RTT_MS;
+    uint32_t timeout_ms = BENCH_DEFAULT_TIMEOUT_MS;
+    uint32_t loss_pct = 0;
+    uint32_t drop_ms = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:w:r:o:l:d:")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            window = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            rtt_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            timeout_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            loss_pct = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            drop_ms = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-s payload bytes] [-w window] [-r rtt ms] [-o timeout ms] [-l loss %%] [-d drop every ms]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (count == 0 || window == 0 || window > UINT8_MAX || rtt_ms == 0 || loss_pct >= 100 ||
+        size + sizeof(BENCH_TOPIC) > BENCH_QUEUE_SIZE) {
+        fprintf(stderr, "messages, window and rtt must be > 0, loss < 100 and the payload must fit %d bytes\n", BENCH_QUEUE_SIZE);
+        return 1;
+    }
+
+    static uint8_t buf[BENCH_QUEUE_SIZE];
+    static pubq_t queue;
+    uint8_t *payload = calloc(1, size ? size : 1);
+    uint32_t *latency_us = calloc(count, sizeof(*latency_us));
+    if (!payload || !latency_us) return 1;
+
+    pubq_init(&queue, buf, sizeof(buf), (uint8_t)window);
+    srandom(1);
+
+    uint64_t now_us = 0;
+    uint64_t next_drop_us = drop_ms ? (uint64_t)drop_ms * 1000 : UINT64_MAX;
+    uint64_t connected_at_us = 0;
+    size_t pushed = 0;
+    size_t completed = 0;
+    size_t acked = 0;
+    uint32_t drops = 0;
+
+    while (completed < count) {
+        // Keep the queue full, the producer is never the bottleneck
+        while (pushed < count && pubq_push(&queue, BENCH_TOPIC, payload, size, now_us) == 0) {
+            pushed++;
+        }
+
+        if (now_us >= next_drop_us) {
+            request_count = 0;
+            connected_at_us = now_us + BENCH_RECONNECT_MS * 1000;
+            next_drop_us += (uint64_t)drop_ms * 1000;
+            drops++;
+        }
+
+        bool connected = now_us >= connected_at_us;
+        if (connected && connected_at_us == now_us) {
+            pubq_requeue(&queue);
+        }
+
+        pubq_entry_t *entry;
+        while (connected && (entry = pubq_next(&queue)) != NULL) {
+            if (request_count >= MQTT_REQ_MAX_IN_FLIGHT) {
+                pubq_defer(&queue);
+                break;
+            }
+
+            request_t *request = &requests[request_count++];
+            request->entry = entry;
+            request->ok = (uint32_t)(random() % 100) >= loss_pct;
+            request->done_us = now_us + (uint64_t)(request->ok ? rtt_ms : timeout_ms) * 1000;
+            pubq_sent(&queue, entry, now_us);
+        }
+
+        // Advance to the next completion or event
+        uint64_t next_us = next_drop_us;
+        if (!connected && connected_at_us < next_us) next_us = connected_at_us;
+        for (size_t i = 0; i < request_count; i++) {
+            if (requests[i].done_us < next_us) next_us = requests[i].done_us;
+        }
+        if (next_us == UINT64_MAX) break;
+        now_us = next_us;
+
+        for (size_t i = 0; i < request_count;) {
+            if (requests[i].done_us > now_us) {
+                i++;
+                continue;
+            }
+
+            request_t request = requests[i];
+            requests[i] = requests[--request_count];
+
+            uint64_t queued_us = request.entry->queued_us;
+            pubq_result_t result = pubq_complete(&queue, request.entry, request.ok);
+            if (result == PUBQ_ACKED) latency_us[acked++] = (uint32_t)(now_us - queued_us);
+            if (result != PUBQ_RETRY) completed++;
+        }
+    }
+
+    const pubq_stats_t *stats = &queue.stats;
+    double elapsed_s = now_us / 1e6;
+
+    qsort(latency_us, acked, sizeof(*latency_us), cmp_u32);
+
+    printf("link:        window %lu of %d requests, rtt %lu ms, %lu %% lost, %lu drops\n",
+        (unsigned long)window, MQTT_REQ_MAX_IN_FLIGHT, (unsigned long)rtt_ms, (unsigned long)loss_pct, (unsigned long)drops);
+    printf("messages:    %zu acked, %lu failed in %.1f s, %.1f msg/s sustained\n", acked,
+        (unsigned long)stats->failed, elapsed_s, elapsed_s > 0 ? acked / elapsed_s : 0.0);
+    printf("queue:       %lu submitted, %lu retried, %lu requeued, %lu deferred, %lu rejected, max depth %lu, max in flight %lu\n",
+        (unsigned long)stats->submitted, (unsigned long)stats->retried, (unsigned long)stats->requeued,
+        (unsigned long)stats->deferred, (unsigned long)stats->rejected, (unsigned long)stats->max_depth,
+        (unsigned long)stats->max_in_flight);
+    if (acked > 0) {
+        printf("latency ms:  p50 %.1f  p99 %.1f  max %.1f, queueing included\n", latency_us[(acked - 1) / 2] / 1000.0,
+            latency_us[(acked - 1) * 99 / 100] / 1000.0, latency_us[acked - 1] / 1000.0);
+    }
+
+    free(latency_us);
+    free(payload);
+
+    return acked + stats->failed != count;
+}
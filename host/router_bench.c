@@ -0,0 +1,158 @@
+// Matches generated topics against hundreds of subscription filters, once through the
+// trie in pico_router and once with a linear scan that tests every filter, and reports
+// the matches per second of both.
+//
+//     ./router_bench -f 500 -n 200000
+
+#include "pico_router.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_FILTERS   500
+#define BENCH_DEFAULT_MATCHES   200000
+#define BENCH_TOPICS            1024
+#define BENCH_TOPIC_LEN         64
+
+static router_t router;
+static char filters[ROUTER_MAX_ROUTES][BENCH_TOPIC_LEN];
+static char topics[BENCH_TOPICS][BENCH_TOPIC_LEN];
+
+static const char *metrics[] = {"temperature", "humidity", "pressure", "battery", "rssi"};
+#define METRIC_COUNT (sizeof(metrics) / sizeof(metrics[0]))
+
+static void count_handler(void *arg, __attribute__((unused)) const char *topic,
+    __attribute__((unused)) const uint8_t *payload, __attribute__((unused)) size_t len) {
+    (*(size_t *)arg)++;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Reference matcher, one filter at a time
+static bool filter_matches(const char *filter, const char *topic) {
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) return false;
+
+    while (1) {
+        if (filter[0] == '#') return true;
+
+        const char *filter_end = strchr(filter, '/');
+        const char *topic_end = strchr(topic, '/');
+        size_t filter_len = filter_end ? (size_t)(filter_end - filter) : strlen(filter);
+        size_t topic_len = topic_end ? (size_t)(topic_end - topic) : strlen(topic);
+
+        if (!(filter_len == 1 && filter[0] == '+') &&
+            (filter_len != topic_len || memcmp(filter, topic, topic_len) != 0)) {
+            return false;
+        }
+
+        if (!filter_end) return !topic_end;
+        if (!topic_end) return strcmp(filter_end + 1, "#") == 0;
+
+        filter = filter_end + 1;
+        topic = topic_end + 1;
+    }
+}
+
+// Filters in the shape of a building fleet: site/<n>/room/<n>/<metric> with wildcards mixed in
+static void make_filter(char *out, unsigned int i) {
+    unsigned int site = i % 16;
+    unsigned int room = i / 16 % 64;
+    const char *metric = metrics[i % METRIC_COUNT];
+
+    switch (i % 8) {
+    case 0:
+        snprintf(out, BENCH_TOPIC_LEN, "site/%u/room/+/%s", site, metric);
+        break;
+    case 1:
+        snprintf(out, BENCH_TOPIC_LEN, "site/%u/room/%u/#", site, room);
+        break;
+    case 2:
+        snprintf(out, BENCH_TOPIC_LEN, "site/+/room/%u/%s", room, metric);
+        break;
+    default:
+        snprintf(out, BENCH_TOPIC_LEN, "site/%u/room/%u/%s/%u", site, room, metric, i);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t filter_count = BENCH_DEFAULT_FILTERS;
+    size_t match_count = BENCH_DEFAULT_MATCHES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:n:")) != -1) {
+        switch (opt) {
+        case 'f':
+            filter_count = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            match_count = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f filters] [-n matches]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (filter_count == 0 || filter_count > ROUTER_MAX_ROUTES) {
+        fprintf(stderr, "filters must be between 1 and %d\n", ROUTER_MAX_ROUTES);
+        return 1;
+    }
+
+    size_t handled = 0;
+    router_init(&router);
+    for (size_t i = 0; i < filter_count; i++) {
+        make_filter(filters[i], (unsigned int)i);
+        if (router_add(&router, filters[i], count_handler, &handled) != 0) {
+            fprintf(stderr, "unable to add %s\n", filters[i]);
+            return 1;
+        }
+    }
+
+    srand(1);
+    for (size_t i = 0; i < BENCH_TOPICS; i++) {
+        unsigned int n = (unsigned int)rand();
+        snprintf(topics[i], BENCH_TOPIC_LEN, "site/%u/room/%u/%s%s", n % 16, n / 16 % 64,
+            metrics[n % METRIC_COUNT], n % 4 == 0 ? "/extra" : "");
+    }
+
+    uint16_t routes[ROUTER_MAX_MATCHES];
+    size_t trie_hits = 0;
+    size_t scan_hits = 0;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < match_count; i++) {
+        trie_hits += router_match(&router, topics[i % BENCH_TOPICS], routes, ROUTER_MAX_MATCHES);
+    }
+    uint64_t trie_ns = now_ns() - start;
+
+    start = now_ns();
+    for (size_t i = 0; i < match_count; i++) {
+        for (size_t f = 0; f < filter_count; f++) {
+            scan_hits += filter_matches(filters[f], topics[i % BENCH_TOPICS]);
+        }
+    }
+    uint64_t scan_ns = now_ns() - start;
+
+    // Push one publish through the consumer path to check the handlers are called
+    if (router_begin(&router, "site/1/room/1/temperature", 5) == 0) {
+        router_data(&router, (const uint8_t *)"21.50", 5, 1);
+    }
+
+    printf("filters:     %zu, %zu trie nodes, %zu pool bytes, %zu bytes of router state\n",
+        filter_count, router.node_count, router.pool_used, sizeof(router));
+    printf("trie:        %.0f matches/s, %.1f ns per topic\n", match_count * 1e9 / trie_ns, (double)trie_ns / match_count);
+    printf("linear scan: %.0f matches/s, %.1f ns per topic\n", match_count * 1e9 / scan_ns, (double)scan_ns / match_count);
+    printf("hits:        %zu trie, %zu scan%s\n", trie_hits, scan_hits, trie_hits == scan_hits ? "" : " MISMATCH");
+    printf("handlers:    %zu called for one routed publish\n", handled);
+
+    return trie_hits != scan_hits;
+}
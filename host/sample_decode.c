@@ -0,0 +1,103 @@
+// Decodes binary sample payloads into JSON lines.
+//
+// Reads one payload per file argument, or a stream of concatenated payloads from
+// stdin when no arguments are given, for example:
+//
+//     mosquitto_sub -t /room_meas -N | ./sample_decode
+//
+// Build:
+//     gcc -Iinclude host/sample_decode.c src/pico_codec.c src/pico_sample.c src/pico_window.c -o sample_decode
+
+#include "pico_codec.h"
+#include "pico_sample.h"
+
+#include <stdio.h>
+
+static uint8_t payload[CODEC_BINARY_MAX_LEN];
+static sample_t samples[CODEC_BINARY_MAX_SAMPLES];
+
+static void print_window(const window_summary_t *window) {
+    char min[SAMPLE_JSON_MAX_LEN], max[SAMPLE_JSON_MAX_LEN], mean[SAMPLE_JSON_MAX_LEN], ewma[SAMPLE_JSON_MAX_LEN];
+
+    if (sample_to_json(&window->min, min, sizeof(min)) < 0 || sample_to_json(&window->max, max, sizeof(max)) < 0 ||
+        sample_to_json(&window->mean, mean, sizeof(mean)) < 0 || sample_to_json(&window->ewma, ewma, sizeof(ewma)) < 0) {
+        return;
+    }
+
+    printf("{\"window\":{\"count\":%lu,\"min\":%s,\"max\":%s,\"mean\":%s,\"ewma\":%s}}\n",
+        (unsigned long)window->count, min, max, mean, ewma);
+}
+
+static int print_payload(const uint8_t *buf, size_t len) {
+    char json[SAMPLE_JSON_MAX_LEN];
+    window_summary_t window;
+
+    int count = codec_decode_binary(buf, len, samples, CODEC_BINARY_MAX_SAMPLES, &window);
+    if (count < 0) {
+        fprintf(stderr, "malformed payload of %zu bytes\n", len);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (sample_to_json(&samples[i], json, sizeof(json)) > 0) {
+            puts(json);
+        }
+    }
+    if (window.count > 0) {
+        print_window(&window);
+    }
+    return 0;
+}
+
+// Payloads are self delimiting, the header carries the version and the sample count
+static int decode_stream(FILE *f) {
+    int c;
+
+    while ((c = fgetc(f)) != EOF) {
+        payload[0] = (uint8_t)c;
+
+        c = fgetc(f);
+        if (c == EOF) {
+            fprintf(stderr, "truncated header\n");
+            return 1;
+        }
+        payload[1] = (uint8_t)c;
+
+        size_t len = codec_binary_len(payload);
+        if (len == 0) {
+            fprintf(stderr, "unknown payload version %u\n", payload[0]);
+            return 1;
+        }
+
+        size_t body = len - CODEC_BINARY_HEADER_LEN;
+        if (fread(&payload[CODEC_BINARY_HEADER_LEN], 1, body, f) != body) {
+            fprintf(stderr, "truncated payload\n");
+            return 1;
+        }
+
+        if (print_payload(payload, len)) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return decode_stream(stdin);
+    }
+
+    int err = 0;
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "unable to open %s\n", argv[i]);
+            err = 1;
+            continue;
+        }
+
+        size_t len = fread(payload, 1, sizeof(payload), f);
+        fclose(f);
+
+        err |= print_payload(payload, len);
+    }
+    return err;
+}
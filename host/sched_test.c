@@ -0,0 +1,189 @@
+// Checks the scheduler on a simulated clock: run counts and order of tasks with different
+// periods, deadlines kept on their grid, periods skipped by a task that overran, period
+// changes, sched_run_in and sched_run_at, a full scheduler and the rejection of a period of 0.
+//
+//     ./sched_test
+//
+// Prints every failed check and exits non-zero if there was one.
+
+#include "pico_sched.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_LOG_MAX    64
+
+static uint64_t sim_clock_us;
+static uint32_t failures;
+
+// Names of the tasks in the order they ran
+static const char *run_log[TEST_LOG_MAX];
+static uint32_t run_count;
+
+typedef struct {
+    const char *name;
+    uint32_t runs;
+    uint64_t last_us;
+    uint32_t busy_ms;       // simulated time the task takes
+} test_task_t;
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+static void record_task(void *arg) {
+    test_task_t *task = arg;
+
+    task->runs++;
+    task->last_us = sim_clock_us;
+    if (run_count < TEST_LOG_MAX) run_log[run_count++] = task->name;
+    sim_clock_us += (uint64_t)task->busy_ms * 1000;
+}
+
+// Sleeps until every deadline up to end_us, the way the main loop does
+static void run_until(sched_t *sched, uint64_t end_us) {
+    while (1) {
+        uint64_t next_us = sched_run(sched);
+        if (next_us > end_us) break;
+        if (next_us > sim_clock_us) sim_clock_us = next_us;
+    }
+    sim_clock_us = end_us;
+}
+
+static void reset(sched_t *sched) {
+    sim_clock_us = 1000000;
+    run_count = 0;
+    sched_init(sched, sim_now_us);
+}
+
+static void test_periods(void) {
+    sched_t sched;
+    test_task_t fast = { .name = "fast" };
+    test_task_t mid = { .name = "mid" };
+    test_task_t slow = { .name = "slow" };
+
+    reset(&sched);
+    int slow_id = sched_add(&sched, slow.name, 1000, 1000, record_task, &slow);
+    int fast_id = sched_add(&sched, fast.name, 100, 100, record_task, &fast);
+    int mid_id = sched_add(&sched, mid.name, 250, 250, record_task, &mid);
+    CHECK(slow_id == 0 && fast_id == 1 && mid_id == 2);
+
+    run_until(&sched, sim_clock_us + 10000000);
+
+    CHECK(fast.runs == 100);
+    CHECK(mid.runs == 40);
+    CHECK(slow.runs == 10);
+
+    // The clock jumps to every deadline, so nothing ran late
+    const sched_task_stats_t *stats = sched_get_stats(&sched, fast_id);
+    CHECK(stats && stats->runs == 100 && stats->max_jitter_us == 0 && stats->late == 0 && stats->skipped == 0);
+
+    // Tasks run in deadline order, not in the order they were added
+    CHECK(run_count == TEST_LOG_MAX);
+    CHECK(strcmp(run_log[0], "fast") == 0);
+    CHECK(strcmp(run_log[1], "fast") == 0);
+    CHECK(strcmp(run_log[2], "mid") == 0 || strcmp(run_log[3], "mid") == 0);
+    CHECK(sched_get_stats(&sched, 3) == NULL);
+}
+
+static void test_overrun(void) {
+    sched_t sched;
+    test_task_t slow = { .name = "slow", .busy_ms = 350 };
+    test_task_t tick = { .name = "tick" };
+
+    reset(&sched);
+    uint64_t start_us = sim_clock_us;
+    sched_add(&sched, slow.name, 1000, 1050, record_task, &slow);
+    int tick_id = sched_add(&sched, tick.name, 100, 100, record_task, &tick);
+
+    run_until(&sched, start_us + 10000000);
+
+    // slow blocks from 50 to 400 ms past every second. tick runs 300 ms late for the deadline
+    // at 100 ms and skips the ones at 200, 300 and 400 ms, then continues at 500 ms.
+    const sched_task_stats_t *stats = sched_get_stats(&sched, tick_id);
+    CHECK(slow.runs == 9);
+    CHECK(stats->late == 9);
+    CHECK(stats->skipped == 27);
+    CHECK(stats->max_jitter_us == 300000);
+    CHECK(tick.runs == 100 - 27);
+    CHECK(stats->runs == tick.runs);
+    CHECK(tick.last_us == start_us + 10000000);
+}
+
+static void test_changes(void) {
+    sched_t sched;
+    test_task_t task = { .name = "task" };
+
+    reset(&sched);
+    uint64_t start_us = sim_clock_us;
+    int id = sched_add(&sched, task.name, 1000, 1000, record_task, &task);
+
+    // A new period applies from the next deadline on
+    run_until(&sched, start_us + 1500000);
+    CHECK(task.runs == 1);
+    CHECK(sched_set_period(&sched, id, 100) == 0);
+    run_until(&sched, start_us + 1999999);
+    CHECK(task.runs == 1);
+    run_until(&sched, start_us + 2300000);
+    CHECK(task.runs == 5);
+    CHECK(task.last_us == start_us + 2300000);
+
+    // Run earlier than the period, then on a grid of its own
+    sched_set_period(&sched, id, 1000);
+    sched_run_in(&sched, id, 10);
+    run_until(&sched, start_us + 2310000);
+    CHECK(task.runs == 6);
+    sched_run_at(&sched, id, start_us + 5000000);
+    run_until(&sched, start_us + 4999999);
+    CHECK(task.runs == 6);
+    run_until(&sched, start_us + 6000000);
+    CHECK(task.runs == 8);
+    CHECK(task.last_us == start_us + 6000000);
+
+    CHECK(sched_set_period(&sched, id + 1, 100) == 1);
+}
+
+static void test_limits(void) {
+    sched_t sched;
+    test_task_t tasks[SCHED_MAX_TASKS + 1];
+
+    reset(&sched);
+    memset(tasks, 0, sizeof(tasks));
+
+    // A period of 0 would keep sched_run spinning on the same task forever
+    CHECK(sched_add(&sched, "zero", 0, 0, record_task, &tasks[0]) == -1);
+    CHECK(sched_add(&sched, "nofn", 100, 0, NULL, NULL) == -1);
+
+    for (int i = 0; i < SCHED_MAX_TASKS; i++) {
+        tasks[i].name = "task";
+        CHECK(sched_add(&sched, tasks[i].name, 100 + i, 0, record_task, &tasks[i]) == i);
+    }
+    CHECK(sched_add(&sched, "full", 100, 0, record_task, &tasks[SCHED_MAX_TASKS]) == -1);
+
+    CHECK(sched_set_period(&sched, 0, 0) == 1);
+    run_until(&sched, sim_clock_us + 1000000);
+    CHECK(tasks[0].runs == 11);
+    CHECK(tasks[SCHED_MAX_TASKS].runs == 0);
+
+    // An empty scheduler has nothing to wake up for
+    sched_t empty;
+    sched_init(&empty, sim_now_us);
+    CHECK(sched_run(&empty) == UINT64_MAX);
+}
+
+int main(void) {
+    test_periods();
+    test_overrun();
+    test_changes();
+    test_limits();
+
+    printf("sched_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
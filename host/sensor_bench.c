@@ -0,0 +1,210 @@
+// Runs the sensor registry against simulated BME280s on two simulated I2C buses, on a
+// simulated clock, and measures the aggregate sampling throughput, the bus utilization and
+// how late the reads start. Sensors alternate between the buses, i2c0 0x76, i2c1 0x76,
+// i2c0 0x77 and i2c1 0x77. With -u every sensor is read at the same instant instead of
+// staggered, to show the burst the registry avoids.
+//
+// Sensors are triggered in forced mode and fetched with asynchronous reads. With -n they run
+// in normal mode and are read with blocking transfers, as before forced mode, to compare the
+// CPU time per sample and the estimated sensor current.
+//
+//     ./sensor_bench -s 4 -p 1000 -t 3600
+//     ./sensor_bench -s 4 -p 1000 -t 3600 -n  # blocking reads of continuous conversions
+//     ./sensor_bench -s 4 -p 12 -t 10         # close to what the buses can carry
+
+#include "pico_sensor.h"
+#include "pico_bme280.h"
+#include "sim_i2c.h"
+#include "pico_trace.h"
+#include "pico.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_SENSORS   SENSOR_MAX_SENSORS
+#define BENCH_DEFAULT_PERIOD_MS 1000
+#define BENCH_DEFAULT_SECONDS   3600
+
+// Bus clocks of one burst read: address, register, repeated start, address and the data
+#define BENCH_READ_CLOCKS       ((3 + BME280_DATA_LEN) * 9 + 3)
+// and of the trigger, address, register and value
+#define BENCH_TRIGGER_CLOCKS    (3 * 9 + 2)
+
+// Oversampling x1, normal mode
+#define BENCH_CTRL_MEAS_NORMAL  0x27
+
+static uint64_t sim_clock_us;
+static uint64_t samples;
+static int64_t temperature_sum;
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+static void count_sample(__unused void *arg, __unused uint8_t sensor, const sample_t *s, __unused uint64_t taken_us) {
+    samples++;
+    temperature_sum += s->temperature;
+}
+
+int main(int argc, char **argv) {
+    size_t count = BENCH_DEFAULT_SENSORS;
+    uint32_t period_ms = BENCH_DEFAULT_PERIOD_MS;
+    uint32_t seconds = BENCH_DEFAULT_SECONDS;
+    uint32_t baud = I2C_BAUD;
+    int unstaggered = 0;
+    int normal = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:p:t:b:un")) != -1) {
+        switch (opt) {
+        case 's':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            period_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            baud = strtoul(optarg, NULL, 10);
+            break;
+        case 'u':
+            unstaggered = 1;
+            break;
+        case 'n':
+            normal = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s sensors] [-p period ms] [-t seconds] [-b baud] [-u] [-n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (count == 0 || count > SENSOR_MAX_SENSORS || period_ms == 0 || seconds == 0 || baud == 0) {
+        fprintf(stderr, "1 to %d sensors, period, time and baud must be > 0\n", SENSOR_MAX_SENSORS);
+        return 1;
+    }
+
+    // A bus that cannot carry the reads of one period keeps the scheduler busy forever
+    uint32_t clocks = BENCH_READ_CLOCKS + (normal ? 0 : BENCH_TRIGGER_CLOCKS);
+    if ((uint64_t)count * clocks * 1000 >= (uint64_t)period_ms * baud) {
+        fprintf(stderr, "%zu reads do not fit in %lu ms at %lu Hz\n", count, (unsigned long)period_ms, (unsigned long)baud);
+        return 1;
+    }
+
+    static i2c_bus_t buses[I2C_BUS_COUNT];
+    static bme280_t devices[SENSOR_MAX_SENSORS];
+    // Unstaggered, every sensor gets a registry of its own and is read at the same instant
+    static sensor_registry_t registries[SENSOR_MAX_SENSORS];
+    size_t registry_count = unstaggered ? count : 1;
+    // Blocking reads only, the driver without its trigger and fetch
+    sensor_ops_t blocking_ops = { .read = bme280_sensor_ops.read };
+    const sensor_ops_t *ops = normal ? &blocking_ops : &bme280_sensor_ops;
+
+    for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+        if (sim_i2c_init(&buses[i], i, baud, &sim_clock_us) != 0) return 1;
+    }
+    for (size_t i = 0; i < registry_count; i++) {
+        sensor_registry_init(&registries[i], sim_now_us, count_sample, NULL);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        i2c_bus_t *bus = &buses[i % I2C_BUS_COUNT];
+        uint8_t addr = i < I2C_BUS_COUNT ? BME280_ADDR_PRIMARY : BME280_ADDR_SECONDARY;
+        char name[SENSOR_NAME_LEN];
+
+        const uint8_t ctrl_meas[2] = { BME280_REG_CTRL_MEAS, BENCH_CTRL_MEAS_NORMAL };
+
+        snprintf(name, sizeof(name), "i2c%u-%02x", bus->index, addr);
+        if (sim_i2c_add_bme280(bus, addr) != 0 || bme280_open(&devices[i], bus, addr) != 0 ||
+            (normal && bus->transfer(bus, addr, ctrl_meas, sizeof(ctrl_meas), NULL, 0) != 0) ||
+            sensor_register(&registries[unstaggered ? i : 0], name, ops, &devices[i]) < 0) {
+            fprintf(stderr, "unable to set up sensor %s\n", name);
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < registry_count; i++) {
+        sensor_start(&registries[i], period_ms);
+    }
+
+    // Setup traffic is not part of the measurement
+    uint64_t start_us = sim_clock_us;
+    sim_i2c_stats_t setup[I2C_BUS_COUNT];
+    for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+        sim_i2c_get_stats(&buses[i], &setup[i]);
+    }
+
+    uint64_t end_us = start_us + (uint64_t)seconds * 1000000;
+    while (sim_clock_us < end_us) {
+        uint64_t next_us = UINT64_MAX;
+
+        for (size_t i = 0; i < registry_count; i++) {
+            uint64_t deadline = sensor_run(&registries[i]);
+            if (deadline < next_us) next_us = deadline;
+        }
+
+        // Sleep until the next read, reads advance the clock by their bus time
+        if (next_us > sim_clock_us) sim_clock_us = next_us;
+    }
+
+    double elapsed_s = (sim_clock_us - start_us) / 1e6;
+    uint64_t busy_us = 0;
+    uint32_t max_jitter_us = 0;
+    uint64_t total_jitter_us = 0;
+    uint32_t runs = 0;
+    uint64_t cpu_us = 0;
+    uint32_t max_cpu_us = 0;
+    uint32_t reads = 0;
+    uint32_t failures = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const sensor_registry_t *registry = &registries[unstaggered ? i : 0];
+        const sensor_t *sensor = &registry->sensors[unstaggered ? 0 : i];
+        const sched_task_stats_t *stats = sched_get_stats(&registry->sched, sensor->task);
+
+        runs += stats->runs;
+        total_jitter_us += stats->total_jitter_us;
+        if (stats->max_jitter_us > max_jitter_us) max_jitter_us = stats->max_jitter_us;
+
+        cpu_us += sensor->stats.busy_us;
+        reads += sensor->stats.reads;
+        failures += sensor->stats.failures;
+        if (sensor->stats.max_busy_us > max_cpu_us) max_cpu_us = sensor->stats.max_busy_us;
+    }
+
+    printf("sensors:     %zu, %s every %lu ms, %lu Hz, %s\n", count, unstaggered ? "together" : "staggered",
+        (unsigned long)period_ms, (unsigned long)baud, normal ? "normal mode, blocking reads" : "forced mode, async reads");
+    printf("samples:     %llu in %.1f s, %.1f samples/s, mean %.2f C\n", (unsigned long long)samples, elapsed_s,
+        samples / elapsed_s, samples ? temperature_sum / 100.0 / samples : 0.0);
+
+    for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+        sim_i2c_stats_t stats;
+        sim_i2c_get_stats(&buses[i], &stats);
+
+        uint64_t bus_us = stats.busy_us - setup[i].busy_us;
+        uint64_t transfers = stats.transfers - setup[i].transfers;
+        busy_us += bus_us;
+
+        printf("i2c%u:        %llu transfers, %.1f us each, %.2f %% busy\n", i, (unsigned long long)transfers,
+            transfers ? (double)bus_us / transfers : 0.0, bus_us * 100.0 / (sim_clock_us - start_us));
+    }
+
+    printf("start delay: mean %.1f us, max %lu us\n", runs ? (double)total_jitter_us / runs : 0.0,
+        (unsigned long)max_jitter_us);
+    printf("cpu:         %.1f us blocked per sample, max %lu us, %lu of %lu reads failed\n",
+        reads ? (double)cpu_us / reads : 0.0, (unsigned long)max_cpu_us, (unsigned long)failures, (unsigned long)reads);
+    printf("current:     %lu nA per sensor estimated\n", (unsigned long)bme280_estimate_current_na(period_ms, !normal));
+    printf("ceiling:     %.0f samples/s of bus time\n", busy_us ? samples * 1e6 / busy_us : 0.0);
+
+    for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+        sim_i2c_deinit(&buses[i]);
+    }
+
+    // Built with PICO_TRACE, the latest spans follow for trace_json
+    trace_dump();
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "pico/cyw43_arch.h"
+#include "pico_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/init.h"
+#include "lwip/timeouts.h"
+#include "lwip/ip4_addr.h"
+#include "netif/tapif.h"
+
+// Addresses of the TAP interface, override with PICO_HOST_IP, PICO_HOST_NETMASK and PICO_HOST_GW
+#define HOST_DEFAULT_IP         "192.168.1.200"
+#define HOST_DEFAULT_NETMASK    "255.255.255.0"
+#define HOST_DEFAULT_GW         "192.168.1.1"
+
+#define HOST_POLL_INTERVAL_US   1000
+
+// Simulated association times. A join with a known BSSID and channel skips the scan.
+#define HOST_SCAN_JOIN_MS       2500
+#define HOST_DIRECT_JOIN_MS     300
+#define HOST_CHANNEL            6
+
+static const uint8_t host_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+cyw43_t cyw43_state;
+
+static bool ap_present = true;
+static bool associated;
+static bool joining;
+static absolute_time_t join_done;
+static bool led_on;
+
+static const char *env_or(const char *name, const char *fallback) {
+    const char *value = getenv(name);
+    return value ? value : fallback;
+}
+
+int cyw43_arch_init(void) {
+    ip4_addr_t ip, netmask, gw;
+
+    if (!ip4addr_aton(env_or("PICO_HOST_IP", HOST_DEFAULT_IP), &ip) ||
+        !ip4addr_aton(env_or("PICO_HOST_NETMASK", HOST_DEFAULT_NETMASK), &netmask) ||
+        !ip4addr_aton(env_or("PICO_HOST_GW", HOST_DEFAULT_GW), &gw)) {
+        PICO_LOGE("Invalid PICO_HOST_IP, PICO_HOST_NETMASK or PICO_HOST_GW\n");
+        return 1;
+    }
+
+    lwip_init();
+
+    // tapif honours PRECONFIGURED_TAPIF to attach to an existing TAP device
+    if (!netif_add(&cyw43_state.netif[CYW43_ITF_STA], &ip, &netmask, &gw, NULL, tapif_init, netif_input)) {
+        PICO_LOGE("Unable to open the TAP interface\n");
+        return 1;
+    }
+    netif_set_default(&cyw43_state.netif[CYW43_ITF_STA]);
+
+    return 0;
+}
+
+void cyw43_arch_deinit(void) {
+    netif_remove(&cyw43_state.netif[CYW43_ITF_STA]);
+}
+
+void cyw43_arch_enable_sta_mode(void) {
+}
+
+int cyw43_wifi_join(__unused cyw43_t *self, __unused size_t ssid_len, __unused const uint8_t *ssid,
+    __unused size_t key_len, __unused const uint8_t *key, __unused uint32_t auth_type,
+    const uint8_t *bssid, uint32_t channel) {
+    bool direct = bssid != NULL && channel != CYW43_CHANNEL_NONE;
+
+    associated = false;
+    joining = true;
+    join_done = make_timeout_time_ms(direct ? HOST_DIRECT_JOIN_MS : HOST_SCAN_JOIN_MS);
+    return 0;
+}
+
+int cyw43_wifi_leave(__unused cyw43_t *self, __unused int itf) {
+    associated = false;
+    joining = false;
+    netif_set_link_down(&cyw43_state.netif[CYW43_ITF_STA]);
+    return 0;
+}
+
+int cyw43_wifi_link_status(__unused cyw43_t *self, __unused int itf) {
+    return associated ? CYW43_LINK_JOIN : CYW43_LINK_DOWN;
+}
+
+// Reports the progress of a join like the driver does. The TAP interface has a static address,
+// so the link is up as soon as the association completes.
+int cyw43_tcpip_link_status(__unused cyw43_t *self, __unused int itf) {
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+
+    if (joining && absolute_time_diff_us(get_absolute_time(), join_done) <= 0) {
+        joining = false;
+        if (!ap_present) return CYW43_LINK_NONET;
+
+        associated = true;
+        netif_set_up(netif);
+        netif_set_link_up(netif);
+    }
+
+    if (associated) return CYW43_LINK_UP;
+    return joining ? CYW43_LINK_JOIN : CYW43_LINK_DOWN;
+}
+
+int cyw43_wifi_get_bssid(__unused cyw43_t *self, uint8_t bssid[6]) {
+    if (!associated) return -1;
+
+    memcpy(bssid, host_bssid, sizeof(host_bssid));
+    return 0;
+}
+
+int cyw43_ioctl(__unused cyw43_t *self, uint32_t cmd, size_t len, uint8_t *buf, __unused uint32_t iface) {
+    if (cmd != CYW43_IOCTL_GET_CHANNEL || len < sizeof(uint32_t) || !associated) return -1;
+
+    uint32_t channel = HOST_CHANNEL;
+    memcpy(buf, &channel, sizeof(channel));
+    return 0;
+}
+
+void cyw43_arch_poll(void) {
+    tapif_poll(&cyw43_state.netif[CYW43_ITF_STA]);
+    sys_check_timeouts();
+}
+
+void cyw43_arch_wait_for_work_until(absolute_time_t until) {
+    do {
+        cyw43_arch_poll();
+
+        int64_t remaining = absolute_time_diff_us(get_absolute_time(), until);
+        if (remaining <= 0) break;
+
+        sleep_us(remaining < HOST_POLL_INTERVAL_US ? (uint64_t)remaining : HOST_POLL_INTERVAL_US);
+    } while (1);
+}
+
+void cyw43_arch_gpio_put(__unused uint wl_gpio, bool value) {
+    led_on = value;
+}
+
+void cyw43_host_set_link(bool up) {
+    ap_present = up;
+    if (!up) {
+        cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    }
+}
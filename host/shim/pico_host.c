@@ -0,0 +1,87 @@
+#include "pico.h"
+#include "pico/time.h"
+#include "pico/rand.h"
+#include "pico/unique_id.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t board_id;
+static bool board_id_set;
+static uint64_t (*sim_now_us)(void);
+
+static uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+uint64_t time_us_64(void) {
+    static uint64_t boot_us;
+
+    if (sim_now_us) return sim_now_us();
+    if (boot_us == 0) {
+        boot_us = monotonic_us();
+    }
+    return monotonic_us() - boot_us;
+}
+
+void sleep_us(uint64_t us) {
+    if (sim_now_us) return;
+
+    struct timespec ts = {
+        .tv_sec = (time_t)(us / 1000000u),
+        .tv_nsec = (long)(us % 1000000u) * 1000
+    };
+    nanosleep(&ts, NULL);
+}
+
+void host_set_clock(uint64_t (*now_us)(void)) {
+    sim_now_us = now_us;
+}
+
+uint32_t get_rand_32(void) {
+    static bool seeded;
+
+    if (!seeded) {
+        srandom((unsigned int)(time_us_64() ^ (uint64_t)getpid()));
+        seeded = true;
+    }
+    return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+void panic(const char *fmt, ...) {
+    va_list args;
+
+    fputs("\n*** PANIC ***\n\n", stderr);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+
+    abort();
+}
+
+void host_set_board_id(uint64_t id) {
+    board_id = id;
+    board_id_set = true;
+}
+
+void pico_get_unique_board_id_string(char *id_out, unsigned int len) {
+    if (!board_id_set) {
+        const char *env = getenv("PICO_HOST_BOARD_ID");
+        host_set_board_id(env ? strtoull(env, NULL, 16) : (uint64_t)getpid());
+    }
+
+    if (len == 0) return;
+
+    unsigned int i;
+    for (i = 0; i < 2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES && i < len - 1; i++) {
+        unsigned int nibble = (board_id >> (60 - 4 * i)) & 0xF;
+        id_out[i] = (char)(nibble < 10 ? '0' + nibble : 'A' + nibble - 10);
+    }
+    id_out[i] = '\0';
+}
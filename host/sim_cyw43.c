@@ -0,0 +1,192 @@
+#include "sim_cyw43.h"
+#include "sim_lwip.h"
+#include "pico/cyw43_arch.h"
+
+#include <string.h>
+
+typedef enum {
+    SIM_JOIN_IDLE,
+    SIM_JOIN_ASSOCIATING,
+    SIM_JOIN_DHCP,
+    SIM_JOIN_UP,
+    SIM_JOIN_FAILED
+} sim_join_state_t;
+
+static const uint8_t sim_bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+cyw43_t cyw43_state;
+
+static struct {
+    sim_ap_mode_t mode;
+    uint32_t channel;
+    uint32_t scan_ms;
+    uint32_t direct_ms;
+    uint32_t dhcp_ms;
+    sim_cyw43_wait_t wait;
+
+    sim_join_state_t state;
+    sim_ap_mode_t join_mode;        // mode of the access point when the join started
+    bool join_reaches_ap;           // false for a direct join to a channel the access point left
+    uint64_t next_us;               // end of the association or of DHCP
+
+    sim_cyw43_stats_t stats;
+} sim;
+
+void sim_cyw43_reset(void) {
+    sim_cyw43_wait_t wait = sim.wait;
+
+    memset(&sim, 0, sizeof(sim));
+    memset(&cyw43_state, 0, sizeof(cyw43_state));
+    sim.mode = SIM_AP_UP;
+    sim.channel = SIM_CYW43_CHANNEL;
+    sim.scan_ms = 2500;
+    sim.direct_ms = 300;
+    sim.dhcp_ms = 200;
+    sim.wait = wait;
+}
+
+void sim_cyw43_set_mode(sim_ap_mode_t mode) {
+    sim.mode = mode;
+}
+
+void sim_cyw43_set_timing(uint32_t scan_ms, uint32_t direct_ms, uint32_t dhcp_ms) {
+    sim.scan_ms = scan_ms;
+    sim.direct_ms = direct_ms;
+    sim.dhcp_ms = dhcp_ms;
+}
+
+void sim_cyw43_set_channel(uint32_t channel) {
+    sim.channel = channel;
+}
+
+void sim_cyw43_drop(void) {
+    if (sim.state == SIM_JOIN_DHCP || sim.state == SIM_JOIN_UP) {
+        sim.state = SIM_JOIN_IDLE;
+        cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr = 0;
+    }
+}
+
+void sim_cyw43_set_wait(sim_cyw43_wait_t wait) {
+    sim.wait = wait;
+}
+
+void sim_cyw43_get_stats(sim_cyw43_stats_t *stats) {
+    *stats = sim.stats;
+}
+
+void cyw43_host_set_link(bool up) {
+    sim.mode = up ? SIM_AP_UP : SIM_AP_GONE;
+    if (!up) {
+        sim_cyw43_drop();
+    }
+}
+
+// Moves the join on to the step that is due
+static void advance(void) {
+    if (time_us_64() < sim.next_us) return;
+
+    switch (sim.state) {
+    case SIM_JOIN_ASSOCIATING:
+        if (sim.join_mode == SIM_AP_GONE || !sim.join_reaches_ap) {
+            sim.state = SIM_JOIN_FAILED;
+            break;
+        }
+        sim.state = SIM_JOIN_DHCP;
+        sim.next_us = sim.join_mode == SIM_AP_NO_DHCP ? UINT64_MAX : time_us_64() + (uint64_t)sim.dhcp_ms * 1000;
+        advance();
+        break;
+
+    case SIM_JOIN_DHCP:
+        sim.state = SIM_JOIN_UP;
+        ipaddr_aton(SIM_LWIP_DEVICE_IP, &cyw43_state.netif[CYW43_ITF_STA].ip_addr);
+        break;
+
+    default:
+        break;
+    }
+}
+
+int cyw43_arch_init(void) {
+    return 0;
+}
+
+void cyw43_arch_deinit(void) {
+}
+
+void cyw43_arch_enable_sta_mode(void) {
+}
+
+int cyw43_wifi_join(__unused cyw43_t *self, __unused size_t ssid_len, __unused const uint8_t *ssid,
+    __unused size_t key_len, __unused const uint8_t *key, __unused uint32_t auth_type,
+    const uint8_t *bssid, uint32_t channel) {
+    bool direct = bssid != NULL && channel != CYW43_CHANNEL_NONE;
+
+    sim.stats.joins++;
+    sim.stats.direct_joins += direct;
+    sim.stats.last_channel = direct ? channel : CYW43_CHANNEL_NONE;
+
+    cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr = 0;
+    sim.state = SIM_JOIN_ASSOCIATING;
+    sim.join_mode = sim.mode;
+    sim.join_reaches_ap = !direct || (channel == sim.channel && memcmp(bssid, sim_bssid, sizeof(sim_bssid)) == 0);
+    sim.next_us = time_us_64() + (uint64_t)(direct ? sim.direct_ms : sim.scan_ms) * 1000;
+    return 0;
+}
+
+int cyw43_wifi_leave(__unused cyw43_t *self, __unused int itf) {
+    sim.stats.leaves++;
+    sim.state = SIM_JOIN_IDLE;
+    cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr = 0;
+    return 0;
+}
+
+int cyw43_wifi_link_status(__unused cyw43_t *self, __unused int itf) {
+    advance();
+
+    switch (sim.state) {
+    case SIM_JOIN_ASSOCIATING:
+    case SIM_JOIN_DHCP:
+    case SIM_JOIN_UP:
+        return CYW43_LINK_JOIN;
+    case SIM_JOIN_FAILED:
+        return CYW43_LINK_NONET;
+    default:
+        return CYW43_LINK_DOWN;
+    }
+}
+
+// Like the driver, the interface status once associated and the join status before
+int cyw43_tcpip_link_status(cyw43_t *self, int itf) {
+    int status = cyw43_wifi_link_status(self, itf);
+
+    if (sim.state == SIM_JOIN_UP) return CYW43_LINK_UP;
+    if (sim.state == SIM_JOIN_DHCP) return CYW43_LINK_NOIP;
+    return status;
+}
+
+int cyw43_wifi_get_bssid(__unused cyw43_t *self, uint8_t bssid[6]) {
+    if (sim.state != SIM_JOIN_UP) return -1;
+
+    memcpy(bssid, sim_bssid, sizeof(sim_bssid));
+    return 0;
+}
+
+int cyw43_ioctl(__unused cyw43_t *self, uint32_t cmd, size_t len, uint8_t *buf, __unused uint32_t iface) {
+    if (cmd != CYW43_IOCTL_GET_CHANNEL || len < sizeof(uint32_t) || sim.state != SIM_JOIN_UP) return -1;
+
+    memcpy(buf, &sim.channel, sizeof(sim.channel));
+    return 0;
+}
+
+void cyw43_arch_poll(void) {
+    advance();
+    sim_lwip_poll();
+}
+
+void cyw43_arch_wait_for_work_until(absolute_time_t until) {
+    sim.stats.waits++;
+    if (sim.wait) sim.wait(to_us_since_boot(until));
+}
+
+void cyw43_arch_gpio_put(__unused uint wl_gpio, __unused bool value) {
+}
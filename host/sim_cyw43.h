@@ -0,0 +1,61 @@
+#ifndef SIM_CYW43_H
+#define SIM_CYW43_H
+
+// Simulated Wi-Fi chip for the host tests. Serves the cyw43 API of host/include/pico/cyw43_arch.h
+// from an access point in the process, on whatever clock time_us_64 reads, so a test on
+// host_set_clock decides when every join ends. The interface gets SIM_LWIP_DEVICE_IP once
+// the simulated DHCP is done, and cyw43_arch_poll polls the network of sim_lwip.c.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_CYW43_CHANNEL       6       // channel of the access point after a reset
+
+/**
+ * @brief How the access point answers joins that start from now on.
+ */
+typedef enum {
+    SIM_AP_UP,                  // joins complete, DHCP answers
+    SIM_AP_GONE,                // joins fail with CYW43_LINK_NONET once the scan is done
+    SIM_AP_NO_DHCP              // joins associate, DHCP never answers
+} sim_ap_mode_t;
+
+/**
+ * @brief Called by cyw43_arch_wait_for_work_until, the test moves its clock to until_us.
+ */
+typedef void (*sim_cyw43_wait_t)(uint64_t until_us);
+
+typedef struct {
+    uint32_t joins;             // calls to cyw43_wifi_join
+    uint32_t direct_joins;      // joins given a BSSID and a channel
+    uint32_t leaves;
+    uint32_t waits;             // calls to cyw43_arch_wait_for_work_until
+    uint32_t last_channel;      // channel of the last join, CYW43_CHANNEL_NONE for a scan
+} sim_cyw43_stats_t;
+
+/**
+ * @brief Drops the association and goes back to an access point that is up on
+ * SIM_CYW43_CHANNEL, 2500 ms for a join with a scan, 300 ms for a direct join and 200 ms for DHCP.
+ */
+void sim_cyw43_reset(void);
+
+void sim_cyw43_set_mode(sim_ap_mode_t mode);
+
+void sim_cyw43_set_timing(uint32_t scan_ms, uint32_t direct_ms, uint32_t dhcp_ms);
+
+/**
+ * @brief Moves the access point to another channel. A direct join to the old channel then
+ * fails with CYW43_LINK_NONET, a scan finds it on the new one.
+ */
+void sim_cyw43_set_channel(uint32_t channel);
+
+/**
+ * @brief The access point drops the association, as on a deauthentication.
+ */
+void sim_cyw43_drop(void);
+
+void sim_cyw43_set_wait(sim_cyw43_wait_t wait);
+
+void sim_cyw43_get_stats(sim_cyw43_stats_t *stats);
+
+#endif
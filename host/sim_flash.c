@@ -0,0 +1,159 @@
+#include "sim_flash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *data;
+    uint32_t *erase_counts;
+    char *path;
+    uint32_t worn_sector;       // UINT32_MAX for none
+    sim_flash_stats_t stats;
+} sim_flash_t;
+
+static struct {
+    uint8_t armed;
+    uint32_t ops;               // until the torn one, 0 once the power is off
+} power;
+
+// Returns the bytes of a program or erase of len bytes that reach the flash
+static uint32_t powered_len(uint32_t len) {
+    if (!power.armed) return len;
+    if (power.ops == 0) return 0;
+    if (--power.ops > 0) return len;
+
+    return len / 2;
+}
+
+void sim_flash_cut_power(uint32_t ops) {
+    power.armed = ops != 0;
+    power.ops = ops;
+}
+
+static uint8_t sim_read(const flash_dev_t *dev, uint32_t offset, void *buf, size_t len) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+
+    if (offset + len > dev->size) return 1;
+
+    memcpy(buf, &sim->data[offset], len);
+    sim->stats.bytes_read += len;
+    return 0;
+}
+
+static uint8_t sim_program_page(const flash_dev_t *dev, uint32_t offset, const uint8_t *page) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+
+    if (offset % FLASH_DEV_PAGE_SIZE || offset + FLASH_DEV_PAGE_SIZE > dev->size) return 1;
+    if (offset / FLASH_DEV_SECTOR_SIZE == sim->worn_sector) return 1;
+
+    // NOR flash can only clear bits
+    uint32_t len = powered_len(FLASH_DEV_PAGE_SIZE);
+    for (uint32_t i = 0; i < len; i++) {
+        sim->data[offset + i] &= page[i];
+    }
+    if (len < FLASH_DEV_PAGE_SIZE) return 1;
+
+    sim->stats.pages_programmed++;
+    return 0;
+}
+
+static uint8_t sim_erase_sector(const flash_dev_t *dev, uint32_t offset) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+
+    if (offset % FLASH_DEV_SECTOR_SIZE || offset + FLASH_DEV_SECTOR_SIZE > dev->size) return 1;
+    if (offset / FLASH_DEV_SECTOR_SIZE == sim->worn_sector) return 1;
+
+    uint32_t len = powered_len(FLASH_DEV_SECTOR_SIZE);
+    memset(&sim->data[offset], 0xFF, len);
+    if (len < FLASH_DEV_SECTOR_SIZE) return 1;
+
+    sim->erase_counts[offset / FLASH_DEV_SECTOR_SIZE]++;
+    sim->stats.sectors_erased++;
+    return 0;
+}
+
+uint8_t sim_flash_init(flash_dev_t *dev, uint32_t size, const char *path) {
+    if (!dev || size == 0 || size % FLASH_DEV_SECTOR_SIZE) return 1;
+
+    sim_flash_t *sim = calloc(1, sizeof(sim_flash_t));
+    if (!sim) return 1;
+
+    sim->data = malloc(size);
+    sim->erase_counts = calloc(size / FLASH_DEV_SECTOR_SIZE, sizeof(uint32_t));
+    if (!sim->data || !sim->erase_counts) goto exit;
+
+    memset(sim->data, 0xFF, size);
+    sim->worn_sector = UINT32_MAX;
+
+    if (path) {
+        sim->path = strdup(path);
+        if (!sim->path) goto exit;
+
+        FILE *f = fopen(path, "rb");
+        if (f) {
+            size_t n = fread(sim->data, 1, size, f);
+            fclose(f);
+            if (n != size) memset(&sim->data[n], 0xFF, size - n);
+        }
+    }
+
+    dev->size = size;
+    dev->read = sim_read;
+    dev->program_page = sim_program_page;
+    dev->erase_sector = sim_erase_sector;
+    dev->ctx = sim;
+
+    return 0;
+exit:
+    free(sim->data);
+    free(sim->erase_counts);
+    free(sim);
+    return 1;
+}
+
+void sim_flash_get_stats(const flash_dev_t *dev, sim_flash_stats_t *stats) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+    uint32_t sectors = dev->size / FLASH_DEV_SECTOR_SIZE;
+
+    *stats = sim->stats;
+    stats->min_erase = UINT32_MAX;
+    stats->max_erase = 0;
+
+    for (uint32_t i = 0; i < sectors; i++) {
+        if (sim->erase_counts[i] < stats->min_erase) stats->min_erase = sim->erase_counts[i];
+        if (sim->erase_counts[i] > stats->max_erase) stats->max_erase = sim->erase_counts[i];
+    }
+}
+
+uint32_t sim_flash_erase_count(const flash_dev_t *dev, uint32_t sector) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+
+    if (sector >= dev->size / FLASH_DEV_SECTOR_SIZE) return 0;
+    return sim->erase_counts[sector];
+}
+
+void sim_flash_wear_out(const flash_dev_t *dev, uint32_t sector) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+
+    sim->worn_sector = sector;
+}
+
+void sim_flash_deinit(flash_dev_t *dev) {
+    sim_flash_t *sim = (sim_flash_t *)dev->ctx;
+    if (!sim) return;
+
+    if (sim->path) {
+        FILE *f = fopen(sim->path, "wb");
+        if (f) {
+            fwrite(sim->data, 1, dev->size, f);
+            fclose(f);
+        }
+    }
+
+    free(sim->path);
+    free(sim->data);
+    free(sim->erase_counts);
+    free(sim);
+    dev->ctx = NULL;
+}
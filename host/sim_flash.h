@@ -0,0 +1,60 @@
+#ifndef SIM_FLASH_H
+#define SIM_FLASH_H
+
+#include <stdint.h>
+
+#include "pico_flash.h"
+
+/**
+ * @brief Wear and traffic counters of a simulated flash region.
+ */
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t pages_programmed;
+    uint64_t sectors_erased;
+    uint32_t min_erase;         // lowest erase count of any sector
+    uint32_t max_erase;         // highest erase count of any sector
+} sim_flash_stats_t;
+
+/**
+ * @brief Creates a RAM backed flash region with NOR semantics for host builds.
+ * Programming ANDs the data into the array, erasing resets a sector to 0xFF.
+ *
+ * @param[out] dev The device to initialize
+ * @param[in] size Size of the region in bytes. Must be a multiple of the sector size.
+ * @param[in] path Optional file the contents are loaded from and saved to, so the
+ * region survives a restart of the host process. NULL for a volatile region.
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t sim_flash_init(flash_dev_t *dev, uint32_t size, const char *path);
+
+/**
+ * @brief Copies the wear and traffic counters of the region.
+ */
+void sim_flash_get_stats(const flash_dev_t *dev, sim_flash_stats_t *stats);
+
+/**
+ * @brief Returns the erase count of one sector.
+ */
+uint32_t sim_flash_erase_count(const flash_dev_t *dev, uint32_t sector);
+
+/**
+ * @brief Cuts the power during the ops-th program or erase from now, counted over every
+ * region. That one is torn, an erase resets only the first half of the sector and a program
+ * writes only the first half of the page, and every one after it fails. 0 restores the power.
+ */
+void sim_flash_cut_power(uint32_t ops);
+
+/**
+ * @brief Wears out one sector of the region: every program and erase of it fails from now
+ * on and leaves it as it is. UINT32_MAX restores it, a later call replaces the sector.
+ */
+void sim_flash_wear_out(const flash_dev_t *dev, uint32_t sector);
+
+/**
+ * @brief Writes the contents back to the backing file, if any, and frees the region.
+ */
+void sim_flash_deinit(flash_dev_t *dev);
+
+#endif
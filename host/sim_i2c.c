@@ -0,0 +1,173 @@
+#include "sim_i2c.h"
+#include "pico_bme280.h"
+#include "pico.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_I2C_MAX_DEVICES     4
+
+// Datasheet example of the trimming parameters and a reading of about 25 C, 1006 hPa and 50 %RH
+static const uint8_t bme280_calib_tp[BME280_CALIB_TP_LEN] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC,             // T1 27504, T2 26435, T3 -1000
+    0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27, 0x0B, // P1 36477, P2 -10685, P3 3024, P4 2855
+    0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, // P5 140, P6 -7, P7 15500, P8 -14600
+    0x70, 0x17                                      // P9 6000
+};
+static const uint8_t bme280_calib_h1 = 75;
+static const uint8_t bme280_calib_h[BME280_CALIB_H_LEN] = {
+    0x6A, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1E        // H2 362, H3 0, H4 313, H5 50, H6 30
+};
+
+#define SIM_BME280_ADC_T        519888
+#define SIM_BME280_ADC_P        415148
+#define SIM_BME280_ADC_H        29100
+
+typedef struct {
+    uint8_t addr;
+    uint8_t pointer;            // register the next read or write starts at
+    uint8_t regs[256];
+    int32_t drift;
+} sim_device_t;
+
+typedef struct {
+    uint64_t *clock_us;
+    sim_device_t devices[SIM_I2C_MAX_DEVICES];
+    uint8_t count;
+    sim_i2c_stats_t stats;
+} sim_i2c_t;
+
+static sim_device_t *find_device(sim_i2c_t *sim, uint8_t addr) {
+    for (uint8_t i = 0; i < sim->count; i++) {
+        if (sim->devices[i].addr == addr) return &sim->devices[i];
+    }
+    return NULL;
+}
+
+static void put_20bit(uint8_t *regs, int32_t value) {
+    regs[0] = (uint8_t)(value >> 12);
+    regs[1] = (uint8_t)(value >> 4);
+    regs[2] = (uint8_t)(value << 4);
+}
+
+// Runs on a forced mode trigger, and in normal mode whenever the data registers are read
+static void convert(sim_device_t *dev) {
+    dev->drift += (int32_t)(random() % 33) - 16;
+
+    put_20bit(&dev->regs[BME280_REG_DATA], SIM_BME280_ADC_P - dev->drift);
+    put_20bit(&dev->regs[BME280_REG_DATA + 3], SIM_BME280_ADC_T + dev->drift);
+    dev->regs[BME280_REG_DATA + 6] = (uint8_t)((SIM_BME280_ADC_H + dev->drift) >> 8);
+    dev->regs[BME280_REG_DATA + 7] = (uint8_t)(SIM_BME280_ADC_H + dev->drift);
+}
+
+static uint8_t sim_transfer(const i2c_bus_t *bus, uint8_t addr, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    sim_i2c_t *sim = (sim_i2c_t *)bus->ctx;
+    sim_device_t *dev = find_device(sim, addr);
+
+    // Start, address and stop, then one more start and address for the read
+    uint64_t bytes = 1 + tx_len + (rx_len > 0 ? 1 + rx_len : 0);
+    uint64_t clocks = bytes * 9 + 2 + (rx_len > 0 ? 1 : 0);
+    uint64_t busy_us = (clocks * 1000000 + bus->baud - 1) / bus->baud;
+
+    sim->stats.transfers++;
+    sim->stats.bytes += bytes;
+    sim->stats.busy_us += busy_us;
+    *sim->clock_us += busy_us;
+
+    if (!dev) {
+        sim->stats.nacks++;
+        return 1;
+    }
+
+    if (tx_len > 0) {
+        dev->pointer = tx[0];
+    }
+    // Writes are register and value pairs
+    for (size_t i = 0; i + 1 < tx_len; i += 2) {
+        dev->regs[tx[i]] = tx[i + 1];
+
+        // Forced mode converts once and goes back to sleep
+        uint8_t mode = dev->regs[BME280_REG_CTRL_MEAS] & BME280_MODE_MASK;
+        if (tx[i] == BME280_REG_CTRL_MEAS && (mode == 1 || mode == 2)) {
+            convert(dev);
+            dev->regs[BME280_REG_CTRL_MEAS] &= (uint8_t)~BME280_MODE_MASK;
+        }
+    }
+
+    if (rx_len > 0) {
+        if (dev->pointer == BME280_REG_DATA && (dev->regs[BME280_REG_CTRL_MEAS] & BME280_MODE_MASK) == BME280_MODE_MASK) {
+            convert(dev);
+        }
+        for (size_t i = 0; i < rx_len; i++) {
+            rx[i] = dev->regs[(uint8_t)(dev->pointer + i)];
+        }
+    }
+
+    return 0;
+}
+
+// The DMA engine moves the bytes while the core carries on, so the clock does not advance
+static uint8_t sim_read_regs_async(const i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len, i2c_done_fn done, void *arg) {
+    sim_i2c_t *sim = (sim_i2c_t *)bus->ctx;
+    uint64_t clock_us = *sim->clock_us;
+
+    if (len == 0 || len > I2C_DMA_MAX_LEN) return 1;
+
+    uint8_t err = sim_transfer(bus, addr, &reg, 1, buf, len);
+    *sim->clock_us = clock_us;
+
+    // A read the device did not acknowledge never completes on the hardware either
+    if (err == 0) done(arg, 0);
+    return 0;
+}
+
+static void sim_cancel(__unused const i2c_bus_t *bus) {
+}
+
+uint8_t sim_i2c_init(i2c_bus_t *bus, uint8_t index, uint32_t baud, uint64_t *clock_us) {
+    if (!bus || baud == 0 || !clock_us) return 1;
+
+    sim_i2c_t *sim = calloc(1, sizeof(sim_i2c_t));
+    if (!sim) return 1;
+
+    sim->clock_us = clock_us;
+
+    bus->index = index;
+    bus->baud = baud;
+    bus->transfer = sim_transfer;
+    bus->read_regs_async = sim_read_regs_async;
+    bus->cancel = sim_cancel;
+    bus->ctx = sim;
+
+    return 0;
+}
+
+uint8_t sim_i2c_add_bme280(i2c_bus_t *bus, uint8_t addr) {
+    sim_i2c_t *sim = (sim_i2c_t *)bus->ctx;
+
+    if (sim->count >= SIM_I2C_MAX_DEVICES || find_device(sim, addr)) return 1;
+
+    sim_device_t *dev = &sim->devices[sim->count++];
+    memset(dev, 0, sizeof(*dev));
+
+    dev->addr = addr;
+    dev->regs[BME280_REG_CHIP_ID] = BME280_CHIP_ID;
+    memcpy(&dev->regs[BME280_REG_CALIB_TP], bme280_calib_tp, sizeof(bme280_calib_tp));
+    dev->regs[BME280_REG_CALIB_H1] = bme280_calib_h1;
+    memcpy(&dev->regs[BME280_REG_CALIB_H], bme280_calib_h, sizeof(bme280_calib_h));
+    // Reset values, the data registers read as skipped until the first conversion
+    dev->regs[BME280_REG_DATA] = 0x80;
+    dev->regs[BME280_REG_DATA + 3] = 0x80;
+    dev->regs[BME280_REG_DATA + 6] = 0x80;
+
+    return 0;
+}
+
+void sim_i2c_get_stats(const i2c_bus_t *bus, sim_i2c_stats_t *stats) {
+    *stats = ((const sim_i2c_t *)bus->ctx)->stats;
+}
+
+void sim_i2c_deinit(i2c_bus_t *bus) {
+    free(bus->ctx);
+    bus->ctx = NULL;
+}
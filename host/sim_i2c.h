@@ -0,0 +1,52 @@
+#ifndef SIM_I2C_H
+#define SIM_I2C_H
+
+#include <stdint.h>
+
+#include "pico_i2c.h"
+
+/**
+ * @brief Traffic counters of a simulated bus.
+ */
+typedef struct {
+    uint64_t transfers;
+    uint64_t bytes;             // address bytes included
+    uint64_t busy_us;           // time the bus was driven
+    uint32_t nacks;             // transfers to an address without a device
+} sim_i2c_stats_t;
+
+/**
+ * @brief Creates a simulated I2C bus for host builds. Every transfer takes the time it would
+ * take on the wire, 9 clocks per byte plus start and stop, and advances the passed clock by it.
+ * Asynchronous reads complete before they return and leave the clock alone, as the core is
+ * free while the DMA engine is busy.
+ *
+ * @param[out] bus The bus to initialize
+ * @param[in] index Number of the bus, used in log messages
+ * @param[in] baud Clock rate in Hz
+ * @param[in,out] clock_us Simulated clock advanced by every transfer
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t sim_i2c_init(i2c_bus_t *bus, uint8_t index, uint32_t baud, uint64_t *clock_us);
+
+/**
+ * @brief Attaches a simulated BME280 with the trimming parameters of the datasheet example.
+ * It converts when triggered in forced mode, or on every read of the data registers in normal
+ * mode, and its readings drift a little with every conversion.
+ *
+ * @return 0 for success. 1 if the address is taken or the bus is full.
+ */
+uint8_t sim_i2c_add_bme280(i2c_bus_t *bus, uint8_t addr);
+
+/**
+ * @brief Copies the traffic counters of the bus.
+ */
+void sim_i2c_get_stats(const i2c_bus_t *bus, sim_i2c_stats_t *stats);
+
+/**
+ * @brief Frees the bus and its devices.
+ */
+void sim_i2c_deinit(i2c_bus_t *bus);
+
+#endif
@@ -0,0 +1,396 @@
+#include "sim_lwip.h"
+#include "pico.h"
+#include "pico/time.h"
+
+#include "lwip/apps/mqtt.h"
+#include "lwip/apps/mqtt_priv.h"
+#include "lwip/dns.h"
+#include "lwip/netif.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_DEFAULT_CONNECT_MS  50
+#define SIM_DEFAULT_RTT_MS      20
+
+// Connection states, as lwIP's client goes through them
+typedef enum {
+    SIM_CONN_DISCONNECTED,
+    SIM_CONN_TCP_CONNECTING,    // TCP connect and TLS handshake
+    SIM_CONN_MQTT_CONNECTING,   // CONNECT sent
+    SIM_CONN_CONNECTED
+} sim_conn_state_t;
+
+typedef struct {
+    bool used;
+    dns_found_callback found;
+    void *arg;
+    uint64_t done_us;
+    bool ok;
+    char name[64];
+} sim_lookup_t;
+
+static struct {
+    sim_broker_mode_t mode;
+    uint32_t connect_ms;
+    uint32_t rtt_ms;
+    bool acks;
+    sim_broker_observer_t observer;
+    void *observer_arg;
+
+    sim_dns_mode_t dns_mode;
+    uint32_t dns_delay_ms;
+    sim_lookup_t lookups[SIM_LWIP_MAX_LOOKUPS];
+
+    mqtt_client_t *clients[SIM_LWIP_MAX_CLIENTS];   // every client that ever connected
+    size_t client_count;
+    sim_lwip_stats_t stats;
+} sim;
+
+static struct netif sim_netif;
+struct netif *netif_list = &sim_netif;
+
+static uint64_t after_ms(uint32_t ms) {
+    return time_us_64() + (uint64_t)ms * 1000;
+}
+
+void sim_lwip_reset(void) {
+    for (size_t i = 0; i < sim.client_count; i++) {
+        sim.clients[i]->conn_state = SIM_CONN_DISCONNECTED;
+        memset(sim.clients[i]->req, 0, sizeof(sim.clients[i]->req));
+    }
+
+    memset(&sim, 0, sizeof(sim));
+    sim.mode = SIM_BROKER_ACCEPT;
+    sim.connect_ms = SIM_DEFAULT_CONNECT_MS;
+    sim.rtt_ms = SIM_DEFAULT_RTT_MS;
+    sim.acks = true;
+    sim.dns_mode = SIM_DNS_CACHED;
+
+    ipaddr_aton(SIM_LWIP_DEVICE_IP, &sim_netif.ip_addr);
+}
+
+void sim_broker_set_mode(sim_broker_mode_t mode) {
+    sim.mode = mode;
+}
+
+void sim_broker_set_timing(uint32_t connect_ms, uint32_t rtt_ms) {
+    sim.connect_ms = connect_ms;
+    sim.rtt_ms = rtt_ms;
+}
+
+void sim_broker_set_acks(bool acks) {
+    sim.acks = acks;
+}
+
+void sim_broker_set_observer(sim_broker_observer_t observer, void *arg) {
+    sim.observer = observer;
+    sim.observer_arg = arg;
+}
+
+void sim_dns_set_mode(sim_dns_mode_t mode, uint32_t delay_ms) {
+    sim.dns_mode = mode;
+    sim.dns_delay_ms = delay_ms;
+}
+
+void sim_lwip_get_stats(sim_lwip_stats_t *stats) {
+    *stats = sim.stats;
+}
+
+char *ipaddr_ntoa(const ip_addr_t *addr) {
+    static char buf[16];
+    const uint8_t *bytes = (const uint8_t *)&addr->addr;
+
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return buf;
+}
+
+int ipaddr_aton(const char *cp, ip_addr_t *addr) {
+    unsigned int parts[4];
+    char tail;
+
+    if (sscanf(cp, "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &tail) != 4) return 0;
+
+    uint8_t *bytes = (uint8_t *)&addr->addr;
+    for (int i = 0; i < 4; i++) {
+        if (parts[i] > 255) return 0;
+        bytes[i] = (uint8_t)parts[i];
+    }
+    return 1;
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+    sim.stats.lookups++;
+
+    if (sim.dns_mode == SIM_DNS_CACHED) {
+        ipaddr_aton(SIM_LWIP_BROKER_IP, addr);
+        return ERR_OK;
+    }
+
+    for (size_t i = 0; i < SIM_LWIP_MAX_LOOKUPS; i++) {
+        sim_lookup_t *lookup = &sim.lookups[i];
+        if (lookup->used) continue;
+
+        lookup->used = true;
+        lookup->found = found;
+        lookup->arg = callback_arg;
+        lookup->ok = sim.dns_mode == SIM_DNS_ANSWER;
+        lookup->done_us = sim.dns_mode == SIM_DNS_NO_ANSWER ? UINT64_MAX : after_ms(sim.dns_delay_ms);
+        snprintf(lookup->name, sizeof(lookup->name), "%s", hostname);
+        return ERR_INPROGRESS;
+    }
+
+    return ERR_MEM;
+}
+
+// Drops the requests of a closed connection without completing them, like lwIP. lwIP closes
+// without a DISCONNECT, so the broker publishes the will of an accepted connection.
+static void close_connection(mqtt_client_t *client) {
+    bool will = client->conn_state == SIM_CONN_CONNECTED && client->will_topic[0] != '\0';
+
+    client->conn_state = SIM_CONN_DISCONNECTED;
+    memset(client->req, 0, sizeof(client->req));
+
+    if (will) {
+        sim.stats.wills++;
+        if (sim.observer) {
+            sim.observer(sim.observer_arg, client->will_topic, (const uint8_t *)client->will_msg, client->will_msg_len);
+        }
+    }
+}
+
+err_t mqtt_client_connect(mqtt_client_t *client, __unused const ip_addr_t *ipaddr,
+    __unused u16_t port, mqtt_connection_cb_t cb, void *arg,
+    const struct mqtt_connect_client_info_t *client_info) {
+    if (client->conn_state != SIM_CONN_DISCONNECTED) return ERR_ISCONN;
+
+    sim.stats.connects++;
+    if (sim.mode == SIM_BROKER_UNREACHABLE) return ERR_RTE;
+
+    // Client handles are static in the firmware, so a pointer identifies the client for good
+    size_t i;
+    for (i = 0; i < sim.client_count && sim.clients[i] != client; i++) {
+    }
+    if (i == sim.client_count) {
+        if (sim.client_count == SIM_LWIP_MAX_CLIENTS) return ERR_MEM;
+        sim.clients[sim.client_count++] = client;
+    }
+
+    memset(client->req, 0, sizeof(client->req));
+    client->mode = (u8_t)sim.mode;
+    client->connect_cb = cb;
+    client->connect_arg = arg;
+    client->will_topic[0] = '\0';
+    client->will_msg_len = 0;
+    if (client_info && client_info->will_topic && client_info->will_msg) {
+        // A length of 0 takes the length of the string, as in lwIP
+        size_t len = client_info->will_msg_len ? client_info->will_msg_len : strlen(client_info->will_msg);
+        if (len > sizeof(client->will_msg)) return ERR_VAL;
+
+        snprintf(client->will_topic, sizeof(client->will_topic), "%s", client_info->will_topic);
+        memcpy(client->will_msg, client_info->will_msg, len);
+        client->will_msg_len = (u8_t)len;
+    }
+    client->conn_state = SIM_CONN_TCP_CONNECTING;
+    client->event_us = sim.mode == SIM_BROKER_NO_ANSWER ? UINT64_MAX : after_ms(sim.connect_ms);
+    return ERR_OK;
+}
+
+void mqtt_disconnect(mqtt_client_t *client) {
+    if (client->conn_state == SIM_CONN_DISCONNECTED) return;
+
+    // Closed by the client, lwIP does not call the connection callback
+    sim.stats.disconnects++;
+    close_connection(client);
+}
+
+u8_t mqtt_client_is_connected(mqtt_client_t *client) {
+    return client->conn_state == SIM_CONN_CONNECTED;
+}
+
+void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb,
+    mqtt_incoming_data_cb_t data_cb, void *arg) {
+    client->pub_cb = pub_cb;
+    client->data_cb = data_cb;
+    client->inpub_arg = arg;
+}
+
+// Takes a request slot, answered after a round trip or timed out when the broker stays silent
+static err_t add_request(mqtt_client_t *client, u8_t qos, u8_t publish, mqtt_request_cb_t cb, void *arg) {
+    for (size_t i = 0; i < MQTT_REQ_MAX_IN_FLIGHT; i++) {
+        sim_mqtt_request_t *req = &client->req[i];
+        if (req->used) continue;
+
+        req->used = 1;
+        req->publish = publish && qos > 0;
+        req->cb = cb;
+        req->arg = arg;
+        if (qos == 0) {
+            // Completed once written to TCP
+            req->done_us = time_us_64();
+            req->err = ERR_OK;
+        } else if (sim.acks) {
+            req->done_us = after_ms(sim.rtt_ms);
+            req->err = ERR_OK;
+        } else {
+            req->done_us = after_ms(MQTT_REQ_TIMEOUT * 1000);
+            req->err = ERR_TIMEOUT;
+        }
+        return ERR_OK;
+    }
+
+    return ERR_MEM;
+}
+
+err_t mqtt_sub_unsub(mqtt_client_t *client, __unused const char *topic, u8_t qos,
+    mqtt_request_cb_t cb, void *arg, u8_t sub) {
+    if (client->conn_state == SIM_CONN_DISCONNECTED) return ERR_CONN;
+
+    err_t err = add_request(client, qos > 0 ? qos : 1, 0, cb, arg);
+    if (err == ERR_OK) {
+        if (sub) {
+            sim.stats.subscribes++;
+        } else {
+            sim.stats.unsubscribes++;
+        }
+    }
+    return err;
+}
+
+err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length,
+    u8_t qos, __unused u8_t retain, mqtt_request_cb_t cb, void *arg) {
+    if (client->conn_state == SIM_CONN_DISCONNECTED) return ERR_CONN;
+
+    // Fixed header, topic, packet id and payload must fit the output ring
+    if (5 + strlen(topic) + 2 + payload_length > MQTT_OUTPUT_RINGBUF_SIZE) return ERR_MEM;
+
+    err_t err = add_request(client, qos, 1, cb, arg);
+    if (err != ERR_OK) return err;
+
+    sim.stats.publishes++;
+    if (sim.observer) {
+        sim.observer(sim.observer_arg, topic, (const uint8_t *)payload, payload_length);
+    }
+    return ERR_OK;
+}
+
+void sim_broker_drop(void) {
+    for (size_t i = 0; i < sim.client_count; i++) {
+        mqtt_client_t *client = sim.clients[i];
+        if (client->conn_state == SIM_CONN_DISCONNECTED) continue;
+
+        sim.stats.drops++;
+        close_connection(client);
+        if (client->connect_cb) {
+            client->connect_cb(client, client->connect_arg, MQTT_CONNECT_DISCONNECTED);
+        }
+    }
+}
+
+void sim_broker_publish(const char *topic, const uint8_t *payload, size_t len) {
+    for (size_t i = 0; i < sim.client_count; i++) {
+        mqtt_client_t *client = sim.clients[i];
+        if (client->conn_state != SIM_CONN_CONNECTED || !client->pub_cb || !client->data_cb) continue;
+
+        client->pub_cb(client->inpub_arg, topic, (u32_t)len);
+        client->data_cb(client->inpub_arg, payload, (u16_t)len, MQTT_DATA_FLAG_LAST);
+    }
+}
+
+// Advances the connection of one client by the steps that are due
+static void poll_connection(mqtt_client_t *client, uint64_t now) {
+    if (client->event_us > now) return;
+
+    switch (client->conn_state) {
+    case SIM_CONN_TCP_CONNECTING:
+        // lwIP sends CONNECT as soon as TCP and TLS are up
+        client->conn_state = SIM_CONN_MQTT_CONNECTING;
+        client->event_us = client->mode == SIM_BROKER_NO_CONNACK ? UINT64_MAX : now + (uint64_t)sim.rtt_ms * 1000;
+        break;
+
+    case SIM_CONN_MQTT_CONNECTING:
+        sim.stats.connacks++;
+        client->event_us = UINT64_MAX;
+        if (client->mode == SIM_BROKER_REFUSE) {
+            client->connect_cb(client, client->connect_arg, MQTT_CONNECT_REFUSED_NOT_AUTHORIZED_);
+
+            // The broker closes the connection after a refusal, unless the client already did
+            if (client->conn_state != SIM_CONN_DISCONNECTED) {
+                sim.stats.drops++;
+                close_connection(client);
+                client->connect_cb(client, client->connect_arg, MQTT_CONNECT_DISCONNECTED);
+            }
+        } else {
+            client->conn_state = SIM_CONN_CONNECTED;
+            client->connect_cb(client, client->connect_arg, MQTT_CONNECT_ACCEPTED);
+        }
+        break;
+
+    default:
+        client->event_us = UINT64_MAX;
+        break;
+    }
+}
+
+static void poll_requests(mqtt_client_t *client, uint64_t now) {
+    for (size_t i = 0; i < MQTT_REQ_MAX_IN_FLIGHT; i++) {
+        sim_mqtt_request_t *req = &client->req[i];
+        if (!req->used || req->done_us > now) continue;
+
+        // Free the slot first, the callback may take it for the next request
+        mqtt_request_cb_t cb = req->cb;
+        void *arg = req->arg;
+        err_t err = req->err;
+        bool puback = req->publish && err == ERR_OK;
+        req->used = 0;
+
+        if (puback) sim.stats.pubacks++;
+        if (cb) cb(arg, err);
+    }
+}
+
+void sim_lwip_poll(void) {
+    uint64_t now = time_us_64();
+
+    for (size_t i = 0; i < SIM_LWIP_MAX_LOOKUPS; i++) {
+        sim_lookup_t *lookup = &sim.lookups[i];
+        if (!lookup->used || lookup->done_us > now) continue;
+
+        lookup->used = false;
+        if (lookup->ok) {
+            ip_addr_t addr;
+            ipaddr_aton(SIM_LWIP_BROKER_IP, &addr);
+            lookup->found(lookup->name, &addr, lookup->arg);
+        } else {
+            lookup->found(lookup->name, NULL, lookup->arg);
+        }
+    }
+
+    for (size_t i = 0; i < sim.client_count; i++) {
+        mqtt_client_t *client = sim.clients[i];
+        poll_connection(client, now);
+        if (client->conn_state != SIM_CONN_DISCONNECTED) {
+            poll_requests(client, now);
+        }
+    }
+}
+
+uint64_t sim_lwip_next_event_us(void) {
+    uint64_t next = UINT64_MAX;
+
+    for (size_t i = 0; i < SIM_LWIP_MAX_LOOKUPS; i++) {
+        if (sim.lookups[i].used && sim.lookups[i].done_us < next) next = sim.lookups[i].done_us;
+    }
+
+    for (size_t i = 0; i < sim.client_count; i++) {
+        mqtt_client_t *client = sim.clients[i];
+        if (client->conn_state == SIM_CONN_DISCONNECTED) continue;
+
+        if (client->event_us < next) next = client->event_us;
+        for (size_t i = 0; i < MQTT_REQ_MAX_IN_FLIGHT; i++) {
+            if (client->req[i].used && client->req[i].done_us < next) next = client->req[i].done_us;
+        }
+    }
+
+    return next;
+}
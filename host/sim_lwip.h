@@ -0,0 +1,108 @@
+#ifndef SIM_LWIP_H
+#define SIM_LWIP_H
+
+// Simulated network for the host tests. Serves the MQTT client and DNS API of lwIP from an
+// in-process broker and resolver, without sockets, on whatever clock time_us_64 reads, so a
+// test on host_set_clock decides when every answer arrives. The headers in sim_lwip/include
+// replace lwIP's, and the firmware modules are built with MQTT_NO_TLS against them.
+//
+// Nothing happens on its own: sim_lwip_poll delivers the answers that are due, as
+// cyw43_arch_poll does on the board.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SIM_LWIP_BROKER_IP      "192.168.1.10"      // address the resolver answers with
+#define SIM_LWIP_DEVICE_IP      "192.168.1.200"
+#define SIM_LWIP_MAX_LOOKUPS    4
+#ifndef SIM_LWIP_MAX_CLIENTS
+#define SIM_LWIP_MAX_CLIENTS    8
+#endif
+
+/**
+ * @brief How the broker answers new connections. A connection keeps the mode it started with.
+ */
+typedef enum {
+    SIM_BROKER_ACCEPT,          // TCP and TLS up after connect_ms, CONNACK one round trip later
+    SIM_BROKER_REFUSE,          // CONNACK refuses the client as not authorized, then the broker closes
+    SIM_BROKER_NO_ANSWER,       // SYNs are dropped, the TCP connect never completes
+    SIM_BROKER_NO_CONNACK,      // TCP and TLS come up, the CONNECT is never answered
+    SIM_BROKER_UNREACHABLE      // no route, mqtt_client_connect fails at once
+} sim_broker_mode_t;
+
+typedef enum {
+    SIM_DNS_CACHED,             // dns_gethostbyname returns the address at once
+    SIM_DNS_ANSWER,             // the address arrives after the delay
+    SIM_DNS_NOT_FOUND,          // the lookup fails after the delay
+    SIM_DNS_NO_ANSWER           // the resolver never answers
+} sim_dns_mode_t;
+
+/**
+ * @brief Called for every publish the broker receives, before its PUBACK, and for the will of
+ * every connection that closes without a DISCONNECT.
+ */
+typedef void (*sim_broker_observer_t)(void *arg, const char *topic, const uint8_t *payload, size_t len);
+
+typedef struct {
+    uint32_t connects;          // calls to mqtt_client_connect, refused ones included
+    uint32_t connacks;          // CONNECTs the broker answered, refusals included
+    uint32_t disconnects;       // connections closed by the client
+    uint32_t drops;             // connections closed by the broker
+    uint32_t publishes;
+    uint32_t pubacks;           // publishes of QoS 1 the broker acknowledged
+    uint32_t subscribes;
+    uint32_t unsubscribes;
+    uint32_t lookups;
+    uint32_t wills;             // wills the broker published
+} sim_lwip_stats_t;
+
+/**
+ * @brief Forgets every connection and lookup and goes back to an accepting broker, a cached
+ * name, 50 ms to connect and a 20 ms round trip.
+ */
+void sim_lwip_reset(void);
+
+void sim_broker_set_mode(sim_broker_mode_t mode);
+
+/**
+ * @brief Sets the time from mqtt_client_connect until TCP and TLS are up, and the round trip
+ * of every MQTT exchange after that.
+ */
+void sim_broker_set_timing(uint32_t connect_ms, uint32_t rtt_ms);
+
+/**
+ * @brief With acks off the broker takes publishes and subscriptions without answering, and
+ * lwIP completes them with ERR_TIMEOUT after MQTT_REQ_TIMEOUT seconds.
+ */
+void sim_broker_set_acks(bool acks);
+
+void sim_broker_set_observer(sim_broker_observer_t observer, void *arg);
+
+/**
+ * @brief Closes every connection from the broker side, as when the link goes away.
+ * Clients see MQTT_CONNECT_DISCONNECTED and their requests are dropped without completion.
+ * The broker publishes the will of every connection it had accepted.
+ */
+void sim_broker_drop(void);
+
+/**
+ * @brief Delivers a publish to every connected client, in one fragment.
+ */
+void sim_broker_publish(const char *topic, const uint8_t *payload, size_t len);
+
+void sim_dns_set_mode(sim_dns_mode_t mode, uint32_t delay_ms);
+
+/**
+ * @brief Delivers every connection step, answer, timeout and DNS result that is due.
+ */
+void sim_lwip_poll(void);
+
+/**
+ * @brief Returns the time of the next pending event. UINT64_MAX if nothing is pending.
+ */
+uint64_t sim_lwip_next_event_us(void);
+
+void sim_lwip_get_stats(sim_lwip_stats_t *stats);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_SIM_LWIP_ALTCP_TLS_H
+#define HOST_SIM_LWIP_ALTCP_TLS_H
+
+// The simulated network has no TLS, the firmware is built with MQTT_NO_TLS against it
+
+#endif
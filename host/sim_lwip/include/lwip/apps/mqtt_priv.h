@@ -0,0 +1,34 @@
+#ifndef HOST_SIM_LWIP_MQTT_PRIV_H
+#define HOST_SIM_LWIP_MQTT_PRIV_H
+
+#include <stdint.h>
+
+#include "lwip/apps/mqtt.h"
+
+// A request waiting for its answer from the simulated broker
+typedef struct {
+    mqtt_request_cb_t cb;
+    void *arg;
+    uint64_t done_us;           // time of the answer, or of the timeout
+    err_t err;                  // result at done_us
+    u8_t used;
+    u8_t publish;
+} sim_mqtt_request_t;
+
+// The client state is simulated, so only host/sim_lwip.c reads these fields
+struct mqtt_client_s {
+    u8_t conn_state;
+    u8_t mode;                  // sim_broker_mode_t the connection started with
+    uint64_t event_us;          // next step of the connection
+    mqtt_connection_cb_t connect_cb;
+    void *connect_arg;
+    mqtt_incoming_publish_cb_t pub_cb;
+    mqtt_incoming_data_cb_t data_cb;
+    void *inpub_arg;
+    sim_mqtt_request_t req[MQTT_REQ_MAX_IN_FLIGHT];
+    char will_topic[64];        // empty without a will
+    char will_msg[255];
+    u8_t will_msg_len;
+};
+
+#endif
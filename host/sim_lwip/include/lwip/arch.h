@@ -0,0 +1,16 @@
+#ifndef HOST_SIM_LWIP_ARCH_H
+#define HOST_SIM_LWIP_ARCH_H
+
+// Types of lwIP's port layer, for the simulated network in host/sim_lwip.c
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef HOST_SIM_LWIP_DNS_H
+#define HOST_SIM_LWIP_DNS_H
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+/**
+ * @brief Resolves a name like lwIP. ERR_OK with the address filled in for a cached name,
+ * ERR_INPROGRESS when found is called later, from sim_lwip_poll.
+ */
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg);
+
+#endif
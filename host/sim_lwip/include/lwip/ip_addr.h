@@ -0,0 +1,16 @@
+#ifndef HOST_SIM_LWIP_IP_ADDR_H
+#define HOST_SIM_LWIP_IP_ADDR_H
+
+#include "lwip/arch.h"
+
+// IPv4 only, in network byte order like lwIP
+typedef struct {
+    u32_t addr;
+} ip_addr_t;
+
+typedef ip_addr_t ip4_addr_t;
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
+int ipaddr_aton(const char *cp, ip_addr_t *addr);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_SIM_LWIP_NETIF_H
+#define HOST_SIM_LWIP_NETIF_H
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+struct netif {
+    struct netif *next;
+    ip_addr_t ip_addr;
+};
+
+extern struct netif *netif_list;
+
+#endif
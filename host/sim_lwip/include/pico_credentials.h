@@ -0,0 +1,11 @@
+#ifndef PICO_CREDENTIALS_H
+#define PICO_CREDENTIALS_H
+
+// Credentials of the simulated network, the host tests never reach a real access point or broker
+
+#define DEVICE_MODEL "PICO_W_SIM"
+
+#define WIFI_SSID "sim-network"
+#define WIFI_PASS "sim-password"
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_SIM_MBEDTLS_SHA256_H
+#define HOST_SIM_MBEDTLS_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The SHA-256 calls of mbedTLS that pico_ota.c makes, for host tests built without the SDK.
+// Implemented by host/sim_mbedtls.c. SHA-224 is not supported, is224 must be 0.
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t total;             // bytes fed so far
+    uint8_t block[64];
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]);
+
+#endif
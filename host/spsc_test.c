@@ -0,0 +1,151 @@
+// Runs the sample queue between two threads, as between the two cores, and checks that every
+// sample arrives once, whole and in order, then reports the throughput. The producer retries
+// a push on a full ring, so nothing may be lost. With -d it drops the sample instead, as the
+// acquisition core does, and the samples that arrive plus the dropped counter must add up to
+// the pushes.
+//
+//     ./spsc_test                         # 10 million samples
+//     ./spsc_test -n 100000000 -d
+//
+// A side that finds the ring full or empty yields, so the test also runs on a single CPU.
+// Prints the checks and the rate on this host, exits non-zero on a failure.
+
+#include "pico_spsc.h"
+#include "pico/time.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_DEFAULT_SAMPLES    10000000
+
+typedef struct {
+    spsc_queue_t queue;
+    uint32_t samples;
+    uint8_t drop;
+    uint32_t full;          // pushes refused by a full ring, producer side
+    uint32_t received;      // consumer side
+    uint32_t out_of_order;
+    uint32_t torn;
+} test_t;
+
+// Every field carries the sequence number, a torn copy shows up as a mismatch
+static void make_sample(sample_t *sample, uint32_t seq) {
+    sample->temperature = (int32_t)seq;
+    sample->humidity = ~seq;
+    sample->pressure = seq * 2654435761u;
+    sample->sensor = (uint16_t)seq;
+    sample->time_ms = (uint16_t)(seq >> 16);
+    sample->time = seq ^ 0x5A5A5A5Au;
+}
+
+static uint8_t sample_matches(const sample_t *sample, uint32_t seq) {
+    sample_t want;
+    make_sample(&want, seq);
+    return sample->temperature == want.temperature && sample->humidity == want.humidity &&
+        sample->pressure == want.pressure && sample->sensor == want.sensor &&
+        sample->time_ms == want.time_ms && sample->time == want.time;
+}
+
+static void *producer(void *arg) {
+    test_t *test = arg;
+    sample_t sample;
+
+    for (uint32_t seq = 0; seq < test->samples; seq++) {
+        make_sample(&sample, seq);
+        while (spsc_push(&test->queue, &sample) != 0) {
+            test->full++;
+            sched_yield();
+            if (test->drop) break;
+        }
+    }
+
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    test_t *test = arg;
+    sample_t sample;
+    uint32_t next = 0;
+
+    // The last sample may have been dropped, stop once the producer is done and the ring is empty
+    while (next < test->samples) {
+        if (spsc_pop(&test->queue, &sample) != 0) {
+            if (test->drop && atomic_load_explicit(&test->queue.head, memory_order_acquire) == test->received &&
+                test->received + atomic_load_explicit(&test->queue.dropped, memory_order_relaxed) == test->samples) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        uint32_t seq = (uint32_t)sample.temperature;
+        if (!sample_matches(&sample, seq)) {
+            test->torn++;
+        } else if (test->drop ? seq < next : seq != next) {
+            test->out_of_order++;
+        }
+        next = seq + 1;
+        test->received++;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    static test_t test;
+    uint32_t samples = TEST_DEFAULT_SAMPLES;
+    uint8_t drop = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d")) != -1) {
+        switch (opt) {
+        case 'n':
+            samples = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            drop = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples] [-d]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (samples == 0) {
+        fprintf(stderr, "samples must be > 0\n");
+        return 1;
+    }
+
+    spsc_init(&test.queue);
+    test.samples = samples;
+    test.drop = drop;
+
+    pthread_t threads[2];
+    uint64_t start_us = time_us_64();
+    if (pthread_create(&threads[0], NULL, consumer, &test) != 0 ||
+        pthread_create(&threads[1], NULL, producer, &test) != 0) {
+        fprintf(stderr, "unable to start the threads\n");
+        return 1;
+    }
+    pthread_join(threads[1], NULL);
+    pthread_join(threads[0], NULL);
+    uint64_t elapsed_us = time_us_64() - start_us;
+
+    uint32_t dropped = (uint32_t)atomic_load_explicit(&test.queue.dropped, memory_order_relaxed);
+    uint32_t lost = drop ? samples - test.received - dropped : samples - test.received;
+    uint8_t failed = test.torn != 0 || test.out_of_order != 0 || lost != 0 || dropped != test.full ||
+        spsc_count(&test.queue) != 0;
+
+    printf("samples:     %lu pushed, %lu received, %lu refused by a full ring%s\n", (unsigned long)samples,
+        (unsigned long)test.received, (unsigned long)test.full, drop ? " and dropped" : " and retried");
+    printf("checks:      %lu torn, %lu out of order, %lu lost, dropped counter %lu\n", (unsigned long)test.torn,
+        (unsigned long)test.out_of_order, (unsigned long)lost, (unsigned long)dropped);
+    printf("throughput:  %.1f million samples/s, %.1f ns per sample\n",
+        elapsed_us ? test.received / (double)elapsed_us : 0.0, test.received ? elapsed_us * 1000.0 / test.received : 0.0);
+    printf("spsc_test: %s\n", failed ? "FAILED" : "passed");
+
+    return failed;
+}
@@ -0,0 +1,170 @@
+// Runs the sample store on a simulated flash region through repeated outages and measures the
+// append and replay rates and the wear of every sector. Each cycle the device is offline for
+// -o samples, which are appended, then reconnects and drains the backlog in batches of
+// STORE_DRAIN_BATCH with store_peek and store_consume as main.c does. With -r the store is
+// mounted again before every replay, as after a reboot during the outage.
+//
+//     ./store_bench                       # the firmware region, 1000 outages of 500 samples
+//     ./store_bench -s 8 -o 2000 -r       # a small region that overflows, with reboots
+//
+// Reports the rates on this host, the flash traffic per sample and the erase count of every
+// sector. An even ring leaves the lowest and highest counts at most one apart.
+
+#include "pico_store.h"
+#include "sim_flash.h"
+#include "pico/time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_SECTORS   (FLASH_STORE_SIZE / FLASH_DEV_SECTOR_SIZE)
+#define BENCH_DEFAULT_CYCLES    1000
+#define BENCH_DEFAULT_OUTAGE    500     // samples per outage, 40 minutes at DEVICE_POLLING_MS
+#define BENCH_HISTOGRAM_WIDTH   50
+
+static void make_sample(sample_t *sample, uint32_t seq) {
+    memset(sample, 0, sizeof(*sample));
+    sample->temperature = 2150 + (int32_t)(seq % 200) - 100;
+    sample->humidity = 4520 + seq % 50;
+    sample->pressure = 101325 - seq % 300;
+    sample->sensor = (uint16_t)(seq % 4);
+    sample_set_time(sample, 1700000000000000ull + (uint64_t)seq * 5000000ull);
+}
+
+int main(int argc, char **argv) {
+    uint32_t sectors = BENCH_DEFAULT_SECTORS;
+    uint32_t cycles = BENCH_DEFAULT_CYCLES;
+    uint32_t outage = BENCH_DEFAULT_OUTAGE;
+    uint8_t remount = 0;
+    uint8_t verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:c:o:rv")) != -1) {
+        switch (opt) {
+        case 's':
+            sectors = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            cycles = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            outage = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            remount = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-s sectors] [-c cycles] [-o samples per outage] [-r] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (sectors < 2 || cycles == 0 || outage == 0) {
+        fprintf(stderr, "at least 2 sectors, cycles and outage > 0\n");
+        return 1;
+    }
+
+    flash_dev_t dev;
+    if (sim_flash_init(&dev, sectors * FLASH_DEV_SECTOR_SIZE, NULL) != 0 || store_init(&dev) != 0) {
+        fprintf(stderr, "unable to mount the store\n");
+        return 1;
+    }
+
+    sample_t batch[STORE_DRAIN_BATCH];
+    uint32_t seq = 0;
+    uint32_t expected = 0;          // sequence of the next sample the replay should return
+    uint64_t appended = 0;
+    uint64_t replayed = 0;
+    uint64_t lost = 0;
+    uint64_t mismatched = 0;
+    uint64_t append_us = 0;
+    uint64_t replay_us = 0;
+    uint64_t mount_us = 0;
+
+    for (uint32_t cycle = 0; cycle < cycles; cycle++) {
+        uint64_t start_us = time_us_64();
+        for (uint32_t i = 0; i < outage; i++) {
+            sample_t sample;
+            make_sample(&sample, seq++);
+            if (store_append(&sample) != 0) {
+                fprintf(stderr, "append failed\n");
+                return 1;
+            }
+        }
+        appended += outage;
+        append_us += time_us_64() - start_us;
+
+        if (remount) {
+            start_us = time_us_64();
+            if (store_init(&dev) != 0) {
+                fprintf(stderr, "remount failed\n");
+                return 1;
+            }
+            mount_us += time_us_64() - start_us;
+        }
+
+        // Samples overwritten by a full ring are skipped, the oldest survivor comes first
+        uint32_t pending = store_pending();
+        lost += (seq - expected) - pending;
+        expected = seq - pending;
+
+        start_us = time_us_64();
+        size_t count;
+        while ((count = store_peek(batch, STORE_DRAIN_BATCH)) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                sample_t want;
+                make_sample(&want, expected++);
+                if (memcmp(&want, &batch[i], sizeof(want)) != 0) mismatched++;
+            }
+            store_consume(count);
+            replayed += count;
+        }
+        replay_us += time_us_64() - start_us;
+    }
+
+    store_stats_t stats;
+    sim_flash_stats_t flash;
+    store_get_stats(&stats);
+    sim_flash_get_stats(&dev, &flash);
+
+    printf("region:      %lu sectors of %d bytes, %lu records each\n", (unsigned long)sectors,
+        FLASH_DEV_SECTOR_SIZE, (unsigned long)(FLASH_DEV_SECTOR_SIZE / STORE_RECORD_SIZE - 1));
+    printf("cycles:      %lu outages of %lu samples%s\n", (unsigned long)cycles, (unsigned long)outage,
+        remount ? ", mounted again before every replay" : "");
+    printf("append:      %llu samples, %.2f us per sample\n", (unsigned long long)appended,
+        appended ? (double)append_us / appended : 0.0);
+    printf("replay:      %llu samples, %.2f us per sample, %.0f samples/s\n", (unsigned long long)replayed,
+        replayed ? (double)replay_us / replayed : 0.0, replay_us ? replayed * 1e6 / replay_us : 0.0);
+    if (remount) {
+        printf("mount:       %.1f us per mount\n", (double)mount_us / cycles);
+    }
+    printf("integrity:   %llu lost to a full ring, %llu mismatched\n", (unsigned long long)lost,
+        (unsigned long long)mismatched);
+    printf("flash:       %.3f pages programmed and %.1f bytes read per sample\n",
+        (double)flash.pages_programmed / appended, (double)flash.bytes_read / appended);
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < sectors; i++) {
+        total += sim_flash_erase_count(&dev, i);
+    }
+    printf("wear:        %llu erases, per sector min %lu  mean %.1f  max %lu\n", (unsigned long long)total,
+        (unsigned long)flash.min_erase, (double)total / sectors, (unsigned long)flash.max_erase);
+
+    if (verbose) {
+        for (uint32_t i = 0; i < sectors; i++) {
+            uint32_t count = sim_flash_erase_count(&dev, i);
+            int bar = flash.max_erase ? (int)((uint64_t)count * BENCH_HISTOGRAM_WIDTH / flash.max_erase) : 0;
+            printf("  sector %3lu %6lu %.*s\n", (unsigned long)i, (unsigned long)count, bar,
+                "##################################################");
+        }
+    }
+
+    sim_flash_deinit(&dev);
+
+    return mismatched != 0 || flash.max_erase - flash.min_erase > 1;
+}
@@ -0,0 +1,133 @@
+// Measures the TLS handshake time and the peak use of the mbedTLS arena for the mbedTLS
+// profile this build was configured with (TLS_PROFILE in CMake). Connects to the broker
+// over and over through the firmware's pico_mqtt module. The first connection makes a full
+// handshake and the others resume the cached session, unless -f forces full handshakes.
+//
+// Runs on the same TAP interface as mqtt_bench:
+//
+//     PRECONFIGURED_TAPIF=tap0 ./tls_bench -n 50
+//
+// scripts/tls_profiles.sh builds every profile and adds the code size of the mbedTLS libraries.
+
+#include "pico_mqtt.h"
+#include "pico_wifi.h"
+#include "pico/stdlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_COUNT     20
+#define BENCH_CLOSE_MS          100     // lets the broker see the FIN before the next connection
+
+#ifndef TLS_PROFILE_NAME
+#define TLS_PROFILE_NAME        "full"
+#endif
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned int pct) {
+    if (n == 0) return 0;
+    return sorted[(n - 1) * pct / 100];
+}
+
+static void print_times(const char *name, uint32_t *us, size_t n) {
+    qsort(us, n, sizeof(*us), cmp_u32);
+    printf("%-12s %zu, ms p50 %.1f  p90 %.1f  max %.1f\n", name, n,
+        percentile(us, n, 50) / 1000.0, percentile(us, n, 90) / 1000.0, n ? us[n - 1] / 1000.0 : 0.0);
+}
+
+static void poll_for(uint32_t ms) {
+    absolute_time_t until = make_timeout_time_ms(ms);
+
+    while (absolute_time_diff_us(get_absolute_time(), until) > 0) {
+        cyw43_arch_poll();
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = BENCH_DEFAULT_COUNT;
+    bool always_full = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            always_full = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n connections] [-f]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    uint32_t *full_us = calloc(count, sizeof(*full_us));
+    uint32_t *resumed_us = calloc(count, sizeof(*resumed_us));
+    if (count == 0 || !full_us || !resumed_us) return 1;
+
+    if (wifi_init() != WIFI_STATUS_CONNECTED) {
+        fprintf(stderr, "unable to bring up the TAP interface\n");
+        return 1;
+    }
+
+    size_t full = 0;
+    size_t resumed = 0;
+    MQTT_tls_stats_t stats;
+
+    for (size_t i = 0; i < count; i++) {
+        MQTT_client_handle_t handle = NULL;
+
+        if (always_full) MQTT_tls_forget_session();
+        MQTT_tls_stats(&stats);
+        uint32_t full_before = stats.full_handshakes;
+        uint64_t start = time_us_64();
+
+        if (MQTT_open(&handle) != 0) {
+            fprintf(stderr, "unable to create the MQTT client\n");
+            return 1;
+        }
+
+        // A failed attempt is not retried, the backoff would only distort the times
+        MQTT_state_t state;
+        while ((state = MQTT_process(handle)) != MQTT_STATE_CONNECTED) {
+            if (state == MQTT_STATE_BACKOFF) {
+                fprintf(stderr, "unable to connect to %s\n", MQTT_SERVER);
+                return 1;
+            }
+            cyw43_arch_poll();
+        }
+
+        uint32_t elapsed_us = (uint32_t)(time_us_64() - start);
+
+        MQTT_tls_stats(&stats);
+        if (stats.full_handshakes != full_before) {
+            full_us[full++] = elapsed_us;
+        } else {
+            resumed_us[resumed++] = elapsed_us;
+        }
+
+        MQTT_close(handle);
+        poll_for(BENCH_CLOSE_MS);
+    }
+
+    if (MQTT_tls_stats(&stats) != 0) {
+        fprintf(stderr, "built without TLS\n");
+        return 1;
+    }
+
+    printf("profile:     %s\n", TLS_PROFILE_NAME);
+    print_times("full:", full_us, full);
+    print_times("resumed:", resumed_us, resumed);
+    printf("arena:       peak %lu of %d bytes, %lu in use when idle, %lu failed\n",
+        (unsigned long)stats.arena_peak, MQTT_TLS_ARENA_SIZE, (unsigned long)stats.arena_used,
+        (unsigned long)stats.arena_failed);
+
+    return stats.arena_failed != 0;
+}
@@ -0,0 +1,64 @@
+// Turns the spans dumped by trace_dump into Chrome trace JSON, one complete event per span
+// with the core as the thread. Open the output in chrome://tracing or ui.perfetto.dev.
+// Lines that are not spans, like the log of the firmware, are ignored.
+//
+//     ./trace_json < capture.txt > trace.json
+
+#include "pico_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_JSON_LINE_MAX_LEN 256
+#define TRACE_JSON_CORES        2
+
+// Names are literals of the firmware, quotes and control characters are escaped anyway
+static void put_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+int main(void) {
+    char line[TRACE_JSON_LINE_MAX_LEN];
+    unsigned long spans = 0;
+    unsigned long malformed = 0;
+
+    printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (unsigned int core = 0; core < TRACE_JSON_CORES; core++) {
+        printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"core %u\"}},\n", core, core);
+    }
+
+    while (fgets(line, sizeof(line), stdin)) {
+        unsigned int core;
+        unsigned long long start_us;
+        unsigned long duration_us;
+        int name_pos = 0;
+
+        if (line[0] != TRACE_LINE_PREFIX) continue;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (sscanf(&line[1], "%u %llu %lu %n", &core, &start_us, &duration_us, &name_pos) != 3 || name_pos == 0) {
+            malformed++;
+            continue;
+        }
+
+        printf("%s{\"name\":", spans++ ? ",\n" : "");
+        put_json_string(&line[1 + name_pos]);
+        printf(",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%llu,\"dur\":%lu}", core, start_us, duration_us);
+    }
+
+    // The metadata events end with a comma, an empty object closes the list without spans
+    printf("%s]}\n", spans ? "\n" : "{}\n");
+
+    fprintf(stderr, "%lu spans, %lu malformed lines\n", spans, malformed);
+    return spans == 0;
+}
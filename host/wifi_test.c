@@ -0,0 +1,183 @@
+// Drives the Wi-Fi layer of pico_wifi.c against the simulated access point of sim_cyw43.c on
+// a simulated clock: the first join in wifi_init, background rejoins after the link is lost,
+// direct joins to the cached BSSID and channel, the fallback to a scan when the access point
+// moved to another channel, an access point that is gone and a join that times out in DHCP.
+//
+//     ./wifi_test
+//
+// wifi_check_connection is called every 10 ms like the main loop does and must never block.
+// Prints every failed check, exits non-zero if any.
+
+#include "pico_wifi.h"
+#include "sim_cyw43.h"
+#include "sim_lwip.h"
+#include "pico/time.h"
+
+#include <stdio.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_STEP_MS        10
+#define TEST_SCAN_MS        2500
+#define TEST_DIRECT_MS      300
+#define TEST_DHCP_MS        200
+
+static uint64_t sim_clock_us;
+static uint32_t failures;
+
+static uint64_t sim_now_us(void) {
+    return sim_clock_us;
+}
+
+static void sim_wait(uint64_t until_us) {
+    if (until_us > sim_clock_us) sim_clock_us = until_us;
+}
+
+// Checks the connection every TEST_STEP_MS until a join has finished. Returns the milliseconds
+// it took, -1 if limit_ms passed first. A call that blocked counts as a failed check.
+static int64_t run_until_up(uint32_t limit_ms) {
+    sim_cyw43_stats_t before, after;
+    uint64_t start_us = sim_clock_us;
+    int64_t elapsed_ms = -1;
+
+    sim_cyw43_get_stats(&before);
+    while (sim_clock_us - start_us <= (uint64_t)limit_ms * 1000) {
+        uint64_t call_us = sim_clock_us;
+        PICO_WIFI_STATUS status = wifi_check_connection();
+        CHECK(sim_clock_us == call_us);
+
+        if (status == WIFI_STATUS_RE_CONNECTED) {
+            elapsed_ms = (int64_t)((sim_clock_us - start_us) / 1000);
+            break;
+        }
+        CHECK(status == WIFI_STATUS_NOT_CONNECTED);
+        sim_clock_us += TEST_STEP_MS * 1000;
+    }
+
+    sim_cyw43_get_stats(&after);
+    CHECK(after.waits == before.waits);
+    return elapsed_ms;
+}
+
+static void test_init(void) {
+    wifi_stats_t stats;
+    sim_cyw43_stats_t sim;
+
+    // Nothing is cached yet, the first join scans. wifi_init is the one call that blocks.
+    CHECK(wifi_init() == WIFI_STATUS_CONNECTED);
+    wifi_get_stats(&stats);
+    sim_cyw43_get_stats(&sim);
+    CHECK(stats.joins == 1 && stats.direct_joins == 0 && stats.failed_joins == 0);
+    CHECK(stats.last_link_ms == TEST_SCAN_MS + TEST_DHCP_MS);
+    CHECK(sim.joins == 1 && sim.last_channel == CYW43_CHANNEL_NONE);
+    CHECK(sim.waits == (TEST_SCAN_MS + TEST_DHCP_MS) / WIFI_INIT_POLL_MS);
+    CHECK(cyw43_state.netif[CYW43_ITF_STA].ip_addr.addr != 0);
+    CHECK(wifi_check_connection() == WIFI_STATUS_CONNECTED);
+}
+
+static void test_rejoin(void) {
+    wifi_stats_t stats;
+    sim_cyw43_stats_t sim;
+
+    // The rejoin goes straight to the access point of the last join
+    sim_cyw43_drop();
+    CHECK(run_until_up(10000) == TEST_DIRECT_MS + TEST_DHCP_MS);
+    wifi_get_stats(&stats);
+    sim_cyw43_get_stats(&sim);
+    CHECK(stats.joins == 2 && stats.direct_joins == 1 && stats.failed_joins == 0);
+    CHECK(stats.last_link_ms == TEST_DIRECT_MS + TEST_DHCP_MS);
+    CHECK(stats.max_link_ms == TEST_SCAN_MS + TEST_DHCP_MS);
+    CHECK(sim.direct_joins == 1 && sim.last_channel == SIM_CYW43_CHANNEL);
+    CHECK(wifi_check_connection() == WIFI_STATUS_CONNECTED);
+}
+
+static void test_moved(void) {
+    wifi_stats_t before, after;
+    sim_cyw43_stats_t sim_before, sim_after;
+
+    // The direct join to the old channel fails, the next attempt scans and caches the new channel
+    wifi_get_stats(&before);
+    sim_cyw43_get_stats(&sim_before);
+    sim_cyw43_set_channel(11);
+    sim_cyw43_drop();
+    CHECK(run_until_up(10000) == TEST_DIRECT_MS + TEST_STEP_MS + TEST_SCAN_MS + TEST_DHCP_MS);
+    wifi_get_stats(&after);
+    sim_cyw43_get_stats(&sim_after);
+    CHECK(after.failed_joins == before.failed_joins + 1);
+    CHECK(after.joins == before.joins + 1 && after.direct_joins == before.direct_joins);
+    CHECK(sim_after.joins == sim_before.joins + 2 && sim_after.direct_joins == sim_before.direct_joins + 1);
+    CHECK(sim_after.leaves == sim_before.leaves + 1);
+    CHECK(sim_after.last_channel == CYW43_CHANNEL_NONE);
+
+    sim_cyw43_drop();
+    CHECK(run_until_up(10000) == TEST_DIRECT_MS + TEST_DHCP_MS);
+    sim_cyw43_get_stats(&sim_after);
+    CHECK(sim_after.last_channel == 11);
+}
+
+static void test_gone(void) {
+    wifi_stats_t before, after;
+    sim_cyw43_stats_t sim_before, sim_after;
+
+    // One direct join, then scans that all fail while the access point is away
+    wifi_get_stats(&before);
+    sim_cyw43_get_stats(&sim_before);
+    cyw43_host_set_link(false);
+    CHECK(run_until_up(60000) == -1);
+    wifi_get_stats(&after);
+    sim_cyw43_get_stats(&sim_after);
+
+    uint32_t joins = sim_after.joins - sim_before.joins;
+    uint32_t failed = after.failed_joins - before.failed_joins;
+    CHECK(joins >= 60000 / (TEST_SCAN_MS + TEST_STEP_MS));
+    CHECK(failed == joins || failed == joins - 1);
+    CHECK(sim_after.direct_joins == sim_before.direct_joins + 1);
+    CHECK(after.joins == before.joins);
+
+    // Back within the scan in progress and one more
+    cyw43_host_set_link(true);
+    int64_t elapsed_ms = run_until_up(10000);
+    CHECK(elapsed_ms > 0 && elapsed_ms <= 2 * (TEST_SCAN_MS + TEST_STEP_MS) + TEST_DHCP_MS);
+    CHECK(wifi_check_connection() == WIFI_STATUS_CONNECTED);
+}
+
+static void test_no_dhcp(void) {
+    wifi_stats_t before, after;
+    sim_cyw43_stats_t sim;
+
+    // The direct join associates but never gets an address, the next attempt scans
+    wifi_get_stats(&before);
+    sim_cyw43_set_mode(SIM_AP_NO_DHCP);
+    sim_cyw43_drop();
+    CHECK(wifi_check_connection() == WIFI_STATUS_NOT_CONNECTED);
+    sim_cyw43_set_mode(SIM_AP_UP);
+    CHECK(run_until_up(WIFI_CONNECT_TIMEOUT_MS + 10000) ==
+        WIFI_CONNECT_TIMEOUT_MS + TEST_STEP_MS + TEST_SCAN_MS + TEST_DHCP_MS);
+    wifi_get_stats(&after);
+    sim_cyw43_get_stats(&sim);
+    CHECK(after.failed_joins == before.failed_joins + 1);
+    CHECK(sim.last_channel == CYW43_CHANNEL_NONE);
+}
+
+int main(void) {
+    sim_clock_us = 1000000;
+    host_set_clock(sim_now_us);
+    sim_lwip_reset();
+    sim_cyw43_set_wait(sim_wait);
+    sim_cyw43_reset();
+    sim_cyw43_set_timing(TEST_SCAN_MS, TEST_DIRECT_MS, TEST_DHCP_MS);
+
+    test_init();
+    test_rejoin();
+    test_moved();
+    test_gone();
+    test_no_dhcp();
+
+    printf("wifi_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
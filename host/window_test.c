@@ -0,0 +1,254 @@
+// Checks the integer window aggregates against a double precision reference: min, max and
+// mean of every window exactly, the EWMA within its rounding bound on every sample, over
+// random walks of every channel, temperatures from -40 to +85 degrees included, and after
+// steps to negative and positive levels, where a division that truncates toward zero stops
+// the EWMA short of the level. Then times an update of both.
+//
+//     ./window_test
+//     ./window_test -i 10000000           # more updates for the timing
+//
+// Times are for this host. Prints every failed check, exits non-zero if any.
+
+#include "pico_window.h"
+#include "pico/time.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define TEST_CHANNELS           3
+#define TEST_WINDOWS            200
+#define TEST_WINDOW_SAMPLES     60
+#define TEST_DEFAULT_ITERS      1000000
+#define TEST_SCALE              (1 << WINDOW_EWMA_FRAC_BITS)
+
+typedef struct {
+    double ewma[TEST_CHANNELS];
+    double sum[TEST_CHANNELS];
+    double min[TEST_CHANNELS];
+    double max[TEST_CHANNELS];
+    uint32_t count;
+    uint8_t shift;
+    uint8_t seeded;
+} ref_window_t;
+
+static uint32_t failures;
+static uint32_t rng_state = 1;
+static volatile int64_t sink;
+
+// Limits of the walks, in the fixed point units of sample_t
+static const int32_t walk_min[TEST_CHANNELS] = { -4000, 0, 30000 };
+static const int32_t walk_max[TEST_CHANNELS] = { 8500, 10000, 110000 };
+
+static uint32_t rng_next(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+static void sample_values(const sample_t *sample, int32_t values[TEST_CHANNELS]) {
+    values[0] = sample->temperature;
+    values[1] = (int32_t)sample->humidity;
+    values[2] = (int32_t)sample->pressure;
+}
+
+static void set_values(sample_t *sample, const int32_t values[TEST_CHANNELS]) {
+    memset(sample, 0, sizeof(*sample));
+    sample->temperature = values[0];
+    sample->humidity = (uint32_t)values[1];
+    sample->pressure = (uint32_t)values[2];
+}
+
+static void ref_init(ref_window_t *ref, uint8_t shift) {
+    memset(ref, 0, sizeof(*ref));
+    ref->shift = shift;
+}
+
+static void ref_reset(ref_window_t *ref) {
+    memset(ref->sum, 0, sizeof(ref->sum));
+    ref->count = 0;
+}
+
+static void ref_add(ref_window_t *ref, const int32_t values[TEST_CHANNELS]) {
+    for (int i = 0; i < TEST_CHANNELS; i++) {
+        if (ref->count == 0 || values[i] < ref->min[i]) ref->min[i] = values[i];
+        if (ref->count == 0 || values[i] > ref->max[i]) ref->max[i] = values[i];
+        ref->sum[i] += values[i];
+        ref->ewma[i] = ref->seeded ? ref->ewma[i] + (values[i] - ref->ewma[i]) / (1 << ref->shift) : values[i];
+    }
+    ref->seeded = 1;
+    ref->count++;
+}
+
+// Halves away from zero, like the summary
+static int32_t ref_round(double value) {
+    return (int32_t)(value >= 0 ? floor(value + 0.5) : -floor(-value + 0.5));
+}
+
+// Every update rounds the step to a whole 1/TEST_SCALE, the EWMA carries each error on with a
+// weight of 1 - 2^-shift, so the error stays within 2^shift / 2 of those units
+static double ewma_bound(uint8_t shift) {
+    return (double)(1 << shift) / 2 / TEST_SCALE;
+}
+
+static void check_ewma(const window_t *window, const ref_window_t *ref, double *max_error) {
+    for (int i = 0; i < TEST_CHANNELS; i++) {
+        double error = fabs((double)window->channels[i].ewma / TEST_SCALE - ref->ewma[i]);
+        if (error > *max_error) *max_error = error;
+    }
+}
+
+static void check_summary(const window_t *window, const ref_window_t *ref) {
+    window_summary_t summary;
+    int32_t min[TEST_CHANNELS], max[TEST_CHANNELS], mean[TEST_CHANNELS], ewma[TEST_CHANNELS];
+
+    window_summary(window, &summary);
+    sample_values(&summary.min, min);
+    sample_values(&summary.max, max);
+    sample_values(&summary.mean, mean);
+    sample_values(&summary.ewma, ewma);
+
+    CHECK(summary.count == ref->count);
+    for (int i = 0; i < TEST_CHANNELS; i++) {
+        CHECK(min[i] == (int32_t)ref->min[i]);
+        CHECK(max[i] == (int32_t)ref->max[i]);
+        CHECK(mean[i] == ref_round(ref->sum[i] / ref->count));
+        CHECK(fabs(ewma[i] - ref->ewma[i]) <= 0.5 + ewma_bound(ref->shift));
+    }
+}
+
+static void test_walks(uint8_t shift) {
+    window_t window;
+    ref_window_t ref;
+    int32_t values[TEST_CHANNELS];
+    sample_t sample;
+    double max_error = 0;
+
+    window_init(&window, shift);
+    ref_init(&ref, shift);
+    for (int i = 0; i < TEST_CHANNELS; i++) {
+        values[i] = walk_min[i] + (int32_t)(rng_next() % (uint32_t)(walk_max[i] - walk_min[i]));
+    }
+
+    for (int w = 0; w < TEST_WINDOWS; w++) {
+        for (int s = 0; s < TEST_WINDOW_SAMPLES; s++) {
+            for (int i = 0; i < TEST_CHANNELS; i++) {
+                values[i] += (int32_t)(rng_next() % 201) - 100;
+                if (values[i] < walk_min[i]) values[i] = walk_min[i];
+                if (values[i] > walk_max[i]) values[i] = walk_max[i];
+            }
+            set_values(&sample, values);
+            window_add(&window, &sample);
+            ref_add(&ref, values);
+            check_ewma(&window, &ref, &max_error);
+        }
+
+        check_summary(&window, &ref);
+        window_reset(&window);
+        ref_reset(&ref);
+    }
+
+    printf("walks:       shift %u, EWMA error up to %.4f, bound %.4f\n", shift, max_error, ewma_bound(shift));
+    CHECK(max_error <= ewma_bound(shift));
+}
+
+// The EWMA settles on a constant input within the bound, on either side of zero
+static void test_steps(uint8_t shift) {
+    static const int32_t levels[] = { -1000, -1, 0, 1, 1000, -4000, 8500 };
+    window_t window;
+    ref_window_t ref;
+    sample_t sample;
+    double max_error = 0;
+
+    window_init(&window, shift);
+    ref_init(&ref, shift);
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        int32_t values[TEST_CHANNELS] = { levels[l], 5000, 100000 };
+
+        set_values(&sample, values);
+        for (int s = 0; s < 64 << shift; s++) {
+            window_add(&window, &sample);
+            ref_add(&ref, values);
+        }
+        check_ewma(&window, &ref, &max_error);
+
+        window_summary_t summary;
+        window_summary(&window, &summary);
+        CHECK(summary.ewma.temperature == levels[l]);
+        window_reset(&window);
+        ref_reset(&ref);
+    }
+
+    printf("steps:       shift %u, settled EWMA error up to %.4f, bound %.4f\n", shift, max_error, ewma_bound(shift));
+    CHECK(max_error <= ewma_bound(shift));
+}
+
+static void bench_update(uint32_t iters) {
+    static sample_t samples[256];
+    static int32_t values[256][TEST_CHANNELS];
+    window_t window;
+    ref_window_t ref;
+
+    for (int s = 0; s < 256; s++) {
+        for (int i = 0; i < TEST_CHANNELS; i++) {
+            values[s][i] = walk_min[i] + (int32_t)(rng_next() % (uint32_t)(walk_max[i] - walk_min[i]));
+        }
+        set_values(&samples[s], values[s]);
+    }
+
+    window_init(&window, 2);
+    uint64_t start_us = time_us_64();
+    for (uint32_t n = 0; n < iters; n++) {
+        window_add(&window, &samples[n & 255]);
+    }
+    double fixed_ns = (time_us_64() - start_us) * 1000.0 / iters;
+    sink += window.channels[0].ewma;
+
+    ref_init(&ref, 2);
+    start_us = time_us_64();
+    for (uint32_t n = 0; n < iters; n++) {
+        ref_add(&ref, values[n & 255]);
+    }
+    double ref_ns = (time_us_64() - start_us) * 1000.0 / iters;
+    sink += (int64_t)ref.ewma[0];
+
+    printf("update:      %.1f ns fixed point, %.1f ns double, 3 channels\n", fixed_ns, ref_ns);
+}
+
+int main(int argc, char **argv) {
+    uint32_t iters = TEST_DEFAULT_ITERS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+        case 'i':
+            iters = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (iters == 0) {
+        fprintf(stderr, "iterations must be > 0\n");
+        return 1;
+    }
+
+    for (uint8_t shift = 0; shift <= 6; shift += 2) {
+        test_walks(shift);
+        test_steps(shift);
+    }
+    bench_update(iters);
+
+    printf("window_test: %s, %lu failed checks\n", failures ? "FAILED" : "passed", (unsigned long)failures);
+    return failures != 0;
+}
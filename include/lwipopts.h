@@ -1,9 +1,13 @@
 #ifndef _LWIPOPTS_EXAMPLE_COMMONH_H
 #define _LWIPOPTS_EXAMPLE_COMMONH_H
 
+// MQTT_NO_TLS builds plain MQTT on MQTT_PORT, for the simulated network of the host tests
+#ifndef MQTT_NO_TLS
 #define MQTT_CERT_INC 1
+#endif
 
-#ifdef MQTT_CERT_INC
+// The pools below are raised by the fleet simulator in host/CMakeLists.txt
+#if defined(MQTT_CERT_INC) && !defined(MEM_SIZE)
 #define MEM_SIZE 8000
 #endif
 
@@ -33,9 +37,16 @@
 #ifndef MEM_SIZE
 #define MEM_SIZE                    4000
 #endif
+#ifndef MEMP_NUM_TCP_PCB
+#define MEMP_NUM_TCP_PCB            5
+#endif
+#ifndef MEMP_NUM_TCP_SEG
 #define MEMP_NUM_TCP_SEG            32
+#endif
 #define MEMP_NUM_ARP_QUEUE          10
+#ifndef PBUF_POOL_SIZE
 #define PBUF_POOL_SIZE              24
+#endif
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
 #define LWIP_ICMP                   1
@@ -48,7 +59,7 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+#define MEM_STATS                   1       // lwIP heap use, read by the metrics
 #define SYS_STATS                   0
 #define MEMP_STATS                  0
 #define LINK_STATS                  0
@@ -97,7 +108,10 @@
 #define SLIP_DEBUG                  LWIP_DBG_OFF
 #define DHCP_DEBUG                  LWIP_DBG_OFF
 
+// One more for the cyclic timer of every MQTT client
+#ifndef MEMP_NUM_SYS_TIMEOUT
 #define MEMP_NUM_SYS_TIMEOUT        (LWIP_NUM_SYS_TIMEOUT_INTERNAL+1)
+#endif
 
 #ifdef MQTT_CERT_INC
 #define LWIP_ALTCP               1
@@ -4,6 +4,66 @@
 /* Workaround for some mbedtls source files using INT_MAX without including limits.h */
 #include <limits.h>
 
+// PROFILE SETTINGS
+//
+// TLS_PROFILE_MINIMAL, set by -DTLS_PROFILE=minimal in CMake, builds a client that speaks
+// TLS 1.2 with ECDHE-ECDSA on P-256 and AES-128-GCM only. The broker and the CA and client
+// certificates must use P-256 ECDSA keys and SHA-256 signatures. Without it the full profile
+// below is used, which also accepts RSA certificates and the other curves.
+
+#if defined(TLS_PROFILE_MINIMAL)
+
+#define MBEDTLS_ENTROPY_HARDWARE_ALT
+
+#define MBEDTLS_SSL_OUT_CONTENT_LEN    2048
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+#define MBEDTLS_HAVE_TIME
+
+#define MBEDTLS_PLATFORM_C
+#define MBEDTLS_PLATFORM_MEMORY     // mbedTLS allocates from the arena set in pico_mqtt.c
+
+/* TLS 1.2 client */
+#define MBEDTLS_SSL_TLS_C
+#define MBEDTLS_SSL_CLI_C
+#define MBEDTLS_SSL_PROTO_TLS1_2
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_SSL_SERVER_NAME_INDICATION
+#define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
+#define MBEDTLS_SSL_CIPHERSUITES    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256
+
+/* P-256 only, mbedTLS sizes the curve buffers from the enabled curves */
+#define MBEDTLS_ECP_C
+#define MBEDTLS_ECDH_C
+#define MBEDTLS_ECDSA_C
+#define MBEDTLS_ECP_DP_SECP256R1_ENABLED
+#define MBEDTLS_ECP_NIST_OPTIM
+#define MBEDTLS_BIGNUM_C
+
+/* AES-128-GCM records, SHA-256 for the PRF and the signatures */
+#define MBEDTLS_AES_C
+#define MBEDTLS_AES_FEWER_TABLES
+#define MBEDTLS_GCM_C
+#define MBEDTLS_CIPHER_C
+#define MBEDTLS_MD_C
+#define MBEDTLS_SHA256_C
+#define MBEDTLS_SHA256_SMALLER
+#define MBEDTLS_CTR_DRBG_C
+#define MBEDTLS_ENTROPY_C
+
+/* Certificates and the client key */
+#define MBEDTLS_ASN1_PARSE_C
+#define MBEDTLS_ASN1_WRITE_C
+#define MBEDTLS_OID_C
+#define MBEDTLS_PK_C
+#define MBEDTLS_PK_PARSE_C
+#define MBEDTLS_PEM_PARSE_C
+#define MBEDTLS_BASE64_C
+#define MBEDTLS_X509_USE_C
+#define MBEDTLS_X509_CRT_PARSE_C
+
+#else
+
 #define MBEDTLS_ENTROPY_HARDWARE_ALT
 
 #define MBEDTLS_SSL_OUT_CONTENT_LEN    2048
@@ -42,6 +102,7 @@
 #define MBEDTLS_PK_C
 #define MBEDTLS_PK_PARSE_C
 #define MBEDTLS_PLATFORM_C
+#define MBEDTLS_PLATFORM_MEMORY     // mbedTLS allocates from the arena set in pico_mqtt.c
 #define MBEDTLS_RSA_C
 #define MBEDTLS_SHA1_C
 #define MBEDTLS_SHA224_C
@@ -56,6 +117,7 @@
 
 /* TLS 1.2 */
 #define MBEDTLS_SSL_PROTO_TLS1_2
+#define MBEDTLS_SSL_SESSION_TICKETS
 #define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
 #define MBEDTLS_GCM_C
 #define MBEDTLS_ECDH_C
@@ -70,4 +132,6 @@
 // The following significantly speeds up mbedtls due to NIST optimizations.
 #define MBEDTLS_ECP_NIST_OPTIM
 
-#endif
\ No newline at end of file
+#endif
+
+#endif
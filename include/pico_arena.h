@@ -0,0 +1,65 @@
+#ifndef PICO_ARENA_H
+#define PICO_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ARENA SETTINGS
+
+#define ARENA_ALIGN         8       // alignment of every allocation
+#define ARENA_HEADER_LEN    8       // bytes in front of every block
+
+typedef struct {
+    uint32_t used;              // bytes in allocated blocks, headers included
+    uint32_t peak;              // highest value of used
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failed;            // allocations that found no block large enough
+    uint32_t free_blocks;       // number of free blocks, 1 when not fragmented
+    uint32_t largest_free;      // largest allocation that would succeed now
+} arena_stats_t;
+
+/**
+ * @brief First fit allocator over a fixed buffer. Free blocks are kept in address order and
+ * merged with their neighbours when freed, so a workload that frees everything it allocated
+ * leaves one free block behind. Interrupts are masked while the block list changes, so core 0
+ * may allocate from the main loop and from lwIP callbacks. One core only.
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t free_head;         // offset of the first free block, size when there is none
+    uint32_t used;
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failed;
+} arena_t;
+
+/**
+ * @brief Initializes an arena with one free block covering the buffer.
+ *
+ * @param[out] arena The arena
+ * @param[in] buf Backing buffer, aligned to ARENA_ALIGN
+ * @param[in] size Size of the buffer
+ */
+void arena_init(arena_t *arena, void *buf, size_t size);
+
+/**
+ * @brief Allocates zeroed memory for count elements of size bytes.
+ *
+ * @return The memory. NULL if no free block is large enough.
+ */
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+
+/**
+ * @brief Returns memory to the arena. NULL is ignored.
+ */
+void arena_free(arena_t *arena, void *ptr);
+
+/**
+ * @brief Reads the counters and walks the free blocks for the fragmentation figures.
+ */
+void arena_get_stats(const arena_t *arena, arena_stats_t *stats);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PICO_BACKLOG_H
+#define PICO_BACKLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_sample.h"
+#include "pico_codec.h"
+#include "pico_store.h"
+#include "pico_mqtt.h"
+
+/**
+ * @brief Returns the topic the backlog of a sensor is published to. The string must stay
+ * valid while a publish of it is in flight.
+ */
+typedef const char *(*backlog_topic_fn_t)(void *arg, uint16_t sensor);
+
+/**
+ * @brief Counters of the backlog publishes since backlog_init.
+ */
+typedef struct {
+    uint32_t publishes;         // payloads queued for publishing
+    uint32_t acked;             // payloads the broker acknowledged, their records were consumed
+    uint32_t failed;            // payloads given up by the publish queue, their records were kept
+    uint32_t kept;              // acknowledged while the store dropped records, kept to be sent again
+} backlog_stats_t;
+
+/**
+ * @brief Publishes the samples recorded in the store while offline. One payload is in flight
+ * at a time, and its records are only consumed from the store once the broker acknowledged
+ * it, so a publish that fails, a lost connection or a reboot before the PUBACK sends the
+ * same records again instead of losing them.
+ *
+ * The completion arrives in lwIP's context, where the flash must not be written, so it is
+ * only recorded there and settled by the next backlog_drain.
+ */
+typedef struct {
+    MQTT_client_handle_t mqtt;
+    codec_format_t format;
+    backlog_topic_fn_t topic;
+    void *topic_arg;
+    sample_t samples[STORE_DRAIN_BATCH];
+    size_t in_flight;           // records of the payload waiting for its PUBACK, 0 if none
+    uint16_t sensor;            // of the records in flight
+    const char *in_flight_topic;
+    uint32_t dropped;           // store records dropped when the payload was queued
+    volatile uint8_t completed; // set by backlog_publish_done, err holds the result
+    int err;
+    backlog_stats_t stats;
+} backlog_t;
+
+/**
+ * @brief Initializes the backlog. The store must be mounted.
+ *
+ * @param[out] backlog The backlog
+ * @param[in] mqtt The client the payloads are published with
+ * @param[in] format Payload format
+ * @param[in] topic Topic of the backlog of a sensor
+ * @param[in] arg Argument passed to topic
+ */
+void backlog_init(backlog_t *backlog, MQTT_client_handle_t mqtt, codec_format_t format, backlog_topic_fn_t topic, void *arg);
+
+/**
+ * @brief Consumes the records of an acknowledged payload, then publishes the oldest run of
+ * records of one sensor unless a payload is still in flight. The sensors share the store, so
+ * a payload holds records of one sensor only.
+ *
+ * @param[in,out] backlog The backlog
+ * @param[out] buf Buffer for the payload
+ * @param[in] buf_len Size of the buffer
+ *
+ * @return Length of the payload queued. 0 if nothing was published. -1 if the payload does not fit or the publish was refused.
+ */
+int backlog_drain(backlog_t *backlog, uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief Records the completion of the payload in flight. Call it from the callback set with
+ * MQTT_set_publish_cb for every completed publish, other topics are ignored.
+ *
+ * @param[in,out] backlog The backlog
+ * @param[in] topic Topic of the completed publish
+ * @param[in] err 0 when the broker acknowledged the publish
+ *
+ * @return 1 if the publish was the payload in flight. 0 otherwise.
+ */
+uint8_t backlog_publish_done(backlog_t *backlog, const char *topic, int err);
+
+#endif
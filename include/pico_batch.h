@@ -0,0 +1,117 @@
+#ifndef PICO_BATCH_H
+#define PICO_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_sample.h"
+#include "pico_codec.h"
+#include "pico_window.h"
+
+// BATCH SETTINGS
+
+#define BATCH_MAX_SAMPLES   16
+#define BATCH_EWMA_SHIFT    2       // EWMA weight of the newest sample, 1/4
+
+/**
+ * @brief Counters for the publishes made from batches. wire_bytes is the estimated
+ * number of bytes on air, including MQTT, TLS and TCP/IP framing and the PUBACK.
+ */
+typedef struct {
+    uint32_t samples;
+    uint32_t publishes;
+    uint32_t payload_bytes;
+    uint32_t wire_bytes;
+} batch_stats_t;
+
+/**
+ * @brief Collects samples until the sample limit, the byte budget or the flush deadline is reached.
+ * Every payload also carries the aggregates of all samples observed since the previous one.
+ */
+typedef struct {
+    codec_format_t format;
+    size_t max_samples;
+    size_t max_bytes;
+    uint32_t flush_ms;
+    sample_t samples[BATCH_MAX_SAMPLES];
+    size_t count;
+    size_t bytes;           // length of the encoded payload
+    uint32_t first_ms;      // time the oldest sample was added
+    window_t window;        // every sample observed since the last publish, including suppressed ones
+    batch_stats_t stats;
+} batch_t;
+
+/**
+ * @brief Initializes an empty batch.
+ *
+ * @param[out] batch The batch to initialize
+ * @param[in] format Payload format the batch is encoded in
+ * @param[in] max_samples Samples per publish, capped at BATCH_MAX_SAMPLES
+ * @param[in] max_bytes Byte budget for the encoded payload
+ * @param[in] flush_ms Longest time a sample may wait in the batch
+ */
+void batch_init(batch_t *batch, codec_format_t format, size_t max_samples, size_t max_bytes, uint32_t flush_ms);
+
+/**
+ * @brief Adds a sample to the batch.
+ *
+ * @param[in,out] batch The batch
+ * @param[in] sample The sample to add
+ * @param[in] now_ms Current time in milliseconds
+ *
+ * @return 0 for success. 1 if the batch has no room left and must be flushed first.
+ */
+uint8_t batch_add(batch_t *batch, const sample_t *sample, uint32_t now_ms);
+
+/**
+ * @brief Adds a sample to the window aggregates without adding it to the batch.
+ * Call it for every sample read, whether it is published or not.
+ */
+void batch_observe(batch_t *batch, const sample_t *sample);
+
+/**
+ * @brief Checks whether the batch should be published now.
+ *
+ * @param[in] batch The batch
+ * @param[in] now_ms Current time in milliseconds
+ *
+ * @return 1 if the batch is full or its flush deadline has passed. 0 otherwise.
+ */
+uint8_t batch_ready(const batch_t *batch, uint32_t now_ms);
+
+/**
+ * @brief Encodes the batch and the window aggregates in its payload format.
+ *
+ * @param[in] batch The batch
+ * @param[out] buf Output buffer
+ * @param[in] buf_len Size of the output buffer
+ *
+ * @return Length of the payload. -1 if the buffer was too small.
+ */
+int batch_encode(const batch_t *batch, uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief Empties the batch after a successful publish and updates the counters.
+ *
+ * @param[in,out] batch The batch
+ * @param[in] wire_bytes Estimated bytes on air for the publish
+ * @param[in] payload_len Length of the published payload
+ */
+void batch_commit(batch_t *batch, uint32_t wire_bytes, size_t payload_len);
+
+/**
+ * @brief Empties the batch and starts a new window without counting it as published.
+ */
+void batch_clear(batch_t *batch);
+
+/**
+ * @brief Adds one publish to the counters. Used for payloads built outside of a batch.
+ *
+ * @param[in,out] stats The counters
+ * @param[in] samples Number of samples in the payload
+ * @param[in] wire_bytes Estimated bytes on air for the publish
+ * @param[in] payload_len Length of the published payload
+ */
+void batch_stats_record(batch_stats_t *stats, size_t samples, uint32_t wire_bytes, size_t payload_len);
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef PICO_BME280_H
+#define PICO_BME280_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_i2c.h"
+#include "pico_sample.h"
+#include "pico_sensor.h"
+
+// BME280 SETTINGS
+
+#define BME280_ADDR_PRIMARY     0x76    // SDO to ground
+#define BME280_ADDR_SECONDARY   0x77    // SDO to VDDIO
+#define BME280_CHIP_ID          0x60
+
+// REGISTERS
+
+#define BME280_REG_CALIB_TP     0x88    // 24 bytes of temperature and pressure trimming, then H1 at 0xA1
+#define BME280_REG_CALIB_H1     0xA1
+#define BME280_REG_CHIP_ID      0xD0
+#define BME280_REG_CALIB_H      0xE1    // 7 bytes of humidity trimming
+#define BME280_REG_CTRL_HUM     0xF2
+#define BME280_REG_CTRL_MEAS    0xF4
+#define BME280_REG_CONFIG       0xF5
+#define BME280_REG_DATA         0xF7    // pressure, temperature and humidity, 8 bytes
+
+#define BME280_CALIB_TP_LEN     24
+#define BME280_CALIB_H_LEN      7
+#define BME280_DATA_LEN         8
+
+// Oversampling x1 for all three channels and no filter. The sensor sleeps until a write of
+// ctrl_meas in forced mode starts one conversion, after which it goes back to sleep.
+#define BME280_CTRL_HUM_VALUE   0x01
+#define BME280_CTRL_MEAS_SLEEP  0x24
+#define BME280_CTRL_MEAS_FORCED 0x25
+#define BME280_CONFIG_VALUE     0x00
+#define BME280_MODE_MASK        0x03
+
+// Longest conversion at x1, 1.25 + 2.3 + 2.3 + 0.575 + 2.3 + 0.575 ms (datasheet 9.1)
+#define BME280_CONVERSION_MS    10
+
+// CURRENT ESTIMATE, datasheet 4.2 and 9.1 at x1
+
+#define BME280_IDD_TEMP_UA      350     // during the temperature conversion, startup included
+#define BME280_IDD_PRESS_UA     714
+#define BME280_IDD_HUM_UA       340
+#define BME280_TEMP_US          3000    // typical durations of the three conversions
+#define BME280_PRESS_US         2500
+#define BME280_HUM_US           2500
+#define BME280_IDD_SLEEP_NA     100
+#define BME280_IDD_STANDBY_NA   200
+#define BME280_NORMAL_STANDBY_MS 1000   // t_sb of the continuous conversions used before
+
+/**
+ * @brief Trimming parameters from the non-volatile memory of one sensor, named as in the datasheet.
+ */
+typedef struct {
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4, h5;
+    int8_t h6;
+} bme280_calib_t;
+
+/**
+ * @brief One BME280 on an I2C bus.
+ */
+typedef struct {
+    const i2c_bus_t *bus;
+    uint8_t addr;
+    bme280_calib_t calib;
+    uint8_t data[BME280_DATA_LEN];      // target of the asynchronous burst read
+} bme280_t;
+
+/**
+ * @brief Driver of the sensor registry, dev is a bme280_t. Triggers one conversion per read
+ * and fetches the result with an asynchronous burst read.
+ */
+extern const sensor_ops_t bme280_sensor_ops;
+
+/**
+ * @brief Checks whether a BME280 answers at an address.
+ *
+ * @return 0 if the chip id matches. 1 if nothing or another chip answered.
+ */
+uint8_t bme280_probe(const i2c_bus_t *bus, uint8_t addr);
+
+/**
+ * @brief Reads the trimming parameters and configures the sensor for forced conversions.
+ *
+ * @param[out] dev The sensor
+ * @param[in] bus Bus the sensor is on, must outlive the sensor
+ * @param[in] addr BME280_ADDR_PRIMARY or BME280_ADDR_SECONDARY
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t bme280_open(bme280_t *dev, const i2c_bus_t *bus, uint8_t addr);
+
+/**
+ * @brief Reads the latest conversion in one burst and compensates it.
+ *
+ * @param[in] dev The sensor
+ * @param[out] sample The compensated reading
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t bme280_read(const bme280_t *dev, sample_t *sample);
+
+/**
+ * @brief Starts one conversion, its result is ready after BME280_CONVERSION_MS.
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t bme280_trigger(const bme280_t *dev);
+
+/**
+ * @brief Starts reading the latest conversion into dev->data without blocking.
+ *
+ * @param[in,out] dev The sensor
+ * @param[in] done Called when the data has arrived, from interrupt context
+ * @param[in] arg Passed to done
+ *
+ * @return 0 for success. 1 if the read could not be started.
+ */
+uint8_t bme280_fetch(bme280_t *dev, i2c_done_fn done, void *arg);
+
+/**
+ * @brief Estimates the average supply current of one sensor from the datasheet figures.
+ *
+ * @param[in] period_ms Time between two samples
+ * @param[in] forced 1 for one forced conversion per sample. 0 for continuous conversions with
+ * BME280_NORMAL_STANDBY_MS standby, which do not depend on the period.
+ *
+ * @return The current in nA.
+ */
+uint32_t bme280_estimate_current_na(uint32_t period_ms, uint8_t forced);
+
+/**
+ * @brief Unpacks the trimming parameters from the two calibration blocks.
+ */
+void bme280_parse_calib(bme280_calib_t *calib, const uint8_t tp[BME280_CALIB_TP_LEN], uint8_t h1, const uint8_t h[BME280_CALIB_H_LEN]);
+
+/**
+ * @brief Compensates a raw register burst with the integer formulas of the datasheet.
+ *
+ * @param[in] calib Trimming parameters of the sensor
+ * @param[in] data The registers from BME280_REG_DATA on
+ * @param[out] sample The reading in the fixed point units of sample_t
+ *
+ * @return 0 for success. 1 if a channel was skipped by the sensor.
+ */
+uint8_t bme280_compensate(const bme280_calib_t *calib, const uint8_t data[BME280_DATA_LEN], sample_t *sample);
+
+#endif
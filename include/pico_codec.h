@@ -0,0 +1,106 @@
+#ifndef PICO_CODEC_H
+#define PICO_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_sample.h"
+#include "pico_window.h"
+
+// BINARY FORMAT
+// All fields are little endian.
+//
+// Header:  u8 version, u8 sample count
+// Base:    u32 seconds since the Unix epoch, versions 3 and 4 only
+// Sample:  i16 temperature (C * 100), u16 humidity (%RH * 100), u32 pressure (hPa * 100),
+//          versions 3 and 4 add u32 milliseconds after the base, CODEC_BINARY_NO_TIME without a time
+// Window:  u16 sample count, then min, max, mean and EWMA, each encoded like a version 1 sample
+//
+// Version 1 payloads hold the samples only. Version 2 payloads are followed by the
+// aggregates of the window the samples were collected in. Versions 3 and 4 are 1 and 2 with
+// the time of every sample, relative to the earliest one. The encoder writes 3 and 4.
+
+#define CODEC_BINARY_VERSION        1
+#define CODEC_BINARY_VERSION_WINDOW 2
+#define CODEC_BINARY_VERSION_TIME   3
+#define CODEC_BINARY_VERSION_TIME_WINDOW 4
+#define CODEC_BINARY_HEADER_LEN     2
+#define CODEC_BINARY_BASE_LEN       4
+#define CODEC_BINARY_SAMPLE_LEN     8
+#define CODEC_BINARY_STAMP_LEN      4
+#define CODEC_BINARY_WINDOW_LEN     (2 + 4 * CODEC_BINARY_SAMPLE_LEN)
+#define CODEC_BINARY_MAX_SAMPLES    255
+#define CODEC_BINARY_NO_TIME        0xFFFFFFFFu
+#define CODEC_BINARY_MAX_LEN        (CODEC_BINARY_HEADER_LEN + CODEC_BINARY_BASE_LEN + \
+    CODEC_BINARY_MAX_SAMPLES * (CODEC_BINARY_SAMPLE_LEN + CODEC_BINARY_STAMP_LEN) + CODEC_BINARY_WINDOW_LEN)
+
+// JSON FORMAT
+// A plain array of samples, or {"samples":[...],"window":{"count":n,"min":{...},"max":{...},"mean":{...},"ewma":{...}}}
+
+#define CODEC_JSON_WINDOW_MAX_LEN   (4 * (SAMPLE_JSON_MAX_LEN + 8) + 40)
+
+/**
+ * @brief Payload formats a list of samples can be encoded in
+ */
+typedef enum {
+    CODEC_FORMAT_JSON,
+    CODEC_FORMAT_BINARY
+} codec_format_t;
+
+/**
+ * @brief Encodes samples in the passed format. JSON payloads are null terminated,
+ * binary payloads use the packed format described above.
+ *
+ * @param[in] format Payload format
+ * @param[in] samples Samples to encode, oldest first
+ * @param[in] count Number of samples
+ * @param[in] window Aggregates of the window to append. NULL for a payload of samples only.
+ * @param[out] buf Output buffer
+ * @param[in] buf_len Size of the output buffer
+ *
+ * @return Length of the payload, excluding any terminator. -1 if the buffer was too small.
+ */
+int codec_encode(codec_format_t format, const sample_t *samples, size_t count, const window_summary_t *window, uint8_t *buf, size_t buf_len);
+
+/**
+ * @brief Decodes a binary payload of any version.
+ *
+ * @param[in] buf The payload
+ * @param[in] len Length of the payload
+ * @param[out] samples Buffer for the decoded samples
+ * @param[in] max Capacity of the buffer
+ * @param[out] window Aggregates of the window. count is 0 when the payload has none. May be NULL.
+ *
+ * @return Number of samples decoded. -1 if the payload is malformed, has an unknown
+ * version or holds more than max samples.
+ */
+int codec_decode_binary(const uint8_t *buf, size_t len, sample_t *samples, size_t max, window_summary_t *window);
+
+/**
+ * @brief Returns the length of a binary payload from its header.
+ *
+ * @param[in] header The first CODEC_BINARY_HEADER_LEN bytes of the payload
+ *
+ * @return Length of the whole payload. 0 for an unknown version.
+ */
+size_t codec_binary_len(const uint8_t *header);
+
+/**
+ * @brief Returns the number of bytes a sample adds to a payload that already holds count samples.
+ */
+size_t codec_sample_len(codec_format_t format, const sample_t *sample, size_t count);
+
+/**
+ * @brief Returns the largest number of bytes one sample can add to a payload.
+ */
+size_t codec_sample_max_len(codec_format_t format);
+
+/**
+ * @brief Returns the length of an empty payload. With a window it is an upper bound.
+ *
+ * @param[in] format Payload format
+ * @param[in] with_window Non-zero for a payload that carries window aggregates
+ */
+size_t codec_frame_len(codec_format_t format, uint8_t with_window);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef PICO_FLASH_H
+#define PICO_FLASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// FLASH GEOMETRY
+
+#define FLASH_DEV_SECTOR_SIZE   4096
+#define FLASH_DEV_PAGE_SIZE     256
+
+// FLASH LAYOUT
+// The boot stage (boot/pico_boot.c) takes the first sectors of flash and is never
+// overwritten, the firmware image is linked right after it. The reserved regions live at
+// the very end of the flash chip, far away from the firmware image.
+
+#ifndef FLASH_DEV_TOTAL_SIZE
+#ifdef PICO_FLASH_SIZE_BYTES
+#define FLASH_DEV_TOTAL_SIZE    PICO_FLASH_SIZE_BYTES
+#else
+#define FLASH_DEV_TOTAL_SIZE    (2 * 1024 * 1024)
+#endif
+#endif
+
+// Set by CMakeLists.txt for the boot stage and the linker scripts of both images
+#ifndef FLASH_BOOT_SIZE
+#define FLASH_BOOT_SIZE         (8 * FLASH_DEV_SECTOR_SIZE)
+#endif
+#define FLASH_APP_OFFSET        FLASH_BOOT_SIZE
+
+#define FLASH_STORE_SIZE        (64 * FLASH_DEV_SECTOR_SIZE)
+#define FLASH_STORE_OFFSET      (FLASH_DEV_TOTAL_SIZE - FLASH_STORE_SIZE)
+
+// A firmware update is staged below the store and copied over the firmware image by the boot
+// stage, so half of the flash after the boot stage is left for the image. The last sector of
+// the OTA region holds the state of the transfer, see pico_ota.h.
+#define FLASH_OTA_SIZE          (((FLASH_STORE_OFFSET - FLASH_APP_OFFSET) / 2) / FLASH_DEV_SECTOR_SIZE * FLASH_DEV_SECTOR_SIZE)
+#define FLASH_OTA_OFFSET        (FLASH_STORE_OFFSET - FLASH_OTA_SIZE)
+#define FLASH_APP_MAX_SIZE      (FLASH_OTA_OFFSET - FLASH_APP_OFFSET)   // the firmware image must end below the OTA region
+
+/**
+ * @brief A region of NOR flash. Offsets are relative to the start of the region.
+ * Programming can only clear bits, erasing sets a whole sector back to 0xFF.
+ */
+typedef struct flash_dev {
+    uint32_t size;
+    uint8_t (*read)(const struct flash_dev *dev, uint32_t offset, void *buf, size_t len);
+    uint8_t (*program_page)(const struct flash_dev *dev, uint32_t offset, const uint8_t *page);
+    uint8_t (*erase_sector)(const struct flash_dev *dev, uint32_t offset);
+    void *ctx;
+} flash_dev_t;
+
+/**
+ * @brief Binds a flash device to a region of the onboard QSPI flash.
+ *
+ * @param[out] dev The device to initialize
+ * @param[in] region_offset Offset of the region from the start of flash. Must be sector aligned.
+ * @param[in] region_size Size of the region in bytes. Must be a multiple of the sector size.
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t flash_dev_init_onboard(flash_dev_t *dev, uint32_t region_offset, uint32_t region_size);
+
+#endif
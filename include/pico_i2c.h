@@ -0,0 +1,64 @@
+#ifndef PICO_I2C_H
+#define PICO_I2C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// I2C SETTINGS
+
+#define I2C_BUS_COUNT           2
+#define I2C_BAUD                400000
+#define I2C_TIMEOUT_US          10000   // per transfer, a stuck bus fails the read instead of hanging the core
+
+// Pins of i2c0 and i2c1
+#define I2C0_SDA_PIN            4
+#define I2C0_SCL_PIN            5
+#define I2C1_SDA_PIN            6
+#define I2C1_SCL_PIN            7
+
+#define I2C_DMA_MAX_LEN         32      // longest read_regs_async
+
+/**
+ * @brief Called when an asynchronous read has completed, from interrupt context on the
+ * core that started it. err is 0 on success.
+ */
+typedef void (*i2c_done_fn)(void *arg, uint8_t err);
+
+/**
+ * @brief An I2C bus. Host builds pass a simulated bus.
+ *
+ * transfer writes tx and, when rx_len is not 0, reads rx_len bytes after a repeated start.
+ * The calling core is blocked until the transfer is done.
+ *
+ * read_regs_async writes the register address and reads len bytes into buf by DMA, then calls
+ * done. The calling core is free in the meantime. One read per bus at a time, buf must stay
+ * valid until done is called or cancel has returned.
+ *
+ * cancel stops an asynchronous read that did not complete, e.g. because the device did not
+ * acknowledge. done is not called for it.
+ */
+typedef struct i2c_bus {
+    uint8_t index;
+    uint32_t baud;
+    uint8_t (*transfer)(const struct i2c_bus *bus, uint8_t addr, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+    uint8_t (*read_regs_async)(const struct i2c_bus *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len, i2c_done_fn done, void *arg);
+    void (*cancel)(const struct i2c_bus *bus);
+    void *ctx;
+} i2c_bus_t;
+
+/**
+ * @brief Sets up one of the I2C controllers of the RP2040 on its pins, with pull-ups. The DMA
+ * channels of the bus are claimed on the first asynchronous read, and their interrupt is
+ * handled on the core that made it.
+ *
+ * @param[out] bus The bus to initialize
+ * @param[in] index 0 for i2c0, 1 for i2c1
+ * @param[in] sda_pin SDA pin
+ * @param[in] scl_pin SCL pin
+ * @param[in] baud Clock rate in Hz
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t i2c_bus_init_onboard(i2c_bus_t *bus, uint8_t index, unsigned int sda_pin, unsigned int scl_pin, uint32_t baud);
+
+#endif
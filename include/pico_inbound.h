@@ -0,0 +1,63 @@
+#ifndef PICO_INBOUND_H
+#define PICO_INBOUND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Counters for reassembled messages. bytes_copied counts the payload bytes copied
+ * into the buffer, which is the only copy made between lwIP and the consumer.
+ */
+typedef struct {
+    uint32_t messages;      // complete messages handed out
+    uint32_t dropped;       // messages larger than the buffer or shorter than announced
+    uint32_t bytes_copied;
+} inbound_stats_t;
+
+/**
+ * @brief Reassembles the fragments of one inbound publish into a caller provided buffer.
+ * Only needed by consumers that want the payload in one piece, streaming consumers
+ * can use the fragments as they arrive.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;             // bytes received of the current message
+    size_t total;           // length announced in the PUBLISH header
+    uint8_t discard;        // the current message is being dropped
+    inbound_stats_t stats;
+} inbound_msg_t;
+
+/**
+ * @brief Initializes the reassembly buffer.
+ *
+ * @param[out] msg The reassembly state
+ * @param[in] buf Buffer for the payload. One byte is kept for a terminating NUL.
+ * @param[in] size Size of the buffer
+ */
+void inbound_init(inbound_msg_t *msg, uint8_t *buf, size_t size);
+
+/**
+ * @brief Starts a new message and drops a previous one that never completed.
+ *
+ * @param[in,out] msg The reassembly state
+ * @param[in] total_len Payload length announced by the PUBLISH header
+ *
+ * @return 0 for success. 1 if the payload does not fit, its fragments are then ignored.
+ */
+uint8_t inbound_begin(inbound_msg_t *msg, size_t total_len);
+
+/**
+ * @brief Appends the next fragment.
+ *
+ * @param[in,out] msg The reassembly state
+ * @param[in] data The fragment
+ * @param[in] len Length of the fragment
+ * @param[in] last Non-zero for the last fragment of the message
+ *
+ * @return 0 when the message is complete. buf then holds msg->len bytes followed by a NUL.
+ * 1 while more fragments are expected or the message is dropped.
+ */
+uint8_t inbound_append(inbound_msg_t *msg, const uint8_t *data, size_t len, uint8_t last);
+
+#endif
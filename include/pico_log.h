@@ -1,30 +1,177 @@
 #ifndef PICO_W_LOGG_H_
 #define PICO_W_LOGG_H_
 
-#include "stdio.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 
-#define PICO_DEBUG_MODE 1
+// LOG SETTINGS
 
-#if PICO_DEBUG_MODE
-#define PICO_LOGI(...) (printf(__VA_ARGS__))
+#define PICO_LOG_LEVEL_NONE     0
+#define PICO_LOG_LEVEL_ERROR    1
+#define PICO_LOG_LEVEL_WARNING  2
+#define PICO_LOG_LEVEL_INFO     3
+
+// Calls above this level are compiled out, format strings included
+#ifndef PICO_LOG_LEVEL
+#define PICO_LOG_LEVEL          PICO_LOG_LEVEL_INFO
+#endif
+
+// 1 queues records in RAM and prints them from log_drain(), 0 prints synchronously
+#ifndef PICO_LOG_DEFERRED
+#define PICO_LOG_DEFERRED       1
+#endif
+
+#define LOG_RING_SIZE           2048    // bytes per core, must be a power of two
+#define LOG_RECORD_MAX_LEN      128     // encoded record, arguments included
+#define LOG_STRING_MAX_LEN      48      // longer %s arguments are truncated
+#define LOG_LINE_PREFIX         '@'     // marks a record in the drained output
+
+// RECORD FORMAT
+// All fields are little endian. A drained record is printed as LOG_LINE_PREFIX followed
+// by the record in hex, host/log_decode.c turns it back into text.
+//
+// Header:    u8 record length, u8 level | core << 4, u32 format string address, u32 time in us
+// Argument:  u8 tag, then u32, u64 or double by tag, or u8 length and the bytes of a string
+
+#define LOG_HEADER_LEN          10
+
+typedef enum {
+    LOG_ARG_U32,
+    LOG_ARG_U64,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING
+} log_arg_t;
+
+/**
+ * @brief A record being encoded on the stack of the caller
+ */
+typedef struct {
+    uint8_t data[LOG_RECORD_MAX_LEN];
+    uint8_t len;
+} log_record_t;
+
+typedef struct {
+    uint32_t records;       // records written to the ring
+    uint32_t dropped;       // records lost because the ring was full
+    uint32_t max_used;      // high water mark of the ring in bytes
+} log_stats_t;
+
+/**
+ * @brief Starts a record. Used by the logging macros.
+ */
+void log_begin(log_record_t *record, uint8_t level, const char *fmt);
+
+void log_put_u32(log_record_t *record, uint32_t value);
+void log_put_u64(log_record_t *record, uint64_t value);
+void log_put_double(log_record_t *record, double value);
+void log_put_str(log_record_t *record, const char *value);
+
+static inline void log_put_ptr(log_record_t *record, const void *value) {
+    log_put_u32(record, (uint32_t)(uintptr_t)value);
+}
+
+// long is 32 bits on the Pico and 64 bits on most hosts
+static inline void log_put_long(log_record_t *record, long value) {
+    if (sizeof(long) > sizeof(uint32_t)) log_put_u64(record, (uint64_t)value);
+    else log_put_u32(record, (uint32_t)value);
+}
+
+static inline void log_put_ulong(log_record_t *record, unsigned long value) {
+    if (sizeof(long) > sizeof(uint32_t)) log_put_u64(record, (uint64_t)value);
+    else log_put_u32(record, (uint32_t)value);
+}
+
+/**
+ * @brief Copies a finished record into the ring of the calling core. Never blocks,
+ * the record is dropped and counted when the ring is full.
+ */
+void log_commit(log_record_t *record);
+
+/**
+ * @brief Prints queued records, oldest first across both cores. Core 0 only, call it when idle.
+ *
+ * @param[in] max_records Largest number of records to print in this call
+ *
+ * @return 1 if records are left in the rings. 0 if they are empty.
+ */
+uint8_t log_drain(size_t max_records);
+
+/**
+ * @brief Prints every queued record. Used before a reset or panic.
+ */
+void log_flush(void);
+
+/**
+ * @brief Returns the counters of the ring of a core.
+ */
+const log_stats_t *log_get_stats(unsigned int core);
+
+// Picks the encoder by the type of the argument, the decoder matches it to the conversion
+#define LOG_PUT(record, value) _Generic((value), \
+    char *: log_put_str, \
+    const char *: log_put_str, \
+    float: log_put_double, \
+    double: log_put_double, \
+    long: log_put_long, \
+    unsigned long: log_put_ulong, \
+    long long: log_put_u64, \
+    unsigned long long: log_put_u64, \
+    void *: log_put_ptr, \
+    const void *: log_put_ptr, \
+    default: log_put_u32)(record, value)
+
+// Applies LOG_PUT to every argument after the format string, up to 8 arguments
+#define LOG_PUT_1(r, f)
+#define LOG_PUT_2(r, f, a) LOG_PUT(r, a);
+#define LOG_PUT_3(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_2(r, f, __VA_ARGS__)
+#define LOG_PUT_4(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_3(r, f, __VA_ARGS__)
+#define LOG_PUT_5(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_4(r, f, __VA_ARGS__)
+#define LOG_PUT_6(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_5(r, f, __VA_ARGS__)
+#define LOG_PUT_7(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_6(r, f, __VA_ARGS__)
+#define LOG_PUT_8(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_7(r, f, __VA_ARGS__)
+#define LOG_PUT_9(r, f, a, ...) LOG_PUT(r, a); LOG_PUT_8(r, f, __VA_ARGS__)
+
+#define LOG_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, n, ...) n
+#define LOG_COUNT(...) LOG_COUNT_(__VA_ARGS__, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_CAT_(a, b) a##b
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_FIRST_(fmt, ...) fmt
+#define LOG_FIRST(...) LOG_FIRST_(__VA_ARGS__, 0)
+
+// Never runs, it keeps the format checks of printf and the arguments in use
+#define LOG_DISCARD(...) do { if (0) printf(__VA_ARGS__); } while (0)
+
+#if PICO_LOG_DEFERRED
+#define LOG_WRITE(level, prefix, ...) do { \
+    LOG_DISCARD(__VA_ARGS__); \
+    log_record_t log_record_; \
+    log_begin(&log_record_, level, LOG_FIRST(__VA_ARGS__)); \
+    LOG_CAT(LOG_PUT_, LOG_COUNT(__VA_ARGS__))(&log_record_, __VA_ARGS__) \
+    log_commit(&log_record_); \
+} while (0)
 #else
-#define PICO_LOGI(...)
+#define LOG_WRITE(level, prefix, ...) ((void)printf(prefix __VA_ARGS__))
 #endif
 
-#define PICO_WARNING_MODE 1
+// The format string must be a literal
 
-#if PICO_WARNING_MODE
-#define PICO_LOGW(...) (printf("Warning: %s", __VA_ARGS__))
+#if PICO_LOG_LEVEL >= PICO_LOG_LEVEL_INFO
+#define PICO_LOGI(...) LOG_WRITE(PICO_LOG_LEVEL_INFO, "", __VA_ARGS__)
 #else
-#define PICO_LOGW(...)
+#define PICO_LOGI(...) LOG_DISCARD(__VA_ARGS__)
 #endif
 
-#define PICO_ERROR_MODE 1
+#if PICO_LOG_LEVEL >= PICO_LOG_LEVEL_WARNING
+#define PICO_LOGW(...) LOG_WRITE(PICO_LOG_LEVEL_WARNING, "Warning: ", __VA_ARGS__)
+#else
+#define PICO_LOGW(...) LOG_DISCARD(__VA_ARGS__)
+#endif
 
-#if PICO_ERROR_MODE
-#define PICO_LOGE(...) (printf("ERROR: %s", __VA_ARGS__))
+#if PICO_LOG_LEVEL >= PICO_LOG_LEVEL_ERROR
+#define PICO_LOGE(...) LOG_WRITE(PICO_LOG_LEVEL_ERROR, "ERROR: ", __VA_ARGS__)
 #else
-#define PICO_LOGE(...)
+#define PICO_LOGE(...) LOG_DISCARD(__VA_ARGS__)
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,114 @@
+#ifndef PICO_METRICS_H
+#define PICO_METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// METRICS SETTINGS
+
+#define METRICS_BUCKETS             8       // per histogram, the last one takes everything above the last bound
+
+// Upper bounds of the histogram buckets, METRICS_BUCKETS - 1 each
+#define METRICS_LOOP_US_BOUNDS      {50, 100, 250, 500, 1000, 5000, 20000}
+#define METRICS_PUBACK_MS_BOUNDS    {20, 50, 100, 200, 500, 1000, 5000}
+#define METRICS_CONNECT_MS_BOUNDS   {500, 1000, 2000, 5000, 10000, 20000, 60000}
+
+typedef enum {
+    METRIC_PUBLISHES,           // publishes handed to lwIP
+    METRIC_PUBLISH_FAILED,      // publishes refused by a full queue or given up
+    METRIC_MQTT_CONNECTS,       // broker connections established
+    METRIC_MQTT_FAILED,         // connection attempts that failed
+    METRIC_MQTT_LOST,           // established connections that dropped
+    METRIC_WIFI_REJOINS,        // Wi-Fi links restored after a loss
+    METRIC_PUBLISH_RETRIED,     // publishes sent again after a timeout
+    METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+typedef enum {
+    METRIC_HEAP_USED,           // bytes allocated from the C heap
+    METRIC_LWIP_MEM_USED,       // bytes allocated from the lwIP heap
+    METRIC_TLS_ARENA_PEAK,      // highest use of the mbedTLS arena, updated on connect
+    METRIC_TCP_REXMIT,          // lwIP counters since boot
+    METRIC_TCP_DROP,
+    METRIC_LOG_DROPPED,         // log records lost to a full ring
+    METRIC_QUEUE_DROPPED,       // samples lost between the cores
+    METRIC_STORE_PENDING,       // samples waiting in flash
+    METRIC_SAMPLES_SENT,        // samples passed on by the reporting policy
+    METRIC_SAMPLES_SUPPRESSED,
+    METRIC_HEARTBEATS,
+    METRIC_PUBLISH_QUEUED,      // publishes queued or waiting for their PUBACK
+    METRIC_SENSOR_CPU_US,       // CPU time of one sample, bus waits included
+    METRIC_SENSOR_CURRENT_NA,   // estimated supply current of all sensors
+    METRIC_CLOCK_OFFSET_US,     // wall clock error measured by the latest NTP exchange, absolute
+    METRIC_GAUGE_COUNT
+} metric_gauge_t;
+
+typedef enum {
+    METRIC_LOOP_US,             // busy time of one main loop pass
+    METRIC_PUBACK_MS,           // publish to PUBACK
+    METRIC_CONNECT_MS,          // start of an attempt to CONNACK
+    METRIC_HISTOGRAM_COUNT
+} metric_histogram_t;
+
+typedef struct {
+    uint32_t value;
+    uint32_t max;               // since boot
+} metrics_gauge_t;
+
+typedef struct {
+    uint32_t buckets[METRICS_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+} metrics_histogram_t;
+
+/**
+ * @brief Counters, gauges and histograms since boot. Everything is recorded on core 0,
+ * from the main loop and from lwIP callbacks. Interrupts are masked for the update, so
+ * both may record the same metric. Core 1 must not record.
+ */
+typedef struct {
+    uint32_t counters[METRIC_COUNTER_COUNT];
+    metrics_gauge_t gauges[METRIC_GAUGE_COUNT];
+    metrics_histogram_t histograms[METRIC_HISTOGRAM_COUNT];
+} metrics_t;
+
+/**
+ * @brief Adds one to a counter.
+ */
+void metrics_count(metric_counter_t counter);
+
+/**
+ * @brief Sets a gauge to its current value and updates its maximum.
+ */
+void metrics_gauge(metric_gauge_t gauge, uint32_t value);
+
+/**
+ * @brief Records one value in a histogram.
+ */
+void metrics_observe(metric_histogram_t histogram, uint32_t value);
+
+/**
+ * @brief Returns the metrics recorded so far.
+ */
+const metrics_t *metrics_get(void);
+
+/**
+ * @brief Clears every metric.
+ */
+void metrics_reset(void);
+
+/**
+ * @brief Encodes a snapshot as compact JSON: {"up":s,"c":{name:n,..},"g":{name:[value,max],..},
+ * "h":{name:{"n":count,"sum":sum,"max":max,"b":[buckets]},..}}. The bucket bounds are
+ * the METRICS_*_BOUNDS settings.
+ *
+ * @param[in] uptime_s Seconds since boot
+ * @param[out] buf Output buffer, null terminated
+ * @param[in] buf_len Size of the output buffer
+ *
+ * @return Length of the payload. -1 if the buffer was too small.
+ */
+int metrics_to_json(uint32_t uptime_s, char *buf, size_t buf_len);
+
+#endif
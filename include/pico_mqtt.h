@@ -2,6 +2,11 @@
 #define PICO_W_MQTT_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "lwipopts.h"
+#include "pico_router.h"
+#include "pico_pubq.h"
 
 #define MQTT_SERVER         "192.168.61.111"
 
@@ -14,10 +19,31 @@
 #define MQTT_TLS_PORT       8883
 #define MQTT_PORT           8883
 
+// CONNECTION SETTINGS
+
+#define MQTT_DNS_TIMEOUT_MS         5000
+#define MQTT_CONNECT_TIMEOUT_MS     30000   // TCP connect, TLS handshake and CONNACK
+#define MQTT_BACKOFF_BASE_MS        1000    // delay after the first failed attempt
+#define MQTT_BACKOFF_MAX_MS         300000
+
+// MEMORY SETTINGS
+
+#ifndef MQTT_MAX_CLIENTS
+#define MQTT_MAX_CLIENTS    1               // handles, allocated statically
+#endif
+#ifndef MQTT_TLS_ARENA_SIZE
+#define MQTT_TLS_ARENA_SIZE (48 * 1024)     // heap of mbedTLS: certificates, cached session and handshakes
+#endif
+
 // PUBLISH SETTINGS
 
 #define MQTT_PUB_QOS        1
 #define MQTT_PUB_RETAIN     true
+#define MQTT_PUB_QUEUE_SIZE 4096            // bytes of queued topics and payloads per handle
+#define MQTT_PUB_WINDOW     (MQTT_REQ_MAX_IN_FLIGHT - 1)    // publishes in flight, one request is left for subscriptions
+
+// Largest payload that fits the output ring buffer next to the fixed header, topic and packet id
+#define MQTT_PAYLOAD_MAX_LEN (MQTT_OUTPUT_RINGBUF_SIZE - MQTT_TOPIC_LEN - 9)
 
 // SUBSCRIBE SETTINGS
 
@@ -33,16 +59,74 @@
 
 typedef struct MQTT_CLIENT_DATA_T *MQTT_client_handle_t;
 
+typedef struct {
+    uint32_t full_handshakes;
+    uint32_t resumed_handshakes;
+    uint32_t arena_used;        // bytes of the mbedTLS arena in use now
+    uint32_t arena_peak;        // highest use since boot, certificates included
+    uint32_t arena_failed;      // allocations the arena could not serve
+} MQTT_tls_stats_t;
+
+/**
+ * @brief states of the broker connection. An attempt runs from MQTT_STATE_RESOLVING to
+ * MQTT_STATE_CONNECTED. A phase that fails or times out sends the client back to
+ * MQTT_STATE_BACKOFF, which waits twice as long after every failed attempt.
+ */
+typedef enum {
+    MQTT_STATE_BACKOFF,     // waiting for the next attempt
+    MQTT_STATE_RESOLVING,   // DNS lookup of MQTT_SERVER, only with MQTT_DNS_NAME
+    MQTT_STATE_CONNECTING,  // TCP connect, TLS handshake, CONNECT and CONNACK
+    MQTT_STATE_CONNECTED
+} MQTT_state_t;
+
 /**
- * @brief initializes the MQTT protocol. Points the 
- * @param[out] handle Opaque pointer to the internal datastructure for the MQTT protocol. Succesful initialization re-directs the pointer to the datastructure on heap.
+ * @brief called once for every publish accepted by MQTT_publish or MQTT_publish_bytes, when the
+ * broker has acknowledged it or when it was given up after PUBQ_MAX_ATTEMPTS.
+ * 
+ * @param[in] arg The argument passed to MQTT_set_publish_cb
+ * @param[in] topic Topic of the publish, only valid during the call
+ * @param[in] err 0 when the broker acknowledged the publish (PUBACK for QoS 1). The lwIP error of the last attempt otherwise.
+ * @param[in] latency_us Time from MQTT_publish_bytes to the completion, queueing and retries included
+ */
+typedef void (*MQTT_publish_cb_t)(void *arg, const char *topic, int err, uint32_t latency_us);
+
+/**
+ * @brief receives inbound publishes as a stream. begin is called once per publish with the topic,
+ * then data is called with the payload fragments in order. Topic and fragments point into lwIP's
+ * receive buffer and are only valid during the call. pico_inbound.h reassembles whole messages.
+ * By default the client's router is the consumer, see MQTT_subscribe_handler.
+ */
+typedef struct {
+    // Returns 0 to receive the payload, 1 to skip the publish
+    uint8_t (*begin)(void *arg, const char *topic, size_t total_len);
+    // last is non-zero for the final fragment. A publish without payload gets one call with len 0.
+    void (*data)(void *arg, const uint8_t *data, size_t len, uint8_t last);
+    void *arg;
+} MQTT_consumer_t;
+
+/**
+ * @brief initializes the MQTT protocol and starts connecting to the broker. Returns without
+ * waiting for the connection, which is driven by MQTT_process.
+ * @param[out] handle Opaque pointer to the internal datastructure for the MQTT protocol. Succesful initialization re-directs the pointer to one of MQTT_MAX_CLIENTS static handles.
  * 
  * @return 0 for succesful init. 1 for failed init.
  */
 uint8_t MQTT_open(MQTT_client_handle_t *handle);
 
 /**
- * @brief publishes data to broker.
+ * @brief advances the connection. Enforces the timeout of the current phase and starts a new
+ * attempt when the backoff has passed. Call it regularly from the main loop, it never blocks.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * 
+ * @return The state of the connection after the call.
+ */
+MQTT_state_t MQTT_process(MQTT_client_handle_t handle);
+
+/**
+ * @brief publishes data to broker. The message is copied into the publish queue of the handle,
+ * which keeps up to MQTT_PUB_WINDOW publishes unacknowledged and submits the message again
+ * when lwIP is out of memory, the PUBACK times out or the connection drops before it arrives.
  * 
  * @param[in] handle Opaque pointer to internal MQTT handle datastructure
  * @param[in] topic The topic the payload will be sent in
@@ -52,6 +136,58 @@ uint8_t MQTT_open(MQTT_client_handle_t *handle);
  */
 uint8_t MQTT_publish(MQTT_client_handle_t handle, const char *topic, const char *payload);
 
+/**
+ * @brief publishes a binary payload to broker, through the publish queue like MQTT_publish.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[in] topic The topic the payload will be sent in
+ * @param[in] payload The payload to be published
+ * @param[in] len Length of the payload in bytes
+ * 
+ * @return 0 when the message was queued. 1 when not connected, the payload exceeds
+ * MQTT_PAYLOAD_MAX_LEN or the queue is full.
+ */
+uint8_t MQTT_publish_bytes(MQTT_client_handle_t handle, const char *topic, const uint8_t *payload, size_t len);
+
+/**
+ * @brief replaces the router as the consumer of inbound publishes.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[in] consumer The consumer, copied into the handle. NULL to hand inbound publishes to the router again.
+ */
+void MQTT_set_consumer(MQTT_client_handle_t handle, const MQTT_consumer_t *consumer);
+
+/**
+ * @brief registers a callback for completed publishes. Completions arrive in the order the
+ * publishes were made, unless one of them needed another attempt.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[in] cb The callback. NULL to remove it.
+ * @param[in] arg Argument passed to the callback
+ */
+void MQTT_set_publish_cb(MQTT_client_handle_t handle, MQTT_publish_cb_t cb, void *arg);
+
+/**
+ * @brief reads the counters of the publish queue.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[out] stats The counters
+ * 
+ * @return 0 on success. 1 for an invalid handle.
+ */
+uint8_t MQTT_publish_stats(MQTT_client_handle_t handle, pubq_stats_t *stats);
+
+/**
+ * @brief estimates the bytes on air for one publish. Counts the MQTT, TLS and TCP/IP framing
+ * of the PUBLISH and, for QoS 1, of the PUBACK.
+ * 
+ * @param[in] topic_len Length of the topic
+ * @param[in] payload_len Length of the payload
+ * 
+ * @return Estimated number of bytes sent and received for the publish.
+ */
+uint32_t MQTT_wire_bytes(size_t topic_len, size_t payload_len);
+
 /**
  * @brief subscribes to passed topic.
  * 
@@ -63,7 +199,34 @@ uint8_t MQTT_publish(MQTT_client_handle_t handle, const char *topic, const char
 uint8_t MQTT_subscribe(MQTT_client_handle_t handle, const char *topic);
 
 /**
- * @brief unsubscribes from the passed topic.
+ * @brief subscribes to a topic filter and routes the matching publishes to a handler. Unlike
+ * MQTT_subscribe, the subscription is renewed after every reconnect.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[in] filter Topic filter, may contain '+' and a trailing '#'
+ * @param[in] handler Called with every complete matching publish of up to ROUTER_PAYLOAD_MAX_LEN bytes
+ * @param[in] arg Argument passed to the handler
+ * 
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t MQTT_subscribe_handler(MQTT_client_handle_t handle, const char *filter, router_handler_t handler, void *arg);
+
+/**
+ * @brief subscribes to one topic and streams its publishes to consumer instead of the router,
+ * for payloads too large to reassemble in RAM. The fragments arrive as lwIP receives them.
+ * Other topics still go to the router. One stream per handle, a second call replaces the first.
+ * Like MQTT_subscribe_handler, the subscription is renewed after every reconnect.
+ * 
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ * @param[in] topic The topic, without wildcards
+ * @param[in] consumer Receives the publishes of the topic, copied into the handle
+ * 
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t MQTT_subscribe_stream(MQTT_client_handle_t handle, const char *topic, const MQTT_consumer_t *consumer);
+
+/**
+ * @brief unsubscribes from the passed topic and removes its route, if any.
  * 
  * @param[in] handle Opaque pointer to internal MQTT handle datastructure
  * @param[in] topic The topic to unsubscribe from
@@ -73,7 +236,7 @@ uint8_t MQTT_subscribe(MQTT_client_handle_t handle, const char *topic);
 uint8_t MQTT_unsubscribe(MQTT_client_handle_t handle, const char *topic);
 
 /**
- * @brief closes the connection and unitiliazes the handle and free's the memory on the heap.
+ * @brief closes the connection and returns the handle to the static pool.
  * 
  * @param[out] handle Opaque pointer to internal MQTT handle datastructure
  */
@@ -90,12 +253,32 @@ void MQTT_close(MQTT_client_handle_t handle);
 uint8_t MQTT_poll(MQTT_client_handle_t handle);
 
 /**
- * @brief Attempts to reconnect to the broker. De- and Re-initializes the handle.
+ * @brief drops the current connection or attempt and starts a new attempt right away,
+ * skipping the backoff. Used when the network link has just come back.
  * 
  * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ */
+void MQTT_reconnect(MQTT_client_handle_t handle);
+
+/**
+ * @brief returns the client id the device connects with, DEVICE_MODEL and the board id.
  * 
- * @return 0 for success. 1 for failed.
+ * @param[in] handle Opaque pointer to internal MQTT handle datastructure
+ */
+const char *MQTT_device_id(MQTT_client_handle_t handle);
+
+/**
+ * @brief reads the handshake counters and the use of the mbedTLS arena.
+ * 
+ * @param[out] stats The counters
+ * 
+ * @return 0 on success. 1 when the client is built without TLS.
+ */
+uint8_t MQTT_tls_stats(MQTT_tls_stats_t *stats);
+
+/**
+ * @brief drops the cached TLS session, so the next connection makes a full handshake.
  */
-uint8_t MQTT_reconnect(MQTT_client_handle_t *handle);
+void MQTT_tls_forget_session(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef PICO_NTP_H
+#define PICO_NTP_H
+
+#include <stdint.h>
+
+#include "pico_wallclock.h"
+
+// NTP SETTINGS
+
+#define NTP_SERVER          "pool.ntp.org"
+#define NTP_PORT            123
+#define NTP_POLL_MS         64000       // between exchanges once the clock is synced
+#define NTP_RETRY_MS        4000        // until then, and after a lost or invalid reply
+#define NTP_TIMEOUT_MS      2000
+#define NTP_PACKET_LEN      48
+
+typedef struct {
+    uint32_t requests;
+    uint32_t replies;           // valid replies handed to the clock
+    uint32_t invalid;           // wrong length, mode, stratum or origin, kiss-o'-death included
+    uint32_t timeouts;
+    uint32_t dns_failures;
+} ntp_stats_t;
+
+/**
+ * @brief Starts an SNTP client on a UDP socket of lwIP that disciplines the passed clock.
+ *
+ * @param[in,out] clock The clock to discipline, must outlive the client
+ *
+ * @return 0 for success. 1 if the socket could not be created.
+ */
+uint8_t ntp_init(wallclock_t *clock);
+
+/**
+ * @brief Sends the next request when it is due and times out a lost reply. Replies are
+ * handled in the lwIP callback. Call about once a second from the networking core.
+ */
+void ntp_process(void);
+
+/**
+ * @brief Returns the counters of the client.
+ */
+const ntp_stats_t *ntp_get_stats(void);
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef PICO_OTA_H
+#define PICO_OTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_flash.h"
+
+// OTA SETTINGS
+
+#define OTA_TOPIC               "/ota/"     // followed by the device id and a subtopic below
+#define OTA_BEGIN_SUBTOPIC      "/begin"
+#define OTA_CHUNK_SUBTOPIC      "/chunk"
+#define OTA_STATUS_SUBTOPIC     "/status"
+#define OTA_STATUS_BYTES        (16 * 1024) // a progress status after this many bytes
+#define OTA_STATUS_MAX_LEN      112
+
+// MESSAGES
+// All fields are little endian.
+//
+// begin:   u32 image size, u32 version, 32 byte SHA-256 of the image. Starts a transfer, or
+//          continues it when the manifest is the one being received.
+// chunk:   u32 offset in the image, then image bytes. Written to flash as they arrive, any
+//          length. Bytes already received are skipped, a chunk past the next missing byte is dropped.
+// status:  from the device, {"state":"receiving","version":3,"offset":65536,"size":524288,"resume":false}.
+//          Sent every OTA_STATUS_BYTES and at the end, and with resume true after a begin, a
+//          reboot and a dropped chunk. The sender continues from offset when resume is true,
+//          so a transfer survives lost chunks, reconnects and reboots of either side. The
+//          offsets of the progress statuses pace the sender, it keeps a bounded number of
+//          bytes ahead of the latest one.
+
+#define OTA_DIGEST_LEN          32
+#define OTA_MANIFEST_LEN        (8 + OTA_DIGEST_LEN)
+#define OTA_CHUNK_HEADER_LEN    4
+
+// STATE SECTOR
+// The last sector of the region. The first page holds a magic, the manifest and a word that is
+// programmed once the image is verified. The other pages hold checkpoints, the bytes written
+// to flash, one word per finished sector of the image. After a reboot the transfer continues
+// from the latest checkpoint, and the digest is recomputed from the flash up to it.
+
+typedef enum {
+    OTA_IDLE,                   // nothing staged
+    OTA_RECEIVING,
+    OTA_VERIFIED,               // a complete image with the right digest waits for the next boot
+    OTA_FAILED                  // digest mismatch or flash error, a new begin starts over
+} ota_state_t;
+
+typedef struct {
+    uint32_t size;
+    uint32_t version;
+    uint8_t digest[OTA_DIGEST_LEN];
+} ota_manifest_t;
+
+typedef struct {
+    uint32_t begins;            // begin messages accepted
+    uint32_t resumes;           // transfers continued after a repeated begin or a reboot
+    uint32_t chunks;            // chunks with at least one new byte
+    uint32_t bytes;             // image bytes written
+    uint32_t duplicate_bytes;   // bytes skipped because they were already written
+    uint32_t dropped;           // chunks past the next missing byte
+    uint32_t rehashed_bytes;    // read back from flash to recompute the digest after a reboot
+    uint32_t erases;
+    uint32_t flash_errors;
+} ota_stats_t;
+
+/**
+ * @brief Mounts the OTA region and recovers a transfer interrupted by a reboot. Nothing is
+ * erased here. One region at a time, like the sample store.
+ *
+ * @param[in] dev The OTA region, FLASH_OTA_SIZE at FLASH_OTA_OFFSET in the firmware. At least
+ * two sectors, the last one is the state sector. Must outlive the module.
+ *
+ * @return 0 for success. 1 for an invalid region.
+ */
+uint8_t ota_init(const flash_dev_t *dev);
+
+/**
+ * @brief Starts or continues a transfer. Router handler of the begin topic.
+ */
+void ota_begin_handler(void *arg, const char *topic, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Starts receiving a chunk. With ota_chunk_data the stream consumer of the chunk topic.
+ *
+ * @return 0 to receive the chunk. 1 to skip it when no transfer is running.
+ */
+uint8_t ota_chunk_begin(void *arg, const char *topic, size_t total_len);
+
+/**
+ * @brief Streams the fragments of a chunk into flash through a one page buffer.
+ */
+void ota_chunk_data(void *arg, const uint8_t *data, size_t len, uint8_t last);
+
+/**
+ * @brief Writes the status of the transfer as JSON when one is due.
+ *
+ * @param[out] buf Destination, OTA_STATUS_MAX_LEN bytes are enough
+ * @param[in] len Size of buf
+ *
+ * @return Length of the status, 0 when none is due, -1 if it does not fit.
+ */
+int ota_status(char *buf, size_t len);
+
+/**
+ * @brief Returns the state of the transfer.
+ */
+ota_state_t ota_state(void);
+
+/**
+ * @brief Reads the digest of the staged image back from flash and compares it with the
+ * manifest. A mismatch marks the transfer failed.
+ *
+ * @param[out] manifest The manifest of the staged image
+ *
+ * @return 0 when a verified image is staged and still matches its digest. 1 otherwise.
+ */
+uint8_t ota_check_staged(ota_manifest_t *manifest);
+
+/**
+ * @brief Copies the staged image into the application region, reads the copy back against the
+ * digest and clears the state sector. Boot stage only, see boot/pico_boot.c.
+ *
+ * Nothing but the copy is written until it matches, so a reset at any point leaves the
+ * verified image staged and the next boot copies it again from the start.
+ *
+ * @param[in] app The application region, FLASH_APP_MAX_SIZE at FLASH_APP_OFFSET in the firmware
+ *
+ * @return 0 when the image was installed. 1 when no verified image is staged, it does not
+ * fit the region or a flash operation failed. Only after a flash error is the image still
+ * staged, ota_state returns OTA_VERIFIED.
+ */
+uint8_t ota_install(const flash_dev_t *app);
+
+/**
+ * @brief Marks a verified image that could not be installed failed, so it is not installed
+ * again. The state is OTA_FAILED afterwards even if the mark cannot be programmed.
+ *
+ * @return 0 for success. 1 when no verified image is staged or the mark failed.
+ */
+uint8_t ota_abandon(void);
+
+/**
+ * @brief Erases the state sector once the staged image was installed, the region is idle again.
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t ota_clear(void);
+
+/**
+ * @brief Returns the counters since ota_init.
+ */
+const ota_stats_t *ota_get_stats(void);
+
+/**
+ * @brief Returns the RAM the module holds for a transfer, the page buffer and the digest state
+ * included. Nothing else is allocated, the image goes from lwIP's buffers straight to flash.
+ */
+size_t ota_ram_bytes(void);
+
+/**
+ * @brief Binds dev to the OTA region of the onboard flash and mounts it with ota_init.
+ * Firmware only. The boot stage installs a verified image before the firmware starts, one
+ * still staged here is one the boot stage gave up on and is abandoned.
+ *
+ * @param[out] dev The OTA region
+ *
+ * @return 0 when transfers can be received. 1 when the running image reaches into the OTA
+ * region or the region cannot be mounted.
+ */
+uint8_t ota_boot(flash_dev_t *dev);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef PICO_PUBQ_H
+#define PICO_PUBQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// PUBLISH QUEUE SETTINGS
+
+#define PUBQ_MAX_ENTRIES    16
+#define PUBQ_MAX_ATTEMPTS   4       // submissions of one message before it is given up
+
+/**
+ * @brief Outcome of pubq_complete.
+ */
+typedef enum {
+    PUBQ_ACKED,                 // acknowledged, the entry is released
+    PUBQ_RETRY,                 // queued again for another attempt
+    PUBQ_FAILED                 // out of attempts, the entry is released
+} pubq_result_t;
+
+typedef struct {
+    uint32_t queued;            // messages accepted by pubq_push
+    uint32_t rejected;          // messages refused because the queue was full
+    uint32_t submitted;         // submissions, retries included
+    uint32_t deferred;          // submissions refused by the transport, e.g. ERR_MEM
+    uint32_t acked;
+    uint32_t retried;           // completions that failed and were queued again
+    uint32_t requeued;          // in-flight messages queued again after the connection dropped
+    uint32_t failed;            // messages given up after PUBQ_MAX_ATTEMPTS
+    uint32_t max_depth;         // most messages held at once
+    uint32_t max_in_flight;
+} pubq_stats_t;
+
+enum {
+    PUBQ_FREE,
+    PUBQ_QUEUED,
+    PUBQ_IN_FLIGHT,
+    PUBQ_DONE                   // completed, the storage is reclaimed once the older entries are
+};
+
+/**
+ * @brief One message. Topic and payload are copied into the byte ring of the queue.
+ */
+typedef struct pubq_entry {
+    struct pubq *queue;
+    uint32_t offset;            // of the NUL terminated topic in the ring, the payload follows it
+    uint16_t topic_len;
+    uint16_t payload_len;
+    uint8_t state;
+    uint8_t attempts;
+    uint64_t queued_us;
+    uint64_t sent_us;           // of the latest submission
+} pubq_entry_t;
+
+/**
+ * @brief Outbound queue of QoS 1 publishes. Messages are copied in, handed to the transport in
+ * order while fewer than window of them are unacknowledged, and kept until their PUBACK. A
+ * message that times out, or that was in flight when the connection dropped, is submitted again.
+ * Storage is a byte ring reclaimed from the oldest entry, so a slow acknowledgement holds back
+ * the space of the newer ones. One core only.
+ */
+typedef struct pubq {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t head;              // next free byte of the ring
+    pubq_entry_t entries[PUBQ_MAX_ENTRIES];
+    uint8_t oldest;
+    uint8_t count;              // entries from oldest on, done ones not yet reclaimed included
+    uint8_t in_flight;
+    uint8_t window;
+    pubq_stats_t stats;
+    void *owner;                // free for the user of the queue, reachable from every entry
+} pubq_t;
+
+/**
+ * @brief Initializes an empty queue.
+ *
+ * @param[out] queue The queue
+ * @param[in] buf Storage of topics and payloads
+ * @param[in] size Size of buf
+ * @param[in] window Most messages in flight at once
+ */
+void pubq_init(pubq_t *queue, uint8_t *buf, size_t size, uint8_t window);
+
+/**
+ * @brief Copies a message into the queue.
+ *
+ * @return 0 for success. 1 if there is no free entry or not enough room in the ring.
+ */
+uint8_t pubq_push(pubq_t *queue, const char *topic, const uint8_t *payload, size_t len, uint64_t now_us);
+
+/**
+ * @brief Returns the oldest message waiting for submission. NULL if there is none or the window is full.
+ */
+pubq_entry_t *pubq_next(pubq_t *queue);
+
+/**
+ * @brief Marks a message returned by pubq_next as handed to the transport.
+ */
+void pubq_sent(pubq_t *queue, pubq_entry_t *entry, uint64_t now_us);
+
+/**
+ * @brief Records that the transport refused the message returned by pubq_next. It stays first in line.
+ */
+void pubq_defer(pubq_t *queue);
+
+/**
+ * @brief Completes a message in flight.
+ *
+ * @param[in,out] queue The queue
+ * @param[in,out] entry The message
+ * @param[in] ok 1 when the broker acknowledged it
+ *
+ * @return PUBQ_ACKED, PUBQ_RETRY or PUBQ_FAILED. The entry must not be used after ACKED and FAILED.
+ */
+pubq_result_t pubq_complete(pubq_t *queue, pubq_entry_t *entry, uint8_t ok);
+
+/**
+ * @brief Queues every message in flight again, for a transport that dropped them with the connection.
+ */
+void pubq_requeue(pubq_t *queue);
+
+/**
+ * @brief Number of messages queued or in flight.
+ */
+uint32_t pubq_depth(const pubq_t *queue);
+
+const char *pubq_topic(const pubq_t *queue, const pubq_entry_t *entry);
+const uint8_t *pubq_payload(const pubq_t *queue, const pubq_entry_t *entry);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PICO_REPORT_H
+#define PICO_REPORT_H
+
+#include <stdint.h>
+
+#include "pico_sample.h"
+
+/**
+ * @brief Reporting policy. Deadbands are in the fixed point units of sample_t, 0 reports every change.
+ */
+typedef struct {
+    uint32_t deadband_temperature;  // degrees Celsius * 100
+    uint32_t deadband_humidity;     // %RH * 100
+    uint32_t deadband_pressure;     // hPa * 100
+    uint32_t heartbeat_ms;          // longest time without a report
+    uint32_t slow_interval_ms;      // sampling interval while the values are steady
+    uint32_t fast_interval_ms;      // sampling interval while the values are moving
+    uint32_t fast_hold_ms;          // time spent at the fast interval after the last movement
+} report_config_t;
+
+typedef struct {
+    uint32_t sent;                  // samples passed on
+    uint32_t suppressed;            // samples within the deadband
+    uint32_t heartbeats;            // samples passed on only because the heartbeat expired
+} report_stats_t;
+
+/**
+ * @brief Decides which samples are worth publishing. A sample is passed on when a channel has
+ * moved more than its deadband since the last sample passed on, or when the heartbeat expires.
+ * Movement also switches the sampling interval to the fast one for fast_hold_ms.
+ */
+typedef struct {
+    report_config_t config;
+    sample_t last;                  // last sample passed on
+    uint32_t last_ms;
+    uint32_t fast_until_ms;
+    uint8_t has_last;
+    uint8_t fast;
+    report_stats_t stats;
+} report_t;
+
+/**
+ * @brief Initializes the policy. The first sample is always passed on.
+ *
+ * @param[out] report The policy state
+ * @param[in] config The policy, copied
+ */
+void report_init(report_t *report, const report_config_t *config);
+
+/**
+ * @brief Checks a new sample against the policy and counts it as sent or suppressed.
+ *
+ * @param[in,out] report The policy state
+ * @param[in] sample The new sample
+ * @param[in] now_ms Current time in milliseconds
+ *
+ * @return 1 if the sample should be published. 0 if it is suppressed.
+ */
+uint8_t report_check(report_t *report, const sample_t *sample, uint32_t now_ms);
+
+/**
+ * @brief Returns the sampling interval the policy currently asks for.
+ *
+ * @param[in,out] report The policy state
+ * @param[in] now_ms Current time in milliseconds
+ */
+uint32_t report_interval_ms(report_t *report, uint32_t now_ms);
+
+#endif
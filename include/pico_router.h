@@ -0,0 +1,152 @@
+#ifndef PICO_ROUTER_H
+#define PICO_ROUTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_inbound.h"
+
+// ROUTER SETTINGS
+
+#ifndef ROUTER_MAX_ROUTES
+#define ROUTER_MAX_ROUTES       16
+#endif
+
+#ifndef ROUTER_MAX_NODES
+#define ROUTER_MAX_NODES        48      // one per distinct topic level, the root included
+#endif
+
+#ifndef ROUTER_POOL_SIZE
+#define ROUTER_POOL_SIZE        512     // filter strings, NUL terminated
+#endif
+
+#ifndef ROUTER_MAX_MATCHES
+#define ROUTER_MAX_MATCHES      8       // handlers called for one inbound publish
+#endif
+
+#define ROUTER_TOPIC_MAX_LEN    100
+#define ROUTER_PAYLOAD_MAX_LEN  512
+
+#define ROUTER_NONE             0xFFFF
+
+/**
+ * @brief called with a complete inbound publish whose topic matches the filter of the route.
+ *
+ * @param[in] arg The argument passed to router_add
+ * @param[in] topic The topic of the publish
+ * @param[in] payload The payload, followed by a NUL so text payloads can be used as strings
+ * @param[in] len Length of the payload
+ */
+typedef void (*router_handler_t)(void *arg, const char *topic, const uint8_t *payload, size_t len);
+
+typedef struct {
+    uint16_t filter;            // offset of the filter in the pool
+    router_handler_t handler;   // NULL once the route is removed
+    void *arg;
+} router_route_t;
+
+/**
+ * @brief One topic level of the trie. Literal children are chained through sibling, the
+ * '+' child has its own link and a trailing '#' is stored as a route on its parent.
+ */
+typedef struct {
+    uint16_t name;              // offset of the level name in the pool
+    uint16_t name_len;
+    uint16_t child;             // first literal child
+    uint16_t sibling;           // next literal child of the same parent
+    uint16_t plus;              // '+' child
+    uint16_t exact;             // route of the filter ending at this level
+    uint16_t multi;             // route of the filter ending in '#' below this level
+} router_node_t;
+
+typedef struct {
+    uint32_t routed;            // publishes handed to at least one handler
+    uint32_t unmatched;         // publishes no filter matched
+    uint32_t dropped;           // topic or payload too long
+} router_stats_t;
+
+/**
+ * @brief Subscription registry. Filters are compiled into a trie of topic levels when they are
+ * added, so matching an inbound topic walks the trie once instead of testing every filter.
+ * Removed filters keep their nodes and pool space, adding them again reuses both.
+ */
+typedef struct {
+    router_node_t nodes[ROUTER_MAX_NODES];
+    size_t node_count;
+    router_route_t routes[ROUTER_MAX_ROUTES];
+    size_t route_count;
+    char pool[ROUTER_POOL_SIZE];
+    size_t pool_used;
+
+    // Publish being received
+    uint16_t matches[ROUTER_MAX_MATCHES];
+    size_t match_count;
+    char topic[ROUTER_TOPIC_MAX_LEN + 1];
+    uint8_t payload[ROUTER_PAYLOAD_MAX_LEN + 1];
+    inbound_msg_t inbound;
+
+    router_stats_t stats;
+} router_t;
+
+/**
+ * @brief Initializes an empty router.
+ */
+void router_init(router_t *router);
+
+/**
+ * @brief Adds a filter, or replaces the handler of a filter that is already registered.
+ *
+ * @param[in,out] router The router
+ * @param[in] filter Topic filter. '+' matches one level and a trailing '#' any number of levels.
+ * @param[in] handler Called for every matching publish
+ * @param[in] arg Argument passed to the handler
+ *
+ * @return 0 for success. 1 if the filter is invalid or the router is full.
+ */
+uint8_t router_add(router_t *router, const char *filter, router_handler_t handler, void *arg);
+
+/**
+ * @brief Removes a filter.
+ *
+ * @return 0 for success. 1 if the filter is not registered.
+ */
+uint8_t router_remove(router_t *router, const char *filter);
+
+/**
+ * @brief Returns the filter of a route, so the subscriptions can be renewed after a reconnect.
+ *
+ * @param[in] router The router
+ * @param[in] index Route index, from 0 to router->route_count - 1
+ *
+ * @return The filter. NULL if the route has been removed.
+ */
+const char *router_filter(const router_t *router, size_t index);
+
+/**
+ * @brief Finds the routes whose filter matches a topic. Topics starting with '$' are not
+ * matched by a wildcard in the first level.
+ *
+ * @param[in] router The router
+ * @param[in] topic The topic of an inbound publish
+ * @param[out] routes Indices of the matching routes
+ * @param[in] max Size of routes
+ *
+ * @return Number of matching routes, at most max.
+ */
+size_t router_match(const router_t *router, const char *topic, uint16_t *routes, size_t max);
+
+/**
+ * @brief MQTT_consumer_t begin callback with the router as argument. Matches the topic and
+ * starts reassembling the payload if any route wants it.
+ *
+ * @return 0 to receive the payload. 1 to skip the publish.
+ */
+uint8_t router_begin(void *router, const char *topic, size_t total_len);
+
+/**
+ * @brief MQTT_consumer_t data callback with the router as argument. Calls the handlers of
+ * the matching routes once the last fragment has arrived.
+ */
+void router_data(void *router, const uint8_t *data, size_t len, uint8_t last);
+
+#endif
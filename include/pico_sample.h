@@ -0,0 +1,62 @@
+#ifndef PICO_SAMPLE_H
+#define PICO_SAMPLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// JSON KEYS
+
+#define SAMPLE_JSON_KEY_TEMP        "temperature"
+#define SAMPLE_JSON_KEY_HUMIDITY    "humidity"
+#define SAMPLE_JSON_KEY_PRESSURE    "pressure"
+#define SAMPLE_JSON_KEY_TIME        "time"      // seconds since the Unix epoch with three decimals
+
+#define SAMPLE_JSON_MAX_LEN         104
+
+/**
+ * @brief One sensor reading in fixed point. All values are scaled by 100 so two
+ * decimals are kept without using floating point. The time is when the conversion started,
+ * 0 for a sample taken before the clock was set.
+ */
+typedef struct {
+    int32_t temperature;    // degrees Celsius * 100
+    uint32_t humidity;      // %RH * 100
+    uint32_t pressure;      // hPa * 100
+    uint16_t sensor;        // index of the sensor in the registry, 0 with a single sensor
+    uint16_t time_ms;       // milliseconds within the second
+    uint32_t time;          // seconds since the Unix epoch
+} sample_t;
+
+/**
+ * @brief Sets the time of a sample.
+ *
+ * @param[in,out] sample The sample
+ * @param[in] unix_us Microseconds since the Unix epoch
+ */
+void sample_set_time(sample_t *sample, uint64_t unix_us);
+
+/**
+ * @brief Formats a sample as a JSON object using integer arithmetic only. The time is only
+ * included when the sample has one.
+ *
+ * @param[in] sample The sample to format
+ * @param[out] buf Output buffer
+ * @param[in] buf_len Size of the output buffer
+ *
+ * @return Length of the string written, excluding the terminator. -1 if the buffer was too small.
+ */
+int sample_to_json(const sample_t *sample, char *buf, size_t buf_len);
+
+/**
+ * @brief Formats several samples as a JSON array of objects.
+ *
+ * @param[in] samples Samples to format, oldest first
+ * @param[in] count Number of samples
+ * @param[out] buf Output buffer
+ * @param[in] buf_len Size of the output buffer
+ *
+ * @return Length of the string written, excluding the terminator. -1 if the buffer was too small.
+ */
+int sample_to_json_array(const sample_t *samples, size_t count, char *buf, size_t buf_len);
+
+#endif
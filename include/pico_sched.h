@@ -0,0 +1,123 @@
+#ifndef PICO_SCHED_H
+#define PICO_SCHED_H
+
+#include <stdint.h>
+
+// SCHEDULER SETTINGS
+
+#define SCHED_MAX_TASKS     12      // main.c adds up to 8, room for more without a silent drop
+#define SCHED_LATE_US       10000   // a task starting later than this after its deadline counts as late
+
+typedef void (*sched_task_fn)(void *arg);
+
+/**
+ * @brief Clock source of the scheduler. Returns a monotonic time in microseconds.
+ * Host builds pass a simulated clock.
+ */
+typedef uint64_t (*sched_clock_fn)(void);
+
+/**
+ * @brief Timing counters of one task. Jitter is the delay between the deadline and the start of a run.
+ */
+typedef struct {
+    uint32_t runs;
+    uint32_t late;              // runs that started more than SCHED_LATE_US after their deadline
+    uint32_t skipped;           // periods skipped because the task fell more than a period behind
+    uint32_t max_jitter_us;
+    uint64_t total_jitter_us;
+} sched_task_stats_t;
+
+typedef struct {
+    const char *name;
+    sched_task_fn fn;
+    void *arg;
+    uint64_t period_us;
+    uint64_t deadline_us;
+    sched_task_stats_t stats;
+} sched_task_t;
+
+/**
+ * @brief Deadline driven scheduler for periodic tasks. Tasks are kept in a min-heap
+ * ordered by deadline, so finding the next one to run is O(1).
+ */
+typedef struct {
+    sched_clock_fn now_us;
+    sched_task_t tasks[SCHED_MAX_TASKS];
+    uint8_t heap[SCHED_MAX_TASKS];      // task ids ordered by deadline
+    uint8_t count;
+    uint32_t wakeups;                   // calls to sched_run
+    uint32_t idle_wakeups;              // calls to sched_run where no task was due
+} sched_t;
+
+/**
+ * @brief Initializes an empty scheduler.
+ *
+ * @param[out] sched The scheduler
+ * @param[in] now_us Clock source
+ */
+void sched_init(sched_t *sched, sched_clock_fn now_us);
+
+/**
+ * @brief Registers a periodic task.
+ *
+ * @param[in,out] sched The scheduler
+ * @param[in] name Name used in the statistics, must outlive the scheduler
+ * @param[in] period_ms Time between two runs, at least 1
+ * @param[in] first_ms Delay before the first run
+ * @param[in] fn Task function
+ * @param[in] arg Argument passed to the task function
+ *
+ * @return The id of the task. -1 if the scheduler is full or the period is 0.
+ */
+int sched_add(sched_t *sched, const char *name, uint32_t period_ms, uint32_t first_ms, sched_task_fn fn, void *arg);
+
+/**
+ * @brief Changes the period of a task. The new period applies from the next deadline on.
+ *
+ * @param[in,out] sched The scheduler
+ * @param[in] id Id of the task
+ * @param[in] period_ms New period, at least 1
+ *
+ * @return 0 on success, 1 for an unknown id or a period of 0. The period is left unchanged then.
+ */
+uint8_t sched_set_period(sched_t *sched, int id, uint32_t period_ms);
+
+/**
+ * @brief Moves the next deadline of a task. Used to run a task earlier than its period.
+ *
+ * @param[in,out] sched The scheduler
+ * @param[in] id Id of the task
+ * @param[in] delay_ms Time from now until the task should run
+ */
+void sched_run_in(sched_t *sched, int id, uint32_t delay_ms);
+
+/**
+ * @brief Sets the next deadline of a task to an absolute time of the clock. Used to move a
+ * task onto a grid of its own, the period applies from there on.
+ *
+ * @param[in,out] sched The scheduler
+ * @param[in] id Id of the task
+ * @param[in] deadline_us Time the task should run
+ */
+void sched_run_at(sched_t *sched, int id, uint64_t deadline_us);
+
+/**
+ * @brief Runs every task whose deadline has passed.
+ *
+ * @param[in,out] sched The scheduler
+ *
+ * @return The earliest deadline of all tasks in microseconds, to sleep until.
+ */
+uint64_t sched_run(sched_t *sched);
+
+/**
+ * @brief Returns the counters of a task. NULL for an unknown id.
+ */
+const sched_task_stats_t *sched_get_stats(const sched_t *sched, int id);
+
+/**
+ * @brief Logs wakeups and the timing counters of every task.
+ */
+void sched_log_stats(const sched_t *sched);
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef PICO_SENSOR_H
+#define PICO_SENSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "pico_sample.h"
+#include "pico_sched.h"
+
+// SENSOR SETTINGS
+
+#define SENSOR_MAX_SENSORS      4       // both BME280 addresses on both buses
+#define SENSOR_NAME_LEN         12
+
+/**
+ * @brief Called by a driver when an asynchronous fetch has completed, possibly from interrupt
+ * context. err is 0 on success.
+ */
+typedef void (*sensor_done_fn)(void *arg, uint8_t err);
+
+/**
+ * @brief Driver of one kind of sensor. dev is the driver state passed at registration.
+ *
+ * read is required and blocks until it has a sample. A driver of a sensor that only converts
+ * on request sets trigger and conversion_ms, trigger is then called conversion_ms before each
+ * read. A driver that can read without blocking the core also sets fetch, decode and cancel:
+ * fetch starts the read and calls done when the data has arrived, decode turns the data into a
+ * sample, and cancel stops a fetch that never completed.
+ */
+typedef struct {
+    uint8_t (*read)(void *dev, sample_t *sample);
+    uint8_t (*trigger)(void *dev);
+    uint32_t conversion_ms;
+    uint8_t (*fetch)(void *dev, sensor_done_fn done, void *arg);
+    uint8_t (*decode)(void *dev, sample_t *sample);
+    void (*cancel)(void *dev);
+} sensor_ops_t;
+
+/**
+ * @brief Receives every sample read. sensor is the index the sensor was registered with,
+ * taken_us the time of the scheduler clock the conversion was triggered, or the read started
+ * for a sensor without a trigger.
+ */
+typedef void (*sensor_emit_fn)(void *arg, uint8_t sensor, const sample_t *sample, uint64_t taken_us);
+
+/**
+ * @brief Counters of one sensor. busy_us is the time the core spent in the driver, waiting on
+ * the bus included, so busy_us / reads is the CPU time a sample costs.
+ */
+typedef struct {
+    uint32_t reads;
+    uint32_t failures;
+    uint64_t busy_us;
+    uint32_t max_busy_us;
+} sensor_stats_t;
+
+// States of an asynchronous fetch
+enum {
+    SENSOR_FETCH_IDLE,
+    SENSOR_FETCH_BUSY,
+    SENSOR_FETCH_DONE,
+    SENSOR_FETCH_FAILED
+};
+
+typedef struct {
+    const sensor_ops_t *ops;
+    void *dev;
+    char name[SENSOR_NAME_LEN];
+    uint8_t index;
+    int task;                   // id of the read in the scheduler of the registry
+    int trigger_task;           // id of the trigger, -1 for sensors that convert by themselves
+    atomic_uint_fast8_t fetch;  // set by the completion of a fetch
+    uint64_t taken_us;          // start of the conversion being read
+    struct sensor_registry *registry;
+    sensor_stats_t stats;
+} sensor_t;
+
+/**
+ * @brief The sensors of the device and the scheduler that reads them. Every sensor is read
+ * once per period, at an offset of period / count from the previous one, so the bus time is
+ * spread evenly over the period instead of arriving in one burst. Sensors with a trigger are
+ * triggered conversion_ms before their read. Owned by one core.
+ */
+typedef struct sensor_registry {
+    sensor_t sensors[SENSOR_MAX_SENSORS];
+    uint8_t count;
+    uint32_t period_ms;
+    sched_t sched;
+    sensor_emit_fn emit;
+    void *emit_arg;
+} sensor_registry_t;
+
+/**
+ * @brief Initializes an empty registry.
+ *
+ * @param[out] registry The registry
+ * @param[in] now_us Clock of the scheduler
+ * @param[in] emit Called with every successful read
+ * @param[in] arg Passed to emit
+ */
+void sensor_registry_init(sensor_registry_t *registry, sched_clock_fn now_us, sensor_emit_fn emit, void *arg);
+
+/**
+ * @brief Adds a sensor. Must be called before sensor_start.
+ *
+ * @param[in,out] registry The registry
+ * @param[in] name Name of the sensor, used as its MQTT sub-topic. Truncated to SENSOR_NAME_LEN - 1.
+ * @param[in] ops Driver of the sensor, must outlive the registry
+ * @param[in] dev Driver state, must outlive the registry
+ *
+ * @return Index of the sensor. -1 if the registry is full.
+ */
+int sensor_register(sensor_registry_t *registry, const char *name, const sensor_ops_t *ops, void *dev);
+
+/**
+ * @brief Schedules the reads. Sensor i is first read after period_ms + i * period_ms / count.
+ *
+ * @param[in,out] registry The registry
+ * @param[in] period_ms Time between two reads of the same sensor
+ *
+ * @return 0 for success. 1 if no sensor is registered or the period is 0.
+ */
+uint8_t sensor_start(sensor_registry_t *registry, uint32_t period_ms);
+
+/**
+ * @brief Changes the read period of every sensor. Each sensor switches at its next read,
+ * so the offsets between them are kept. A period of 0 is ignored.
+ */
+void sensor_set_period(sensor_registry_t *registry, uint32_t period_ms);
+
+/**
+ * @brief Moves the reads onto a grid starting at start_us, sensor i is next triggered, or
+ * read, at start_us + i * period_ms / count. Used to sample at the same instants as other devices.
+ *
+ * @param[in,out] registry The registry
+ * @param[in] start_us Time of the scheduler clock of the first trigger
+ */
+void sensor_align(sensor_registry_t *registry, uint64_t start_us);
+
+/**
+ * @brief Triggers and reads every sensor that is due, and emits the samples of completed fetches.
+ * Call again when a fetch completes, the completion wakes the core.
+ *
+ * @return The time of the next trigger or read in microseconds, to sleep until.
+ */
+uint64_t sensor_run(sensor_registry_t *registry);
+
+/**
+ * @brief Returns a registered sensor. NULL for an unknown index.
+ */
+const sensor_t *sensor_get(const sensor_registry_t *registry, uint8_t index);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PICO_SPSC_H
+#define PICO_SPSC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "pico_sample.h"
+
+// QUEUE SETTINGS
+
+#define SPSC_CAPACITY       16      // must be a power of two
+
+/**
+ * @brief Lock-free single producer, single consumer ring of samples. One core pushes,
+ * the other pops. The indices run freely and are masked on access, so the ring can
+ * hold all SPSC_CAPACITY entries.
+ */
+typedef struct {
+    sample_t items[SPSC_CAPACITY];
+    atomic_uint_fast32_t head;      // written by the producer only
+    atomic_uint_fast32_t tail;      // written by the consumer only
+    atomic_uint_fast32_t dropped;   // pushes rejected because the ring was full
+} spsc_queue_t;
+
+/**
+ * @brief Initializes an empty queue. Must be called before the other core starts using it.
+ */
+void spsc_init(spsc_queue_t *queue);
+
+/**
+ * @brief Pushes a sample. Producer side only.
+ *
+ * @return 0 for success. 1 if the queue is full.
+ */
+uint8_t spsc_push(spsc_queue_t *queue, const sample_t *sample);
+
+/**
+ * @brief Pops the oldest sample. Consumer side only.
+ *
+ * @return 0 for success. 1 if the queue is empty.
+ */
+uint8_t spsc_pop(spsc_queue_t *queue, sample_t *sample);
+
+/**
+ * @brief Returns the number of queued samples. Exact on either side, a lower bound elsewhere.
+ */
+size_t spsc_count(spsc_queue_t *queue);
+
+#endif
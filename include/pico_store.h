@@ -0,0 +1,82 @@
+#ifndef PICO_STORE_H
+#define PICO_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico_flash.h"
+#include "pico_sample.h"
+
+// STORE SETTINGS
+
+#define STORE_RECORD_SIZE       32
+#define STORE_DRAIN_BATCH       16
+
+/**
+ * @brief Counters describing the store since it was mounted.
+ */
+typedef struct {
+    uint32_t pending;       // records waiting to be drained
+    uint32_t appended;      // records written
+    uint32_t drained;       // records consumed
+    uint32_t dropped;       // records overwritten before they were drained
+    uint32_t erases;        // sector erases
+    uint32_t max_erase;     // highest erase count of any sector
+} store_stats_t;
+
+/**
+ * @brief Mounts the log-structured sample store on the passed flash region. Pending
+ * records from before a reboot are recovered. A region without a valid store is formatted.
+ *
+ * The region is used as a ring of sectors. Every sector starts with a header holding its
+ * sequence number and erase count, followed by fixed size records. When the ring is full
+ * the oldest sector is erased and reused, so every sector is worn evenly.
+ *
+ * @param[in] dev Flash region to use. Must hold at least two sectors and outlive the store.
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t store_init(const flash_dev_t *dev);
+
+/**
+ * @brief Appends a sample to the store. If the store is full the oldest sector is dropped.
+ *
+ * @param[in] sample The sample to record
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t store_append(const sample_t *sample);
+
+/**
+ * @brief Copies the oldest pending samples without consuming them.
+ *
+ * @param[out] samples Buffer for the samples, oldest first
+ * @param[in] max Capacity of the buffer
+ *
+ * @return Number of samples copied.
+ */
+size_t store_peek(sample_t *samples, size_t max);
+
+/**
+ * @brief Marks the oldest pending samples as drained. Call this once a batch returned
+ * by store_peek has been handed over to the broker.
+ *
+ * @param[in] count Number of samples to consume
+ *
+ * @return 0 for success. 1 for failed.
+ */
+uint8_t store_consume(size_t count);
+
+/**
+ * @brief Returns the number of samples waiting to be drained.
+ */
+uint32_t store_pending(void);
+
+/**
+ * @brief Copies the store counters.
+ *
+ * @param[out] stats The counters
+ */
+void store_get_stats(store_stats_t *stats);
+
+#endif
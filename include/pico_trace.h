@@ -0,0 +1,74 @@
+#ifndef PICO_TRACE_H
+#define PICO_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// TRACE SETTINGS
+
+// 1 records spans into RAM, 0 compiles every TRACE_ macro and the buffers out
+#ifndef PICO_TRACE
+#define PICO_TRACE              0
+#endif
+
+#ifndef TRACE_RING_SPANS
+#define TRACE_RING_SPANS        1024    // per core, must be a power of two. The oldest spans are overwritten.
+#endif
+#define TRACE_LINE_PREFIX       '%'     // marks a span in the dumped output
+
+// DUMP FORMAT
+// One line per span: TRACE_LINE_PREFIX, the core, the start in microseconds since boot,
+// the duration in microseconds and the name, separated by spaces. host/trace_json.c turns
+// the lines into Chrome trace JSON for chrome://tracing and ui.perfetto.dev.
+
+/**
+ * @brief One finished span. The name is not copied, it must be a literal or live forever.
+ */
+typedef struct {
+    const char *name;
+    uint32_t start_us;          // low 32 bits of the timer
+    uint32_t duration_us;
+} trace_span_t;
+
+typedef struct {
+    uint32_t spans;             // recorded on the core
+    uint32_t overwritten;       // lost before a dump reached them
+} trace_stats_t;
+
+/**
+ * @brief Returns the start of a span, the low 32 bits of the hardware timer. Used by the macros.
+ */
+uint32_t trace_begin(void);
+
+/**
+ * @brief Records a span that started at start_us and ends now in the ring of the calling core.
+ * Never blocks. Interrupt handlers on the same core may record spans at the same time.
+ */
+void trace_end(const char *name, uint32_t start_us);
+
+/**
+ * @brief Prints the spans recorded since the last dump, core 0 first. Core 0 only. Spans of
+ * core 1 recorded while the dump runs are kept for the next one.
+ */
+void trace_dump(void);
+
+/**
+ * @brief Returns the counters of the ring of a core.
+ */
+const trace_stats_t *trace_get_stats(unsigned int core);
+
+// A span covers the code between TRACE_BEGIN and TRACE_END in the same block:
+//
+//     TRACE_BEGIN(poll);
+//     cyw43_arch_poll();
+//     TRACE_END(poll, "cyw43_arch_poll");
+
+#if PICO_TRACE
+#define TRACE_BEGIN(span) uint32_t trace_##span = trace_begin()
+#define TRACE_END(span, name) trace_end(name, trace_##span)
+#else
+#define TRACE_BEGIN(span) do { } while (0)
+#define TRACE_END(span, name) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef PICO_WALLCLOCK_H
+#define PICO_WALLCLOCK_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "pico_sched.h"
+
+// WALL CLOCK SETTINGS
+
+#define WALLCLOCK_STEP_US           128000      // offsets beyond this are stepped, smaller ones slewed
+#define WALLCLOCK_SLEW_US           16000000    // time over which an offset is slewed away
+#define WALLCLOCK_MAX_SLEW_PPB      500000      // fastest slew, 500 ppm on top of the drift correction
+#define WALLCLOCK_MAX_FREQ_PPB      500000      // drift estimates are clamped to this
+#define WALLCLOCK_PHASE_SHIFT       2           // an exchange slews away 1 / 2^n of its offset
+#define WALLCLOCK_FREQ_SHIFT        5           // and adds 1 / 2^n of offset / interval to the drift estimate
+#define WALLCLOCK_FREQ_MIN_US       8000000     // exchanges closer together only correct the phase
+#define WALLCLOCK_MAX_DELAY_US      500000      // exchanges with a longer round trip are discarded
+#define WALLCLOCK_DELAY_MARGIN_US   1000        // queueing up to this counts fully, more scales the offset down
+#define WALLCLOCK_SPIKE_US          100000      // exchanges queued longer than this are discarded
+#define WALLCLOCK_DELAY_DECAY_US    500         // the shortest round trip is forgotten this fast per exchange
+
+/**
+ * @brief Counters of the clock discipline. Offsets are server time minus local time.
+ */
+typedef struct {
+    uint32_t syncs;             // exchanges accepted
+    uint32_t rejected;          // exchanges discarded for their round trip or queueing
+    uint32_t steps;             // offsets too large to slew, the first sync included
+    int32_t offset_us;          // of the latest exchange
+    uint32_t max_offset_us;     // largest offset slewed since the last step
+    uint32_t delay_us;          // round trip of the latest exchange
+    int32_t freq_ppb;           // drift correction, positive when the crystal runs slow
+} wallclock_stats_t;
+
+/**
+ * @brief Correction published to the readers. Steady time runs at the monotonic rate corrected
+ * for the estimated drift and the ongoing slew, Unix time is steady time plus an offset.
+ */
+typedef struct {
+    uint64_t base_mono_us;      // monotonic time of the latest correction
+    uint64_t base_steady_us;    // steady time at base_mono_us
+    int64_t unix_offset_us;     // Unix time minus steady time
+    int32_t freq_ppb;
+    int32_t slew_ppb;
+    uint64_t slew_end_us;       // monotonic time the slew is complete
+    uint32_t generation;        // increases with every step
+    uint8_t synced;
+} wallclock_params_t;
+
+/**
+ * @brief Local time disciplined by NTP exchanges. Between exchanges the clock keeps time from
+ * the monotonic clock corrected for the estimated crystal drift. Small offsets are slewed away
+ * so time never runs backwards, large ones are stepped. Steady time, the monotonic time with the
+ * same corrections but without the steps, paces periodic work that must stay on the wall clock.
+ *
+ * One core updates the clock, any core reads it. Readers retry while an update is in progress.
+ */
+typedef struct {
+    sched_clock_fn mono_us;
+    atomic_uint_fast32_t seq;   // odd while the parameters are written
+    wallclock_params_t params;
+    uint64_t last_sync_us;      // monotonic time of the latest accepted exchange
+    uint32_t min_delay_us;      // shortest round trip seen lately
+    wallclock_stats_t stats;    // owned by the updating core
+} wallclock_t;
+
+/**
+ * @brief Initializes an unsynced clock, steady time starts out as the monotonic time.
+ *
+ * @param[out] clock The clock
+ * @param[in] mono_us Monotonic clock source, the crystal being disciplined
+ */
+void wallclock_init(wallclock_t *clock, sched_clock_fn mono_us);
+
+/**
+ * @brief Corrects the clock with one NTP exchange.
+ *
+ * @param[in,out] clock The clock
+ * @param[in] sent_us Monotonic time the request was sent
+ * @param[in] server_rx_us Unix time in microseconds the server received the request
+ * @param[in] server_tx_us Unix time in microseconds the server sent the reply
+ * @param[in] received_us Monotonic time the reply arrived
+ *
+ * @return 0 for success. 1 if the exchange was discarded.
+ */
+uint8_t wallclock_sync(wallclock_t *clock, uint64_t sent_us, uint64_t server_rx_us, uint64_t server_tx_us, uint64_t received_us);
+
+/**
+ * @brief Returns the current steady time in microseconds. Monotonic, never stepped.
+ */
+uint64_t wallclock_steady_us(const wallclock_t *clock);
+
+/**
+ * @brief Converts a steady time to Unix time.
+ *
+ * @param[in] clock The clock
+ * @param[in] steady_us Steady time
+ * @param[out] unix_us Microseconds since the Unix epoch
+ *
+ * @return 0 for success. 1 if the clock has not been synced yet.
+ */
+uint8_t wallclock_unix_us(const wallclock_t *clock, uint64_t steady_us, uint64_t *unix_us);
+
+/**
+ * @brief Returns the steady time of the next Unix time that is a multiple of period_ms, so
+ * devices sampling from there on sample at the same instants. 0 if the clock has not been synced.
+ */
+uint64_t wallclock_next_boundary(const wallclock_t *clock, uint32_t period_ms);
+
+/**
+ * @brief Returns the number of steps so far. A change means work aligned to the wall clock must be aligned again.
+ */
+uint32_t wallclock_generation(const wallclock_t *clock);
+
+/**
+ * @brief Returns the counters of the clock. Read on the updating core.
+ */
+const wallclock_stats_t *wallclock_get_stats(const wallclock_t *clock);
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef PICO_WIFI_H
 #define PICO_WIFI_H
 
+#include <stdint.h>
+
 #include "pico/cyw43_arch.h"
 
-#define WIFI_CONNECT_TIMEOUT_MS 20000
+#define WIFI_CONNECT_TIMEOUT_MS 20000       // per join attempt, from the join request to an IP address
+#define WIFI_INIT_POLL_MS       10
 
 /**
  * @brief enum for wifi statuses as return values
@@ -15,17 +18,36 @@ typedef enum{
 }PICO_WIFI_STATUS;
 
 /**
- * @brief Initialize the Wifi with the lwIP stack with the cyw43 chip.
- * 
+ * @brief join statistics. Time to link runs from the join request until the interface has an
+ * IP address. A direct join reuses the BSSID and channel of the last access point and skips the scan.
+ */
+typedef struct {
+    uint32_t joins;             // successful joins
+    uint32_t direct_joins;      // successful joins without a scan
+    uint32_t failed_joins;
+    uint32_t last_link_ms;
+    uint32_t max_link_ms;
+} wifi_stats_t;
+
+/**
+ * @brief Initialize the Wifi with the lwIP stack with the cyw43 chip. Blocks until the first
+ * join has finished or WIFI_CONNECT_TIMEOUT_MS has passed.
+ *
  * @return WIFI_STATUS_CONNECTED for succesfull init. WIFI_STATUS_NOT_CONNECTED for failed init.
  */
 PICO_WIFI_STATUS wifi_init();
 
 /**
- * @brief Checks the connection of the device. 
- * 
- * @return WIFI_STATUS_CONNECTED for stable connection | WIFI_STATUS_RE_CONNECTED if re-connected | WIFI_STATUS_NOT_CONNECTED if unable to re-connect.
+ * @brief Checks the connection of the device without blocking. A lost link starts a join in
+ * the background, which is advanced by the following calls.
+ *
+ * @return WIFI_STATUS_CONNECTED for stable connection | WIFI_STATUS_RE_CONNECTED once, when a join has just finished | WIFI_STATUS_NOT_CONNECTED while the link is down or a join is in progress.
  */
 PICO_WIFI_STATUS wifi_check_connection();
 
-#endif
\ No newline at end of file
+/**
+ * @brief Copies the join statistics.
+ */
+void wifi_get_stats(wifi_stats_t *stats);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PICO_WINDOW_H
+#define PICO_WINDOW_H
+
+#include <stdint.h>
+
+#include "pico_sample.h"
+
+// WINDOW SETTINGS
+
+#define WINDOW_EWMA_FRAC_BITS   8       // fractional bits kept by the EWMA between updates
+
+/**
+ * @brief Aggregates of one window. Each field holds the aggregate of every channel in the
+ * fixed point units of sample_t, the sensor index is 0.
+ */
+typedef struct {
+    uint32_t count;             // samples in the window
+    sample_t min;
+    sample_t max;
+    sample_t mean;
+    sample_t ewma;              // exponentially weighted moving average, runs across windows
+} window_summary_t;
+
+typedef struct {
+    int64_t sum;
+    int64_t ewma;               // value * 2^WINDOW_EWMA_FRAC_BITS
+    int32_t min;
+    int32_t max;
+} window_channel_t;
+
+/**
+ * @brief Rolling statistics over the samples of one publish window, in integer arithmetic only.
+ * The EWMA uses a weight of 1 / 2^ewma_shift for the newest sample.
+ */
+typedef struct {
+    window_channel_t channels[3];   // temperature, humidity, pressure
+    uint32_t count;
+    uint8_t ewma_shift;
+    uint8_t ewma_seeded;
+} window_t;
+
+/**
+ * @brief Initializes an empty window.
+ *
+ * @param[out] window The window
+ * @param[in] ewma_shift EWMA weight of the newest sample as a power of two, 2 gives 1/4
+ */
+void window_init(window_t *window, uint8_t ewma_shift);
+
+/**
+ * @brief Adds a sample to the window.
+ */
+void window_add(window_t *window, const sample_t *sample);
+
+/**
+ * @brief Computes the aggregates of the samples added since the last reset.
+ *
+ * @param[in] window The window
+ * @param[out] summary The aggregates. All zero when the window is empty.
+ */
+void window_summary(const window_t *window, window_summary_t *summary);
+
+/**
+ * @brief Starts a new window. The EWMA carries over.
+ */
+void window_reset(window_t *window);
+
+#endif
@@ -1,91 +1,624 @@
 #include "pico_log.h"
-#include "bme280.h"
 #include "include/pico_wifi.h"
 #include "include/pico_mqtt.h"
+#include "include/pico_flash.h"
+#include "include/pico_sample.h"
+#include "include/pico_store.h"
+#include "include/pico_backlog.h"
+#include "include/pico_batch.h"
+#include "include/pico_codec.h"
+#include "include/pico_sched.h"
+#include "include/pico_spsc.h"
+#include "include/pico_report.h"
+#include "include/pico_metrics.h"
+#include "include/pico_i2c.h"
+#include "include/pico_bme280.h"
+#include "include/pico_sensor.h"
+#include "include/pico_wallclock.h"
+#include "include/pico_ntp.h"
+#include "include/pico_trace.h"
+#include "include/pico_ota.h"
 #include "pico/time.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
 #include "hardware/watchdog.h"
+#include "lwip/stats.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
 
-#define WIFI_POLLING_MS 100
+#define LINK_SUPERVISION_MS 1000
 #define DEVICE_POLLING_MS 5000
-#define MQTT_PUBLISH_MS 20000
+#define DEVICE_POLLING_FAST_MS 1000
+#define REPORT_DEADBAND_TEMP 10         // 0.10 degrees Celsius
+#define REPORT_DEADBAND_HUMIDITY 50     // 0.50 %RH
+#define REPORT_DEADBAND_PRESSURE 20     // 0.20 hPa
+#define REPORT_HEARTBEAT_MS 600000
+#define REPORT_FAST_HOLD_MS 60000
+#define PUBLISH_CHECK_MS 1000
+#define MQTT_PUBLISH_MS 60000
+#define MQTT_BATCH_SAMPLES 12
+#define MQTT_PAYLOAD_FORMAT CODEC_FORMAT_JSON
 #define BLINK_INTERVAL_MS 1000
-#define MQTT_TOPIC "/room_meas"
+#define SCHED_STATS_MS 600000
+#define METRICS_PUBLISH_MS 300000
+#define NTP_CHECK_MS 1000
+#define TRACE_DUMP_MS 10000         // with PICO_TRACE, prints the latest spans of both cores
+#define OTA_CHECK_MS 250
+#define OTA_REBOOT_DELAY_MS 2000    // after the image is verified, so the status reaches the broker
+#define LOG_DRAIN_RECORDS 8         // log records printed per idle pass of the main loop
+#define MQTT_TOPIC "/room_meas/"              // followed by the sensor name
+#define MQTT_BACKLOG_SUBTOPIC "/backlog"        // after the topic of the sensor
+#define MQTT_DIAG_TOPIC "/diag/"            // followed by the device id
 
-int main()
-{
-    stdio_init_all();
-    sleep_ms(5000);
+typedef struct {
+    MQTT_client_handle_t mqtt;
+    uint8_t online;
+    uint8_t led_on;
+} app_t;
+
+// Publishing state of one sensor, owned by core 0
+typedef struct {
+    const char *name;
+    batch_t batch;
+    report_t report;
+    char topic[MQTT_TOPIC_LEN];
+    char backlog_topic[MQTT_TOPIC_LEN];
+} channel_t;
+
+static app_t app;
+static sched_t sched;
+static flash_dev_t store_flash;
+static backlog_t backlog;
+static flash_dev_t ota_flash;
+static uint8_t ota_ready;
+static uint32_t ota_reboot_ms;
+static char ota_status_topic[MQTT_TOPIC_LEN];
+static uint8_t payload[MQTT_PAYLOAD_MAX_LEN + 1];
+static char diag_topic[MQTT_TOPIC_LEN];
+
+// Every BME280 found on either bus. The registry belongs to core 1 once it is launched.
+static i2c_bus_t buses[I2C_BUS_COUNT];
+static bme280_t bme280s[SENSOR_MAX_SENSORS];
+static sensor_registry_t sensors;
+static channel_t channels[SENSOR_MAX_SENSORS];
+static uint8_t channel_count;
+
+// Samples travel from the acquisition core to the networking core through this ring
+static spsc_queue_t sample_queue;
+
+// The fastest interval any sensor asks for, every sensor is read at it
+static atomic_uint_fast32_t polling_ms = DEVICE_POLLING_MS;
+
+// Disciplined by NTP on core 0, read by both cores
+static wallclock_t wallclock;
+
+static uint64_t clock_now_us(void) {
+    return time_us_64();
+}
+
+// Drift corrected time, paces the sensors so their grid stays on the wall clock
+static uint64_t steady_now_us(void) {
+    return wallclock_steady_us(&wallclock);
+}
+
+static uint32_t now_ms(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+static void log_batch_stats(const channel_t *channel) {
+    const batch_stats_t *stats = &channel->batch.stats;
+
+    PICO_LOGI("%s: %lu samples in %lu publishes (%lu publishes per 1000 samples), %lu bytes on air\n",
+        channel->name, (unsigned long)stats->samples, (unsigned long)stats->publishes,
+        (unsigned long)(stats->samples ? stats->publishes * 1000 / stats->samples : 0),
+        (unsigned long)stats->wire_bytes);
+}
+
+// Publishes the collected samples of a sensor as one payload. Samples that could not be
+// handed over to the broker are moved to the store.
+static void flush_batch(channel_t *channel) {
+    batch_t *batch = &channel->batch;
+
+    if (batch->count == 0) return;
+
+    TRACE_BEGIN(encode);
+    int len = batch_encode(batch, payload, sizeof(payload));
+    TRACE_END(encode, "batch_encode");
 
-    bme280_handle_t bm280_handle = NULL;
-    if (bme280_init(&bm280_handle, 0x76, INTERVAL_1000MS) != 0) {
-        panic("Unable to initialize the BM280 handle...");
+    TRACE_BEGIN(publish);
+    uint8_t err = !app.online || len <= 0 || MQTT_publish_bytes(app.mqtt, channel->topic, payload, (size_t)len) != 0;
+    TRACE_END(publish, "MQTT_publish_bytes");
+
+    if (!err) {
+        batch_commit(batch, MQTT_wire_bytes(strlen(channel->topic), (size_t)len), (size_t)len);
+        log_batch_stats(channel);
+        return;
     }
-    
-    if(wifi_init() != WIFI_STATUS_CONNECTED) {
-        panic("Unable to connect to wifi...");
+
+    if (app.online) {
+        PICO_LOGE("Publish failed, keeping samples in store\n");
     }
-    
-    MQTT_client_handle_t mqtt_handle = NULL;
-    if (MQTT_open(&mqtt_handle) != 0) {
-        panic("Unable to initialize MQTT...");
+    for (size_t i = 0; i < batch->count; i++) {
+        if (store_append(&batch->samples[i]) != 0) {
+            PICO_LOGE("Failed to store sample\n");
+        }
     }
-    
-    absolute_time_t next_device_poll = make_timeout_time_ms(DEVICE_POLLING_MS);
-    absolute_time_t next_publish = make_timeout_time_ms(MQTT_PUBLISH_MS);
-    absolute_time_t next_blink = make_timeout_time_ms(BLINK_INTERVAL_MS);
+    batch_clear(batch);
+}
 
-    uint8_t led_on = 0;
+// Records of a sensor that is gone are published under the first one
+static const char *backlog_topic(__unused void *arg, uint16_t sensor) {
+    return sensor < channel_count ? channels[sensor].backlog_topic : channels[0].backlog_topic;
+}
 
-    int err = 0;
+// Runs in lwIP's context for every completed publish
+static void publish_done(__unused void *arg, const char *topic, int err, __unused uint32_t latency_us) {
+    backlog_publish_done(&backlog, topic, err);
+}
 
-    while(1) {
-        cyw43_arch_poll();
+// Publishes the oldest samples recorded while offline. They stay in the store until the
+// broker acknowledged them.
+static void drain_store(void) {
+    int len = backlog_drain(&backlog, payload, sizeof(payload));
+    if (len <= 0) return;
 
-        err = wifi_check_connection();
+    channel_t *channel = backlog.sensor < channel_count ? &channels[backlog.sensor] : &channels[0];
+    batch_stats_record(&channel->batch.stats, backlog.in_flight, MQTT_wire_bytes(strlen(channel->backlog_topic), (size_t)len), (size_t)len);
+}
 
-        if(err == WIFI_STATUS_CONNECTED) {
-            if (MQTT_poll(mqtt_handle) != 0) {
-                if(MQTT_reconnect(&mqtt_handle) != 0) {
-                    watchdog_reboot(0,0,0);
-                }
-            }
+// Supervises Wi-Fi and the broker connection
+static void link_task(__unused void *arg) {
+    TRACE_BEGIN(check);
+    int err = wifi_check_connection();
+    TRACE_END(check, "wifi_check_connection");
+
+    if(err == WIFI_STATUS_RE_CONNECTED) {
+        // The broker connection did not survive the link, start over without waiting for the backoff
+        metrics_count(METRIC_WIFI_REJOINS);
+        MQTT_reconnect(app.mqtt);
+    }
 
-            if(absolute_time_diff_us(get_absolute_time(), next_publish) <= 0) {
-                PICO_LOGI("Publish to topic\n");
+    if(err == WIFI_STATUS_NOT_CONNECTED) {
+        app.online = 0;
+    }
+    else {
+        // Keep sampling into the store while the broker is unreachable
+        TRACE_BEGIN(process);
+        app.online = MQTT_process(app.mqtt) == MQTT_STATE_CONNECTED;
+        TRACE_END(process, "MQTT_process");
+    }
 
-                if (MQTT_publish(mqtt_handle, MQTT_TOPIC, bme280_get_json(bm280_handle)) != 0) {
-                    PICO_LOGE("Publish failed\n");
-                }
+    // Hand the batches over to the store as soon as the link is lost
+    if (!app.online) {
+        for (uint8_t i = 0; i < channel_count; i++) {
+            flush_batch(&channels[i]);
+        }
+    }
+}
 
-                next_publish = make_timeout_time_ms(MQTT_PUBLISH_MS);
-            }
+// Runs on core 1 for every sample read. Samples taken before the first NTP reply carry no time.
+static void push_sample(__unused void *arg, __unused uint8_t sensor, const sample_t *sample, uint64_t taken_us) {
+    sample_t stamped = *sample;
+    uint64_t unix_us;
+
+    if (wallclock_unix_us(&wallclock, taken_us, &unix_us) == 0) {
+        sample_set_time(&stamped, unix_us);
+    }
+
+    if (spsc_push(&sample_queue, &stamped) != 0) {
+        PICO_LOGE("Sample queue full\n");
+    }
+    else {
+        // Wake core 0 from cyw43_arch_wait_for_work_until
+        __sev();
+    }
+}
+
+// Core 1 owns the sensors. It reads them on a fixed grid, staggered over the polling interval,
+// and hands the fixed point readings to core 0, so slow I2C and slow TLS writes never delay each other.
+// The burst reads run by DMA, their completion interrupt wakes the core to emit the sample.
+// Once the clock is synced the grid starts on a multiple of the interval in Unix time, so every
+// device of the fleet samples at the same instants. It is aligned again after a step of the clock
+// and when the interval changes.
+static void acquisition_core(void) {
+    uint32_t aligned_generation = 0;
+    uint32_t aligned_ms = 0;
+
+    // Allow core 0 to pause this core while it writes the sample store
+    flash_safe_execute_core_init();
+
+    sensor_start(&sensors, DEVICE_POLLING_MS);
+
+    while (1) {
+        uint32_t period_ms = (uint32_t)atomic_load_explicit(&polling_ms, memory_order_relaxed);
+        uint32_t generation = wallclock_generation(&wallclock);
 
-            if(absolute_time_diff_us(get_absolute_time(), next_device_poll) <= 0) {
-                if (bme280_read_data(bm280_handle) != 0) {
-                    PICO_LOGE("Failed to read data from BM280\n");
-                }
+        sensor_set_period(&sensors, period_ms);
+        if (generation != aligned_generation || period_ms != aligned_ms) {
+            uint64_t boundary_us = wallclock_next_boundary(&wallclock, period_ms);
 
-                next_device_poll = make_timeout_time_ms(DEVICE_POLLING_MS);
+            if (boundary_us != 0) {
+                sensor_align(&sensors, boundary_us);
+                aligned_generation = generation;
+                aligned_ms = period_ms;
             }
+        }
+
+        // The sensors run on steady time, which is within a few hundred ppm of the timer
+        uint64_t next_us = sensor_run(&sensors);
+        uint64_t now_us = steady_now_us();
+
+        TRACE_BEGIN(wait);
+        best_effort_wfe_or_timeout(delayed_by_us(get_absolute_time(), next_us > now_us ? next_us - now_us : 0));
+        TRACE_END(wait, "wait");
+    }
+}
 
-            if(absolute_time_diff_us(get_absolute_time(), next_blink) <= 0) {
-                led_on = !led_on;
-                cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, led_on);
+// Moves the samples handed over by core 1 into the batch of their sensor, or into the store
+// while offline. Samples within the deadband of the last one passed on are dropped.
+static void consume_samples(void) {
+    sample_t sample;
 
-                next_blink = make_timeout_time_ms(BLINK_INTERVAL_MS);
+    while (spsc_pop(&sample_queue, &sample) == 0) {
+        if (sample.sensor >= channel_count) continue;
+
+        channel_t *channel = &channels[sample.sensor];
+
+        // The window aggregates cover suppressed samples as well
+        batch_observe(&channel->batch, &sample);
+
+        uint8_t wanted = report_check(&channel->report, &sample, now_ms());
+
+        // Sample faster while the values of any sensor are moving
+        uint32_t interval_ms = DEVICE_POLLING_MS;
+        for (uint8_t i = 0; i < channel_count; i++) {
+            uint32_t channel_ms = report_interval_ms(&channels[i].report, now_ms());
+            if (channel_ms < interval_ms) interval_ms = channel_ms;
+        }
+        atomic_store_explicit(&polling_ms, interval_ms, memory_order_relaxed);
+
+        if (!wanted) continue;
+
+        if (!app.online) {
+            if (store_append(&sample) != 0) {
+                PICO_LOGE("Failed to store sample\n");
             }
         }
+        else if (batch_add(&channel->batch, &sample, now_ms()) != 0) {
+            flush_batch(channel);
 
-        else if(err == WIFI_STATUS_RE_CONNECTED) {
-            if(MQTT_reconnect(&mqtt_handle) != 0) {
-                watchdog_reboot(0,0,0);
+            // The flush could not empty the batch, the publish queue may be full
+            if (batch_add(&channel->batch, &sample, now_ms()) != 0 && store_append(&sample) != 0) {
+                PICO_LOGE("Failed to store sample\n");
             }
         }
+    }
+}
+
+// Publishes when the batch is full or its flush deadline has passed and drains the store
+static void publish_task(__unused void *arg) {
+    if (!app.online) return;
+
+    if (store_pending() > 0) {
+        drain_store();
+    }
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        if (batch_ready(&channels[i].batch, now_ms())) {
+            flush_batch(&channels[i]);
+        }
+    }
+}
+
+static void ntp_task(__unused void *arg) {
+    ntp_process();
+}
+
+// Publishes the status of a firmware transfer and reboots into a verified image. The transfer
+// itself runs in the MQTT callbacks.
+static void ota_task(__unused void *arg) {
+    char status[OTA_STATUS_MAX_LEN];
+    int len = 0;
+
+    cyw43_arch_lwip_begin();
+    if (app.online) {
+        len = ota_status(status, sizeof(status));
+    }
+    ota_state_t state = ota_state();
+    cyw43_arch_lwip_end();
+
+    if (len > 0) {
+        MQTT_publish_bytes(app.mqtt, ota_status_topic, (const uint8_t *)status, (size_t)len);
+    }
+
+    if (state != OTA_VERIFIED) return;
+
+    if (ota_reboot_ms == 0) {
+        ota_reboot_ms = now_ms() + OTA_REBOOT_DELAY_MS;
+        return;
+    }
+    if ((int32_t)(now_ms() - ota_reboot_ms) < 0) return;
+
+    // Unsent samples go to the store and are published by the new image
+    app.online = 0;
+    for (uint8_t i = 0; i < channel_count; i++) {
+        flush_batch(&channels[i]);
+    }
+
+    PICO_LOGI("Rebooting to install the update\n");
+    log_flush();
+    watchdog_reboot(0, 0, 0);
+}
+
+// Subscribes to the firmware transfer topics of the device
+static void ota_subscribe(void) {
+    static const MQTT_consumer_t chunk_consumer = {
+        .begin = ota_chunk_begin,
+        .data = ota_chunk_data
+    };
+    char topic[MQTT_TOPIC_LEN];
+    const char *id = MQTT_device_id(app.mqtt);
+
+    snprintf(ota_status_topic, sizeof(ota_status_topic), "%s%s%s", OTA_TOPIC, id, OTA_STATUS_SUBTOPIC);
+
+    snprintf(topic, sizeof(topic), "%s%s%s", OTA_TOPIC, id, OTA_BEGIN_SUBTOPIC);
+    if (MQTT_subscribe_handler(app.mqtt, topic, ota_begin_handler, NULL) != 0) {
+        PICO_LOGE("Unable to subscribe to %s\n", topic);
+    }
+
+    // Chunks are written to flash as they arrive instead of being reassembled by the router
+    snprintf(topic, sizeof(topic), "%s%s%s", OTA_TOPIC, id, OTA_CHUNK_SUBTOPIC);
+    if (MQTT_subscribe_stream(app.mqtt, topic, &chunk_consumer) != 0) {
+        PICO_LOGE("Unable to subscribe to %s\n", topic);
+    }
+}
+
+#if PICO_TRACE
+static void trace_task(__unused void *arg) {
+    trace_dump();
+}
+#endif
+
+static void blink_task(__unused void *arg) {
+    if (!app.online) return;
+
+    app.led_on = !app.led_on;
+    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, app.led_on);
+}
+
+static void stats_task(__unused void *arg) {
+    sched_log_stats(&sched);
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        const report_stats_t *stats = &channels[i].report.stats;
+        // Written by core 1, a torn pair of counters only skews one log line
+        const sensor_stats_t *reads = &sensor_get(&sensors, i)->stats;
+
+        PICO_LOGI("%s: %lu reads, %lu failed, %lu samples sent, %lu suppressed by the deadband, %lu heartbeats\n",
+            channels[i].name, (unsigned long)reads->reads, (unsigned long)reads->failures,
+            (unsigned long)stats->sent, (unsigned long)stats->suppressed, (unsigned long)stats->heartbeats);
+        PICO_LOGI("%s: %lu us of CPU per sample, %lu us at most\n", channels[i].name,
+            (unsigned long)(reads->reads ? reads->busy_us / reads->reads : 0), (unsigned long)reads->max_busy_us);
+    }
+
+    uint32_t period_ms = (uint32_t)atomic_load_explicit(&polling_ms, memory_order_relaxed);
+    PICO_LOGI("Sensor current %lu nA estimated, %lu nA in normal mode\n",
+        (unsigned long)(channel_count * bme280_estimate_current_na(period_ms, 1)),
+        (unsigned long)(channel_count * bme280_estimate_current_na(period_ms, 0)));
+
+    const wallclock_stats_t *clock_stats = wallclock_get_stats(&wallclock);
+    const ntp_stats_t *ntp_stats = ntp_get_stats();
+    PICO_LOGI("Clock: %lu NTP replies of %lu requests, %lu rejected, %lu steps, offset %ld us, drift %ld ppb\n",
+        (unsigned long)ntp_stats->replies, (unsigned long)ntp_stats->requests, (unsigned long)clock_stats->rejected,
+        (unsigned long)clock_stats->steps, (long)clock_stats->offset_us, (long)clock_stats->freq_ppb);
+
+    for (unsigned int core = 0; core < 2; core++) {
+        const log_stats_t *log_stats = log_get_stats(core);
+        PICO_LOGI("Log core %u: %lu records, %lu dropped, %lu of %d ring bytes used at most\n", core,
+            (unsigned long)log_stats->records, (unsigned long)log_stats->dropped,
+            (unsigned long)log_stats->max_used, LOG_RING_SIZE);
+    }
+}
+
+// Reads the gauges from the modules that keep their own counters
+static void collect_metrics(void) {
+    struct mallinfo heap = mallinfo();
+    metrics_gauge(METRIC_HEAP_USED, (uint32_t)heap.uordblks);
+
+#if MEM_STATS && !MEM_LIBC_MALLOC
+    metrics_gauge(METRIC_LWIP_MEM_USED, (uint32_t)lwip_stats.mem.used);
+#endif
+#if TCP_STATS
+    metrics_gauge(METRIC_TCP_REXMIT, lwip_stats.tcp.rexmit);
+    metrics_gauge(METRIC_TCP_DROP, lwip_stats.tcp.drop);
+#endif
+
+    metrics_gauge(METRIC_LOG_DROPPED, log_get_stats(0)->dropped + log_get_stats(1)->dropped);
+    metrics_gauge(METRIC_QUEUE_DROPPED, (uint32_t)atomic_load_explicit(&sample_queue.dropped, memory_order_relaxed));
+    metrics_gauge(METRIC_STORE_PENDING, store_pending());
+
+    report_stats_t totals = {0};
+    for (uint8_t i = 0; i < channel_count; i++) {
+        totals.sent += channels[i].report.stats.sent;
+        totals.suppressed += channels[i].report.stats.suppressed;
+        totals.heartbeats += channels[i].report.stats.heartbeats;
+    }
+    metrics_gauge(METRIC_SAMPLES_SENT, totals.sent);
+    metrics_gauge(METRIC_SAMPLES_SUPPRESSED, totals.suppressed);
+    metrics_gauge(METRIC_HEARTBEATS, totals.heartbeats);
+
+    uint64_t busy_us = 0;
+    uint32_t reads = 0;
+    for (uint8_t i = 0; i < channel_count; i++) {
+        busy_us += sensor_get(&sensors, i)->stats.busy_us;
+        reads += sensor_get(&sensors, i)->stats.reads;
+    }
+    metrics_gauge(METRIC_SENSOR_CPU_US, reads ? (uint32_t)(busy_us / reads) : 0);
+    metrics_gauge(METRIC_SENSOR_CURRENT_NA, channel_count *
+        bme280_estimate_current_na((uint32_t)atomic_load_explicit(&polling_ms, memory_order_relaxed), 1));
+
+    int32_t offset_us = wallclock_get_stats(&wallclock)->offset_us;
+    metrics_gauge(METRIC_CLOCK_OFFSET_US, (uint32_t)(offset_us < 0 ? -(int64_t)offset_us : offset_us));
+}
+
+// Publishes a snapshot of the metrics to the diagnostics topic of the device
+static void metrics_task(__unused void *arg) {
+    collect_metrics();
+
+    if (!app.online) return;
+
+    int len = metrics_to_json(to_ms_since_boot(get_absolute_time()) / 1000, (char *)payload, sizeof(payload));
+    if (len < 0) {
+        PICO_LOGE("Metrics payload does not fit\n");
+        return;
+    }
+
+    MQTT_publish_bytes(app.mqtt, diag_topic, payload, (size_t)len);
+}
+
+// Probes both addresses on both buses and registers every BME280 that answers.
+// Returns the number of sensors found.
+static uint8_t open_sensors(void) {
+    static const unsigned int pins[I2C_BUS_COUNT][2] = {
+        { I2C0_SDA_PIN, I2C0_SCL_PIN },
+        { I2C1_SDA_PIN, I2C1_SCL_PIN }
+    };
+    static const uint8_t addrs[] = { BME280_ADDR_PRIMARY, BME280_ADDR_SECONDARY };
+
+    sensor_registry_init(&sensors, steady_now_us, push_sample, NULL);
+
+    for (uint8_t bus = 0; bus < I2C_BUS_COUNT; bus++) {
+        if (i2c_bus_init_onboard(&buses[bus], bus, pins[bus][0], pins[bus][1], I2C_BAUD) != 0) continue;
+
+        for (size_t a = 0; a < sizeof(addrs); a++) {
+            bme280_t *dev = &bme280s[channel_count];
+            char name[SENSOR_NAME_LEN];
+
+            if (bme280_probe(&buses[bus], addrs[a]) != 0 || bme280_open(dev, &buses[bus], addrs[a]) != 0) continue;
+
+            snprintf(name, sizeof(name), "i2c%u-%02x", bus, addrs[a]);
+            int index = sensor_register(&sensors, name, &bme280_sensor_ops, dev);
+            if (index < 0) continue;
+
+            channels[index].name = sensor_get(&sensors, (uint8_t)index)->name;
+            channel_count++;
+            PICO_LOGI("BME280 %s\n", name);
+        }
+    }
+
+    return channel_count;
+}
+
+// Prints the queued log records before giving up
+static void fatal(const char *reason) {
+    log_flush();
+    panic("%s", reason);
+}
+
+int main()
+{
+    stdio_init_all();
+    sleep_ms(5000);
+
+    // The boot stage installed a staged update before this image started
+    ota_ready = ota_boot(&ota_flash) == 0;
+
+    wallclock_init(&wallclock, clock_now_us);
+
+    if (open_sensors() == 0) {
+        fatal("No BME280 found on either I2C bus...");
+    }
+
+    if (flash_dev_init_onboard(&store_flash, FLASH_STORE_OFFSET, FLASH_STORE_SIZE) != 0 ||
+        store_init(&store_flash) != 0) {
+        fatal("Unable to mount the sample store...");
+    }
+
+    const report_config_t report_config = {
+        .deadband_temperature = REPORT_DEADBAND_TEMP,
+        .deadband_humidity = REPORT_DEADBAND_HUMIDITY,
+        .deadband_pressure = REPORT_DEADBAND_PRESSURE,
+        .heartbeat_ms = REPORT_HEARTBEAT_MS,
+        .slow_interval_ms = DEVICE_POLLING_MS,
+        .fast_interval_ms = DEVICE_POLLING_FAST_MS,
+        .fast_hold_ms = REPORT_FAST_HOLD_MS
+    };
+    for (uint8_t i = 0; i < channel_count; i++) {
+        channel_t *channel = &channels[i];
+
+        batch_init(&channel->batch, MQTT_PAYLOAD_FORMAT, MQTT_BATCH_SAMPLES, MQTT_PAYLOAD_MAX_LEN, MQTT_PUBLISH_MS);
+        report_init(&channel->report, &report_config);
+        snprintf(channel->topic, sizeof(channel->topic), "%s%s", MQTT_TOPIC, channel->name);
+        snprintf(channel->backlog_topic, sizeof(channel->backlog_topic), "%s%s", channel->topic, MQTT_BACKLOG_SUBTOPIC);
+    }
+
+    if(wifi_init() != WIFI_STATUS_CONNECTED) {
+        fatal("Unable to connect to wifi...");
+    }
+
+    if (MQTT_open(&app.mqtt) != 0) {
+        fatal("Unable to initialize MQTT...");
+    }
+    backlog_init(&backlog, app.mqtt, MQTT_PAYLOAD_FORMAT, backlog_topic, NULL);
+    MQTT_set_publish_cb(app.mqtt, publish_done, NULL);
+
+    // Samples carry no time until the first reply, the device works without one
+    ntp_init(&wallclock);
+
+    // The broker connection comes up in the background, samples go to the store until then
+    app.online = 0;
+    snprintf(diag_topic, sizeof(diag_topic), "%s%s", MQTT_DIAG_TOPIC, MQTT_device_id(app.mqtt));
+    if (ota_ready) {
+        ota_subscribe();
+    }
+
+    spsc_init(&sample_queue);
+    multicore_launch_core1(acquisition_core);
+
+    // A task that does not fit would never run
+    uint8_t full = 0;
+    sched_init(&sched, clock_now_us);
+    full |= sched_add(&sched, "link", LINK_SUPERVISION_MS, LINK_SUPERVISION_MS, link_task, NULL) < 0;
+    full |= sched_add(&sched, "publish", PUBLISH_CHECK_MS, PUBLISH_CHECK_MS, publish_task, NULL) < 0;
+    full |= sched_add(&sched, "ntp", NTP_CHECK_MS, NTP_CHECK_MS, ntp_task, NULL) < 0;
+    full |= sched_add(&sched, "blink", BLINK_INTERVAL_MS, BLINK_INTERVAL_MS, blink_task, NULL) < 0;
+    full |= sched_add(&sched, "stats", SCHED_STATS_MS, SCHED_STATS_MS, stats_task, NULL) < 0;
+    full |= sched_add(&sched, "metrics", METRICS_PUBLISH_MS, METRICS_PUBLISH_MS, metrics_task, NULL) < 0;
+    if (ota_ready) {
+        full |= sched_add(&sched, "ota", OTA_CHECK_MS, OTA_CHECK_MS, ota_task, NULL) < 0;
+    }
+#if PICO_TRACE
+    full |= sched_add(&sched, "trace", TRACE_DUMP_MS, TRACE_DUMP_MS, trace_task, NULL) < 0;
+#endif
+    if (full) {
+        fatal("Too many tasks for SCHED_MAX_TASKS...");
+    }
+
+    while(1) {
+        uint64_t busy_start = time_us_64();
+
+        TRACE_BEGIN(poll);
+        cyw43_arch_poll();
+        TRACE_END(poll, "cyw43_arch_poll");
+
+        TRACE_BEGIN(consume);
+        consume_samples();
+        TRACE_END(consume, "consume_samples");
+
+        // Sleep until the next task is due, the network has work to do or core 1 sends a sample
+        uint64_t next_deadline = sched_run(&sched);
+        metrics_observe(METRIC_LOOP_US, (uint32_t)(time_us_64() - busy_start));
+        // Print queued log records while idle, and come straight back if some are left
+        TRACE_BEGIN(drain);
+        uint8_t pending = log_drain(LOG_DRAIN_RECORDS);
+        TRACE_END(drain, "log_drain");
 
-        else if(err == WIFI_STATUS_NOT_CONNECTED) {
-            watchdog_reboot(0,0,0);
+        if (pending == 0) {
+            TRACE_BEGIN(wait);
+            cyw43_arch_wait_for_work_until(from_us_since_boot(next_deadline));
+            TRACE_END(wait, "wait");
         }
-        
-        cyw43_arch_wait_for_work_until(make_timeout_time_ms(100));
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+# Builds the host targets once per mbedTLS profile and runs tls_bench against the broker,
+# followed by the code size of the mbedTLS libraries of that profile.
+#
+#     PICO_SDK_PATH=~/.pico-sdk/sdk/2.1.1 PRECONFIGURED_TAPIF=tap0 scripts/tls_profiles.sh -n 50
+#
+# Arguments are passed on to tls_bench. When arm-none-eabi-size is on the PATH the firmware
+# is also built once per profile and the size of its ELF is printed, which is what the
+# profile costs in flash and static RAM on the board.
+
+set -e
+
+HOST_DIR=$(cd "$(dirname "$0")/../host" && pwd)
+REPO_DIR=$(dirname "$HOST_DIR")
+
+for profile in full minimal; do
+    build="build-host-tls-$profile"
+
+    cmake -S "$HOST_DIR" -B "$build" -DCMAKE_BUILD_TYPE=Release -DTLS_PROFILE="$profile" > /dev/null
+    cmake --build "$build" --target tls_bench > /dev/null
+
+    echo "== $profile"
+    "./$build/tls_bench" "$@"
+    size -t "$build"/mbedtls/library/libmbedcrypto.a "$build"/mbedtls/library/libmbedx509.a \
+        "$build"/mbedtls/library/libmbedtls.a | tail -n 1 | awk '{ print "code:        " $1 " bytes text, " $3 " bytes bss" }'
+
+    if command -v arm-none-eabi-size > /dev/null; then
+        firmware="build-tls-$profile"
+
+        cmake -S "$REPO_DIR" -B "$firmware" -DCMAKE_BUILD_TYPE=Release -DTLS_PROFILE="$profile" > /dev/null
+        cmake --build "$firmware" --target raspberry_pico_w_bme280_i2c > /dev/null
+        arm-none-eabi-size "$firmware/raspberry_pico_w_bme280_i2c.elf" | tail -n 1 | \
+            awk '{ print "firmware:    " $1 " bytes text, " $2 " bytes data, " $3 " bytes bss" }'
+    fi
+done
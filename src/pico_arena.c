@@ -0,0 +1,146 @@
+#include "pico_arena.h"
+
+#include <string.h>
+
+#include "hardware/sync.h"
+
+_Static_assert(ARENA_HEADER_LEN % ARENA_ALIGN == 0, "the header must keep the payload aligned");
+
+// Marks an allocated block in place of the free list link, catches double frees
+#define ARENA_MAGIC         0xA110C8EDu
+
+// Smallest remainder worth splitting off as a free block
+#define ARENA_MIN_SPLIT     (ARENA_HEADER_LEN + ARENA_ALIGN)
+
+typedef struct {
+    uint32_t size;              // of the whole block, header included
+    uint32_t next;              // offset of the next free block, or ARENA_MAGIC when allocated
+} arena_block_t;
+
+static arena_block_t *block_at(const arena_t *arena, uint32_t offset) {
+    return (arena_block_t *)(void *)&arena->buf[offset];
+}
+
+void arena_init(arena_t *arena, void *buf, size_t size) {
+    memset(arena, 0, sizeof(*arena));
+
+    arena->buf = buf;
+    arena->size = (uint32_t)(size & ~(size_t)(ARENA_ALIGN - 1));
+    arena->free_head = 0;
+
+    arena_block_t *block = block_at(arena, 0);
+    block->size = arena->size;
+    block->next = arena->size;
+}
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size) {
+    if (count == 0 || size == 0 || count > (UINT32_MAX - ARENA_HEADER_LEN - ARENA_ALIGN) / size) {
+        return NULL;
+    }
+
+    uint32_t need = (uint32_t)((count * size + ARENA_HEADER_LEN + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+    arena_block_t *found = NULL;
+
+    uint32_t irq = save_and_disable_interrupts();
+
+    uint32_t *link = &arena->free_head;
+    while (*link < arena->size) {
+        arena_block_t *block = block_at(arena, *link);
+
+        if (block->size >= need) {
+            if (block->size - need >= ARENA_MIN_SPLIT) {
+                // Hand out the tail, the free block stays where it is in the list
+                block->size -= need;
+                found = block_at(arena, *link + block->size);
+                found->size = need;
+            } else {
+                *link = block->next;
+                found = block;
+            }
+            found->next = ARENA_MAGIC;
+            break;
+        }
+        link = &block->next;
+    }
+
+    if (found) {
+        arena->used += found->size;
+        arena->allocs++;
+        if (arena->used > arena->peak) arena->peak = arena->used;
+    } else {
+        arena->failed++;
+    }
+
+    restore_interrupts(irq);
+
+    if (!found) return NULL;
+
+    // Cleared outside of the critical section, the block is already ours
+    void *ptr = (uint8_t *)found + ARENA_HEADER_LEN;
+    memset(ptr, 0, found->size - ARENA_HEADER_LEN);
+    return ptr;
+}
+
+void arena_free(arena_t *arena, void *ptr) {
+    if (!ptr) return;
+
+    uint32_t offset = (uint32_t)((uint8_t *)ptr - arena->buf) - ARENA_HEADER_LEN;
+    arena_block_t *block = block_at(arena, offset);
+
+    if (offset >= arena->size || block->next != ARENA_MAGIC) return;
+
+    uint32_t irq = save_and_disable_interrupts();
+
+    arena->used -= block->size;
+    arena->frees++;
+
+    // Find the free neighbours on either side in the address ordered list
+    uint32_t prev = arena->size;
+    uint32_t next = arena->free_head;
+    while (next < offset) {
+        prev = next;
+        next = block_at(arena, next)->next;
+    }
+
+    block->next = next;
+    if (next < arena->size && offset + block->size == next) {
+        block->size += block_at(arena, next)->size;
+        block->next = block_at(arena, next)->next;
+    }
+
+    if (prev == arena->size) {
+        arena->free_head = offset;
+    } else {
+        arena_block_t *prev_block = block_at(arena, prev);
+
+        if (prev + prev_block->size == offset) {
+            prev_block->size += block->size;
+            prev_block->next = block->next;
+        } else {
+            prev_block->next = offset;
+        }
+    }
+
+    restore_interrupts(irq);
+}
+
+void arena_get_stats(const arena_t *arena, arena_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    uint32_t irq = save_and_disable_interrupts();
+
+    stats->used = arena->used;
+    stats->peak = arena->peak;
+    stats->allocs = arena->allocs;
+    stats->frees = arena->frees;
+    stats->failed = arena->failed;
+
+    for (uint32_t offset = arena->free_head; offset < arena->size; offset = block_at(arena, offset)->next) {
+        uint32_t size = block_at(arena, offset)->size;
+
+        stats->free_blocks++;
+        if (size - ARENA_HEADER_LEN > stats->largest_free) stats->largest_free = size - ARENA_HEADER_LEN;
+    }
+
+    restore_interrupts(irq);
+}
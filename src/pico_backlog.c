@@ -0,0 +1,89 @@
+#include "pico_backlog.h"
+#include "pico_log.h"
+
+#include <string.h>
+
+static uint32_t store_dropped(void) {
+    store_stats_t stats;
+    store_get_stats(&stats);
+    return stats.dropped;
+}
+
+void backlog_init(backlog_t *backlog, MQTT_client_handle_t mqtt, codec_format_t format, backlog_topic_fn_t topic, void *arg) {
+    memset(backlog, 0, sizeof(*backlog));
+
+    backlog->mqtt = mqtt;
+    backlog->format = format;
+    backlog->topic = topic;
+    backlog->topic_arg = arg;
+}
+
+// Consumes the records of the payload in flight if the broker acknowledged it
+static void settle(backlog_t *backlog) {
+    size_t run = backlog->in_flight;
+
+    backlog->in_flight = 0;
+    backlog->completed = 0;
+
+    // Given up by the publish queue, the records are sent again right away
+    if (backlog->err != 0) {
+        backlog->stats.failed++;
+        return;
+    }
+
+    // The store overwrote its oldest records meanwhile, consuming run records now would
+    // consume ones that were never sent
+    if (store_dropped() != backlog->dropped) {
+        backlog->stats.kept++;
+        return;
+    }
+
+    if (store_consume(run) != 0) {
+        PICO_LOGE("Failed to consume backlog records\n");
+        return;
+    }
+    backlog->stats.acked++;
+}
+
+int backlog_drain(backlog_t *backlog, uint8_t *buf, size_t buf_len) {
+    if (backlog->in_flight > 0) {
+        if (!backlog->completed) return 0;
+        settle(backlog);
+    }
+
+    size_t count = store_peek(backlog->samples, STORE_DRAIN_BATCH);
+    if (count == 0) return 0;
+
+    size_t run = 1;
+    while (run < count && backlog->samples[run].sensor == backlog->samples[0].sensor) {
+        run++;
+    }
+
+    int len = codec_encode(backlog->format, backlog->samples, run, NULL, buf, buf_len);
+    if (len < 0) {
+        PICO_LOGE("Backlog payload does not fit\n");
+        return -1;
+    }
+
+    // In flight before the publish, a completion may arrive from within it
+    backlog->in_flight = run;
+    backlog->sensor = backlog->samples[0].sensor;
+    backlog->in_flight_topic = backlog->topic(backlog->topic_arg, backlog->sensor);
+    backlog->dropped = store_dropped();
+
+    if (MQTT_publish_bytes(backlog->mqtt, backlog->in_flight_topic, buf, (size_t)len) != 0) {
+        backlog->in_flight = 0;
+        return -1;
+    }
+
+    backlog->stats.publishes++;
+    return len;
+}
+
+uint8_t backlog_publish_done(backlog_t *backlog, const char *topic, int err) {
+    if (backlog->in_flight == 0 || backlog->completed || strcmp(topic, backlog->in_flight_topic) != 0) return 0;
+
+    backlog->err = err;
+    backlog->completed = 1;
+    return 1;
+}
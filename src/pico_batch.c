@@ -0,0 +1,70 @@
+#include "pico_batch.h"
+
+#include <string.h>
+
+void batch_init(batch_t *batch, codec_format_t format, size_t max_samples, size_t max_bytes, uint32_t flush_ms) {
+    memset(batch, 0, sizeof(*batch));
+
+    batch->format = format;
+    batch->max_samples = max_samples > BATCH_MAX_SAMPLES ? BATCH_MAX_SAMPLES : max_samples;
+    if (batch->max_samples == 0) batch->max_samples = 1;
+    batch->max_bytes = max_bytes;
+    batch->flush_ms = flush_ms;
+    batch->bytes = codec_frame_len(format, 1);
+    window_init(&batch->window, BATCH_EWMA_SHIFT);
+}
+
+void batch_observe(batch_t *batch, const sample_t *sample) {
+    window_add(&batch->window, sample);
+}
+
+uint8_t batch_add(batch_t *batch, const sample_t *sample, uint32_t now_ms) {
+    size_t bytes = batch->bytes + codec_sample_len(batch->format, sample, batch->count);
+    if (batch->count >= batch->max_samples || bytes > batch->max_bytes) {
+        return 1;
+    }
+
+    if (batch->count == 0) {
+        batch->first_ms = now_ms;
+    }
+    batch->samples[batch->count++] = *sample;
+    batch->bytes = bytes;
+
+    return 0;
+}
+
+uint8_t batch_ready(const batch_t *batch, uint32_t now_ms) {
+    if (batch->count == 0) return 0;
+
+    if (batch->count >= batch->max_samples) return 1;
+
+    // Another sample of the longest possible encoding would not fit the budget
+    if (batch->bytes + codec_sample_max_len(batch->format) > batch->max_bytes) return 1;
+
+    return (uint32_t)(now_ms - batch->first_ms) >= batch->flush_ms;
+}
+
+int batch_encode(const batch_t *batch, uint8_t *buf, size_t buf_len) {
+    window_summary_t summary;
+    window_summary(&batch->window, &summary);
+
+    return codec_encode(batch->format, batch->samples, batch->count, &summary, buf, buf_len);
+}
+
+void batch_commit(batch_t *batch, uint32_t wire_bytes, size_t payload_len) {
+    batch_stats_record(&batch->stats, batch->count, wire_bytes, payload_len);
+    batch_clear(batch);
+}
+
+void batch_clear(batch_t *batch) {
+    batch->count = 0;
+    batch->bytes = codec_frame_len(batch->format, 1);
+    window_reset(&batch->window);
+}
+
+void batch_stats_record(batch_stats_t *stats, size_t samples, uint32_t wire_bytes, size_t payload_len) {
+    stats->samples += samples;
+    stats->publishes++;
+    stats->payload_bytes += payload_len;
+    stats->wire_bytes += wire_bytes;
+}
@@ -0,0 +1,217 @@
+#include "pico_bme280.h"
+#include "pico_log.h"
+
+#include <string.h>
+
+// Raw value of a channel the sensor did not measure
+#define BME280_SKIPPED_20BIT    0x80000
+#define BME280_SKIPPED_16BIT    0x8000
+
+static uint8_t write_reg(const bme280_t *dev, uint8_t reg, uint8_t value) {
+    const uint8_t tx[2] = { reg, value };
+
+    return dev->bus->transfer(dev->bus, dev->addr, tx, sizeof(tx), NULL, 0);
+}
+
+static uint8_t read_regs(const i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len) {
+    return bus->transfer(bus, addr, &reg, 1, buf, len);
+}
+
+static uint16_t u16_le(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+void bme280_parse_calib(bme280_calib_t *calib, const uint8_t tp[BME280_CALIB_TP_LEN], uint8_t h1, const uint8_t h[BME280_CALIB_H_LEN]) {
+    calib->t1 = u16_le(&tp[0]);
+    calib->t2 = (int16_t)u16_le(&tp[2]);
+    calib->t3 = (int16_t)u16_le(&tp[4]);
+    calib->p1 = u16_le(&tp[6]);
+    calib->p2 = (int16_t)u16_le(&tp[8]);
+    calib->p3 = (int16_t)u16_le(&tp[10]);
+    calib->p4 = (int16_t)u16_le(&tp[12]);
+    calib->p5 = (int16_t)u16_le(&tp[14]);
+    calib->p6 = (int16_t)u16_le(&tp[16]);
+    calib->p7 = (int16_t)u16_le(&tp[18]);
+    calib->p8 = (int16_t)u16_le(&tp[20]);
+    calib->p9 = (int16_t)u16_le(&tp[22]);
+
+    calib->h1 = h1;
+    calib->h2 = (int16_t)u16_le(&h[0]);
+    calib->h3 = h[2];
+    // H4 and H5 are 12 bit values sharing the nibbles of 0xE5
+    calib->h4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0F));
+    calib->h5 = (int16_t)((int8_t)h[5] * 16 | (h[4] >> 4));
+    calib->h6 = (int8_t)h[6];
+}
+
+// The compensation below is the 32 and 64 bit integer code of the datasheet, section 4.2.3.
+// t_fine carries the temperature into the pressure and humidity formulas.
+
+static int32_t compensate_temperature(const bme280_calib_t *c, int32_t adc_t, int32_t *t_fine) {
+    int32_t var1 = ((((adc_t >> 3) - ((int32_t)c->t1 << 1))) * ((int32_t)c->t2)) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - ((int32_t)c->t1)) * ((adc_t >> 4) - ((int32_t)c->t1))) >> 12) *
+        ((int32_t)c->t3)) >> 14;
+
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;            // degrees Celsius * 100
+}
+
+static uint32_t compensate_pressure(const bme280_calib_t *c, int32_t adc_p, int32_t t_fine) {
+    int64_t var1 = (int64_t)t_fine - 128000;
+    int64_t var2 = var1 * var1 * (int64_t)c->p6;
+
+    var2 = var2 + ((var1 * (int64_t)c->p5) * 131072);
+    var2 = var2 + ((int64_t)c->p4 * 34359738368);
+    var1 = ((var1 * var1 * (int64_t)c->p3) >> 8) + ((var1 * (int64_t)c->p2) * 4096);
+    var1 = ((((int64_t)1 << 47) + var1) * (int64_t)c->p1) >> 33;
+    if (var1 == 0) return 0;
+
+    int64_t p = 1048576 - adc_p;
+    p = (((p * 2147483648) - var2) * 3125) / var1;
+    var1 = ((int64_t)c->p9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((int64_t)c->p8 * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + ((int64_t)c->p7 * 16);
+
+    return (uint32_t)p;                         // Pa in Q24.8
+}
+
+static uint32_t compensate_humidity(const bme280_calib_t *c, int32_t adc_h, int32_t t_fine) {
+    int32_t v = t_fine - 76800;
+
+    v = (((((adc_h * 16384) - ((int32_t)c->h4 * 1048576) - ((int32_t)c->h5 * v)) + 16384) >> 15) *
+        (((((((v * (int32_t)c->h6) >> 10) * (((v * (int32_t)c->h3) >> 11) + 32768)) >> 10) + 2097152) *
+        (int32_t)c->h2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * (int32_t)c->h1) >> 4);
+    if (v < 0) v = 0;
+    if (v > 419430400) v = 419430400;
+
+    return (uint32_t)(v >> 12);                 // %RH in Q22.10
+}
+
+uint8_t bme280_compensate(const bme280_calib_t *calib, const uint8_t data[BME280_DATA_LEN], sample_t *sample) {
+    int32_t adc_p = (int32_t)((uint32_t)data[0] << 12 | (uint32_t)data[1] << 4 | data[2] >> 4);
+    int32_t adc_t = (int32_t)((uint32_t)data[3] << 12 | (uint32_t)data[4] << 4 | data[5] >> 4);
+    int32_t adc_h = (int32_t)((uint32_t)data[6] << 8 | data[7]);
+    int32_t t_fine;
+
+    if (adc_t == BME280_SKIPPED_20BIT || adc_p == BME280_SKIPPED_20BIT || adc_h == BME280_SKIPPED_16BIT) {
+        return 1;
+    }
+
+    sample->temperature = compensate_temperature(calib, adc_t, &t_fine);
+    // Pa equals hPa * 100, %RH * 100 is rounded from the 10 fractional bits
+    sample->pressure = (compensate_pressure(calib, adc_p, t_fine) + 128) >> 8;
+    sample->humidity = (compensate_humidity(calib, adc_h, t_fine) * 100 + 512) >> 10;
+    sample->sensor = 0;
+    sample->time_ms = 0;
+    sample->time = 0;
+
+    return 0;
+}
+
+uint8_t bme280_probe(const i2c_bus_t *bus, uint8_t addr) {
+    uint8_t id;
+
+    if (read_regs(bus, addr, BME280_REG_CHIP_ID, &id, 1) != 0) return 1;
+
+    return id != BME280_CHIP_ID;
+}
+
+uint8_t bme280_open(bme280_t *dev, const i2c_bus_t *bus, uint8_t addr) {
+    uint8_t tp[BME280_CALIB_TP_LEN];
+    uint8_t h[BME280_CALIB_H_LEN];
+    uint8_t h1;
+
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->addr = addr;
+
+    if (bme280_probe(bus, addr) != 0 ||
+        read_regs(bus, addr, BME280_REG_CALIB_TP, tp, sizeof(tp)) != 0 ||
+        read_regs(bus, addr, BME280_REG_CALIB_H1, &h1, 1) != 0 ||
+        read_regs(bus, addr, BME280_REG_CALIB_H, h, sizeof(h)) != 0) {
+        PICO_LOGE("No BME280 at 0x%02x on i2c%u\n", addr, bus->index);
+        return 1;
+    }
+
+    bme280_parse_calib(&dev->calib, tp, h1, h);
+
+    // ctrl_hum only takes effect with the following write to ctrl_meas. config is only
+    // written reliably in sleep mode, which a sensor left in normal mode is not in yet.
+    if (write_reg(dev, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_SLEEP) != 0 ||
+        write_reg(dev, BME280_REG_CONFIG, BME280_CONFIG_VALUE) != 0 ||
+        write_reg(dev, BME280_REG_CTRL_HUM, BME280_CTRL_HUM_VALUE) != 0 ||
+        write_reg(dev, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_SLEEP) != 0) {
+        PICO_LOGE("Failed to configure the BME280 at 0x%02x on i2c%u\n", addr, bus->index);
+        return 1;
+    }
+
+    return 0;
+}
+
+uint8_t bme280_read(const bme280_t *dev, sample_t *sample) {
+    uint8_t data[BME280_DATA_LEN];
+
+    // One burst, the sensor keeps the registers of one conversion together while they are read
+    if (read_regs(dev->bus, dev->addr, BME280_REG_DATA, data, sizeof(data)) != 0) return 1;
+
+    return bme280_compensate(&dev->calib, data, sample);
+}
+
+uint8_t bme280_trigger(const bme280_t *dev) {
+    return write_reg(dev, BME280_REG_CTRL_MEAS, BME280_CTRL_MEAS_FORCED);
+}
+
+uint8_t bme280_fetch(bme280_t *dev, i2c_done_fn done, void *arg) {
+    if (!dev->bus->read_regs_async) return 1;
+
+    return dev->bus->read_regs_async(dev->bus, dev->addr, BME280_REG_DATA, dev->data, sizeof(dev->data), done, arg);
+}
+
+uint32_t bme280_estimate_current_na(uint32_t period_ms, uint8_t forced) {
+    // uA * us is pC, so the sum / 1000 is the charge of one conversion in nC
+    uint64_t charge_nc = ((uint64_t)BME280_IDD_TEMP_UA * BME280_TEMP_US +
+        (uint64_t)BME280_IDD_PRESS_UA * BME280_PRESS_US + (uint64_t)BME280_IDD_HUM_UA * BME280_HUM_US) / 1000;
+
+    if (!forced) {
+        uint32_t cycle_us = (BME280_TEMP_US + BME280_PRESS_US + BME280_HUM_US) + BME280_NORMAL_STANDBY_MS * 1000;
+        return (uint32_t)(charge_nc * 1000000 / cycle_us) + BME280_IDD_STANDBY_NA;
+    }
+
+    if (period_ms == 0) return 0;
+    // nC per ms is uA
+    return (uint32_t)(charge_nc * 1000 / period_ms) + BME280_IDD_SLEEP_NA;
+}
+
+static uint8_t sensor_read(void *dev, sample_t *sample) {
+    return bme280_read((const bme280_t *)dev, sample);
+}
+
+static uint8_t sensor_trigger(void *dev) {
+    return bme280_trigger((const bme280_t *)dev);
+}
+
+static uint8_t sensor_fetch(void *dev, sensor_done_fn done, void *arg) {
+    return bme280_fetch((bme280_t *)dev, done, arg);
+}
+
+static uint8_t sensor_decode(void *dev, sample_t *sample) {
+    const bme280_t *bme280 = (const bme280_t *)dev;
+
+    return bme280_compensate(&bme280->calib, bme280->data, sample);
+}
+
+static void sensor_cancel(void *dev) {
+    const bme280_t *bme280 = (const bme280_t *)dev;
+
+    bme280->bus->cancel(bme280->bus);
+}
+
+const sensor_ops_t bme280_sensor_ops = {
+    .read = sensor_read,
+    .trigger = sensor_trigger,
+    .conversion_ms = BME280_CONVERSION_MS,
+    .fetch = sensor_fetch,
+    .decode = sensor_decode,
+    .cancel = sensor_cancel
+};
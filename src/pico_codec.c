@@ -0,0 +1,234 @@
+#include "pico_codec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int16_t clamp_i16(int32_t v) {
+    if (v > INT16_MAX) return INT16_MAX;
+    if (v < INT16_MIN) return INT16_MIN;
+    return (int16_t)v;
+}
+
+static uint16_t clamp_u16(uint32_t v) {
+    return v > UINT16_MAX ? UINT16_MAX : (uint16_t)v;
+}
+
+static uint8_t *put_sample(uint8_t *p, const sample_t *sample) {
+    put_u16(&p[0], (uint16_t)clamp_i16(sample->temperature));
+    put_u16(&p[2], clamp_u16(sample->humidity));
+    put_u32(&p[4], sample->pressure);
+    return p + CODEC_BINARY_SAMPLE_LEN;
+}
+
+static const uint8_t *get_sample(const uint8_t *p, sample_t *sample) {
+    sample->temperature = (int16_t)get_u16(&p[0]);
+    sample->humidity = get_u16(&p[2]);
+    sample->pressure = get_u32(&p[4]);
+    sample->sensor = 0;
+    sample->time_ms = 0;
+    sample->time = 0;
+    return p + CODEC_BINARY_SAMPLE_LEN;
+}
+
+// Earliest time of the samples, 0 if none has one
+static uint32_t base_time(const sample_t *samples, size_t count) {
+    uint32_t base = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].time != 0 && (base == 0 || samples[i].time < base)) base = samples[i].time;
+    }
+    return base;
+}
+
+static uint8_t *put_stamp(uint8_t *p, const sample_t *sample, uint32_t base) {
+    uint64_t ms = (uint64_t)(sample->time - base) * 1000 + sample->time_ms;
+
+    put_u32(p, sample->time == 0 || ms >= CODEC_BINARY_NO_TIME ? CODEC_BINARY_NO_TIME : (uint32_t)ms);
+    return p + CODEC_BINARY_STAMP_LEN;
+}
+
+static const uint8_t *get_stamp(const uint8_t *p, sample_t *sample, uint32_t base) {
+    uint32_t stamp = get_u32(p);
+
+    if (stamp != CODEC_BINARY_NO_TIME) {
+        sample_set_time(sample, ((uint64_t)base * 1000 + stamp) * 1000);
+    }
+    return p + CODEC_BINARY_STAMP_LEN;
+}
+
+static int encode_binary(const sample_t *samples, size_t count, const window_summary_t *window, uint8_t *buf, size_t buf_len) {
+    size_t len = CODEC_BINARY_HEADER_LEN + CODEC_BINARY_BASE_LEN +
+        count * (CODEC_BINARY_SAMPLE_LEN + CODEC_BINARY_STAMP_LEN) + (window ? CODEC_BINARY_WINDOW_LEN : 0);
+
+    if (count > CODEC_BINARY_MAX_SAMPLES || len > buf_len) return -1;
+
+    uint32_t base = base_time(samples, count);
+
+    buf[0] = window ? CODEC_BINARY_VERSION_TIME_WINDOW : CODEC_BINARY_VERSION_TIME;
+    buf[1] = (uint8_t)count;
+    put_u32(&buf[CODEC_BINARY_HEADER_LEN], base);
+
+    uint8_t *p = &buf[CODEC_BINARY_HEADER_LEN + CODEC_BINARY_BASE_LEN];
+    for (size_t i = 0; i < count; i++) {
+        p = put_sample(p, &samples[i]);
+        p = put_stamp(p, &samples[i], base);
+    }
+
+    if (window) {
+        put_u16(p, clamp_u16(window->count));
+        p = put_sample(p + 2, &window->min);
+        p = put_sample(p, &window->max);
+        p = put_sample(p, &window->mean);
+        put_sample(p, &window->ewma);
+    }
+
+    return (int)len;
+}
+
+// Appends text at *pos. Returns 1 if it does not fit.
+static uint8_t append_json(char *buf, size_t buf_len, size_t *pos, const char *text) {
+    size_t len = strlen(text);
+
+    if (*pos + len >= buf_len) return 1;
+    memcpy(&buf[*pos], text, len + 1);
+    *pos += len;
+    return 0;
+}
+
+static uint8_t append_json_sample(char *buf, size_t buf_len, size_t *pos, const char *key, const sample_t *sample) {
+    char json[SAMPLE_JSON_MAX_LEN];
+
+    if (sample_to_json(sample, json, sizeof(json)) < 0) return 1;
+
+    return append_json(buf, buf_len, pos, ",\"") || append_json(buf, buf_len, pos, key) ||
+        append_json(buf, buf_len, pos, "\":") || append_json(buf, buf_len, pos, json);
+}
+
+static int encode_json_window(const sample_t *samples, size_t count, const window_summary_t *window, char *buf, size_t buf_len) {
+    char header[40];
+    size_t pos = 0;
+
+    if (append_json(buf, buf_len, &pos, "{\"samples\":")) return -1;
+
+    int len = sample_to_json_array(samples, count, &buf[pos], buf_len - pos);
+    if (len < 0) return -1;
+    pos += (size_t)len;
+
+    snprintf(header, sizeof(header), ",\"window\":{\"count\":%lu", (unsigned long)window->count);
+
+    if (append_json(buf, buf_len, &pos, header) ||
+        append_json_sample(buf, buf_len, &pos, "min", &window->min) ||
+        append_json_sample(buf, buf_len, &pos, "max", &window->max) ||
+        append_json_sample(buf, buf_len, &pos, "mean", &window->mean) ||
+        append_json_sample(buf, buf_len, &pos, "ewma", &window->ewma) ||
+        append_json(buf, buf_len, &pos, "}}")) {
+        return -1;
+    }
+
+    return (int)pos;
+}
+
+int codec_encode(codec_format_t format, const sample_t *samples, size_t count, const window_summary_t *window, uint8_t *buf, size_t buf_len) {
+    if (format == CODEC_FORMAT_BINARY) {
+        return encode_binary(samples, count, window, buf, buf_len);
+    }
+    if (window) {
+        return encode_json_window(samples, count, window, (char *)buf, buf_len);
+    }
+    return sample_to_json_array(samples, count, (char *)buf, buf_len);
+}
+
+size_t codec_binary_len(const uint8_t *header) {
+    size_t len = CODEC_BINARY_HEADER_LEN + header[1] * CODEC_BINARY_SAMPLE_LEN;
+    size_t timed = CODEC_BINARY_BASE_LEN + header[1] * CODEC_BINARY_STAMP_LEN;
+
+    switch (header[0]) {
+    case CODEC_BINARY_VERSION:
+        return len;
+    case CODEC_BINARY_VERSION_WINDOW:
+        return len + CODEC_BINARY_WINDOW_LEN;
+    case CODEC_BINARY_VERSION_TIME:
+        return len + timed;
+    case CODEC_BINARY_VERSION_TIME_WINDOW:
+        return len + timed + CODEC_BINARY_WINDOW_LEN;
+    default:
+        return 0;
+    }
+}
+
+int codec_decode_binary(const uint8_t *buf, size_t len, sample_t *samples, size_t max, window_summary_t *window) {
+    if (len < CODEC_BINARY_HEADER_LEN) return -1;
+
+    size_t count = buf[1];
+    size_t expected = codec_binary_len(buf);
+    if (expected == 0 || count > max || len != expected) return -1;
+
+    uint8_t timed = buf[0] == CODEC_BINARY_VERSION_TIME || buf[0] == CODEC_BINARY_VERSION_TIME_WINDOW;
+    uint32_t base = timed ? get_u32(&buf[CODEC_BINARY_HEADER_LEN]) : 0;
+
+    const uint8_t *p = &buf[CODEC_BINARY_HEADER_LEN + (timed ? CODEC_BINARY_BASE_LEN : 0)];
+    for (size_t i = 0; i < count; i++) {
+        p = get_sample(p, &samples[i]);
+        if (timed) p = get_stamp(p, &samples[i], base);
+    }
+
+    if (window) {
+        memset(window, 0, sizeof(*window));
+
+        if (buf[0] == CODEC_BINARY_VERSION_WINDOW || buf[0] == CODEC_BINARY_VERSION_TIME_WINDOW) {
+            window->count = get_u16(p);
+            p = get_sample(p + 2, &window->min);
+            p = get_sample(p, &window->max);
+            p = get_sample(p, &window->mean);
+            get_sample(p, &window->ewma);
+        }
+    }
+
+    return (int)count;
+}
+
+size_t codec_sample_len(codec_format_t format, const sample_t *sample, size_t count) {
+    if (format == CODEC_FORMAT_BINARY) {
+        return CODEC_BINARY_SAMPLE_LEN + CODEC_BINARY_STAMP_LEN;
+    }
+
+    char json[SAMPLE_JSON_MAX_LEN];
+    int len = sample_to_json(sample, json, sizeof(json));
+    if (len < 0) return SAMPLE_JSON_MAX_LEN + 1;
+
+    // Every object after the first is preceded by a comma
+    return (size_t)len + (count > 0 ? 1 : 0);
+}
+
+size_t codec_sample_max_len(codec_format_t format) {
+    return format == CODEC_FORMAT_BINARY ? CODEC_BINARY_SAMPLE_LEN + CODEC_BINARY_STAMP_LEN : SAMPLE_JSON_MAX_LEN + 1;
+}
+
+size_t codec_frame_len(codec_format_t format, uint8_t with_window) {
+    if (format == CODEC_FORMAT_BINARY) {
+        return CODEC_BINARY_HEADER_LEN + CODEC_BINARY_BASE_LEN + (with_window ? CODEC_BINARY_WINDOW_LEN : 0);
+    }
+
+    // The brackets of the JSON array, inside {"samples":...} with the window object
+    return 2 + (with_window ? sizeof("{\"samples\":") - 1 + CODEC_JSON_WINDOW_MAX_LEN : 0);
+}
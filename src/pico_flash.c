@@ -0,0 +1,76 @@
+#include "pico_flash.h"
+#include "pico_log.h"
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+#define FLASH_SAFE_TIMEOUT_MS 100
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t *data;
+} flash_op_t;
+
+static uint32_t dev_base(const flash_dev_t *dev) {
+    return (uint32_t)(uintptr_t)dev->ctx;
+}
+
+static void do_program(void *param) {
+    flash_op_t *op = (flash_op_t *)param;
+    flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+static void do_erase(void *param) {
+    flash_op_t *op = (flash_op_t *)param;
+    flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+}
+
+static uint8_t onboard_read(const flash_dev_t *dev, uint32_t offset, void *buf, size_t len) {
+    if (offset + len > dev->size) return 1;
+
+    memcpy(buf, (const void *)(XIP_BASE + dev_base(dev) + offset), len);
+    return 0;
+}
+
+static uint8_t onboard_program_page(const flash_dev_t *dev, uint32_t offset, const uint8_t *page) {
+    if (offset % FLASH_PAGE_SIZE || offset + FLASH_PAGE_SIZE > dev->size) return 1;
+
+    flash_op_t op = { .offset = dev_base(dev) + offset, .data = page };
+    if (flash_safe_execute(do_program, &op, FLASH_SAFE_TIMEOUT_MS) != PICO_OK) {
+        PICO_LOGE("Flash program failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+static uint8_t onboard_erase_sector(const flash_dev_t *dev, uint32_t offset) {
+    if (offset % FLASH_SECTOR_SIZE || offset + FLASH_SECTOR_SIZE > dev->size) return 1;
+
+    flash_op_t op = { .offset = dev_base(dev) + offset, .data = NULL };
+    if (flash_safe_execute(do_erase, &op, FLASH_SAFE_TIMEOUT_MS) != PICO_OK) {
+        PICO_LOGE("Flash erase failed\n");
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t flash_dev_init_onboard(flash_dev_t *dev, uint32_t region_offset, uint32_t region_size) {
+    if (!dev || region_offset % FLASH_SECTOR_SIZE || region_size % FLASH_SECTOR_SIZE) {
+        return 1;
+    }
+
+    if (region_offset + region_size > PICO_FLASH_SIZE_BYTES) {
+        PICO_LOGE("Flash region does not fit in flash\n");
+        return 1;
+    }
+
+    dev->size = region_size;
+    dev->read = onboard_read;
+    dev->program_page = onboard_program_page;
+    dev->erase_sector = onboard_erase_sector;
+    dev->ctx = (void *)(uintptr_t)region_offset;
+
+    return 0;
+}
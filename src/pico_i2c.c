@@ -0,0 +1,154 @@
+#include "pico_i2c.h"
+
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+/**
+ * @brief DMA state of one bus. The TX channel feeds the register address and one read command
+ * per byte into the command FIFO, the RX channel moves the bytes out of the data FIFO and
+ * raises DMA_IRQ_1 when the last one has arrived.
+ */
+typedef struct {
+    int tx_chan;
+    int rx_chan;
+    bool claimed;
+    uint32_t cmds[1 + I2C_DMA_MAX_LEN];
+    i2c_done_fn done;
+    void *arg;
+} i2c_dma_t;
+
+static i2c_dma_t dma_state[I2C_BUS_COUNT];
+static bool dma_irq_ready;
+
+static void dma_irq_handler(void) {
+    for (uint8_t i = 0; i < I2C_BUS_COUNT; i++) {
+        i2c_dma_t *d = &dma_state[i];
+
+        if (!d->done || !dma_channel_get_irq1_status(d->rx_chan)) continue;
+
+        dma_channel_acknowledge_irq1(d->rx_chan);
+        i2c_done_fn done = d->done;
+        d->done = NULL;
+        done(d->arg, 0);
+    }
+}
+
+// Claimed on first use so the interrupt is enabled on the core doing the reads
+static uint8_t dma_setup(uint8_t index) {
+    i2c_dma_t *d = &dma_state[index];
+
+    if (!d->claimed) {
+        d->tx_chan = dma_claim_unused_channel(false);
+        if (d->tx_chan < 0) return 1;
+        d->rx_chan = dma_claim_unused_channel(false);
+        if (d->rx_chan < 0) {
+            dma_channel_unclaim(d->tx_chan);
+            return 1;
+        }
+        dma_channel_set_irq1_enabled(d->rx_chan, true);
+        d->claimed = true;
+    }
+
+    if (!dma_irq_ready) {
+        irq_add_shared_handler(DMA_IRQ_1, dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+        dma_irq_ready = true;
+    }
+    return 0;
+}
+
+static uint8_t onboard_transfer(const i2c_bus_t *bus, uint8_t addr, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    i2c_inst_t *inst = (i2c_inst_t *)bus->ctx;
+
+    // Keep the bus with a repeated start when a read follows
+    if (tx_len > 0 && i2c_write_timeout_us(inst, addr, tx, tx_len, rx_len > 0, I2C_TIMEOUT_US) != (int)tx_len) {
+        return 1;
+    }
+    if (rx_len > 0 && i2c_read_timeout_us(inst, addr, rx, rx_len, false, I2C_TIMEOUT_US) != (int)rx_len) {
+        return 1;
+    }
+    return 0;
+}
+
+static uint8_t onboard_read_regs_async(const i2c_bus_t *bus, uint8_t addr, uint8_t reg, uint8_t *buf, size_t len, i2c_done_fn done, void *arg) {
+    i2c_inst_t *inst = (i2c_inst_t *)bus->ctx;
+    i2c_dma_t *d = &dma_state[bus->index];
+
+    if (len == 0 || len > I2C_DMA_MAX_LEN || d->done || dma_setup(bus->index) != 0) return 1;
+
+    // Register address, then reads with a repeated start before the first and a stop after the last
+    d->cmds[0] = reg;
+    for (size_t i = 0; i < len; i++) {
+        d->cmds[1 + i] = I2C_IC_DATA_CMD_CMD_BITS;
+    }
+    d->cmds[1] |= I2C_IC_DATA_CMD_RESTART_BITS;
+    d->cmds[len] |= I2C_IC_DATA_CMD_STOP_BITS;
+
+    // The target address can only be changed with the controller disabled
+    inst->hw->enable = 0;
+    inst->hw->tar = addr;
+    inst->hw->enable = 1;
+    (void)inst->hw->clr_tx_abrt;
+    inst->hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    d->done = done;
+    d->arg = arg;
+
+    dma_channel_config c = dma_channel_get_default_config(d->rx_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, i2c_get_dreq(inst, false));
+    dma_channel_configure(d->rx_chan, &c, buf, &inst->hw->data_cmd, len, true);
+
+    c = dma_channel_get_default_config(d->tx_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(inst, true));
+    dma_channel_configure(d->tx_chan, &c, &inst->hw->data_cmd, d->cmds, 1 + len, true);
+
+    return 0;
+}
+
+static void onboard_cancel(const i2c_bus_t *bus) {
+    i2c_inst_t *inst = (i2c_inst_t *)bus->ctx;
+    i2c_dma_t *d = &dma_state[bus->index];
+
+    if (!d->done) return;
+
+    // An abort can raise the completion interrupt, keep it masked until it is cleared
+    dma_channel_set_irq1_enabled(d->rx_chan, false);
+    dma_channel_abort(d->tx_chan);
+    dma_channel_abort(d->rx_chan);
+    dma_channel_acknowledge_irq1(d->rx_chan);
+    dma_channel_set_irq1_enabled(d->rx_chan, true);
+    d->done = NULL;
+
+    // Disabling the controller flushes both FIFOs and clears the abort
+    inst->hw->enable = 0;
+    (void)inst->hw->clr_tx_abrt;
+    inst->hw->enable = 1;
+}
+
+uint8_t i2c_bus_init_onboard(i2c_bus_t *bus, uint8_t index, unsigned int sda_pin, unsigned int scl_pin, uint32_t baud) {
+    if (!bus || index >= I2C_BUS_COUNT) return 1;
+
+    i2c_inst_t *inst = i2c_get_instance(index);
+
+    bus->index = index;
+    bus->baud = i2c_init(inst, baud);
+    bus->transfer = onboard_transfer;
+    bus->read_regs_async = onboard_read_regs_async;
+    bus->cancel = onboard_cancel;
+    bus->ctx = inst;
+
+    gpio_set_function(sda_pin, GPIO_FUNC_I2C);
+    gpio_set_function(scl_pin, GPIO_FUNC_I2C);
+    gpio_pull_up(sda_pin);
+    gpio_pull_up(scl_pin);
+
+    return 0;
+}
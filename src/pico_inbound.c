@@ -0,0 +1,60 @@
+#include "pico_inbound.h"
+
+#include <string.h>
+
+void inbound_init(inbound_msg_t *msg, uint8_t *buf, size_t size) {
+    memset(msg, 0, sizeof(*msg));
+
+    msg->buf = buf;
+    msg->size = size;
+    msg->discard = 1;
+}
+
+uint8_t inbound_begin(inbound_msg_t *msg, size_t total_len) {
+    // The previous message is still open, its last fragment never arrived
+    if (!msg->discard) {
+        msg->stats.dropped++;
+    }
+
+    msg->len = 0;
+    msg->total = total_len;
+    msg->discard = 0;
+
+    // Keep a byte for the terminator so text payloads can be used as strings
+    if (msg->size == 0 || total_len > msg->size - 1) {
+        msg->discard = 1;
+        msg->stats.dropped++;
+        return 1;
+    }
+
+    return 0;
+}
+
+uint8_t inbound_append(inbound_msg_t *msg, const uint8_t *data, size_t len, uint8_t last) {
+    if (msg->discard) return 1;
+
+    // More data than announced, the fragments do not belong to this message
+    if (len > msg->total - msg->len) {
+        msg->discard = 1;
+        msg->stats.dropped++;
+        return 1;
+    }
+
+    if (len > 0) {
+        memcpy(&msg->buf[msg->len], data, len);
+        msg->len += len;
+        msg->stats.bytes_copied += len;
+    }
+
+    if (!last) return 1;
+
+    msg->discard = 1;
+    if (msg->len != msg->total) {
+        msg->stats.dropped++;
+        return 1;
+    }
+
+    msg->buf[msg->len] = '\0';
+    msg->stats.messages++;
+    return 0;
+}
@@ -0,0 +1,224 @@
+#include "pico_log.h"
+
+#include <string.h>
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#if PICO_LOG_DEFERRED
+
+#include <stdatomic.h>
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+_Static_assert(LOG_RECORD_MAX_LEN <= 255, "record length must fit the length byte");
+
+#define LOG_CORES 2
+
+/**
+ * @brief Byte ring of encoded records. Written by one core and drained by core 0.
+ * Writers on the same core are serialized by masking interrupts for the copy.
+ */
+typedef struct {
+    uint8_t buf[LOG_RING_SIZE];
+    atomic_uint_fast32_t head;      // written by the owning core only
+    atomic_uint_fast32_t tail;      // written by the drain only
+    log_stats_t stats;              // written by the owning core only
+    uint32_t dropped_reported;      // written by the drain only
+} log_ring_t;
+
+static log_ring_t rings[LOG_CORES];
+
+static void put_bytes(log_record_t *record, const void *data, size_t len) {
+    memcpy(&record->data[record->len], data, len);
+    record->len += (uint8_t)len;
+}
+
+static void put_le(log_record_t *record, uint64_t value, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        record->data[record->len++] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// Arguments that do not fit are left out, the decoder prints them as missing
+static uint8_t no_room(log_record_t *record, size_t len) {
+    return record->len + len > LOG_RECORD_MAX_LEN;
+}
+
+void log_begin(log_record_t *record, uint8_t level, const char *fmt) {
+    record->len = 0;
+    put_le(record, 0, 1);
+    put_le(record, (uint64_t)(level | get_core_num() << 4), 1);
+    put_le(record, (uint32_t)(uintptr_t)fmt, 4);
+    put_le(record, time_us_32(), 4);
+}
+
+void log_put_u32(log_record_t *record, uint32_t value) {
+    if (no_room(record, 5)) return;
+    put_le(record, LOG_ARG_U32, 1);
+    put_le(record, value, 4);
+}
+
+void log_put_u64(log_record_t *record, uint64_t value) {
+    if (no_room(record, 9)) return;
+    put_le(record, LOG_ARG_U64, 1);
+    put_le(record, value, 8);
+}
+
+void log_put_double(log_record_t *record, double value) {
+    uint64_t bits;
+
+    if (no_room(record, 9)) return;
+    memcpy(&bits, &value, sizeof(bits));
+    put_le(record, LOG_ARG_DOUBLE, 1);
+    put_le(record, bits, 8);
+}
+
+void log_put_str(log_record_t *record, const char *value) {
+    size_t len = value ? strnlen(value, LOG_STRING_MAX_LEN) : 0;
+
+    if (no_room(record, 2)) return;
+    if (no_room(record, 2 + len)) len = LOG_RECORD_MAX_LEN - record->len - 2;
+
+    put_le(record, LOG_ARG_STRING, 1);
+    put_le(record, len, 1);
+    put_bytes(record, value, len);
+}
+
+void log_commit(log_record_t *record) {
+    log_ring_t *ring = &rings[get_core_num()];
+    record->data[0] = record->len;
+
+    // Interrupt handlers on this core log into the same ring
+    uint32_t irq = save_and_disable_interrupts();
+
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+
+    if (used + record->len > LOG_RING_SIZE) {
+        ring->stats.dropped++;
+        restore_interrupts(irq);
+        return;
+    }
+
+    size_t offset = head & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - offset < record->len ? LOG_RING_SIZE - offset : record->len;
+    memcpy(&ring->buf[offset], record->data, first);
+    memcpy(ring->buf, &record->data[first], record->len - first);
+
+    ring->stats.records++;
+    if (used + record->len > ring->stats.max_used) {
+        ring->stats.max_used = used + record->len;
+    }
+
+    // Publish the bytes before the new head becomes visible to the drain
+    atomic_store_explicit(&ring->head, head + record->len, memory_order_release);
+
+    restore_interrupts(irq);
+}
+
+static uint8_t ring_byte(const log_ring_t *ring, uint32_t index) {
+    return ring->buf[index & (LOG_RING_SIZE - 1)];
+}
+
+static uint32_t record_time(const log_ring_t *ring, uint32_t tail) {
+    uint32_t time = 0;
+
+    for (int i = 0; i < 4; i++) {
+        time |= (uint32_t)ring_byte(ring, tail + 6 + i) << (8 * i);
+    }
+    return time;
+}
+
+static void print_record(log_ring_t *ring) {
+    static const char hex[] = "0123456789abcdef";
+    char line[2 * LOG_RECORD_MAX_LEN + 2];
+
+    uint32_t tail = (uint32_t)atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint8_t len = ring_byte(ring, tail);
+    size_t pos = 0;
+
+    line[pos++] = LOG_LINE_PREFIX;
+    for (uint8_t i = 0; i < len; i++) {
+        uint8_t b = ring_byte(ring, tail + i);
+        line[pos++] = hex[b >> 4];
+        line[pos++] = hex[b & 0x0F];
+    }
+    line[pos] = '\0';
+
+    // Hand the bytes back to the writer before the slow part
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+
+    puts(line);
+}
+
+static void report_drops(log_ring_t *ring, unsigned int core) {
+    uint32_t dropped = ring->stats.dropped;
+
+    if (dropped != ring->dropped_reported) {
+        printf("log: %lu records dropped on core %u\n", (unsigned long)(dropped - ring->dropped_reported), core);
+        ring->dropped_reported = dropped;
+    }
+}
+
+uint8_t log_drain(size_t max_records) {
+    for (size_t n = 0; n < max_records; n++) {
+        log_ring_t *oldest = NULL;
+        uint32_t oldest_time = 0;
+
+        // Merge the rings by time stamp, so the output keeps the order of both cores
+        for (unsigned int core = 0; core < LOG_CORES; core++) {
+            log_ring_t *ring = &rings[core];
+            uint32_t tail = (uint32_t)atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_acquire);
+
+            if (head == tail) continue;
+
+            uint32_t time = record_time(ring, tail);
+            if (!oldest || (int32_t)(time - oldest_time) < 0) {
+                oldest = ring;
+                oldest_time = time;
+            }
+        }
+
+        if (!oldest) break;
+        print_record(oldest);
+    }
+
+    uint8_t pending = 0;
+    for (unsigned int core = 0; core < LOG_CORES; core++) {
+        log_ring_t *ring = &rings[core];
+
+        report_drops(ring, core);
+        pending |= atomic_load_explicit(&ring->head, memory_order_acquire) !=
+            atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+    return pending;
+}
+
+void log_flush(void) {
+    while (log_drain(LOG_RING_SIZE / LOG_HEADER_LEN) != 0) {
+    }
+}
+
+const log_stats_t *log_get_stats(unsigned int core) {
+    return &rings[core < LOG_CORES ? core : 0].stats;
+}
+
+#else
+
+static const log_stats_t no_stats;
+
+uint8_t log_drain(__unused size_t max_records) {
+    return 0;
+}
+
+void log_flush(void) {
+}
+
+const log_stats_t *log_get_stats(__unused unsigned int core) {
+    return &no_stats;
+}
+
+#endif
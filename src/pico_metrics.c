@@ -0,0 +1,148 @@
+#include "pico_metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/sync.h"
+
+static metrics_t metrics;
+
+static const uint32_t bounds[METRIC_HISTOGRAM_COUNT][METRICS_BUCKETS - 1] = {
+    [METRIC_LOOP_US] = METRICS_LOOP_US_BOUNDS,
+    [METRIC_PUBACK_MS] = METRICS_PUBACK_MS_BOUNDS,
+    [METRIC_CONNECT_MS] = METRICS_CONNECT_MS_BOUNDS
+};
+
+static const char *counter_names[METRIC_COUNTER_COUNT] = {
+    [METRIC_PUBLISHES] = "pub",
+    [METRIC_PUBLISH_FAILED] = "pub_fail",
+    [METRIC_MQTT_CONNECTS] = "conn",
+    [METRIC_MQTT_FAILED] = "conn_fail",
+    [METRIC_MQTT_LOST] = "conn_lost",
+    [METRIC_WIFI_REJOINS] = "wifi_rejoin",
+    [METRIC_PUBLISH_RETRIED] = "pub_retry"
+};
+
+static const char *gauge_names[METRIC_GAUGE_COUNT] = {
+    [METRIC_HEAP_USED] = "heap",
+    [METRIC_LWIP_MEM_USED] = "lwip_mem",
+    [METRIC_TLS_ARENA_PEAK] = "tls_arena",
+    [METRIC_TCP_REXMIT] = "tcp_rexmit",
+    [METRIC_TCP_DROP] = "tcp_drop",
+    [METRIC_LOG_DROPPED] = "log_drop",
+    [METRIC_QUEUE_DROPPED] = "queue_drop",
+    [METRIC_STORE_PENDING] = "store",
+    [METRIC_SAMPLES_SENT] = "sent",
+    [METRIC_SAMPLES_SUPPRESSED] = "suppressed",
+    [METRIC_HEARTBEATS] = "heartbeats",
+    [METRIC_PUBLISH_QUEUED] = "pub_queue",
+    [METRIC_SENSOR_CPU_US] = "sensor_cpu_us",
+    [METRIC_SENSOR_CURRENT_NA] = "sensor_na",
+    [METRIC_CLOCK_OFFSET_US] = "clock_off_us"
+};
+
+static const char *histogram_names[METRIC_HISTOGRAM_COUNT] = {
+    [METRIC_LOOP_US] = "loop_us",
+    [METRIC_PUBACK_MS] = "puback_ms",
+    [METRIC_CONNECT_MS] = "connect_ms"
+};
+
+void metrics_count(metric_counter_t counter) {
+    uint32_t irq = save_and_disable_interrupts();
+    metrics.counters[counter]++;
+    restore_interrupts(irq);
+}
+
+void metrics_gauge(metric_gauge_t gauge, uint32_t value) {
+    metrics_gauge_t *g = &metrics.gauges[gauge];
+
+    uint32_t irq = save_and_disable_interrupts();
+    g->value = value;
+    if (value > g->max) g->max = value;
+    restore_interrupts(irq);
+}
+
+void metrics_observe(metric_histogram_t histogram, uint32_t value) {
+    metrics_histogram_t *h = &metrics.histograms[histogram];
+    const uint32_t *bound = bounds[histogram];
+
+    // Few buckets, a linear scan is cheaper than a search on the M0+
+    size_t bucket = 0;
+    while (bucket < METRICS_BUCKETS - 1 && value > bound[bucket]) {
+        bucket++;
+    }
+
+    uint32_t irq = save_and_disable_interrupts();
+    h->buckets[bucket]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+    restore_interrupts(irq);
+}
+
+const metrics_t *metrics_get(void) {
+    return &metrics;
+}
+
+void metrics_reset(void) {
+    uint32_t irq = save_and_disable_interrupts();
+    memset(&metrics, 0, sizeof(metrics));
+    restore_interrupts(irq);
+}
+
+static uint8_t append(char *buf, size_t buf_len, size_t *pos, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+// Appends formatted text at *pos. Returns 1 if it does not fit.
+static uint8_t append(char *buf, size_t buf_len, size_t *pos, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf(&buf[*pos], buf_len - *pos, fmt, args);
+    va_end(args);
+
+    if (len < 0 || (size_t)len >= buf_len - *pos) return 1;
+    *pos += (size_t)len;
+    return 0;
+}
+
+int metrics_to_json(uint32_t uptime_s, char *buf, size_t buf_len) {
+    metrics_t snapshot;
+    size_t pos = 0;
+
+    if (buf_len == 0) return -1;
+
+    // Callbacks may record while the payload is built, encode a consistent copy
+    uint32_t irq = save_and_disable_interrupts();
+    snapshot = metrics;
+    restore_interrupts(irq);
+
+    uint8_t err = append(buf, buf_len, &pos, "{\"up\":%lu,\"c\":{", (unsigned long)uptime_s);
+
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        err |= append(buf, buf_len, &pos, "%s\"%s\":%lu", i ? "," : "", counter_names[i],
+            (unsigned long)snapshot.counters[i]);
+    }
+
+    err |= append(buf, buf_len, &pos, "},\"g\":{");
+    for (size_t i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        err |= append(buf, buf_len, &pos, "%s\"%s\":[%lu,%lu]", i ? "," : "", gauge_names[i],
+            (unsigned long)snapshot.gauges[i].value, (unsigned long)snapshot.gauges[i].max);
+    }
+
+    err |= append(buf, buf_len, &pos, "},\"h\":{");
+    for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        const metrics_histogram_t *h = &snapshot.histograms[i];
+
+        err |= append(buf, buf_len, &pos, "%s\"%s\":{\"n\":%lu,\"sum\":%llu,\"max\":%lu,\"b\":[", i ? "," : "",
+            histogram_names[i], (unsigned long)h->count, (unsigned long long)h->sum, (unsigned long)h->max);
+        for (size_t b = 0; b < METRICS_BUCKETS; b++) {
+            err |= append(buf, buf_len, &pos, "%s%lu", b ? "," : "", (unsigned long)h->buckets[b]);
+        }
+        err |= append(buf, buf_len, &pos, "]}");
+    }
+
+    err |= append(buf, buf_len, &pos, "}}");
+
+    return err ? -1 : (int)pos;
+}
@@ -1,14 +1,20 @@
 #include "pico_mqtt.h"
 #include "pico_credentials.h"
 #include "pico_log.h"
+#include "pico_metrics.h"
+#include "pico_arena.h"
+#include "pico_trace.h"
+#ifdef MQTT_CERT_INC
 #include "../certs/ca_cert.h"
 #include "../certs/client_cert.h"
 #include "../certs/client_key.h"
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include "pico/stdio.h"
 #include "pico/stdlib.h"
+#include "pico/rand.h"
 #include "string.h"
 
 #include "pico/cyw43_arch.h"
@@ -18,28 +24,257 @@
 #include "lwip/dns.h"
 #include "lwip/altcp_tls.h"
 
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+#include "mbedtls/ssl.h"
+#include "mbedtls/platform.h"
+#endif
+
+// Framing overhead used when estimating the bytes on air
+#define MQTT_TLS_RECORD_OVERHEAD    29      // record header, explicit nonce and GCM tag
+#define MQTT_TCPIP_OVERHEAD         40
+#define MQTT_PUBACK_LEN             4
+
+// DEVICE_MODEL, an underscore and the board id in hex
+#define MQTT_DEVICE_ID_LEN          (sizeof(DEVICE_MODEL) + 1 + 2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES)
+
 struct MQTT_CLIENT_DATA_T{
+    bool in_use;
+    mqtt_client_t mqtt_client;      // lwIP client state, output and receive buffers included
     mqtt_client_t* mqtt_client_inst;
     struct mqtt_connect_client_info_t mqtt_client_info;
-    char data[MQTT_OUTPUT_RINGBUF_SIZE];
-    char topic[MQTT_TOPIC_LEN];
-    uint32_t len;
+    char device_id[MQTT_DEVICE_ID_LEN];
+    MQTT_consumer_t consumer;
+    bool inbound_skip;              // the consumer declined the publish being received
+    MQTT_consumer_t stream;         // consumer of the stream topic, begin is NULL without one
+    char stream_topic[MQTT_TOPIC_LEN];
+    bool stream_pending;            // the stream topic still has to be subscribed
+    bool inbound_stream;            // the publish being received goes to the stream
+    router_t router;
+    size_t resubscribe_next;        // next route to subscribe after a connect
     ip_addr_t mqtt_server_address;
-    bool connect_done;
+    MQTT_state_t state;
+    absolute_time_t deadline;       // end of the current phase or of the backoff
+    absolute_time_t connect_start;
+    uint32_t attempts;              // failed attempts since the last connection
+    pubq_t publish_queue;           // survives reconnects, unacknowledged publishes are sent again
+    uint8_t publish_buf[MQTT_PUB_QUEUE_SIZE];
+    MQTT_publish_cb_t publish_cb;
+    void *publish_cb_arg;
     int subscribe_count;
     bool stop_client;
 };
 
+// Handles live here for the lifetime of the firmware, reconnects reuse them without allocating
+static struct MQTT_CLIENT_DATA_T clients[MQTT_MAX_CLIENTS];
+
+#if defined(MQTT_DNS_NAME)
+// lwIP cannot cancel a lookup, so answers are only delivered to the handle that is still waiting
+static MQTT_client_handle_t dns_client;
+#endif
+
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+// Outlives the client handle. Reconnects reuse the parsed certificates and offer
+// the session of the previous connection for an abbreviated handshake.
+static struct {
+    struct altcp_tls_config *config;
+    mbedtls_ssl_session session;
+    bool session_valid;
+    bool peer_verified;         // a resumed handshake does not verify the server certificate again
+    uint32_t full_handshakes;
+    uint32_t resumed_handshakes;
+} tls_cache;
+
+// mbedTLS allocates from its own arena, so handshakes cannot fragment the general heap
+static uint64_t tls_arena_buf[MQTT_TLS_ARENA_SIZE / sizeof(uint64_t)];
+static arena_t tls_arena;
+
+static void *tls_calloc(size_t count, size_t size) {
+    return arena_calloc(&tls_arena, count, size);
+}
+
+static void tls_free(void *ptr) {
+    arena_free(&tls_arena, ptr);
+}
+
+// Must run before the first mbedTLS allocation, the certificates are parsed into the arena
+static void tls_arena_init(void) {
+    static bool ready;
+
+    if (ready) return;
+
+    arena_init(&tls_arena, tls_arena_buf, sizeof(tls_arena_buf));
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
+    ready = true;
+}
+
+static void tls_session_forget(void) {
+    mbedtls_ssl_session_free(&tls_cache.session);
+    mbedtls_ssl_session_init(&tls_cache.session);
+    tls_cache.session_valid = false;
+}
+
+// Only called for the certificates of a full handshake, leaves their verification as it is
+static int tls_verify(__unused void *arg, __unused mbedtls_x509_crt *crt, __unused int depth, __unused uint32_t *flags) {
+    tls_cache.peer_verified = true;
+    return 0;
+}
+
+static void tls_session_save(MQTT_client_handle_t handle) {
+    mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)altcp_tls_context(handle->mqtt_client_inst->conn);
+    uint32_t elapsed_ms = (uint32_t)(absolute_time_diff_us(handle->connect_start, get_absolute_time()) / 1000);
+
+    // A resumed session, by id or by ticket, skips the server certificate
+    bool resumed = tls_cache.session_valid && !tls_cache.peer_verified;
+
+    if (resumed) {
+        tls_cache.resumed_handshakes++;
+    } else {
+        tls_cache.full_handshakes++;
+    }
+    PICO_LOGI("Connected in %lu ms with a %s handshake (%lu full, %lu resumed)\n",
+        (unsigned long)elapsed_ms, resumed ? "resumed" : "full",
+        (unsigned long)tls_cache.full_handshakes, (unsigned long)tls_cache.resumed_handshakes);
+
+    arena_stats_t arena_stats;
+    arena_get_stats(&tls_arena, &arena_stats);
+    metrics_gauge(METRIC_TLS_ARENA_PEAK, arena_stats.peak);
+    PICO_LOGI("TLS arena: %lu bytes used, peak %lu of %lu, %lu failed allocations\n",
+        (unsigned long)arena_stats.used, (unsigned long)arena_stats.peak,
+        (unsigned long)sizeof(tls_arena_buf), (unsigned long)arena_stats.failed);
+
+    // The cached session is only replaced by one that was copied whole
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(ssl, &session) != 0) {
+        mbedtls_ssl_session_free(&session);
+        PICO_LOGW("Unable to keep the TLS session, the cached one is offered again\n");
+        return;
+    }
+
+    tls_session_forget();
+    tls_cache.session = session;
+    tls_cache.session_valid = true;
+}
+#endif
+
+static void enter_state(MQTT_client_handle_t handle, MQTT_state_t state, uint32_t timeout_ms) {
+    handle->state = state;
+    handle->deadline = make_timeout_time_ms(timeout_ms);
+}
+
+// Exponential backoff with equal jitter. Half of the delay is fixed and half is random,
+// so devices that lost the broker at the same time do not come back in lockstep.
+static uint32_t backoff_ms(uint32_t attempts) {
+    uint32_t delay = MQTT_BACKOFF_MAX_MS;
+
+    if (attempts < 16 && (MQTT_BACKOFF_BASE_MS << attempts) < MQTT_BACKOFF_MAX_MS) {
+        delay = MQTT_BACKOFF_BASE_MS << attempts;
+    }
+
+    return delay / 2 + get_rand_32() % (delay / 2 + 1);
+}
+
+// Drops whatever is left of the connection and waits before the next attempt
+static void schedule_retry(MQTT_client_handle_t handle) {
+    uint32_t delay_ms = backoff_ms(handle->attempts);
+
+    mqtt_disconnect(handle->mqtt_client_inst);
+    enter_state(handle, MQTT_STATE_BACKOFF, delay_ms);
+
+    PICO_LOGI("Next MQTT connection attempt in %lu ms\n", (unsigned long)delay_ms);
+}
+
+static void connect_failed(MQTT_client_handle_t handle, const char *reason) {
+    PICO_LOGE("%s", reason);
+
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+    // The server may have rejected the cached session, start over with a full handshake
+    tls_session_forget();
+#endif
+
+    metrics_count(METRIC_MQTT_FAILED);
+
+    handle->attempts++;
+    schedule_retry(handle);
+}
+
 static void pub_request_cb(__unused void *arg, err_t err) {
     if (err != 0) {
-        PICO_LOGE("pub_request_cb failed %d", (uint8_t)err);
+        PICO_LOGE("pub_request_cb failed %d\n", (int)err);
+    }
+}
+
+static void publish_done_cb(void *arg, err_t err);
+
+// Hands queued publishes to lwIP while the window has room. Runs in the lwIP context.
+static void pump_publishes(MQTT_client_handle_t handle) {
+    pubq_t *queue = &handle->publish_queue;
+    pubq_entry_t *entry;
+
+    TRACE_BEGIN(pump);
+
+    while (handle->state == MQTT_STATE_CONNECTED && (entry = pubq_next(queue)) != NULL) {
+        err_t err = mqtt_publish(handle->mqtt_client_inst, pubq_topic(queue, entry), pubq_payload(queue, entry),
+            entry->payload_len, MQTT_PUB_QOS, MQTT_PUB_RETAIN, publish_done_cb, entry);
+
+        // ERR_MEM: the output ring or the request slots are full, a completion frees them
+        if (err != ERR_OK) {
+            pubq_defer(queue);
+            break;
+        }
+        pubq_sent(queue, entry, time_us_64());
+        metrics_count(METRIC_PUBLISHES);
+    }
+
+    metrics_gauge(METRIC_PUBLISH_QUEUED, pubq_depth(queue));
+    TRACE_END(pump, "mqtt pump");
+}
+
+// Completion of a queued publish, after the PUBACK for QoS 1 or lwIP's request timeout. The
+// entry identifies the publish, so completions need not arrive in order.
+static void publish_done_cb(void *arg, err_t err) {
+    TRACE_BEGIN(done);
+    pubq_entry_t *entry = (pubq_entry_t *)arg;
+    MQTT_client_handle_t handle = (MQTT_client_handle_t)entry->queue->owner;
+    uint64_t now_us = time_us_64();
+    uint32_t puback_ms = (uint32_t)((now_us - entry->sent_us) / 1000);
+    uint32_t latency_us = (uint32_t)(now_us - entry->queued_us);
+
+    // A completed entry is reclaimed and its topic may be overwritten by the next push
+    char topic[MQTT_TOPIC_LEN];
+    if (handle->publish_cb) {
+        snprintf(topic, sizeof(topic), "%s", pubq_topic(&handle->publish_queue, entry));
+    }
+
+    pubq_result_t result = pubq_complete(&handle->publish_queue, entry, err == ERR_OK);
+
+    switch (result) {
+    case PUBQ_ACKED:
+        metrics_observe(METRIC_PUBACK_MS, puback_ms);
+        break;
+    case PUBQ_RETRY:
+        PICO_LOGW("Publish not acknowledged (%d), sending it again\n", (int)err);
+        metrics_count(METRIC_PUBLISH_RETRIED);
+        break;
+    case PUBQ_FAILED:
+        PICO_LOGE("Publish given up after %d attempts (%d)\n", PUBQ_MAX_ATTEMPTS, (int)err);
+        metrics_count(METRIC_PUBLISH_FAILED);
+        break;
+    }
+
+    if (result != PUBQ_RETRY && handle->publish_cb) {
+        handle->publish_cb(handle->publish_cb_arg, topic, err, latency_us);
     }
+
+    pump_publishes(handle);
+    TRACE_END(done, "mqtt publish done");
 }
 
 static void sub_request_cb(void *arg, err_t err) {
     MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
     if (err != 0) {
-        panic("subscribe request failed %d", err);
+        PICO_LOGE("Subscribe request failed\n");
+        return;
     }
     handle->subscribe_count++;
 }
@@ -47,10 +282,11 @@ static void sub_request_cb(void *arg, err_t err) {
 static void unsub_request_cb(void *arg, err_t err) {
     MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
     if (err != 0) {
-        panic("unsubscribe request failed %d", err);
+        PICO_LOGE("Unsubscribe request failed\n");
+        return;
     }
     handle->subscribe_count--;
-    assert(state->subscribe_count >= 0);
+    assert(handle->subscribe_count >= 0);
 
     // Stop if requested
     if (handle->subscribe_count <= 0 && handle->stop_client) {
@@ -58,47 +294,99 @@ static void unsub_request_cb(void *arg, err_t err) {
     }
 }
 
-static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
+static void mqtt_connection_cb(__unused mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
+    TRACE_BEGIN(connection);
 
     PICO_LOGI("mqtt_connection_cb called! status: %d\n", status);
     if (status == MQTT_CONNECT_ACCEPTED) {
         PICO_LOGI("MQTT connected!\n");
-        handle->connect_done = true;
+        handle->state = MQTT_STATE_CONNECTED;
+        handle->attempts = 0;
+
+        metrics_count(METRIC_MQTT_CONNECTS);
+        metrics_observe(METRIC_CONNECT_MS, (uint32_t)(absolute_time_diff_us(handle->connect_start, get_absolute_time()) / 1000));
+
+        // lwIP drops the requests of a closed connection without completing them
+        pubq_requeue(&handle->publish_queue);
+
+        // The session is clean, the routed filters are subscribed again by MQTT_process
+        handle->resubscribe_next = 0;
+        handle->stream_pending = handle->stream.begin != NULL;
+
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+        TRACE_BEGIN(save);
+        tls_session_save(handle);
+        TRACE_END(save, "tls session save");
+#endif
 
         // indicate online
         if (handle->mqtt_client_info.will_topic) {
             mqtt_publish(handle->mqtt_client_inst, handle->mqtt_client_info.will_topic, "1", 1, MQTT_LWT_QOS, true, pub_request_cb, handle);
         }
 
-    } else if (status == MQTT_CONNECT_DISCONNECTED) {
-        PICO_LOGE("Not MQTT connected!\n");
-        if (!handle->connect_done) {
-            panic("Failed to connect to mqtt server");
-        }
+        pump_publishes(handle);
+
+    } else if (handle->state == MQTT_STATE_CONNECTED) {
+        PICO_LOGE("Connection to MQTT broker lost\n");
+        metrics_count(METRIC_MQTT_LOST);
+        schedule_retry(handle);
     }
     else {
-        panic("Unexpected status");
+        // Refused by the broker, TCP reset, failed TLS handshake or CONNACK timeout
+        connect_failed(handle, "Failed to connect to mqtt server\n");
     }
+    TRACE_END(connection, "mqtt connection");
 }
 
-static void mqtt_incoming_data_cb(void *handle, const u8_t *data, u16_t len, u8_t flags) {
-    MQTT_client_handle_t state = (MQTT_client_handle_t)handle;
-#if MQTT_UNIQUE_TOPIC
-    const char *basic_topic = state->topic + strlen(state->mqtt_client_info.client_id) + 1;
-#else
-    const char *basic_topic = state->topic;
-#endif
-    strncpy(state->data, (const char *)data, len);
-    state->len = len;
-    state->data[len] = '\0';
+// Payload fragments point into lwIP's receive buffer and are passed on without a copy
+static void mqtt_incoming_data_cb(void *arg, const u8_t *data, u16_t len, u8_t flags) {
+    MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
 
-    PICO_LOGI("Topic: %s, Message: %s\n", state->topic, state->data);
+    if (!handle->inbound_skip) {
+        const MQTT_consumer_t *consumer = handle->inbound_stream ? &handle->stream : &handle->consumer;
+
+        TRACE_BEGIN(data);
+        consumer->data(consumer->arg, data, len, (flags & MQTT_DATA_FLAG_LAST) != 0);
+        TRACE_END(data, "mqtt inbound data");
+    }
 }
 
-static void mqtt_incoming_publish_cb(void *handle, const char *topic, u32_t tot_len) {
-    MQTT_client_handle_t state = (MQTT_client_handle_t)handle;
-    strncpy(state->topic, topic, sizeof(state->topic));
+static void mqtt_incoming_publish_cb(void *arg, const char *topic, u32_t tot_len) {
+    MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
+
+    // The topic is only valid here, the payload fragments reuse its buffer
+    handle->inbound_stream = handle->stream.begin && strcmp(topic, handle->stream_topic) == 0;
+    const MQTT_consumer_t *consumer = handle->inbound_stream ? &handle->stream : &handle->consumer;
+
+    TRACE_BEGIN(begin);
+    handle->inbound_skip = consumer->begin(consumer->arg, topic, tot_len) != 0;
+    TRACE_END(begin, "mqtt inbound begin");
+}
+
+static void use_router(MQTT_client_handle_t handle) {
+    handle->consumer.begin = router_begin;
+    handle->consumer.data = router_data;
+    handle->consumer.arg = &handle->router;
+}
+
+// Subscribes the routed filters, as many as the request queue takes per call
+static void renew_subscriptions(MQTT_client_handle_t handle) {
+    while (handle->resubscribe_next < handle->router.route_count) {
+        const char *filter = router_filter(&handle->router, handle->resubscribe_next);
+
+        if (filter && mqtt_sub_unsub(handle->mqtt_client_inst, filter, MQTT_SUB_QOS, sub_request_cb, handle, true) != ERR_OK) {
+            return;
+        }
+        handle->resubscribe_next++;
+    }
+
+    if (handle->stream_pending) {
+        if (mqtt_sub_unsub(handle->mqtt_client_inst, handle->stream_topic, MQTT_SUB_QOS, sub_request_cb, handle, true) != ERR_OK) {
+            return;
+        }
+        handle->stream_pending = false;
+    }
 }
 
 static void start_client(MQTT_client_handle_t handle) {
@@ -107,57 +395,116 @@ static void start_client(MQTT_client_handle_t handle) {
     PICO_LOGI("Using TLS\n");
 #else
     const int port = MQTT_PORT;
-    PICO_LOGI("Warning: Not using TLS\n");
+    PICO_LOGW("Not using TLS\n");
 #endif
 
-    handle->mqtt_client_inst = mqtt_client_new();
-    if (!handle->mqtt_client_inst) {
-        panic("MQTT client instance creation error");
-    }
     PICO_LOGI("IP address of this device %s\n", ipaddr_ntoa(&(netif_list->ip_addr)));
     PICO_LOGI("Connecting to mqtt server at %s\n", ipaddr_ntoa(&handle->mqtt_server_address));
 
+    // lwIP sends CONNECT once TCP and TLS are up and does not report that step, so one
+    // timeout covers everything up to the CONNACK
+    enter_state(handle, MQTT_STATE_CONNECTING, MQTT_CONNECT_TIMEOUT_MS);
+
     cyw43_arch_lwip_begin();
-    if (mqtt_client_connect(handle->mqtt_client_inst, &handle->mqtt_server_address, port, mqtt_connection_cb, handle, &handle->mqtt_client_info) != ERR_OK) {
-        panic("MQTT broker connection error");
+    TRACE_BEGIN(connect);
+    err_t err = mqtt_client_connect(handle->mqtt_client_inst, &handle->mqtt_server_address, port, mqtt_connection_cb, handle, &handle->mqtt_client_info);
+    TRACE_END(connect, "mqtt_client_connect");
+
+    if (err != ERR_OK) {
+        connect_failed(handle, "MQTT broker connection error\n");
+        cyw43_arch_lwip_end();
+        return;
     }
 #if LWIP_ALTCP && LWIP_ALTCP_TLS
+    mbedtls_ssl_context *ssl = (mbedtls_ssl_context *)altcp_tls_context(handle->mqtt_client_inst->conn);
+
     // This is important for MBEDTLS_SSL_SERVER_NAME_INDICATION
-    mbedtls_ssl_set_hostname(altcp_tls_context(handle->mqtt_client_inst->conn), MQTT_SERVER);
+    mbedtls_ssl_set_hostname(ssl, MQTT_SERVER);
+
+    tls_cache.peer_verified = false;
+    mbedtls_ssl_set_verify(ssl, tls_verify, NULL);
+
+    // The handshake starts once TCP is connected, so the session can still be set here
+    if (tls_cache.session_valid && mbedtls_ssl_set_session(ssl, &tls_cache.session) != 0) {
+        PICO_LOGW("Unable to offer the cached TLS session\n");
+        tls_session_forget();
+    }
 #endif
     mqtt_set_inpub_callback(handle->mqtt_client_inst, mqtt_incoming_publish_cb, mqtt_incoming_data_cb, handle);
     cyw43_arch_lwip_end();
 }
 
+#if defined(MQTT_DNS_NAME)
 // Call back with a DNS result
-static void dns_found(const char *hostname, const ip_addr_t *ipaddr, void *arg) {
+static void dns_found(__unused const char *hostname, const ip_addr_t *ipaddr, void *arg) {
     MQTT_client_handle_t handle = (MQTT_client_handle_t)arg;
+
+    // Late answer for a closed handle or for an attempt that already timed out
+    if (handle != dns_client || handle->state != MQTT_STATE_RESOLVING) return;
+
     if (ipaddr) {
         handle->mqtt_server_address = *ipaddr;
         start_client(handle);
     } else {
-        panic("dns request failed");
+        connect_failed(handle, "DNS request failed\n");
+    }
+}
+#endif
+
+static void start_attempt(MQTT_client_handle_t handle) {
+    handle->connect_start = get_absolute_time();
+
+#if defined(MQTT_DNS_NAME)
+    dns_client = handle;
+    enter_state(handle, MQTT_STATE_RESOLVING, MQTT_DNS_TIMEOUT_MS);
+
+    cyw43_arch_lwip_begin();
+    err_t err = dns_gethostbyname(MQTT_SERVER, &handle->mqtt_server_address, dns_found, handle);
+    cyw43_arch_lwip_end();
+
+    // ERR_OK means the address was cached and dns_found will not be called
+    if (err == ERR_OK) {
+        start_client(handle);
+    }
+    else if (err != ERR_INPROGRESS) {
+        connect_failed(handle, "Failed to assign a correct IP-address for broker\n");
     }
+#else
+    start_client(handle);
+#endif
 }
 
 uint8_t MQTT_open(MQTT_client_handle_t *handle) {
-    MQTT_client_handle_t temp_handle = malloc(sizeof(struct MQTT_CLIENT_DATA_T));
+    MQTT_client_handle_t temp_handle = NULL;
+
+    for (size_t i = 0; i < MQTT_MAX_CLIENTS; i++) {
+        if (!clients[i].in_use) {
+            temp_handle = &clients[i];
+            break;
+        }
+    }
 
     if(temp_handle == NULL) {
-        PICO_LOGE("Failed to allocate MQTT handle in memory\n");
+        PICO_LOGE("No free MQTT handle, raise MQTT_MAX_CLIENTS\n");
         goto exit;
     }
 
-    // Create a unique ID for the device
-    char unique_id_buf[sizeof(DEVICE_MODEL)];
+    memset(temp_handle, 0, sizeof(*temp_handle));
+    temp_handle->in_use = true;
+    temp_handle->mqtt_client_inst = &temp_handle->mqtt_client;
+    pubq_init(&temp_handle->publish_queue, temp_handle->publish_buf, sizeof(temp_handle->publish_buf), MQTT_PUB_WINDOW);
+    temp_handle->publish_queue.owner = temp_handle;
+
+    // Create a unique ID for the device. lwIP reads it on every connect, so it lives in the handle.
+    char unique_id_buf[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
     pico_get_unique_board_id_string(unique_id_buf, sizeof(unique_id_buf));
-    char device_id[sizeof(DEVICE_MODEL) + sizeof(unique_id_buf) - 1];
-    memcpy(device_id, DEVICE_MODEL, sizeof(DEVICE_MODEL) - 1);
-    memcpy(&device_id[sizeof(DEVICE_MODEL)], unique_id_buf, sizeof(unique_id_buf) - 1);
-    device_id[sizeof(device_id) - 1] = '\0';
-    PICO_LOGI("Device id finished: %s\n", device_id);
+    snprintf(temp_handle->device_id, sizeof(temp_handle->device_id), "%s_%s", DEVICE_MODEL, unique_id_buf);
+    PICO_LOGI("Device id finished: %s\n", temp_handle->device_id);
+
+    temp_handle->mqtt_client_info.client_id = temp_handle->device_id;
 
-    temp_handle->mqtt_client_info.client_id = device_id;
+    router_init(&temp_handle->router);
+    use_router(temp_handle);
 
     // Decide how long the TCP connection should be kept alive between intervals
     temp_handle->mqtt_client_info.keep_alive = MQTT_KEEP_ALIVE_S;
@@ -180,15 +527,20 @@ uint8_t MQTT_open(MQTT_client_handle_t *handle) {
 
     // Configure the client for tls
     #if LWIP_ALTCP && LWIP_ALTCP_TLS
+        tls_arena_init();
+
     #ifdef MQTT_CERT_INC
-        
-        // Configure for MTLS
-        temp_handle->mqtt_client_info.tls_config = altcp_tls_create_config_client_2wayauth(
-            (const u8_t *)ca_cert, sizeof(ca_cert),
-            (const u8_t *)client_key, sizeof(client_key),
-            CLIENT_KEY_PASS, CLIENT_KEY_PASS_LEN,
-            (const u8_t *)client_cert, sizeof(client_cert)
-        );
+
+        // Configure for MTLS. Parsing the certificates is expensive, so it is only done once.
+        if (tls_cache.config == NULL) {
+            tls_cache.config = altcp_tls_create_config_client_2wayauth(
+                (const u8_t *)ca_cert, sizeof(ca_cert),
+                (const u8_t *)client_key, sizeof(client_key),
+                CLIENT_KEY_PASS, CLIENT_KEY_PASS_LEN,
+                (const u8_t *)client_cert, sizeof(client_cert)
+            );
+        }
+        temp_handle->mqtt_client_info.tls_config = tls_cache.config;
 
         if (temp_handle->mqtt_client_info.tls_config == NULL) {
             PICO_LOGE("TLS config creation failed!\n");
@@ -197,101 +549,273 @@ uint8_t MQTT_open(MQTT_client_handle_t *handle) {
         }
 
     #if ALTCP_MBEDTLS_AUTHMODE != MBEDTLS_SSL_VERIFY_REQUIRED
-        PICO_LOGW("Warning: tls without verification is insecure\n");
+        PICO_LOGW("TLS without verification is insecure\n");
     #endif
     #else
         // Configure for TLS
-        state->client_info.tls_config = altcp_tls_create_config_client(NULL, 0);
-        PICO_LOGW("Warning: tls without a certificate is insecure\n");
+        if (tls_cache.config == NULL) {
+            tls_cache.config = altcp_tls_create_config_client(NULL, 0);
+        }
+        temp_handle->mqtt_client_info.tls_config = tls_cache.config;
+        PICO_LOGW("TLS without a certificate is insecure\n");
     #endif
     #endif
-    
-    // Depending if we need to use DNS to find the servers IP-address
-    // Else just use the MQTT_SERVER address
-    int err;
-    #if defined(MQTT_DNS_NAME)
-    cyw43_arch_lwip_begin();
-    err = dns_gethostbyname(MQTT_SERVER, &temp_handle->mqtt_server_address, dns_found, &temp_handle);
-    cyw43_arch_lwip_end();
 
-    if(err) {
-        PICO_LOGE("Failed to assign a correct IP-address for broker\n");
-        goto exit;
-    }
-    #else
-    err = ipaddr_aton(MQTT_SERVER, &temp_handle->mqtt_server_address);
-    if(!err) {
+    // Without DNS the MQTT_SERVER address is used as is
+    #if !defined(MQTT_DNS_NAME)
+    if(!ipaddr_aton(MQTT_SERVER, &temp_handle->mqtt_server_address)) {
         PICO_LOGE("Failed to assign a correct IP-address for broker\n");
         goto exit;
     }
     #endif
-    
-    start_client(temp_handle);
 
-    while (!temp_handle->connect_done || !mqtt_client_is_connected(temp_handle->mqtt_client_inst)) {
-        cyw43_arch_poll();
-        cyw43_arch_wait_for_work_until(make_timeout_time_ms(10000));
-    }
+    // The connection is made in the background and driven by MQTT_process
+    cyw43_arch_lwip_begin();
+    start_attempt(temp_handle);
+    cyw43_arch_lwip_end();
 
     *handle = temp_handle;
 
-    PICO_LOGI("MQTT successfully connected!");
-
     return 0;
 exit:
 
     if(temp_handle != NULL) {
-        free(temp_handle);
+        temp_handle->in_use = false;
     }
 
     return 1;
 }
 
+MQTT_state_t MQTT_process(MQTT_client_handle_t handle) {
+    if (!handle) return MQTT_STATE_BACKOFF;
+
+    // The connection callbacks run from the lwIP context, keep them out while the state is checked
+    cyw43_arch_lwip_begin();
+
+    bool expired = absolute_time_diff_us(get_absolute_time(), handle->deadline) <= 0;
+
+    switch (handle->state) {
+    case MQTT_STATE_BACKOFF:
+        if (expired) {
+            start_attempt(handle);
+        }
+        break;
+
+    case MQTT_STATE_RESOLVING:
+        if (expired) {
+            connect_failed(handle, "DNS lookup timed out\n");
+        }
+        break;
+
+    case MQTT_STATE_CONNECTING:
+        if (expired) {
+            connect_failed(handle, "No CONNACK from broker, TCP connect or TLS handshake timed out\n");
+        }
+        break;
+
+    case MQTT_STATE_CONNECTED:
+        renew_subscriptions(handle);
+        pump_publishes(handle);
+        break;
+    }
+
+    MQTT_state_t state = handle->state;
+    cyw43_arch_lwip_end();
+
+    return state;
+}
+
 uint8_t MQTT_publish(MQTT_client_handle_t handle, const char *topic, const char *payload) {
-    err_t err = mqtt_publish(handle->mqtt_client_inst, topic, payload, strlen(payload), MQTT_PUB_QOS, MQTT_PUB_RETAIN, pub_request_cb, handle);
+    return MQTT_publish_bytes(handle, topic, (const uint8_t *)payload, strlen(payload));
+}
 
-    if(err == ERR_OK) return 0;
-    else if(err == ERR_MEM) {
-        PICO_LOGE("Out of memory error\n");
+uint8_t MQTT_publish_bytes(MQTT_client_handle_t handle, const char *topic, const uint8_t *payload, size_t len) {
+    if (!handle || handle->state != MQTT_STATE_CONNECTED) return 1;
+    if (len > MQTT_PAYLOAD_MAX_LEN) {
+        PICO_LOGE("Payload of %u bytes does not fit the output buffer\n", (unsigned int)len);
         return 1;
     }
-    else if(err == ERR_CONN) {
-        PICO_LOGE("Not connected to broker\n");
+
+    cyw43_arch_lwip_begin();
+    uint8_t err = pubq_push(&handle->publish_queue, topic, payload, len, time_us_64());
+    if (err == 0) {
+        pump_publishes(handle);
+    }
+    cyw43_arch_lwip_end();
+
+    // The caller keeps the message, e.g. in the sample store, so a full queue is not logged
+    if (err != 0) {
+        metrics_count(METRIC_PUBLISH_FAILED);
         return 1;
     }
+    return 0;
 }
 
-uint8_t MQTT_subscribe(MQTT_client_handle_t handle, const char *topic) {
-    if(mqtt_sub_unsub(handle->mqtt_client_inst, topic, MQTT_SUB_QOS, pub_request_cb, handle, true) == 0) {
-        return 0;
+void MQTT_set_consumer(MQTT_client_handle_t handle, const MQTT_consumer_t *consumer) {
+    if (!handle) return;
+
+    cyw43_arch_lwip_begin();
+    if (consumer && consumer->begin && consumer->data) {
+        handle->consumer = *consumer;
+    } else {
+        use_router(handle);
     }
-    return 1;
+    handle->inbound_skip = true;
+    cyw43_arch_lwip_end();
+}
+
+void MQTT_set_publish_cb(MQTT_client_handle_t handle, MQTT_publish_cb_t cb, void *arg) {
+    if (!handle) return;
+
+    handle->publish_cb = cb;
+    handle->publish_cb_arg = arg;
+}
+
+uint8_t MQTT_publish_stats(MQTT_client_handle_t handle, pubq_stats_t *stats) {
+    if (!handle) return 1;
+
+    cyw43_arch_lwip_begin();
+    *stats = handle->publish_queue.stats;
+    cyw43_arch_lwip_end();
+    return 0;
 }
 
-uint8_t MQTT_unsubscribe(MQTT_client_handle_t handle, const char *topic) { 
-    if(mqtt_sub_unsub(handle->mqtt_client_inst, topic, MQTT_SUB_QOS, unsub_request_cb, handle, false) == 0) {
-        return 0;
+uint32_t MQTT_wire_bytes(size_t topic_len, size_t payload_len) {
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+    const uint32_t record_overhead = MQTT_TLS_RECORD_OVERHEAD;
+#else
+    const uint32_t record_overhead = 0;
+#endif
+    uint32_t remaining = 2 + topic_len + payload_len + (MQTT_PUB_QOS > 0 ? 2 : 0);
+    uint32_t fixed_header = 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3);
+    uint32_t record = fixed_header + remaining + record_overhead;
+    uint32_t segments = (record + TCP_MSS - 1) / TCP_MSS;
+
+    uint32_t bytes = record + segments * MQTT_TCPIP_OVERHEAD;
+    if (MQTT_PUB_QOS > 0) {
+        bytes += MQTT_PUBACK_LEN + record_overhead + MQTT_TCPIP_OVERHEAD;
     }
-    return 1;
+
+    return bytes;
+}
+
+uint8_t MQTT_subscribe(MQTT_client_handle_t handle, const char *topic) {
+    if (!handle) return 1;
+
+    cyw43_arch_lwip_begin();
+    err_t err = mqtt_sub_unsub(handle->mqtt_client_inst, topic, MQTT_SUB_QOS, sub_request_cb, handle, true);
+    cyw43_arch_lwip_end();
+
+    return err == ERR_OK ? 0 : 1;
+}
+
+uint8_t MQTT_subscribe_handler(MQTT_client_handle_t handle, const char *filter, router_handler_t handler, void *arg) {
+    if (!handle) return 1;
+
+    cyw43_arch_lwip_begin();
+    size_t routes = handle->router.route_count;
+    uint8_t err = router_add(&handle->router, filter, handler, arg);
+    cyw43_arch_lwip_end();
+
+    if (err != 0) {
+        PICO_LOGE("Unable to add route\n");
+        return 1;
+    }
+
+    // New routes are subscribed by MQTT_process. A route that existed before may already have
+    // been passed while connected, so it is subscribed here.
+    if (handle->router.route_count == routes && handle->state == MQTT_STATE_CONNECTED) {
+        return MQTT_subscribe(handle, filter);
+    }
+    return 0;
+}
+
+uint8_t MQTT_subscribe_stream(MQTT_client_handle_t handle, const char *topic, const MQTT_consumer_t *consumer) {
+    if (!handle || !consumer || !consumer->begin || !consumer->data || strlen(topic) >= MQTT_TOPIC_LEN) return 1;
+
+    // Subscribed by MQTT_process, now if connected and again after every reconnect
+    cyw43_arch_lwip_begin();
+    handle->stream = *consumer;
+    strcpy(handle->stream_topic, topic);
+    handle->stream_pending = true;
+    // The rest of a streamed publish in progress would reach the new consumer without a begin
+    if (handle->inbound_stream) handle->inbound_skip = true;
+    cyw43_arch_lwip_end();
+
+    return 0;
+}
+
+uint8_t MQTT_unsubscribe(MQTT_client_handle_t handle, const char *topic) {
+    if (!handle) return 1;
+
+    cyw43_arch_lwip_begin();
+    router_remove(&handle->router, topic);
+    err_t err = mqtt_sub_unsub(handle->mqtt_client_inst, topic, MQTT_SUB_QOS, unsub_request_cb, handle, false);
+    cyw43_arch_lwip_end();
+
+    return err == ERR_OK ? 0 : 1;
 }
 
 void MQTT_close(MQTT_client_handle_t handle) {
+    if (!handle) return;
+
+    cyw43_arch_lwip_begin();
+#if defined(MQTT_DNS_NAME)
+    if (dns_client == handle) {
+        dns_client = NULL;
+    }
+#endif
     mqtt_disconnect(handle->mqtt_client_inst);
-    free(handle);
+    handle->in_use = false;
+    cyw43_arch_lwip_end();
 }
 
 uint8_t MQTT_poll(MQTT_client_handle_t handle) {
     if (!handle) return 1;
-    
-    if (!mqtt_client_is_connected(handle->mqtt_client_inst)) {
-        PICO_LOGE("MQTT client not connected\n");
+
+    if (handle->state != MQTT_STATE_CONNECTED || !mqtt_client_is_connected(handle->mqtt_client_inst)) {
         return 1;
     }
 
     return 0;
 }
 
-uint8_t MQTT_reconnect(MQTT_client_handle_t *handle) {
-    MQTT_close(*handle);
-    return MQTT_open(handle);
-}
\ No newline at end of file
+void MQTT_reconnect(MQTT_client_handle_t handle) {
+    if (!handle) return;
+
+    cyw43_arch_lwip_begin();
+    mqtt_disconnect(handle->mqtt_client_inst);
+    handle->attempts = 0;
+    start_attempt(handle);
+    cyw43_arch_lwip_end();
+}
+
+const char *MQTT_device_id(MQTT_client_handle_t handle) {
+    return handle ? handle->device_id : "";
+}
+
+uint8_t MQTT_tls_stats(MQTT_tls_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+    arena_stats_t arena_stats;
+    arena_get_stats(&tls_arena, &arena_stats);
+
+    stats->full_handshakes = tls_cache.full_handshakes;
+    stats->resumed_handshakes = tls_cache.resumed_handshakes;
+    stats->arena_used = arena_stats.used;
+    stats->arena_peak = arena_stats.peak;
+    stats->arena_failed = arena_stats.failed;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+void MQTT_tls_forget_session(void) {
+#if LWIP_ALTCP && LWIP_ALTCP_TLS
+    cyw43_arch_lwip_begin();
+    tls_session_forget();
+    cyw43_arch_lwip_end();
+#endif
+}
@@ -0,0 +1,184 @@
+#include "pico_ntp.h"
+#include "pico_log.h"
+
+#include <string.h>
+
+#include "pico.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+#include "lwip/udp.h"
+#include "lwip/dns.h"
+
+#define NTP_LI_VN_MODE_CLIENT   0x23        // no leap warning, version 4, client
+#define NTP_MODE_SERVER         4
+#define NTP_MODE_MASK           0x07
+#define NTP_STRATUM_MAX         15
+#define NTP_OFFSET_ORIGIN       24
+#define NTP_OFFSET_RECEIVE      32
+#define NTP_OFFSET_TRANSMIT     40
+#define NTP_UNIX_EPOCH          2208988800u // seconds from 1900 to 1970
+
+static struct {
+    wallclock_t *clock;
+    struct udp_pcb *pcb;
+    ip_addr_t server;
+    uint8_t pending;            // a request is waiting for its reply
+    uint64_t sent_us;           // also the transmit timestamp of the request, echoed as the origin
+    absolute_time_t next_request;
+    ntp_stats_t stats;
+} ntp;
+
+static uint32_t get_u32_be(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put_u32_be(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+// NTP seconds wrap in 2036, a value before the Unix epoch belongs to the next era
+static uint64_t ntp_to_unix_us(const uint8_t *p) {
+    uint32_t seconds = get_u32_be(p);
+    uint32_t fraction = get_u32_be(&p[4]);
+    uint64_t unix_s = seconds >= NTP_UNIX_EPOCH ? seconds - NTP_UNIX_EPOCH : (uint64_t)seconds + (1ull << 32) - NTP_UNIX_EPOCH;
+
+    return unix_s * 1000000 + (((uint64_t)fraction * 1000000) >> 32);
+}
+
+static void schedule(uint32_t delay_ms) {
+    ntp.next_request = make_timeout_time_ms(delay_ms);
+}
+
+// Called by lwIP with the reply
+static void ntp_recv(__unused void *arg, __unused struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, __unused u16_t port) {
+    uint64_t received_us = time_us_64();
+    uint8_t buf[NTP_PACKET_LEN];
+    uint8_t origin[8];
+
+    uint16_t len = pbuf_copy_partial(p, buf, sizeof(buf), 0);
+    uint16_t tot_len = p->tot_len;
+    pbuf_free(p);
+
+    if (!ntp.pending || !ip_addr_cmp(addr, &ntp.server)) return;
+
+    put_u32_be(origin, (uint32_t)(ntp.sent_us >> 32));
+    put_u32_be(&origin[4], (uint32_t)ntp.sent_us);
+
+    // A stratum of 0 is a kiss-o'-death, the server asks to be left alone for a while
+    if (len != NTP_PACKET_LEN || tot_len != NTP_PACKET_LEN || (buf[0] & NTP_MODE_MASK) != NTP_MODE_SERVER ||
+        buf[1] == 0 || buf[1] > NTP_STRATUM_MAX || memcmp(&buf[NTP_OFFSET_ORIGIN], origin, sizeof(origin)) != 0) {
+        ntp.stats.invalid++;
+        return;
+    }
+
+    ntp.pending = 0;
+
+    if (wallclock_sync(ntp.clock, ntp.sent_us, ntp_to_unix_us(&buf[NTP_OFFSET_RECEIVE]),
+            ntp_to_unix_us(&buf[NTP_OFFSET_TRANSMIT]), received_us) != 0) {
+        ntp.stats.invalid++;
+        schedule(NTP_RETRY_MS);
+        return;
+    }
+
+    ntp.stats.replies++;
+    schedule(NTP_POLL_MS);
+}
+
+static void send_request(void) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_LEN, PBUF_RAM);
+    if (!p) {
+        schedule(NTP_RETRY_MS);
+        return;
+    }
+
+    uint8_t *buf = (uint8_t *)p->payload;
+    memset(buf, 0, NTP_PACKET_LEN);
+    buf[0] = NTP_LI_VN_MODE_CLIENT;
+
+    // Any value is echoed back as the origin, the send time makes every request unique
+    ntp.sent_us = time_us_64();
+    put_u32_be(&buf[NTP_OFFSET_TRANSMIT], (uint32_t)(ntp.sent_us >> 32));
+    put_u32_be(&buf[NTP_OFFSET_TRANSMIT + 4], (uint32_t)ntp.sent_us);
+
+    err_t err = udp_sendto(ntp.pcb, p, &ntp.server, NTP_PORT);
+    pbuf_free(p);
+
+    if (err != ERR_OK) {
+        schedule(NTP_RETRY_MS);
+        return;
+    }
+
+    ntp.pending = 1;
+    ntp.stats.requests++;
+    schedule(NTP_TIMEOUT_MS);
+}
+
+static void dns_found(__unused const char *hostname, const ip_addr_t *ipaddr, __unused void *arg) {
+    if (!ipaddr) {
+        ntp.stats.dns_failures++;
+        schedule(NTP_RETRY_MS);
+        return;
+    }
+
+    ntp.server = *ipaddr;
+    send_request();
+}
+
+uint8_t ntp_init(wallclock_t *clock) {
+    memset(&ntp, 0, sizeof(ntp));
+    ntp.clock = clock;
+
+    cyw43_arch_lwip_begin();
+    ntp.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (ntp.pcb) {
+        udp_recv(ntp.pcb, ntp_recv, NULL);
+    }
+    cyw43_arch_lwip_end();
+
+    if (!ntp.pcb) {
+        PICO_LOGE("Failed to create the NTP socket\n");
+        return 1;
+    }
+
+    schedule(0);
+    return 0;
+}
+
+void ntp_process(void) {
+    if (!ntp.pcb) return;
+
+    // The reply callback runs in the background, the lwIP lock keeps it out while the state changes
+    cyw43_arch_lwip_begin();
+
+    if (absolute_time_diff_us(get_absolute_time(), ntp.next_request) > 0) {
+        cyw43_arch_lwip_end();
+        return;
+    }
+
+    if (ntp.pending) {
+        ntp.pending = 0;
+        ntp.stats.timeouts++;
+        schedule(NTP_RETRY_MS);
+        cyw43_arch_lwip_end();
+        return;
+    }
+
+    // Servers of the pool come and go, the name is resolved again for every exchange
+    schedule(NTP_RETRY_MS);
+    err_t err = dns_gethostbyname(NTP_SERVER, &ntp.server, dns_found, NULL);
+    if (err == ERR_OK) {
+        send_request();
+    }
+    else if (err != ERR_INPROGRESS) {
+        ntp.stats.dns_failures++;
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+const ntp_stats_t *ntp_get_stats(void) {
+    return &ntp.stats;
+}
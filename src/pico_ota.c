@@ -0,0 +1,479 @@
+#include "pico_ota.h"
+#include "pico_log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "pico.h"
+#include "mbedtls/sha256.h"
+
+#define OTA_MAGIC               0x3141544Fu     // "OTA1"
+#define OTA_VERIFIED_MARK       0x4B4F4B4Fu     // programmed over the erased word once verified
+#define OTA_FAILED_MARK         0x00000000u     // can be programmed over either of the above
+#define OTA_WORD_ERASED         0xFFFFFFFFu
+
+// State sector layout
+#define HDR_MAGIC               0
+#define HDR_MANIFEST            4
+#define HDR_MARK                (HDR_MANIFEST + OTA_MANIFEST_LEN)
+#define HDR_LEN                 (HDR_MARK + 4)
+#define CHECKPOINT_FIRST        FLASH_DEV_PAGE_SIZE
+#define CHECKPOINT_MAX          ((FLASH_DEV_SECTOR_SIZE - FLASH_DEV_PAGE_SIZE) / 4)
+
+static const char *const state_names[] = { "idle", "receiving", "verified", "failed" };
+
+static struct {
+    const flash_dev_t *dev;
+    uint32_t state_offset;          // of the state sector, the image fits below it
+    ota_state_t state;
+    ota_manifest_t manifest;
+    uint32_t offset;                // image bytes received and hashed
+    uint32_t checkpoints;           // written to the state sector
+    uint32_t status_offset;         // offset at the latest status
+    uint8_t status_due;
+    uint8_t status_resume;          // the sender has to continue from the offset
+    mbedtls_sha256_context sha;
+    // Image bytes of the page being filled. Between pages, scratch for the state sector.
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+    // The chunk being received
+    uint8_t header[OTA_CHUNK_HEADER_LEN];
+    uint8_t header_len;
+    uint8_t chunk_dropped;
+    uint8_t chunk_new;
+    uint32_t chunk_pos;             // image offset of the next byte of the chunk
+    ota_stats_t stats;
+} ota;
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void decode_manifest(const uint8_t *p, ota_manifest_t *manifest) {
+    manifest->size = get_u32(&p[0]);
+    manifest->version = get_u32(&p[4]);
+    memcpy(manifest->digest, &p[8], OTA_DIGEST_LEN);
+}
+
+static void fail(const char *reason) {
+    PICO_LOGE("OTA: %s\n", reason);
+    ota.state = OTA_FAILED;
+    ota.status_due = 1;
+}
+
+static void flash_failed(const char *op) {
+    ota.stats.flash_errors++;
+    fail(op);
+}
+
+// Programs len bytes at offset of the state sector. The rest of the page is left as 0xFF,
+// which leaves the bits already programmed there untouched.
+static uint8_t program_state(uint32_t offset, const void *data, size_t len) {
+    uint32_t page_offset = offset - offset % FLASH_DEV_PAGE_SIZE;
+
+    memset(ota.page, 0xFF, sizeof(ota.page));
+    memcpy(&ota.page[offset - page_offset], data, len);
+    return ota.dev->program_page(ota.dev, ota.state_offset + page_offset, ota.page);
+}
+
+static uint8_t program_mark(uint32_t mark) {
+    uint8_t word[4];
+
+    put_u32(word, mark);
+    return program_state(HDR_MARK, word, sizeof(word));
+}
+
+// Feeds the first len bytes of a region to the digest, the staged image or its installed copy
+static uint8_t hash_flash(const flash_dev_t *dev, uint32_t len) {
+    mbedtls_sha256_starts(&ota.sha, 0);
+
+    for (uint32_t offset = 0; offset < len; offset += FLASH_DEV_PAGE_SIZE) {
+        uint32_t n = len - offset < FLASH_DEV_PAGE_SIZE ? len - offset : FLASH_DEV_PAGE_SIZE;
+
+        if (dev->read(dev, offset, ota.page, n) != 0) return 1;
+        mbedtls_sha256_update(&ota.sha, ota.page, n);
+        ota.stats.rehashed_bytes += n;
+    }
+    return 0;
+}
+
+// Returns the bytes of the latest checkpoint and counts the checkpoints
+static uint32_t read_checkpoints(void) {
+    uint32_t committed = 0;
+
+    ota.checkpoints = 0;
+    for (uint32_t page = CHECKPOINT_FIRST; page < FLASH_DEV_SECTOR_SIZE; page += FLASH_DEV_PAGE_SIZE) {
+        if (ota.dev->read(ota.dev, ota.state_offset + page, ota.page, FLASH_DEV_PAGE_SIZE) != 0) return 0;
+
+        for (uint32_t i = 0; i < FLASH_DEV_PAGE_SIZE; i += 4) {
+            uint32_t word = get_u32(&ota.page[i]);
+            if (word == OTA_WORD_ERASED) return committed;
+            committed = word;
+            ota.checkpoints++;
+        }
+    }
+    return committed;
+}
+
+uint8_t ota_init(const flash_dev_t *dev) {
+    if (!dev || dev->size < 2 * FLASH_DEV_SECTOR_SIZE || dev->size % FLASH_DEV_SECTOR_SIZE) return 1;
+
+    // One checkpoint per sector of the largest image
+    if (dev->size / FLASH_DEV_SECTOR_SIZE - 1 > CHECKPOINT_MAX) return 1;
+
+    memset(&ota, 0, sizeof(ota));
+    ota.dev = dev;
+    ota.state_offset = dev->size - FLASH_DEV_SECTOR_SIZE;
+    mbedtls_sha256_init(&ota.sha);
+
+    uint8_t header[HDR_LEN];
+    if (dev->read(dev, ota.state_offset, header, sizeof(header)) != 0) return 1;
+
+    // An erased or foreign state sector means nothing is staged, a new begin formats it
+    if (get_u32(&header[HDR_MAGIC]) != OTA_MAGIC) return 0;
+
+    decode_manifest(&header[HDR_MANIFEST], &ota.manifest);
+    if (ota.manifest.size == 0 || ota.manifest.size > ota.state_offset) return 0;
+
+    uint32_t mark = get_u32(&header[HDR_MARK]);
+    if (mark == OTA_VERIFIED_MARK) {
+        ota.state = OTA_VERIFIED;
+        ota.offset = ota.manifest.size;
+        return 0;
+    }
+    if (mark != OTA_WORD_ERASED) {
+        ota.state = OTA_FAILED;
+        return 0;
+    }
+
+    // The bytes after the latest checkpoint may not have reached the flash, they are sent again
+    uint32_t committed = read_checkpoints();
+    if (committed % FLASH_DEV_SECTOR_SIZE || committed >= ota.manifest.size || hash_flash(dev, committed) != 0) {
+        fail("state sector is corrupt");
+        return 0;
+    }
+
+    ota.state = OTA_RECEIVING;
+    ota.offset = committed;
+    ota.status_offset = committed;
+    ota.status_due = 1;
+    ota.status_resume = 1;
+    ota.stats.resumes++;
+
+    PICO_LOGI("OTA: continuing version %lu at %lu of %lu bytes\n", (unsigned long)ota.manifest.version,
+        (unsigned long)committed, (unsigned long)ota.manifest.size);
+    return 0;
+}
+
+static void start(const ota_manifest_t *manifest) {
+    uint8_t header[HDR_MARK];
+
+    ota.manifest = *manifest;
+    ota.state = OTA_RECEIVING;
+    ota.offset = 0;
+    ota.checkpoints = 0;
+    ota.status_offset = 0;
+
+    // The image sectors are erased as the transfer reaches them
+    ota.stats.erases++;
+    if (ota.dev->erase_sector(ota.dev, ota.state_offset) != 0) {
+        flash_failed("unable to erase the state sector");
+        return;
+    }
+
+    put_u32(&header[HDR_MAGIC], OTA_MAGIC);
+    put_u32(&header[HDR_MANIFEST], manifest->size);
+    put_u32(&header[HDR_MANIFEST + 4], manifest->version);
+    memcpy(&header[HDR_MANIFEST + 8], manifest->digest, OTA_DIGEST_LEN);
+    if (program_state(0, header, sizeof(header)) != 0) {
+        flash_failed("unable to write the state sector");
+        return;
+    }
+
+    mbedtls_sha256_starts(&ota.sha, 0);
+
+    PICO_LOGI("OTA: receiving version %lu, %lu bytes\n", (unsigned long)manifest->version,
+        (unsigned long)manifest->size);
+}
+
+void ota_begin_handler(__unused void *arg, __unused const char *topic, const uint8_t *payload, size_t len) {
+    ota_manifest_t manifest;
+
+    if (!ota.dev || len != OTA_MANIFEST_LEN) {
+        PICO_LOGE("OTA: malformed begin\n");
+        return;
+    }
+
+    decode_manifest(payload, &manifest);
+    ota.stats.begins++;
+    ota.status_due = 1;
+    ota.status_resume = 1;
+
+    // A sender that restarted, or lost the status, asks again and continues from the offset
+    if ((ota.state == OTA_RECEIVING || ota.state == OTA_VERIFIED) && memcmp(&manifest, &ota.manifest, sizeof(manifest)) == 0) {
+        ota.stats.resumes++;
+        return;
+    }
+
+    // The staged state on flash is only replaced by a transfer that can succeed
+    if (manifest.size == 0 || manifest.size > ota.state_offset || manifest.size > FLASH_APP_MAX_SIZE) {
+        ota.manifest = manifest;
+        ota.offset = 0;
+        fail("image does not fit the staging region");
+        return;
+    }
+
+    start(&manifest);
+}
+
+static void finish(void);
+
+// Programs the filled page at page_offset, erasing its sector first when it starts one
+static void program_image_page(uint32_t page_offset) {
+    if (page_offset % FLASH_DEV_SECTOR_SIZE == 0) {
+        ota.stats.erases++;
+        if (ota.dev->erase_sector(ota.dev, page_offset) != 0) {
+            flash_failed("unable to erase the staging region");
+            return;
+        }
+    }
+
+    if (ota.dev->program_page(ota.dev, page_offset, ota.page) != 0) {
+        flash_failed("unable to program the staging region");
+        return;
+    }
+
+    // The last sector of the image is covered by the mark instead
+    uint32_t end = page_offset + FLASH_DEV_PAGE_SIZE;
+    if (end % FLASH_DEV_SECTOR_SIZE == 0 && end < ota.manifest.size && ota.checkpoints < CHECKPOINT_MAX) {
+        uint8_t word[4];
+
+        put_u32(word, end);
+        if (program_state(CHECKPOINT_FIRST + 4 * ota.checkpoints, word, sizeof(word)) != 0) {
+            flash_failed("unable to write a checkpoint");
+            return;
+        }
+        ota.checkpoints++;
+    }
+}
+
+// Appends image bytes at ota.offset
+static void write_image(const uint8_t *data, size_t len) {
+    mbedtls_sha256_update(&ota.sha, data, len);
+
+    while (len && ota.state == OTA_RECEIVING) {
+        uint32_t fill = ota.offset % FLASH_DEV_PAGE_SIZE;
+        size_t n = len < FLASH_DEV_PAGE_SIZE - fill ? len : FLASH_DEV_PAGE_SIZE - fill;
+
+        memcpy(&ota.page[fill], data, n);
+        data += n;
+        len -= n;
+        ota.offset += n;
+        ota.stats.bytes += n;
+
+        if (ota.offset % FLASH_DEV_PAGE_SIZE == 0) {
+            program_image_page(ota.offset - FLASH_DEV_PAGE_SIZE);
+        }
+    }
+
+    if (ota.state != OTA_RECEIVING) return;
+
+    if (ota.offset == ota.manifest.size) {
+        finish();
+    } else if (ota.offset - ota.status_offset >= OTA_STATUS_BYTES) {
+        ota.status_due = 1;
+    }
+}
+
+static void finish(void) {
+    uint32_t fill = ota.offset % FLASH_DEV_PAGE_SIZE;
+    uint8_t digest[OTA_DIGEST_LEN];
+
+    if (fill) {
+        memset(&ota.page[fill], 0xFF, FLASH_DEV_PAGE_SIZE - fill);
+        program_image_page(ota.offset - fill);
+        if (ota.state != OTA_RECEIVING) return;
+    }
+
+    mbedtls_sha256_finish(&ota.sha, digest);
+    ota.status_due = 1;
+
+    if (memcmp(digest, ota.manifest.digest, OTA_DIGEST_LEN) != 0) {
+        // Marked on flash, so a reboot does not continue a transfer that cannot succeed
+        program_mark(OTA_FAILED_MARK);
+        fail("digest mismatch");
+        return;
+    }
+
+    if (program_mark(OTA_VERIFIED_MARK) != 0) {
+        flash_failed("unable to mark the image verified");
+        return;
+    }
+
+    ota.state = OTA_VERIFIED;
+    PICO_LOGI("OTA: version %lu verified, installed at the next boot\n", (unsigned long)ota.manifest.version);
+}
+
+uint8_t ota_chunk_begin(__unused void *arg, __unused const char *topic, size_t total_len) {
+    if (ota.state != OTA_RECEIVING || total_len <= OTA_CHUNK_HEADER_LEN) return 1;
+
+    ota.header_len = 0;
+    ota.chunk_dropped = 0;
+    ota.chunk_new = 0;
+    return 0;
+}
+
+void ota_chunk_data(__unused void *arg, const uint8_t *data, size_t len, uint8_t last) {
+    // The offset may be split over fragments
+    while (len && ota.header_len < OTA_CHUNK_HEADER_LEN) {
+        ota.header[ota.header_len++] = *data++;
+        len--;
+        if (ota.header_len == OTA_CHUNK_HEADER_LEN) {
+            ota.chunk_pos = get_u32(ota.header);
+        }
+    }
+
+    if (len && !ota.chunk_dropped && ota.state == OTA_RECEIVING) {
+        // Bytes sent again after a status are skipped
+        if (ota.chunk_pos < ota.offset) {
+            size_t skip = ota.offset - ota.chunk_pos < len ? ota.offset - ota.chunk_pos : len;
+
+            data += skip;
+            len -= skip;
+            ota.chunk_pos += skip;
+            ota.stats.duplicate_bytes += skip;
+        }
+
+        if (len && ota.chunk_pos > ota.offset) {
+            // A chunk was lost, the status tells the sender where to continue
+            ota.chunk_dropped = 1;
+            ota.stats.dropped++;
+            ota.status_due = 1;
+            ota.status_resume = 1;
+        } else if (len) {
+            size_t n = ota.manifest.size - ota.offset < len ? ota.manifest.size - ota.offset : len;
+
+            ota.chunk_pos += n;
+            ota.chunk_new = 1;
+            write_image(data, n);
+        }
+    }
+
+    if (last && ota.chunk_new) {
+        ota.stats.chunks++;
+    }
+}
+
+int ota_status(char *buf, size_t len) {
+    if (!ota.status_due) return 0;
+
+    int n = snprintf(buf, len, "{\"state\":\"%s\",\"version\":%lu,\"offset\":%lu,\"size\":%lu,\"resume\":%s}",
+        state_names[ota.state], (unsigned long)ota.manifest.version, (unsigned long)ota.offset,
+        (unsigned long)ota.manifest.size, ota.status_resume ? "true" : "false");
+    if (n < 0 || (size_t)n >= len) return -1;
+
+    ota.status_due = 0;
+    ota.status_resume = 0;
+    ota.status_offset = ota.offset;
+    return n;
+}
+
+ota_state_t ota_state(void) {
+    return ota.state;
+}
+
+uint8_t ota_check_staged(ota_manifest_t *manifest) {
+    uint8_t digest[OTA_DIGEST_LEN];
+
+    if (ota.state != OTA_VERIFIED) return 1;
+
+    if (hash_flash(ota.dev, ota.manifest.size) != 0) return 1;
+    mbedtls_sha256_finish(&ota.sha, digest);
+
+    if (memcmp(digest, ota.manifest.digest, OTA_DIGEST_LEN) != 0) {
+        program_mark(OTA_FAILED_MARK);
+        fail("staged image no longer matches its digest");
+        return 1;
+    }
+
+    *manifest = ota.manifest;
+    return 0;
+}
+
+uint8_t ota_install(const flash_dev_t *app) {
+    ota_manifest_t manifest;
+    uint8_t digest[OTA_DIGEST_LEN];
+
+    if (ota_check_staged(&manifest) != 0) return 1;
+
+    // Copying it again would not help
+    if (manifest.size > app->size) {
+        program_mark(OTA_FAILED_MARK);
+        fail("image does not fit the application region");
+        return 1;
+    }
+
+    PICO_LOGI("OTA: installing version %lu, %lu bytes\n", (unsigned long)manifest.version, (unsigned long)manifest.size);
+
+    // Only the copy is written, a reset at any point leaves the staged image and its state for
+    // the next boot to copy again. The last page is copied whole, the staged region goes on.
+    for (uint32_t offset = 0; offset < manifest.size; offset += FLASH_DEV_PAGE_SIZE) {
+        if (offset % FLASH_DEV_SECTOR_SIZE == 0) {
+            ota.stats.erases++;
+            if (app->erase_sector(app, offset) != 0) goto flash_error;
+        }
+        if (ota.dev->read(ota.dev, offset, ota.page, FLASH_DEV_PAGE_SIZE) != 0 ||
+            app->program_page(app, offset, ota.page) != 0) goto flash_error;
+    }
+
+    // The state is cleared once the copy is known to be whole
+    if (hash_flash(app, manifest.size) != 0) goto flash_error;
+    mbedtls_sha256_finish(&ota.sha, digest);
+    if (memcmp(digest, manifest.digest, OTA_DIGEST_LEN) != 0) goto flash_error;
+
+    return ota_clear();
+
+flash_error:
+    ota.stats.flash_errors++;
+    PICO_LOGE("OTA: installing failed\n");
+    return 1;
+}
+
+uint8_t ota_abandon(void) {
+    if (!ota.dev || ota.state != OTA_VERIFIED) return 1;
+
+    fail("giving up on the staged image, it could not be installed");
+    if (program_mark(OTA_FAILED_MARK) != 0) {
+        ota.stats.flash_errors++;
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t ota_clear(void) {
+    if (!ota.dev) return 1;
+
+    ota.stats.erases++;
+    if (ota.dev->erase_sector(ota.dev, ota.state_offset) != 0) {
+        ota.stats.flash_errors++;
+        return 1;
+    }
+
+    ota.state = OTA_IDLE;
+    ota.offset = 0;
+    memset(&ota.manifest, 0, sizeof(ota.manifest));
+    return 0;
+}
+
+const ota_stats_t *ota_get_stats(void) {
+    return &ota.stats;
+}
+
+size_t ota_ram_bytes(void) {
+    return sizeof(ota);
+}
@@ -0,0 +1,28 @@
+#include "pico_ota.h"
+#include "pico_log.h"
+
+#include "pico/stdlib.h"
+
+extern char __flash_binary_end;
+
+uint8_t ota_boot(flash_dev_t *dev) {
+    // Staging writes would overwrite the running image
+    uint32_t image_end = (uint32_t)((uintptr_t)&__flash_binary_end - XIP_BASE);
+    if (image_end > FLASH_APP_OFFSET + FLASH_APP_MAX_SIZE) {
+        PICO_LOGE("Image ends at %lu, in the OTA region, updates are disabled\n", (unsigned long)image_end);
+        return 1;
+    }
+
+    if (flash_dev_init_onboard(dev, FLASH_OTA_OFFSET, FLASH_OTA_SIZE) != 0 || ota_init(dev) != 0) {
+        PICO_LOGE("Unable to mount the OTA region\n");
+        return 1;
+    }
+
+    // The boot stage gave up on it after repeated flash errors, rebooting into it again
+    // would not install it either
+    if (ota_state() == OTA_VERIFIED) {
+        PICO_LOGE("A verified image is still staged, the boot stage could not install it\n");
+        ota_abandon();
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "pico_pubq.h"
+
+#include <string.h>
+
+void pubq_init(pubq_t *queue, uint8_t *buf, size_t size, uint8_t window) {
+    memset(queue, 0, sizeof(*queue));
+    queue->buf = buf;
+    queue->size = (uint32_t)size;
+    queue->window = window > 0 ? window : 1;
+}
+
+// Finds len contiguous bytes behind the newest message. Returns the offset, size if there is no room.
+static uint32_t ring_alloc(pubq_t *queue, uint32_t len) {
+    if (queue->count == 0) {
+        queue->head = 0;
+        return len <= queue->size ? 0 : queue->size;
+    }
+
+    uint32_t tail = queue->entries[queue->oldest].offset;
+
+    // Strictly below the tail, so head only meets it again when the ring is empty
+    if (queue->head >= tail) {
+        if (len <= queue->size - queue->head) return queue->head;
+        if (len < tail) return 0;
+        return queue->size;
+    }
+    if (len < tail - queue->head) return queue->head;
+    return queue->size;
+}
+
+// Releases the completed entries at the front
+static void reclaim(pubq_t *queue) {
+    while (queue->count > 0 && queue->entries[queue->oldest].state == PUBQ_DONE) {
+        queue->entries[queue->oldest].state = PUBQ_FREE;
+        queue->oldest = (queue->oldest + 1) % PUBQ_MAX_ENTRIES;
+        queue->count--;
+    }
+}
+
+uint8_t pubq_push(pubq_t *queue, const char *topic, const uint8_t *payload, size_t len, uint64_t now_us) {
+    size_t topic_len = strlen(topic);
+
+    if (queue->count >= PUBQ_MAX_ENTRIES || topic_len > UINT16_MAX || len > UINT16_MAX) {
+        queue->stats.rejected++;
+        return 1;
+    }
+
+    uint32_t need = (uint32_t)(topic_len + 1 + len);
+    uint32_t offset = ring_alloc(queue, need);
+    if (offset >= queue->size) {
+        queue->stats.rejected++;
+        return 1;
+    }
+
+    pubq_entry_t *entry = &queue->entries[(queue->oldest + queue->count) % PUBQ_MAX_ENTRIES];
+    memset(entry, 0, sizeof(*entry));
+    entry->queue = queue;
+    entry->offset = offset;
+    entry->topic_len = (uint16_t)topic_len;
+    entry->payload_len = (uint16_t)len;
+    entry->state = PUBQ_QUEUED;
+    entry->queued_us = now_us;
+
+    memcpy(&queue->buf[offset], topic, topic_len + 1);
+    if (len > 0) memcpy(&queue->buf[offset + topic_len + 1], payload, len);
+
+    queue->head = offset + need;
+    queue->count++;
+    queue->stats.queued++;
+
+    uint32_t depth = pubq_depth(queue);
+    if (depth > queue->stats.max_depth) queue->stats.max_depth = depth;
+
+    return 0;
+}
+
+pubq_entry_t *pubq_next(pubq_t *queue) {
+    if (queue->in_flight >= queue->window) return NULL;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        pubq_entry_t *entry = &queue->entries[(queue->oldest + i) % PUBQ_MAX_ENTRIES];
+
+        if (entry->state == PUBQ_QUEUED) return entry;
+    }
+    return NULL;
+}
+
+void pubq_sent(pubq_t *queue, pubq_entry_t *entry, uint64_t now_us) {
+    entry->state = PUBQ_IN_FLIGHT;
+    entry->attempts++;
+    entry->sent_us = now_us;
+
+    queue->in_flight++;
+    queue->stats.submitted++;
+    if (queue->in_flight > queue->stats.max_in_flight) queue->stats.max_in_flight = queue->in_flight;
+}
+
+void pubq_defer(pubq_t *queue) {
+    queue->stats.deferred++;
+}
+
+pubq_result_t pubq_complete(pubq_t *queue, pubq_entry_t *entry, uint8_t ok) {
+    pubq_result_t result = PUBQ_ACKED;
+
+    if (entry->state != PUBQ_IN_FLIGHT) return PUBQ_FAILED;
+    queue->in_flight--;
+
+    if (ok) {
+        queue->stats.acked++;
+    } else if (entry->attempts < PUBQ_MAX_ATTEMPTS) {
+        entry->state = PUBQ_QUEUED;
+        queue->stats.retried++;
+        return PUBQ_RETRY;
+    } else {
+        queue->stats.failed++;
+        result = PUBQ_FAILED;
+    }
+
+    entry->state = PUBQ_DONE;
+    reclaim(queue);
+    return result;
+}
+
+void pubq_requeue(pubq_t *queue) {
+    for (uint8_t i = 0; i < queue->count; i++) {
+        pubq_entry_t *entry = &queue->entries[(queue->oldest + i) % PUBQ_MAX_ENTRIES];
+
+        if (entry->state == PUBQ_IN_FLIGHT) {
+            entry->state = PUBQ_QUEUED;
+            queue->stats.requeued++;
+        }
+    }
+    queue->in_flight = 0;
+}
+
+uint32_t pubq_depth(const pubq_t *queue) {
+    uint32_t depth = 0;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        uint8_t state = queue->entries[(queue->oldest + i) % PUBQ_MAX_ENTRIES].state;
+
+        if (state == PUBQ_QUEUED || state == PUBQ_IN_FLIGHT) depth++;
+    }
+    return depth;
+}
+
+const char *pubq_topic(const pubq_t *queue, const pubq_entry_t *entry) {
+    return (const char *)&queue->buf[entry->offset];
+}
+
+const uint8_t *pubq_payload(const pubq_t *queue, const pubq_entry_t *entry) {
+    return &queue->buf[entry->offset + entry->topic_len + 1];
+}
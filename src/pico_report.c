@@ -0,0 +1,57 @@
+#include "pico_report.h"
+
+#include <string.h>
+
+static uint32_t distance(int64_t a, int64_t b) {
+    return (uint32_t)(a > b ? a - b : b - a);
+}
+
+// A channel moved when it left the deadband around the last sample passed on
+static uint8_t moved(const report_t *report, const sample_t *sample) {
+    const report_config_t *config = &report->config;
+    const sample_t *last = &report->last;
+
+    return distance(sample->temperature, last->temperature) > config->deadband_temperature ||
+        distance(sample->humidity, last->humidity) > config->deadband_humidity ||
+        distance(sample->pressure, last->pressure) > config->deadband_pressure;
+}
+
+void report_init(report_t *report, const report_config_t *config) {
+    memset(report, 0, sizeof(*report));
+
+    report->config = *config;
+}
+
+uint8_t report_check(report_t *report, const sample_t *sample, uint32_t now_ms) {
+    uint8_t movement = report->has_last && moved(report, sample);
+    uint8_t heartbeat = report->has_last && (uint32_t)(now_ms - report->last_ms) >= report->config.heartbeat_ms;
+
+    if (movement) {
+        report->fast = 1;
+        report->fast_until_ms = now_ms + report->config.fast_hold_ms;
+    }
+
+    if (report->has_last && !movement && !heartbeat) {
+        report->stats.suppressed++;
+        return 0;
+    }
+
+    if (!movement && report->has_last) {
+        report->stats.heartbeats++;
+    }
+    report->stats.sent++;
+
+    report->last = *sample;
+    report->last_ms = now_ms;
+    report->has_last = 1;
+
+    return 1;
+}
+
+uint32_t report_interval_ms(report_t *report, uint32_t now_ms) {
+    if (report->fast && (int32_t)(report->fast_until_ms - now_ms) <= 0) {
+        report->fast = 0;
+    }
+
+    return report->fast ? report->config.fast_interval_ms : report->config.slow_interval_ms;
+}
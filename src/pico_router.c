@@ -0,0 +1,308 @@
+#include "pico_router.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint16_t *routes;
+    size_t max;
+    size_t count;
+} match_t;
+
+// Length of the topic level starting at level
+static size_t level_len(const char *level) {
+    const char *end = strchr(level, '/');
+    return end ? (size_t)(end - level) : strlen(level);
+}
+
+static bool is_wildcard(const char *level, size_t len, char wildcard) {
+    return len == 1 && level[0] == wildcard;
+}
+
+// Wildcards must fill a whole level and '#' must be the last level
+static bool filter_valid(const char *filter) {
+    const char *level = filter;
+
+    if (*filter == '\0') return false;
+
+    while (1) {
+        size_t len = level_len(level);
+
+        for (size_t i = 0; i < len; i++) {
+            if ((level[i] == '+' || level[i] == '#') && len != 1) return false;
+        }
+        if (is_wildcard(level, len, '#') && level[len] != '\0') return false;
+
+        if (level[len] == '\0') return true;
+        level += len + 1;
+    }
+}
+
+static uint16_t find_child(const router_t *router, uint16_t parent, const char *name, size_t len) {
+    uint16_t child = router->nodes[parent].child;
+
+    while (child != ROUTER_NONE) {
+        const router_node_t *node = &router->nodes[child];
+
+        if (node->name_len == len && memcmp(&router->pool[node->name], name, len) == 0) {
+            return child;
+        }
+        child = node->sibling;
+    }
+
+    return ROUTER_NONE;
+}
+
+static uint16_t new_node(router_t *router, const char *name, size_t len) {
+    uint16_t index = (uint16_t)router->node_count++;
+    router_node_t *node = &router->nodes[index];
+
+    node->name = (uint16_t)(name - router->pool);
+    node->name_len = (uint16_t)len;
+    node->child = ROUTER_NONE;
+    node->sibling = ROUTER_NONE;
+    node->plus = ROUTER_NONE;
+    node->exact = ROUTER_NONE;
+    node->multi = ROUTER_NONE;
+
+    return index;
+}
+
+// Number of nodes that adding the filter would create
+static size_t missing_nodes(const router_t *router, const char *filter) {
+    const char *level = filter;
+    uint16_t node = 0;
+    size_t missing = 0;
+
+    while (1) {
+        size_t len = level_len(level);
+
+        if (is_wildcard(level, len, '#')) break;
+
+        if (node != ROUTER_NONE) {
+            node = is_wildcard(level, len, '+') ? router->nodes[node].plus : find_child(router, node, level, len);
+        }
+        if (node == ROUTER_NONE) {
+            missing++;
+        }
+
+        if (level[len] == '\0') break;
+        level += len + 1;
+    }
+
+    return missing;
+}
+
+// Walks the filter from the root, creating the missing levels, and attaches the route.
+// The filter must be the copy in the pool, the nodes keep pointers into it.
+static void link_route(router_t *router, uint16_t route) {
+    const char *level = &router->pool[router->routes[route].filter];
+    uint16_t node = 0;
+
+    while (1) {
+        size_t len = level_len(level);
+        uint16_t next;
+
+        if (is_wildcard(level, len, '#')) {
+            router->nodes[node].multi = route;
+            return;
+        }
+
+        if (is_wildcard(level, len, '+')) {
+            next = router->nodes[node].plus;
+            if (next == ROUTER_NONE) {
+                next = new_node(router, level, len);
+                router->nodes[node].plus = next;
+            }
+        }
+        else {
+            next = find_child(router, node, level, len);
+            if (next == ROUTER_NONE) {
+                next = new_node(router, level, len);
+                router->nodes[next].sibling = router->nodes[node].child;
+                router->nodes[node].child = next;
+            }
+        }
+        node = next;
+
+        if (level[len] == '\0') {
+            router->nodes[node].exact = route;
+            return;
+        }
+        level += len + 1;
+    }
+}
+
+// Follows a registered filter through the trie and detaches the route
+static void unlink_route(router_t *router, uint16_t route) {
+    const char *level = &router->pool[router->routes[route].filter];
+    uint16_t node = 0;
+
+    while (node != ROUTER_NONE) {
+        size_t len = level_len(level);
+
+        if (is_wildcard(level, len, '#')) {
+            router->nodes[node].multi = ROUTER_NONE;
+            return;
+        }
+
+        node = is_wildcard(level, len, '+') ? router->nodes[node].plus : find_child(router, node, level, len);
+
+        if (node != ROUTER_NONE && level[len] == '\0') {
+            router->nodes[node].exact = ROUTER_NONE;
+            return;
+        }
+        level += len + 1;
+    }
+}
+
+static uint16_t find_route(const router_t *router, const char *filter) {
+    for (size_t i = 0; i < router->route_count; i++) {
+        if (strcmp(&router->pool[router->routes[i].filter], filter) == 0) {
+            return (uint16_t)i;
+        }
+    }
+
+    return ROUTER_NONE;
+}
+
+void router_init(router_t *router) {
+    memset(router, 0, sizeof(*router));
+
+    // The root has no name, its children are the first topic levels
+    new_node(router, router->pool, 0);
+    inbound_init(&router->inbound, router->payload, sizeof(router->payload));
+}
+
+uint8_t router_add(router_t *router, const char *filter, router_handler_t handler, void *arg) {
+    if (!handler || !filter_valid(filter)) return 1;
+
+    uint16_t route = find_route(router, filter);
+
+    if (route == ROUTER_NONE) {
+        size_t len = strlen(filter) + 1;
+
+        if (router->route_count >= ROUTER_MAX_ROUTES ||
+            router->pool_used + len > ROUTER_POOL_SIZE ||
+            router->node_count + missing_nodes(router, filter) > ROUTER_MAX_NODES) {
+            return 1;
+        }
+
+        route = (uint16_t)router->route_count++;
+        router->routes[route].filter = (uint16_t)router->pool_used;
+        memcpy(&router->pool[router->pool_used], filter, len);
+        router->pool_used += len;
+    }
+
+    // A removed filter still has its nodes, linking it again creates none
+    router->routes[route].handler = handler;
+    router->routes[route].arg = arg;
+    link_route(router, route);
+
+    return 0;
+}
+
+uint8_t router_remove(router_t *router, const char *filter) {
+    uint16_t route = find_route(router, filter);
+
+    if (route == ROUTER_NONE || router->routes[route].handler == NULL) return 1;
+
+    unlink_route(router, route);
+    router->routes[route].handler = NULL;
+    router->routes[route].arg = NULL;
+
+    return 0;
+}
+
+const char *router_filter(const router_t *router, size_t index) {
+    if (index >= router->route_count || router->routes[index].handler == NULL) return NULL;
+
+    return &router->pool[router->routes[index].filter];
+}
+
+static void add_match(match_t *match, uint16_t route) {
+    if (route != ROUTER_NONE && match->count < match->max) {
+        match->routes[match->count++] = route;
+    }
+}
+
+// level is NULL once every level of the topic has been consumed. A topic matches one filter
+// along one path only, so no route is reported twice.
+static void match_node(const router_t *router, uint16_t index, const char *level, bool first, match_t *match) {
+    const router_node_t *node = &router->nodes[index];
+
+    // Wildcards in the first level do not match topics like $SYS
+    bool wildcards = !(first && level != NULL && level[0] == '$');
+
+    // 'a/#' also matches 'a' itself
+    if (wildcards) {
+        add_match(match, node->multi);
+    }
+
+    if (level == NULL) {
+        add_match(match, node->exact);
+        return;
+    }
+
+    size_t len = level_len(level);
+    const char *next = level[len] == '/' ? level + len + 1 : NULL;
+
+    uint16_t child = find_child(router, index, level, len);
+    if (child != ROUTER_NONE) {
+        match_node(router, child, next, false, match);
+    }
+
+    if (wildcards && node->plus != ROUTER_NONE) {
+        match_node(router, node->plus, next, false, match);
+    }
+}
+
+size_t router_match(const router_t *router, const char *topic, uint16_t *routes, size_t max) {
+    match_t match = {
+        .routes = routes,
+        .max = max,
+        .count = 0
+    };
+
+    match_node(router, 0, topic, true, &match);
+
+    return match.count;
+}
+
+uint8_t router_begin(void *arg, const char *topic, size_t total_len) {
+    router_t *router = (router_t *)arg;
+    size_t topic_len = strlen(topic);
+
+    router->match_count = router_match(router, topic, router->matches, ROUTER_MAX_MATCHES);
+    if (router->match_count == 0) {
+        router->stats.unmatched++;
+        return 1;
+    }
+
+    // The topic is only valid during this call, the handlers run after the last fragment
+    if (topic_len > ROUTER_TOPIC_MAX_LEN || inbound_begin(&router->inbound, total_len) != 0) {
+        router->stats.dropped++;
+        router->match_count = 0;
+        return 1;
+    }
+    memcpy(router->topic, topic, topic_len + 1);
+
+    return 0;
+}
+
+void router_data(void *arg, const uint8_t *data, size_t len, uint8_t last) {
+    router_t *router = (router_t *)arg;
+
+    if (inbound_append(&router->inbound, data, len, last) != 0) return;
+
+    router->stats.routed++;
+
+    for (size_t i = 0; i < router->match_count; i++) {
+        const router_route_t *route = &router->routes[router->matches[i]];
+
+        // A handler may have removed this route
+        if (route->handler) {
+            route->handler(route->arg, router->topic, router->payload, router->inbound.len);
+        }
+    }
+}
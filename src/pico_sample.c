@@ -0,0 +1,55 @@
+#include "pico_sample.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void sample_set_time(sample_t *sample, uint64_t unix_us) {
+    sample->time = (uint32_t)(unix_us / 1000000);
+    sample->time_ms = (uint16_t)(unix_us / 1000 % 1000);
+}
+
+int sample_to_json(const sample_t *sample, char *buf, size_t buf_len) {
+    uint32_t temp_abs = sample->temperature < 0 ? (uint32_t)-sample->temperature : (uint32_t)sample->temperature;
+
+    int len = snprintf(buf, buf_len,
+        "{\"" SAMPLE_JSON_KEY_TEMP "\":%s%lu.%02lu,"
+        "\"" SAMPLE_JSON_KEY_HUMIDITY "\":%lu.%02lu,"
+        "\"" SAMPLE_JSON_KEY_PRESSURE "\":%lu.%02lu",
+        sample->temperature < 0 ? "-" : "",
+        (unsigned long)(temp_abs / 100), (unsigned long)(temp_abs % 100),
+        (unsigned long)(sample->humidity / 100), (unsigned long)(sample->humidity % 100),
+        (unsigned long)(sample->pressure / 100), (unsigned long)(sample->pressure % 100));
+
+    if (len < 0 || (size_t)len >= buf_len) return -1;
+
+    int tail = sample->time == 0 ? snprintf(&buf[len], buf_len - (size_t)len, "}") :
+        snprintf(&buf[len], buf_len - (size_t)len, ",\"" SAMPLE_JSON_KEY_TIME "\":%lu.%03u}",
+            (unsigned long)sample->time, (unsigned int)sample->time_ms);
+
+    if (tail < 0 || (size_t)(len + tail) >= buf_len) return -1;
+    return len + tail;
+}
+
+int sample_to_json_array(const sample_t *samples, size_t count, char *buf, size_t buf_len) {
+    size_t pos = 0;
+
+    if (buf_len < 3) return -1;
+    buf[pos++] = '[';
+
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            if (pos + 1 >= buf_len) return -1;
+            buf[pos++] = ',';
+        }
+
+        int len = sample_to_json(&samples[i], &buf[pos], buf_len - pos);
+        if (len < 0) return -1;
+        pos += (size_t)len;
+    }
+
+    if (pos + 2 > buf_len) return -1;
+    buf[pos++] = ']';
+    buf[pos] = '\0';
+
+    return (int)pos;
+}
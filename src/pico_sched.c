@@ -0,0 +1,160 @@
+#include "pico_sched.h"
+#include "pico_log.h"
+#include "pico_trace.h"
+
+#include <string.h>
+
+static uint64_t deadline_of(const sched_t *sched, uint8_t heap_pos) {
+    return sched->tasks[sched->heap[heap_pos]].deadline_us;
+}
+
+static void heap_swap(sched_t *sched, uint8_t a, uint8_t b) {
+    uint8_t tmp = sched->heap[a];
+    sched->heap[a] = sched->heap[b];
+    sched->heap[b] = tmp;
+}
+
+static void sift_up(sched_t *sched, uint8_t pos) {
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (deadline_of(sched, parent) <= deadline_of(sched, pos)) break;
+
+        heap_swap(sched, parent, pos);
+        pos = parent;
+    }
+}
+
+static void sift_down(sched_t *sched, uint8_t pos) {
+    while (1) {
+        uint8_t smallest = pos;
+        uint8_t left = 2 * pos + 1;
+        uint8_t right = 2 * pos + 2;
+
+        if (left < sched->count && deadline_of(sched, left) < deadline_of(sched, smallest)) smallest = left;
+        if (right < sched->count && deadline_of(sched, right) < deadline_of(sched, smallest)) smallest = right;
+        if (smallest == pos) break;
+
+        heap_swap(sched, smallest, pos);
+        pos = smallest;
+    }
+}
+
+// Restores the heap order after the deadline of a task changed
+static void heap_fix(sched_t *sched, int id) {
+    for (uint8_t pos = 0; pos < sched->count; pos++) {
+        if (sched->heap[pos] == id) {
+            sift_up(sched, pos);
+            sift_down(sched, pos);
+            return;
+        }
+    }
+}
+
+void sched_init(sched_t *sched, sched_clock_fn now_us) {
+    memset(sched, 0, sizeof(*sched));
+    sched->now_us = now_us;
+}
+
+int sched_add(sched_t *sched, const char *name, uint32_t period_ms, uint32_t first_ms, sched_task_fn fn, void *arg) {
+    // A period of 0 would keep the task due forever and sched_run would never return
+    if (sched->count >= SCHED_MAX_TASKS || !fn || period_ms == 0) return -1;
+
+    int id = sched->count;
+    sched_task_t *task = &sched->tasks[id];
+
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->period_us = (uint64_t)period_ms * 1000;
+    task->deadline_us = sched->now_us() + (uint64_t)first_ms * 1000;
+    memset(&task->stats, 0, sizeof(task->stats));
+
+    sched->heap[sched->count] = (uint8_t)id;
+    sift_up(sched, sched->count++);
+
+    return id;
+}
+
+uint8_t sched_set_period(sched_t *sched, int id, uint32_t period_ms) {
+    if (id < 0 || id >= sched->count || period_ms == 0) return 1;
+
+    sched->tasks[id].period_us = (uint64_t)period_ms * 1000;
+    return 0;
+}
+
+void sched_run_in(sched_t *sched, int id, uint32_t delay_ms) {
+    if (id < 0 || id >= sched->count) return;
+
+    sched->tasks[id].deadline_us = sched->now_us() + (uint64_t)delay_ms * 1000;
+    heap_fix(sched, id);
+}
+
+void sched_run_at(sched_t *sched, int id, uint64_t deadline_us) {
+    if (id < 0 || id >= sched->count) return;
+
+    sched->tasks[id].deadline_us = deadline_us;
+    heap_fix(sched, id);
+}
+
+uint64_t sched_run(sched_t *sched) {
+    uint8_t ran = 0;
+
+    sched->wakeups++;
+    if (sched->count == 0) return UINT64_MAX;
+
+    while (1) {
+        uint64_t now = sched->now_us();
+        sched_task_t *task = &sched->tasks[sched->heap[0]];
+
+        if (task->deadline_us > now) break;
+
+        uint64_t jitter = now - task->deadline_us;
+        task->stats.runs++;
+        task->stats.total_jitter_us += jitter;
+        if (jitter > task->stats.max_jitter_us) {
+            task->stats.max_jitter_us = jitter > UINT32_MAX ? UINT32_MAX : (uint32_t)jitter;
+        }
+        if (jitter > SCHED_LATE_US) {
+            task->stats.late++;
+        }
+
+        // Keep the deadlines on the original grid unless the task fell a whole period behind
+        task->deadline_us += task->period_us;
+        if (task->deadline_us <= now) {
+            task->stats.skipped += (uint32_t)((now - task->deadline_us) / task->period_us) + 1;
+            task->deadline_us = now + task->period_us;
+        }
+        sift_down(sched, 0);
+
+        TRACE_BEGIN(task);
+        task->fn(task->arg);
+        TRACE_END(task, task->name);
+        ran = 1;
+    }
+
+    if (!ran) {
+        sched->idle_wakeups++;
+    }
+
+    return sched->tasks[sched->heap[0]].deadline_us;
+}
+
+const sched_task_stats_t *sched_get_stats(const sched_t *sched, int id) {
+    if (id < 0 || id >= sched->count) return NULL;
+
+    return &sched->tasks[id].stats;
+}
+
+void sched_log_stats(const sched_t *sched) {
+    PICO_LOGI("Scheduler: %lu wakeups, %lu without a due task\n",
+        (unsigned long)sched->wakeups, (unsigned long)sched->idle_wakeups);
+
+    for (uint8_t i = 0; i < sched->count; i++) {
+        const sched_task_t *task = &sched->tasks[i];
+        uint32_t avg = task->stats.runs ? (uint32_t)(task->stats.total_jitter_us / task->stats.runs) : 0;
+
+        PICO_LOGI("  %-8s runs %lu, late %lu, skipped %lu, jitter avg %lu us max %lu us\n",
+            task->name, (unsigned long)task->stats.runs, (unsigned long)task->stats.late,
+            (unsigned long)task->stats.skipped, (unsigned long)avg, (unsigned long)task->stats.max_jitter_us);
+    }
+}
@@ -0,0 +1,202 @@
+#include "pico_sensor.h"
+#include "pico_log.h"
+#include "pico_trace.h"
+
+#include <string.h>
+
+// Time the core spends in a driver call
+static void account(sensor_t *sensor, uint64_t start_us) {
+    uint64_t busy_us = sensor->registry->sched.now_us() - start_us;
+
+    sensor->stats.busy_us += busy_us;
+    if (busy_us > sensor->stats.max_busy_us) sensor->stats.max_busy_us = (uint32_t)busy_us;
+}
+
+static void emit(sensor_t *sensor, sample_t *sample) {
+    sensor_registry_t *registry = sensor->registry;
+
+    sample->sensor = sensor->index;
+    registry->emit(registry->emit_arg, sensor->index, sample, sensor->taken_us);
+}
+
+static void fail(sensor_t *sensor, const char *what) {
+    sensor->stats.failures++;
+    PICO_LOGE("Failed to %s sensor %s\n", what, sensor->name);
+}
+
+static void fetch_done(void *arg, uint8_t err) {
+    sensor_t *sensor = (sensor_t *)arg;
+
+    atomic_store_explicit(&sensor->fetch, err ? SENSOR_FETCH_FAILED : SENSOR_FETCH_DONE, memory_order_release);
+}
+
+static void trigger_task(void *arg) {
+    sensor_t *sensor = (sensor_t *)arg;
+    uint64_t start_us = sensor->registry->sched.now_us();
+
+    sensor->taken_us = start_us;
+    TRACE_BEGIN(trigger);
+    uint8_t err = sensor->ops->trigger(sensor->dev);
+    TRACE_END(trigger, "sensor trigger");
+
+    if (err != 0) fail(sensor, "trigger");
+    account(sensor, start_us);
+}
+
+static void read_task(void *arg) {
+    sensor_t *sensor = (sensor_t *)arg;
+    uint64_t start_us = sensor->registry->sched.now_us();
+    sample_t sample;
+
+    sensor->stats.reads++;
+    if (!sensor->ops->trigger) sensor->taken_us = start_us;
+
+    if (!sensor->ops->fetch) {
+        TRACE_BEGIN(read);
+        uint8_t err = sensor->ops->read(sensor->dev, &sample);
+        TRACE_END(read, "sensor read");
+
+        account(sensor, start_us);
+        if (err != 0) {
+            fail(sensor, "read");
+            return;
+        }
+        emit(sensor, &sample);
+        return;
+    }
+
+    // A fetch still running a whole period later is not going to complete
+    if (atomic_load_explicit(&sensor->fetch, memory_order_acquire) == SENSOR_FETCH_BUSY) {
+        sensor->ops->cancel(sensor->dev);
+        atomic_store_explicit(&sensor->fetch, SENSOR_FETCH_IDLE, memory_order_relaxed);
+        fail(sensor, "fetch");
+    }
+
+    atomic_store_explicit(&sensor->fetch, SENSOR_FETCH_BUSY, memory_order_relaxed);
+    TRACE_BEGIN(fetch);
+    uint8_t err = sensor->ops->fetch(sensor->dev, fetch_done, sensor);
+    TRACE_END(fetch, "sensor fetch");
+
+    if (err != 0) {
+        atomic_store_explicit(&sensor->fetch, SENSOR_FETCH_IDLE, memory_order_relaxed);
+        fail(sensor, "fetch");
+    }
+    account(sensor, start_us);
+}
+
+// Decodes and emits the fetches that completed since the last call
+static void collect(sensor_registry_t *registry) {
+    for (uint8_t i = 0; i < registry->count; i++) {
+        sensor_t *sensor = &registry->sensors[i];
+        uint_fast8_t state = atomic_load_explicit(&sensor->fetch, memory_order_acquire);
+
+        if (state != SENSOR_FETCH_DONE && state != SENSOR_FETCH_FAILED) continue;
+        atomic_store_explicit(&sensor->fetch, SENSOR_FETCH_IDLE, memory_order_relaxed);
+
+        uint64_t start_us = registry->sched.now_us();
+        sample_t sample;
+        TRACE_BEGIN(decode);
+        uint8_t err = state == SENSOR_FETCH_FAILED || sensor->ops->decode(sensor->dev, &sample) != 0;
+        TRACE_END(decode, "sensor decode");
+
+        account(sensor, start_us);
+        if (err) {
+            fail(sensor, "read");
+            continue;
+        }
+        emit(sensor, &sample);
+    }
+}
+
+void sensor_registry_init(sensor_registry_t *registry, sched_clock_fn now_us, sensor_emit_fn emit, void *arg) {
+    memset(registry, 0, sizeof(*registry));
+    sched_init(&registry->sched, now_us);
+    registry->emit = emit;
+    registry->emit_arg = arg;
+}
+
+int sensor_register(sensor_registry_t *registry, const char *name, const sensor_ops_t *ops, void *dev) {
+    if (registry->count >= SENSOR_MAX_SENSORS || !ops || !ops->read) return -1;
+    if (ops->fetch && (!ops->decode || !ops->cancel)) return -1;
+
+    int index = registry->count++;
+    sensor_t *sensor = &registry->sensors[index];
+
+    sensor->ops = ops;
+    sensor->dev = dev;
+    sensor->index = (uint8_t)index;
+    sensor->registry = registry;
+    sensor->task = -1;
+    sensor->trigger_task = -1;
+    atomic_store_explicit(&sensor->fetch, SENSOR_FETCH_IDLE, memory_order_relaxed);
+    strncpy(sensor->name, name, SENSOR_NAME_LEN - 1);
+    sensor->name[SENSOR_NAME_LEN - 1] = '\0';
+
+    return index;
+}
+
+uint8_t sensor_start(sensor_registry_t *registry, uint32_t period_ms) {
+    if (registry->count == 0) return 1;
+
+    registry->period_ms = period_ms;
+
+    for (uint8_t i = 0; i < registry->count; i++) {
+        sensor_t *sensor = &registry->sensors[i];
+        uint32_t first_ms = period_ms + i * period_ms / registry->count;
+
+        // The conversion ends just before the read, so the sample is as fresh as it gets
+        if (sensor->ops->trigger) {
+            sensor->trigger_task = sched_add(&registry->sched, sensor->name, period_ms,
+                first_ms, trigger_task, sensor);
+            if (sensor->trigger_task < 0) return 1;
+            first_ms += sensor->ops->conversion_ms;
+        }
+
+        sensor->task = sched_add(&registry->sched, sensor->name, period_ms, first_ms, read_task, sensor);
+        if (sensor->task < 0) return 1;
+    }
+
+    PICO_LOGI("Reading %u sensors every %lu ms, %lu ms apart\n", registry->count,
+        (unsigned long)period_ms, (unsigned long)(period_ms / registry->count));
+    return 0;
+}
+
+void sensor_set_period(sensor_registry_t *registry, uint32_t period_ms) {
+    if (period_ms == 0 || period_ms == registry->period_ms) return;
+
+    registry->period_ms = period_ms;
+    for (uint8_t i = 0; i < registry->count; i++) {
+        const sensor_t *sensor = &registry->sensors[i];
+
+        if (sensor->trigger_task >= 0) sched_set_period(&registry->sched, sensor->trigger_task, period_ms);
+        sched_set_period(&registry->sched, sensor->task, period_ms);
+    }
+}
+
+void sensor_align(sensor_registry_t *registry, uint64_t start_us) {
+    for (uint8_t i = 0; i < registry->count; i++) {
+        const sensor_t *sensor = &registry->sensors[i];
+        uint64_t first_us = start_us + (uint64_t)i * registry->period_ms * 1000 / registry->count;
+
+        if (sensor->trigger_task >= 0) {
+            sched_run_at(&registry->sched, sensor->trigger_task, first_us);
+            first_us += (uint64_t)sensor->ops->conversion_ms * 1000;
+        }
+        sched_run_at(&registry->sched, sensor->task, first_us);
+    }
+}
+
+uint64_t sensor_run(sensor_registry_t *registry) {
+    collect(registry);
+    uint64_t next_us = sched_run(&registry->sched);
+    // A fetch can complete before it returns, as on the simulated bus
+    collect(registry);
+
+    return next_us;
+}
+
+const sensor_t *sensor_get(const sensor_registry_t *registry, uint8_t index) {
+    if (index >= registry->count) return NULL;
+
+    return &registry->sensors[index];
+}
@@ -0,0 +1,47 @@
+#include "pico_spsc.h"
+
+_Static_assert((SPSC_CAPACITY & (SPSC_CAPACITY - 1)) == 0, "SPSC_CAPACITY must be a power of two");
+
+void spsc_init(spsc_queue_t *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->dropped, 0);
+}
+
+uint8_t spsc_push(spsc_queue_t *queue, const sample_t *sample) {
+    uint32_t head = (uint32_t)atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head - tail >= SPSC_CAPACITY) {
+        // Only the producer writes the counter, so no read-modify-write atomic is needed
+        uint32_t dropped = (uint32_t)atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+        atomic_store_explicit(&queue->dropped, dropped + 1, memory_order_relaxed);
+        return 1;
+    }
+
+    queue->items[head & (SPSC_CAPACITY - 1)] = *sample;
+
+    // Publish the item before the new head becomes visible to the consumer
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 0;
+}
+
+uint8_t spsc_pop(spsc_queue_t *queue, sample_t *sample) {
+    uint32_t tail = (uint32_t)atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = (uint32_t)atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (head == tail) return 1;
+
+    *sample = queue->items[tail & (SPSC_CAPACITY - 1)];
+
+    // Hand the slot back to the producer only after it has been copied out
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+size_t spsc_count(spsc_queue_t *queue) {
+    uint32_t head = (uint32_t)atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    return head - tail;
+}
@@ -0,0 +1,324 @@
+#include "pico_store.h"
+#include "pico_log.h"
+
+#include <string.h>
+
+#define STORE_SECTOR_MAGIC      0x32545353u     // "SST2", samples with a time
+#define STORE_RECORD_MAGIC      0x32435253u     // "SRC2"
+#define STORE_ERASED            0xFFFFFFFFu
+#define STORE_SLOTS             (FLASH_DEV_SECTOR_SIZE / STORE_RECORD_SIZE)
+
+// Slot 0 of every sector holds the header, records use slot 1 and up
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // increases every time a sector is (re)used
+    uint32_t erase_count;
+    uint32_t reserved[4];
+    uint32_t crc;
+} store_header_t;
+
+typedef struct {
+    uint32_t magic;
+    sample_t sample;
+    uint32_t crc;
+    uint32_t ack;           // cleared once this record and all older ones are drained
+} store_record_t;
+
+_Static_assert(sizeof(store_header_t) == STORE_RECORD_SIZE, "store header must fill one slot");
+_Static_assert(sizeof(store_record_t) == STORE_RECORD_SIZE, "store record must fill one slot");
+
+typedef struct {
+    uint32_t sector;
+    uint32_t slot;
+} store_pos_t;
+
+static struct {
+    const flash_dev_t *dev;
+    uint32_t sectors;
+    uint32_t head_seq;          // sequence number of the head sector
+    store_pos_t head;           // next free slot
+    store_pos_t tail;           // oldest pending record
+    store_stats_t stats;
+    uint8_t page[FLASH_DEV_PAGE_SIZE];
+} store;
+
+static uint32_t crc32(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t pos_offset(store_pos_t pos) {
+    return pos.sector * FLASH_DEV_SECTOR_SIZE + pos.slot * STORE_RECORD_SIZE;
+}
+
+static uint8_t pos_equal(store_pos_t a, store_pos_t b) {
+    return a.sector == b.sector && a.slot == b.slot;
+}
+
+static store_pos_t pos_next(store_pos_t pos) {
+    if (++pos.slot == STORE_SLOTS) {
+        pos.slot = 1;
+        pos.sector = (pos.sector + 1) % store.sectors;
+    }
+    return pos;
+}
+
+// Programs len bytes at offset. The rest of the page is left as 0xFF, which
+// leaves the bits already programmed on the page untouched.
+static uint8_t program(uint32_t offset, const void *data, size_t len) {
+    uint32_t page_offset = offset - (offset % FLASH_DEV_PAGE_SIZE);
+
+    memset(store.page, 0xFF, sizeof(store.page));
+    memcpy(&store.page[offset - page_offset], data, len);
+
+    return store.dev->program_page(store.dev, page_offset, store.page);
+}
+
+static uint8_t read_header(uint32_t sector, store_header_t *hdr) {
+    if (store.dev->read(store.dev, sector * FLASH_DEV_SECTOR_SIZE, hdr, sizeof(*hdr))) {
+        return 1;
+    }
+    if (hdr->magic != STORE_SECTOR_MAGIC || hdr->crc != crc32(hdr, offsetof(store_header_t, crc))) {
+        return 1;
+    }
+    return 0;
+}
+
+static uint8_t read_record(store_pos_t pos, store_record_t *rec) {
+    if (store.dev->read(store.dev, pos_offset(pos), rec, sizeof(*rec))) {
+        return 1;
+    }
+    if (rec->magic != STORE_RECORD_MAGIC || rec->crc != crc32(rec, offsetof(store_record_t, crc))) {
+        return 1;
+    }
+    return 0;
+}
+
+// Erases the sector and writes a fresh header carrying the incremented erase count
+static uint8_t open_sector(uint32_t sector, uint32_t seq) {
+    store_header_t hdr;
+    uint32_t erase_count = 0;
+
+    if (read_header(sector, &hdr) == 0) {
+        erase_count = hdr.erase_count;
+    }
+
+    if (store.dev->erase_sector(store.dev, sector * FLASH_DEV_SECTOR_SIZE)) {
+        return 1;
+    }
+    store.stats.erases++;
+    erase_count++;
+    if (erase_count > store.stats.max_erase) {
+        store.stats.max_erase = erase_count;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = STORE_SECTOR_MAGIC;
+    hdr.seq = seq;
+    hdr.erase_count = erase_count;
+    hdr.crc = crc32(&hdr, offsetof(store_header_t, crc));
+
+    return program(sector * FLASH_DEV_SECTOR_SIZE, &hdr, sizeof(hdr));
+}
+
+// Moves the head into the next sector. Pending records stored there are lost.
+static uint8_t advance_head(void) {
+    uint32_t next = (store.head.sector + 1) % store.sectors;
+
+    if (store.stats.pending > 0 && store.tail.sector == next) {
+        store_record_t rec;
+        store_pos_t pos = store.tail;
+        uint32_t dropped = 0;
+
+        while (pos.sector == next) {
+            if (read_record(pos, &rec) == 0) dropped++;
+            pos = pos_next(pos);
+        }
+
+        store.stats.dropped += dropped;
+        store.stats.pending -= dropped;
+        store.tail = pos;
+        PICO_LOGW("Sample store full, dropping oldest samples\n");
+    }
+
+    if (open_sector(next, store.head_seq + 1)) {
+        return 1;
+    }
+
+    store.head_seq++;
+    store.head.sector = next;
+    store.head.slot = 1;
+
+    return 0;
+}
+
+uint8_t store_init(const flash_dev_t *dev) {
+    store_header_t hdr;
+    uint8_t found = 0;
+
+    memset(&store, 0, sizeof(store));
+
+    if (!dev || dev->size < 2 * FLASH_DEV_SECTOR_SIZE) {
+        PICO_LOGE("Sample store region too small\n");
+        return 1;
+    }
+
+    store.dev = dev;
+    store.sectors = dev->size / FLASH_DEV_SECTOR_SIZE;
+
+    // The head is the valid sector with the highest sequence number
+    for (uint32_t i = 0; i < store.sectors; i++) {
+        if (read_header(i, &hdr)) continue;
+
+        if (hdr.erase_count > store.stats.max_erase) {
+            store.stats.max_erase = hdr.erase_count;
+        }
+        if (!found || hdr.seq > store.head_seq) {
+            store.head_seq = hdr.seq;
+            store.head.sector = i;
+            found = 1;
+        }
+    }
+
+    if (!found) {
+        PICO_LOGI("Formatting sample store\n");
+        store.head.sector = 0;
+        store.head.slot = 1;
+        store.tail = store.head;
+        store.head_seq = 1;
+        return open_sector(0, store.head_seq);
+    }
+
+    // Sectors are taken in ring order, so walking from the one after the head
+    // visits every record from oldest to newest
+    store_record_t rec;
+    store_pos_t pos = { .sector = (store.head.sector + 1) % store.sectors, .slot = 1 };
+    store.head.slot = STORE_SLOTS;
+
+    for (uint32_t n = 0; n < store.sectors; n++) {
+        uint32_t sector = (store.head.sector + 1 + n) % store.sectors;
+        if (read_header(sector, &hdr)) continue;
+
+        for (uint32_t slot = 1; slot < STORE_SLOTS; slot++) {
+            pos.sector = sector;
+            pos.slot = slot;
+
+            if (store.dev->read(store.dev, pos_offset(pos), &rec, sizeof(rec))) {
+                return 1;
+            }
+
+            if (rec.magic == STORE_ERASED) {
+                if (sector == store.head.sector) {
+                    store.head.slot = slot;
+                    break;
+                }
+                continue;
+            }
+            if (read_record(pos, &rec)) continue;
+
+            if (rec.ack != STORE_ERASED) {
+                store.stats.pending = 0;
+            } else if (store.stats.pending++ == 0) {
+                store.tail = pos;
+            }
+        }
+    }
+
+    if (store.stats.pending == 0) {
+        store.tail = store.head;
+    }
+
+    PICO_LOGI("Sample store mounted, %lu pending samples\n", (unsigned long)store.stats.pending);
+
+    return 0;
+}
+
+uint8_t store_append(const sample_t *sample) {
+    store_record_t rec;
+
+    if (!store.dev || !sample) return 1;
+
+    if (store.head.slot == STORE_SLOTS && advance_head()) {
+        return 1;
+    }
+
+    rec.magic = STORE_RECORD_MAGIC;
+    rec.sample = *sample;
+    rec.crc = crc32(&rec, offsetof(store_record_t, crc));
+    rec.ack = STORE_ERASED;
+
+    if (program(pos_offset(store.head), &rec, sizeof(rec))) {
+        return 1;
+    }
+
+    if (store.stats.pending++ == 0) {
+        store.tail = store.head;
+    }
+    store.stats.appended++;
+    store.head.slot++;
+
+    return 0;
+}
+
+size_t store_peek(sample_t *samples, size_t max) {
+    store_record_t rec;
+    store_pos_t pos = store.tail;
+    size_t count = 0;
+
+    if (!store.dev) return 0;
+
+    while (count < max && count < store.stats.pending && !pos_equal(pos, store.head)) {
+        if (read_record(pos, &rec) == 0) {
+            samples[count++] = rec.sample;
+        }
+        pos = pos_next(pos);
+    }
+
+    return count;
+}
+
+uint8_t store_consume(size_t count) {
+    store_record_t rec;
+    store_pos_t pos = store.tail;
+    store_pos_t last = pos;
+    size_t consumed = 0;
+
+    if (!store.dev || count > store.stats.pending) return 1;
+    if (count == 0) return 0;
+
+    while (consumed < count && !pos_equal(pos, store.head)) {
+        if (read_record(pos, &rec) == 0) {
+            consumed++;
+            last = pos;
+        }
+        pos = pos_next(pos);
+    }
+
+    // A single cleared ack word marks every older record as drained as well
+    const uint32_t ack = 0;
+    if (program(pos_offset(last) + offsetof(store_record_t, ack), &ack, sizeof(ack))) {
+        return 1;
+    }
+
+    store.stats.pending -= consumed;
+    store.stats.drained += consumed;
+    store.tail = store.stats.pending ? pos : store.head;
+
+    return 0;
+}
+
+uint32_t store_pending(void) {
+    return store.stats.pending;
+}
+
+void store_get_stats(store_stats_t *stats) {
+    *stats = store.stats;
+}
@@ -0,0 +1,114 @@
+#include "pico_trace.h"
+
+#include <stdio.h>
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+#if PICO_TRACE
+
+#include <stdatomic.h>
+
+_Static_assert((TRACE_RING_SPANS & (TRACE_RING_SPANS - 1)) == 0, "TRACE_RING_SPANS must be a power of two");
+
+#define TRACE_CORES 2
+
+/**
+ * @brief Ring of finished spans. Written by one core, its interrupt handlers included, and
+ * read by the dump on core 0. The writer never waits, it overwrites the oldest span.
+ */
+typedef struct {
+    trace_span_t spans[TRACE_RING_SPANS];
+    atomic_uint_fast32_t head;      // spans written, by the owning core only
+    uint32_t dumped;                // spans printed or skipped, by the dump only
+    trace_stats_t stats;
+} trace_ring_t;
+
+static trace_ring_t rings[TRACE_CORES];
+
+uint32_t trace_begin(void) {
+    return time_us_32();
+}
+
+void trace_end(const char *name, uint32_t start_us) {
+    uint32_t end_us = time_us_32();
+    trace_ring_t *ring = &rings[get_core_num()];
+
+    // Interrupt handlers on this core trace into the same ring
+    uint32_t irq = save_and_disable_interrupts();
+
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_span_t *span = &ring->spans[head & (TRACE_RING_SPANS - 1)];
+
+    span->name = name;
+    span->start_us = start_us;
+    span->duration_us = end_us - start_us;
+    ring->stats.spans++;
+
+    // Publish the span before the new head becomes visible to the dump
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    restore_interrupts(irq);
+}
+
+static void dump_ring(trace_ring_t *ring, unsigned int core) {
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t index = ring->dumped;
+
+    // The slot of the oldest span is the next one written, it is given up
+    if (head - index >= TRACE_RING_SPANS) {
+        ring->stats.overwritten += head - index - (TRACE_RING_SPANS - 1);
+        index = head - (TRACE_RING_SPANS - 1);
+    }
+
+    // The dump takes longer than a span, so starts are extended against a fresh 64 bit time
+    for (; index != head; index++) {
+        trace_span_t span = ring->spans[index & (TRACE_RING_SPANS - 1)];
+
+        // A writer on the other core may have reused the slot while it was copied
+        uint32_t now_head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (now_head - index >= TRACE_RING_SPANS) {
+            ring->stats.overwritten++;
+            continue;
+        }
+
+        uint64_t now_us = time_us_64();
+        uint64_t start_us = now_us - (uint32_t)((uint32_t)now_us - span.start_us);
+
+        printf("%c%u %llu %lu %s\n", TRACE_LINE_PREFIX, core, (unsigned long long)start_us,
+            (unsigned long)span.duration_us, span.name ? span.name : "?");
+    }
+
+    ring->dumped = head;
+}
+
+void trace_dump(void) {
+    for (unsigned int core = 0; core < TRACE_CORES; core++) {
+        dump_ring(&rings[core], core);
+    }
+}
+
+const trace_stats_t *trace_get_stats(unsigned int core) {
+    return &rings[core < TRACE_CORES ? core : 0].stats;
+}
+
+#else
+
+static const trace_stats_t no_stats;
+
+uint32_t trace_begin(void) {
+    return 0;
+}
+
+void trace_end(__unused const char *name, __unused uint32_t start_us) {
+}
+
+void trace_dump(void) {
+}
+
+const trace_stats_t *trace_get_stats(__unused unsigned int core) {
+    return &no_stats;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include "pico_wallclock.h"
+
+#include <string.h>
+
+#define PPB 1000000000LL
+
+// Copies the parameters, retrying while the updating core writes them
+static void read_params(const wallclock_t *clock, wallclock_params_t *params) {
+    uint_fast32_t seq;
+
+    do {
+        seq = atomic_load_explicit(&clock->seq, memory_order_acquire);
+        *params = clock->params;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&clock->seq, memory_order_relaxed));
+}
+
+static void write_params(wallclock_t *clock, const wallclock_params_t *params) {
+    uint_fast32_t seq = atomic_load_explicit(&clock->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&clock->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    clock->params = *params;
+    atomic_store_explicit(&clock->seq, seq + 2, memory_order_release);
+}
+
+// Steady time at a monotonic time. Times before the latest correction are extrapolated backwards.
+static uint64_t steady_at(const wallclock_params_t *params, uint64_t mono_us) {
+    int64_t elapsed = (int64_t)(mono_us - params->base_mono_us);
+    int64_t slewed = (int64_t)(params->slew_end_us - params->base_mono_us);
+
+    if (elapsed < slewed) slewed = elapsed;
+
+    return params->base_steady_us + (uint64_t)(elapsed + elapsed * params->freq_ppb / PPB +
+        slewed * params->slew_ppb / PPB);
+}
+
+static int64_t clamp(int64_t v, int64_t limit) {
+    if (v > limit) return limit;
+    if (v < -limit) return -limit;
+    return v;
+}
+
+void wallclock_init(wallclock_t *clock, sched_clock_fn mono_us) {
+    memset(clock, 0, sizeof(*clock));
+    clock->mono_us = mono_us;
+    atomic_store_explicit(&clock->seq, 0, memory_order_relaxed);
+
+    uint64_t now_us = mono_us();
+    clock->params.base_mono_us = now_us;
+    clock->params.base_steady_us = now_us;
+    clock->params.slew_end_us = now_us;
+}
+
+uint8_t wallclock_sync(wallclock_t *clock, uint64_t sent_us, uint64_t server_rx_us, uint64_t server_tx_us, uint64_t received_us) {
+    // Only this core writes the parameters, it reads them without the retry
+    wallclock_params_t params = clock->params;
+
+    if (received_us < sent_us || server_tx_us < server_rx_us) {
+        clock->stats.rejected++;
+        return 1;
+    }
+
+    // The round trip without the time the server held the request. The queueing on a congested
+    // path is rarely the same both ways, so a long round trip means an unreliable offset.
+    int64_t delay_us = (int64_t)(received_us - sent_us) - (int64_t)(server_tx_us - server_rx_us);
+    if (delay_us < 0) delay_us = 0;
+    if (delay_us > WALLCLOCK_MAX_DELAY_US) {
+        clock->stats.rejected++;
+        return 1;
+    }
+
+    uint64_t interval_us = received_us - clock->last_sync_us;
+    int64_t sent_unix_us = (int64_t)steady_at(&params, sent_us) + params.unix_offset_us;
+    int64_t received_unix_us = (int64_t)steady_at(&params, received_us) + params.unix_offset_us;
+    int64_t offset_us = (((int64_t)server_rx_us - sent_unix_us) + ((int64_t)server_tx_us - received_unix_us)) / 2;
+
+    // The offset of an exchange is off by at most half the queueing it saw, the round trip
+    // above the shortest one seen lately. A spike could pass for a step, it is dropped.
+    int64_t excess_us = 0;
+    if (params.synced) {
+        uint32_t min_delay_us = clock->min_delay_us + WALLCLOCK_DELAY_DECAY_US;
+
+        if ((uint64_t)delay_us < min_delay_us) min_delay_us = (uint32_t)delay_us;
+        clock->min_delay_us = min_delay_us;
+        excess_us = delay_us - min_delay_us;
+
+        if (excess_us > WALLCLOCK_SPIKE_US) {
+            clock->stats.rejected++;
+            return 1;
+        }
+    }
+
+    // Rebase at the arrival of the reply, steady time carries on without a jump
+    params.base_steady_us = steady_at(&params, received_us);
+    params.base_mono_us = received_us;
+    params.slew_ppb = 0;
+    params.slew_end_us = received_us;
+
+    clock->stats.syncs++;
+    clock->stats.delay_us = (uint32_t)delay_us;
+    clock->stats.offset_us = (int32_t)clamp(offset_us, INT32_MAX);
+    clock->last_sync_us = received_us;
+
+    if (!params.synced || offset_us > WALLCLOCK_STEP_US || offset_us < -WALLCLOCK_STEP_US) {
+        params.unix_offset_us += offset_us;
+        params.generation++;
+        params.synced = 1;
+        clock->min_delay_us = (uint32_t)delay_us;
+        clock->stats.steps++;
+        clock->stats.max_offset_us = 0;
+        write_params(clock, &params);
+        return 0;
+    }
+
+    // Exchanges with more queueing count for less
+    if (excess_us > WALLCLOCK_DELAY_MARGIN_US) {
+        offset_us = offset_us * WALLCLOCK_DELAY_MARGIN_US / excess_us;
+    }
+
+    // A phase locked loop. A part of the offset is slewed away, and the drift estimate
+    // integrates the offsets, so a constant drift ends up corrected without a phase error.
+    if (interval_us >= WALLCLOCK_FREQ_MIN_US) {
+        int64_t error_ppb = offset_us * PPB / (int64_t)interval_us / (1 << WALLCLOCK_FREQ_SHIFT);
+
+        params.freq_ppb = (int32_t)clamp(params.freq_ppb + error_ppb, WALLCLOCK_MAX_FREQ_PPB);
+    }
+
+    int64_t slew_us = offset_us / (1 << WALLCLOCK_PHASE_SHIFT);
+    if (slew_us != 0) {
+        params.slew_ppb = (int32_t)clamp(slew_us * PPB / WALLCLOCK_SLEW_US, WALLCLOCK_MAX_SLEW_PPB);
+        // An offset below 1 ppb of the slew time is left for the next exchange
+        if (params.slew_ppb != 0) {
+            params.slew_end_us = received_us + (uint64_t)(slew_us * PPB / params.slew_ppb);
+        }
+    }
+
+    uint32_t abs_offset_us = (uint32_t)(offset_us < 0 ? -offset_us : offset_us);
+    if (abs_offset_us > clock->stats.max_offset_us) clock->stats.max_offset_us = abs_offset_us;
+    clock->stats.freq_ppb = params.freq_ppb;
+
+    write_params(clock, &params);
+    return 0;
+}
+
+uint64_t wallclock_steady_us(const wallclock_t *clock) {
+    wallclock_params_t params;
+
+    read_params(clock, &params);
+    return steady_at(&params, clock->mono_us());
+}
+
+uint8_t wallclock_unix_us(const wallclock_t *clock, uint64_t steady_us, uint64_t *unix_us) {
+    wallclock_params_t params;
+
+    read_params(clock, &params);
+    if (!params.synced) return 1;
+
+    *unix_us = (uint64_t)((int64_t)steady_us + params.unix_offset_us);
+    return 0;
+}
+
+uint64_t wallclock_next_boundary(const wallclock_t *clock, uint32_t period_ms) {
+    wallclock_params_t params;
+
+    read_params(clock, &params);
+    if (!params.synced || period_ms == 0) return 0;
+
+    uint64_t period_us = (uint64_t)period_ms * 1000;
+    uint64_t unix_us = (uint64_t)((int64_t)steady_at(&params, clock->mono_us()) + params.unix_offset_us);
+    uint64_t boundary_us = (unix_us / period_us + 1) * period_us;
+
+    return (uint64_t)((int64_t)boundary_us - params.unix_offset_us);
+}
+
+uint32_t wallclock_generation(const wallclock_t *clock) {
+    wallclock_params_t params;
+
+    read_params(clock, &params);
+    return params.generation;
+}
+
+const wallclock_stats_t *wallclock_get_stats(const wallclock_t *clock) {
+    return &clock->stats;
+}
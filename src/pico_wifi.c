@@ -1,6 +1,103 @@
 #include "../include/pico_wifi.h"
 #include "pico_log.h"
-#include "../include/pico_credentials.h"
+#include "pico_credentials.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+typedef enum {
+    WIFI_STATE_DOWN,        // no link and no join in progress
+    WIFI_STATE_JOINING,
+    WIFI_STATE_UP
+} wifi_state_t;
+
+static struct {
+    wifi_state_t state;
+    absolute_time_t join_start;
+    bool join_direct;
+
+    // Access point of the last successful join
+    uint8_t bssid[6];
+    uint32_t channel;
+    bool ap_cached;
+
+    wifi_stats_t stats;
+} wifi;
+
+// Remembers where the current association is, so the next join can skip the scan
+static void remember_ap(void) {
+    uint32_t channel_info[3] = {0};     // hardware, target and scan channel
+
+    wifi.ap_cached = cyw43_wifi_get_bssid(&cyw43_state, wifi.bssid) == 0 &&
+        cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(channel_info), (uint8_t *)channel_info, CYW43_ITF_STA) == 0 &&
+        channel_info[0] != 0;
+
+    if (wifi.ap_cached) {
+        wifi.channel = channel_info[0];
+    }
+}
+
+static void start_join(void) {
+    wifi.join_direct = wifi.ap_cached;
+    wifi.join_start = get_absolute_time();
+
+    // A direct join goes straight to the known access point and channel, otherwise the chip scans all channels
+    int err = cyw43_wifi_join(&cyw43_state, strlen(WIFI_SSID), (const uint8_t *)WIFI_SSID,
+        strlen(WIFI_PASS), (const uint8_t *)WIFI_PASS, CYW43_AUTH_WPA2_AES_PSK,
+        wifi.join_direct ? wifi.bssid : NULL,
+        wifi.join_direct ? wifi.channel : CYW43_CHANNEL_NONE);
+
+    if (err != 0) {
+        PICO_LOGE("Unable to start Wi-Fi join\n");
+        wifi.stats.failed_joins++;
+        wifi.ap_cached = false;
+        wifi.state = WIFI_STATE_DOWN;
+        return;
+    }
+
+    PICO_LOGI("Joining %s with a %s\n", WIFI_SSID, wifi.join_direct ? "direct join" : "scan");
+    wifi.state = WIFI_STATE_JOINING;
+}
+
+static void join_failed(void) {
+    wifi.stats.failed_joins++;
+
+    // The access point may have moved to another channel, scan on the next attempt
+    wifi.ap_cached = false;
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    wifi.state = WIFI_STATE_DOWN;
+}
+
+// Advances a join in progress. The link counts as up once DHCP has assigned an address.
+static void poll_join(void) {
+    int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+    uint32_t elapsed_ms = (uint32_t)(absolute_time_diff_us(wifi.join_start, get_absolute_time()) / 1000);
+
+    if (status == CYW43_LINK_UP) {
+        wifi.state = WIFI_STATE_UP;
+        wifi.stats.joins++;
+        if (wifi.join_direct) {
+            wifi.stats.direct_joins++;
+        }
+        wifi.stats.last_link_ms = elapsed_ms;
+        if (elapsed_ms > wifi.stats.max_link_ms) {
+            wifi.stats.max_link_ms = elapsed_ms;
+        }
+
+        remember_ap();
+        PICO_LOGI("Wi-Fi link up in %lu ms (%lu joins, %lu direct, %lu failed)\n",
+            (unsigned long)elapsed_ms, (unsigned long)wifi.stats.joins,
+            (unsigned long)wifi.stats.direct_joins, (unsigned long)wifi.stats.failed_joins);
+    }
+    else if (status == CYW43_LINK_FAIL || status == CYW43_LINK_NONET || status == CYW43_LINK_BADAUTH) {
+        PICO_LOGE("Wi-Fi join failed\n");
+        join_failed();
+    }
+    else if (elapsed_ms >= WIFI_CONNECT_TIMEOUT_MS) {
+        PICO_LOGE("Wi-Fi join timed out\n");
+        join_failed();
+    }
+}
 
 PICO_WIFI_STATUS wifi_init() {
     // Initialise the Wi-Fi chip
@@ -13,7 +110,15 @@ PICO_WIFI_STATUS wifi_init() {
     cyw43_arch_enable_sta_mode();
 
     PICO_LOGI("Connecting to Wi-Fi...\n");
-    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASS, CYW43_AUTH_WPA2_AES_PSK, WIFI_CONNECT_TIMEOUT_MS)) {
+    start_join();
+
+    while (wifi.state == WIFI_STATE_JOINING) {
+        cyw43_arch_poll();
+        cyw43_arch_wait_for_work_until(make_timeout_time_ms(WIFI_INIT_POLL_MS));
+        poll_join();
+    }
+
+    if (wifi.state != WIFI_STATE_UP) {
         PICO_LOGE("failed to connect.\n");
         return WIFI_STATUS_NOT_CONNECTED;
     }
@@ -28,16 +133,32 @@ PICO_WIFI_STATUS wifi_init() {
 }
 
 PICO_WIFI_STATUS wifi_check_connection() {
-    if(cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_JOIN) {
+    switch (wifi.state) {
+    case WIFI_STATE_UP:
+        if (cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN) {
+            return WIFI_STATUS_CONNECTED;
+        }
         PICO_LOGE("Connection lost....\n");
-        PICO_LOGE("Trying to reconnect...\n");
+        start_join();
+        break;
 
-        if(cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASS, CYW43_AUTH_WPA2_AES_PSK, WIFI_CONNECT_TIMEOUT_MS) == 0) {
+    case WIFI_STATE_JOINING:
+        poll_join();
+        if (wifi.state == WIFI_STATE_UP) {
             PICO_LOGI("Reconnected!\n");
             return WIFI_STATUS_RE_CONNECTED;
         }
+        break;
 
-        return WIFI_STATUS_NOT_CONNECTED;
+    case WIFI_STATE_DOWN:
+        PICO_LOGE("Trying to reconnect...\n");
+        start_join();
+        break;
     }
-    return WIFI_STATUS_CONNECTED;
-}
\ No newline at end of file
+
+    return WIFI_STATUS_NOT_CONNECTED;
+}
+
+void wifi_get_stats(wifi_stats_t *stats) {
+    *stats = wifi.stats;
+}
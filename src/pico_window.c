@@ -0,0 +1,87 @@
+#include "pico_window.h"
+
+#include <string.h>
+
+#define WINDOW_CHANNELS 3
+
+static void sample_values(const sample_t *sample, int32_t values[WINDOW_CHANNELS]) {
+    values[0] = sample->temperature;
+    values[1] = (int32_t)sample->humidity;
+    values[2] = (int32_t)sample->pressure;
+}
+
+static void set_values(sample_t *sample, const int32_t values[WINDOW_CHANNELS]) {
+    sample->temperature = values[0];
+    sample->humidity = (uint32_t)values[1];
+    sample->pressure = (uint32_t)values[2];
+    sample->sensor = 0;
+    sample->time_ms = 0;
+    sample->time = 0;
+}
+
+// Division rounded to the nearest integer, halves away from zero
+static int64_t div_round(int64_t num, int64_t den) {
+    return num >= 0 ? (num + den / 2) / den : -((-num + den / 2) / den);
+}
+
+void window_init(window_t *window, uint8_t ewma_shift) {
+    memset(window, 0, sizeof(*window));
+
+    window->ewma_shift = ewma_shift;
+}
+
+void window_add(window_t *window, const sample_t *sample) {
+    int32_t values[WINDOW_CHANNELS];
+    int64_t half = (1 << window->ewma_shift) >> 1;
+    sample_values(sample, values);
+
+    for (int i = 0; i < WINDOW_CHANNELS; i++) {
+        window_channel_t *channel = &window->channels[i];
+        int64_t scaled = (int64_t)values[i] * (1 << WINDOW_EWMA_FRAC_BITS);
+
+        if (window->count == 0 || values[i] < channel->min) channel->min = values[i];
+        if (window->count == 0 || values[i] > channel->max) channel->max = values[i];
+        channel->sum += values[i];
+
+        // ewma += (x - ewma) / 2^shift, with the fraction kept in the low bits. The step is
+        // rounded to nearest with an arithmetic shift, a division would truncate toward zero
+        // and stop the EWMA up to a whole unit short of the input.
+        if (!window->ewma_seeded) {
+            channel->ewma = scaled;
+        } else {
+            channel->ewma += (scaled - channel->ewma + half) >> window->ewma_shift;
+        }
+    }
+
+    window->ewma_seeded = 1;
+    window->count++;
+}
+
+void window_summary(const window_t *window, window_summary_t *summary) {
+    int32_t min[WINDOW_CHANNELS], max[WINDOW_CHANNELS], mean[WINDOW_CHANNELS], ewma[WINDOW_CHANNELS];
+
+    memset(summary, 0, sizeof(*summary));
+    if (window->count == 0) return;
+
+    for (int i = 0; i < WINDOW_CHANNELS; i++) {
+        const window_channel_t *channel = &window->channels[i];
+
+        min[i] = channel->min;
+        max[i] = channel->max;
+        mean[i] = (int32_t)div_round(channel->sum, window->count);
+        ewma[i] = (int32_t)div_round(channel->ewma, 1 << WINDOW_EWMA_FRAC_BITS);
+    }
+
+    summary->count = window->count;
+    set_values(&summary->min, min);
+    set_values(&summary->max, max);
+    set_values(&summary->mean, mean);
+    set_values(&summary->ewma, ewma);
+}
+
+void window_reset(window_t *window) {
+    for (int i = 0; i < WINDOW_CHANNELS; i++) {
+        window->channels[i].sum = 0;
+    }
+    window->count = 0;
+}